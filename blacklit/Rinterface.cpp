@@ -0,0 +1,205 @@
+#include <Rcpp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "../marketdata/columnStore.hpp"
+#include "blackLitterman.hpp"
+#include "covariance.hpp"
+#include "portfolioOptimizer.hpp"
+
+using namespace Rcpp;
+using namespace CqfProject;
+
+// Row major copy of an R matrix
+std::vector<double> ToRowMajor(NumericMatrix const& m)
+{
+    std::vector<double> rowMajor(static_cast<std::size_t>(m.nrow()) * m.ncol());
+    for (int i = 0; i < m.nrow(); ++i)
+        for (int j = 0; j < m.ncol(); ++j)
+            rowMajor[static_cast<std::size_t>(i) * m.ncol() + j] = m(i, j);
+    return rowMajor;
+}
+
+// Sample covariance of a matrix of returns, one column per asset
+// [[Rcpp::export]]
+NumericMatrix CppSampleCovariance(NumericMatrix returns)
+{
+    std::vector<double> const covariance = SampleCovariance(returns.begin(), returns.nrow(), returns.ncol());
+
+    // Symmetric, so row and column major agree
+    NumericMatrix result(returns.ncol(), returns.ncol(), covariance.begin());
+    List const names = returns.attr("dimnames");
+    if (names.size() == 2 && !Rf_isNull(names[1]))
+        result.attr("dimnames") = List::create(names[1], names[1]);
+    return result;
+}
+
+// Covariance as an R matrix named by the symbols, with the Ledoit-Wolf intensity and target as attributes
+NumericMatrix ToShrunkMatrix(ShrunkCovariance const& shrunk, std::size_t n, SEXP symbols)
+{
+    // Symmetric, so row and column major agree
+    NumericMatrix result(static_cast<int>(n), static_cast<int>(n), shrunk.covariance.begin());
+    if (!Rf_isNull(symbols))
+        result.attr("dimnames") = List::create(symbols, symbols);
+    result.attr("shrinkage") = shrunk.shrinkage;
+    result.attr("target") = shrunk.target;
+    return result;
+}
+
+// Ledoit-Wolf covariance of a matrix of returns, one column per asset, in one pass over its rows
+// [[Rcpp::export]]
+NumericMatrix CppLedoitWolf(NumericMatrix returns)
+{
+    std::size_t const numObservations = returns.nrow(), n = returns.ncol();
+    CovarianceAccumulator accumulator(n);
+    for (std::size_t t = 0; t < numObservations; ++t)
+        accumulator.Add(returns.begin() + t, numObservations);
+
+    List const names = returns.attr("dimnames");
+    return ToShrunkMatrix(accumulator.LedoitWolf(), n, names.size() == 2 ? SEXP(names[1]) : R_NilValue);
+}
+
+// Ledoit-Wolf covariance of the log returns of the symbols in a column store (see marketdata), on dates
+// in [from, to] where all are priced. Returns are streamed from the mapped file a date at a time, so no
+// returns matrix is built.
+// [[Rcpp::export]]
+NumericMatrix CppLedoitWolfStore(std::string path, CharacterVector symbols, double from = NA_REAL, double to = NA_REAL)
+{
+    ColumnStore const store(path);
+    std::vector<std::size_t> const columns = store.Columns(as<std::vector<std::string> >(symbols));
+    std::vector<std::size_t> const rows = store.CompleteRows(columns,
+        std::isnan(from) ? std::numeric_limits<std::int32_t>::min() : static_cast<std::int32_t>(std::floor(from)),
+        std::isnan(to) ? std::numeric_limits<std::int32_t>::max() : static_cast<std::int32_t>(std::floor(to)));
+
+    std::size_t const n = columns.size();
+    CovarianceAccumulator accumulator(n);
+    std::vector<double> previous(n), current(n), returns(n);
+    for (std::size_t t = 0; t < rows.size(); ++t)
+    {
+        for (std::size_t a = 0; a < n; ++a)
+            current[a] = std::log(store.Prices(columns[a])[rows[t]]);
+        if (t > 0)
+        {
+            for (std::size_t a = 0; a < n; ++a)
+                returns[a] = current[a] - previous[a];
+            accumulator.Add(returns.data());
+        }
+        previous.swap(current);
+    }
+
+    return ToShrunkMatrix(accumulator.LedoitWolf(), n, symbols);
+}
+
+// Black-Litterman posteriors of many view sets against one prior. views is a list of lists with P (a
+// matrix of one row per view), Q (a vector) and optionally Omega (NULL for He and Litterman's default).
+// Returns implied (Pi), mean (one column per view set) and, if covariance is true, covariance (an
+// array of one matrix per view set).
+// [[Rcpp::export]]
+List CppBlackLitterman(
+    NumericMatrix sigma,
+    NumericVector weights,
+    double riskAversion,
+    double tau,
+    List views,
+    bool covariance = false,
+    int threads = 0)
+{
+    std::size_t const n = weights.size();
+    BlackLitterman const model(ToRowMajor(sigma), std::vector<double>(weights.begin(), weights.end()), riskAversion, tau);
+
+    std::vector<ViewSet> viewSets(views.size());
+    for (R_xlen_t s = 0; s < views.size(); ++s)
+    {
+        List const view = views[s];
+        NumericMatrix const pick = view["P"];
+        NumericVector const returns = view["Q"];
+        if (static_cast<std::size_t>(pick.ncol()) != n)
+            stop("P of view set " + std::to_string(s + 1) + " needs one column per asset");
+
+        ViewSet& set = viewSets[s];
+        set.numViews = pick.nrow();
+        set.pick = ToRowMajor(pick);
+        set.returns.assign(returns.begin(), returns.end());
+        if (view.containsElementNamed("Omega") && !Rf_isNull(view["Omega"]))
+            set.omega = ToRowMajor(as<NumericMatrix>(view["Omega"]));
+    }
+
+    std::vector<BlackLittermanPosterior> const posteriors = model.Posteriors(viewSets, covariance, static_cast<unsigned>(threads));
+
+    NumericMatrix mean(static_cast<int>(n), static_cast<int>(viewSets.size()));
+    for (std::size_t s = 0; s < posteriors.size(); ++s)
+        std::copy(posteriors[s].mean.begin(), posteriors[s].mean.end(), mean.begin() + s * n);
+
+    NumericVector const implied(model.ImpliedReturns().begin(), model.ImpliedReturns().end());
+    if (!covariance)
+        return List::create(_["implied"] = implied, _["mean"] = mean);
+
+    NumericVector covariances(n * n * posteriors.size());
+    for (std::size_t s = 0; s < posteriors.size(); ++s)
+        std::copy(posteriors[s].covariance.begin(), posteriors[s].covariance.end(), covariances.begin() + s * n * n);
+    covariances.attr("dim") = IntegerVector::create(static_cast<int>(n), static_cast<int>(n), static_cast<int>(posteriors.size()));
+    return List::create(_["implied"] = implied, _["mean"] = mean, _["covariance"] = covariances);
+}
+
+// Mean-variance optimal portfolios for each risk aversion, solved in parallel. sectors gives each asset's
+// sector as a 1-based index into sectorCaps, NA for none. Short positions are allowed unless longOnly, with
+// gross exposure capped at leverage. Returns weights (one column per risk aversion), expectedReturn,
+// variance and nlopt's status (positive on convergence).
+// [[Rcpp::export]]
+List CppEfficientFrontier(
+    NumericVector mean,
+    NumericMatrix sigma,
+    NumericVector riskAversions,
+    bool longOnly = true,
+    double leverage = 1.0,
+    double maxWeight = 1.0,
+    double budget = 1.0,
+    IntegerVector sectors = IntegerVector::create(),
+    NumericVector sectorCaps = NumericVector::create(),
+    std::string algorithm = "SLSQP",
+    int threads = 0)
+{
+    std::size_t const n = mean.size();
+    if (static_cast<std::size_t>(sigma.nrow()) != n || static_cast<std::size_t>(sigma.ncol()) != n)
+        stop("sigma needs one row and column per asset");
+
+    PortfolioConstraints constraints;
+    constraints.budget = budget;
+    constraints.longOnly = longOnly;
+    constraints.leverage = leverage;
+    constraints.maxWeight = maxWeight;
+    if (sectors.size() != 0)
+    {
+        constraints.sectors.resize(sectors.size());
+        for (R_xlen_t i = 0; i < sectors.size(); ++i)
+            constraints.sectors[i] = sectors[i] == NA_INTEGER ? -1 : sectors[i] - 1;
+    }
+    constraints.sectorCaps.assign(sectorCaps.begin(), sectorCaps.end());
+
+    OptimizerSettings settings;
+    if (algorithm == "MMA")
+        settings.algorithm = PortfolioAlgorithm::MMA;
+    else if (algorithm != "SLSQP")
+        stop("algorithm must be SLSQP or MMA");
+    settings.numThreads = static_cast<unsigned>(threads);
+
+    MeanVarianceOptimizer const optimizer(std::vector<double>(mean.begin(), mean.end()), ToRowMajor(sigma), constraints, settings);
+    std::vector<PortfolioSolution> const frontier = optimizer.Frontier(std::vector<double>(riskAversions.begin(), riskAversions.end()));
+
+    NumericMatrix weights(static_cast<int>(n), static_cast<int>(frontier.size()));
+    NumericVector expectedReturn(frontier.size()), variance(frontier.size());
+    IntegerVector status(frontier.size());
+    for (std::size_t p = 0; p < frontier.size(); ++p)
+    {
+        std::copy(frontier[p].weights.begin(), frontier[p].weights.end(), weights.begin() + p * n);
+        expectedReturn[p] = frontier[p].expectedReturn;
+        variance[p] = frontier[p].variance;
+        status[p] = frontier[p].status;
+    }
+
+    return List::create(_["weights"] = weights, _["expectedReturn"] = expectedReturn, _["variance"] = variance, _["status"] = status);
+}
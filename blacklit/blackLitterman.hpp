@@ -0,0 +1,257 @@
+#ifndef BLACKLIT_BLACK_LITTERMAN_HPP
+#define BLACKLIT_BLACK_LITTERMAN_HPP
+
+#include "../coint/linearAlgebra.hpp"
+#include "../coint/parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+namespace CqfProject
+{
+    // Views on returns: numViews rows of P (pick matrix, numViews x numAssets row major) with the
+    // expected returns Q of each view portfolio, and their covariance Omega (numViews x numViews row
+    // major). An empty Omega means He and Litterman's diag(P tau Sigma P'), i.e. each view as uncertain
+    // as the prior on its portfolio.
+    struct ViewSet
+    {
+        ViewSet()
+            : numViews(0)
+        {}
+
+        std::size_t numViews;
+        std::vector<double> pick;
+        std::vector<double> returns;
+        std::vector<double> omega;
+    };
+
+    // Posterior mean returns, and their covariance (numAssets x numAssets row major) when asked for
+    struct BlackLittermanPosterior
+    {
+        std::vector<double> mean;
+        std::vector<double> covariance;
+    };
+
+    // Sample covariance (numAssets x numAssets row major) of returns held column major, numObservations
+    // per asset
+    inline std::vector<double> SampleCovariance(double const* returns, std::size_t numObservations, std::size_t numAssets)
+    {
+        if (numObservations < 2)
+            throw std::invalid_argument("covariance needs at least two observations");
+
+        std::vector<double> centred(returns, returns + numObservations * numAssets);
+        std::vector<double const*> columns(numAssets);
+        for (std::size_t a = 0; a < numAssets; ++a)
+        {
+            double* column = &centred[a * numObservations];
+            double const mean = Sum(column, numObservations) / numObservations;
+            for (std::size_t t = 0; t < numObservations; ++t)
+                column[t] -= mean;
+            columns[a] = column;
+        }
+
+        std::vector<double> covariance(numAssets * numAssets);
+        GramMatrix(columns.data(), numAssets, numObservations, covariance.data());
+        for (auto& c : covariance)
+            c /= numObservations - 1;
+        return covariance;
+    }
+
+    // Black-Litterman model (He and Litterman, "The intuition behind Black-Litterman model portfolios",
+    // 1999): equilibrium returns Pi = delta Sigma w implied by market weights w, and for views (P, Q,
+    // Omega) the posterior
+    //     mean = Pi + tau Sigma P' (P tau Sigma P' + Omega)^-1 (Q - P Pi)
+    //     covariance = (1 + tau) Sigma - tau Sigma P' (P tau Sigma P' + Omega)^-1 P tau Sigma
+    // tau Sigma = L L' is factored once. With B = P L, each view set needs only B (numViews rows), the
+    // small factor of B B' + Omega and solves against it, so thousands of view sets cost little more
+    // than their products with L.
+    class BlackLitterman
+    {
+    public:
+        // Scratch space per thread
+        struct Workspace
+        {
+            std::vector<double> b, m, residual, u, g, column;
+        };
+
+        // Throws if the covariance (numAssets x numAssets, row major) is not positive definite
+        BlackLitterman(std::vector<double> const& covariance, std::vector<double> const& marketWeights, double riskAversion, double tau)
+            : mNumAssets(marketWeights.size())
+            , mTau(tau)
+            , mCovariance(covariance)
+            , mFactor(covariance)
+            , mImplied(marketWeights.size())
+        {
+            if (covariance.size() != mNumAssets * mNumAssets || mNumAssets == 0)
+                throw std::invalid_argument("covariance does not match the market weights");
+            if (!(tau > 0.0))
+                throw std::invalid_argument("tau must be positive");
+
+            for (auto& f : mFactor)
+                f *= tau;
+            if (!CholeskyDecompose(mFactor.data(), mNumAssets))
+                throw std::invalid_argument("covariance is not positive definite");
+
+            for (std::size_t i = 0; i < mNumAssets; ++i)
+                mImplied[i] = riskAversion * Dot(&mCovariance[i * mNumAssets], marketWeights.data(), mNumAssets);
+        }
+
+        std::size_t NumAssets() const
+        {
+            return mNumAssets;
+        }
+
+        std::vector<double> const& Covariance() const
+        {
+            return mCovariance;
+        }
+
+        // Equilibrium returns Pi
+        std::vector<double> const& ImpliedReturns() const
+        {
+            return mImplied;
+        }
+
+        BlackLittermanPosterior Posterior(ViewSet const& views, bool covariance, Workspace& workspace) const
+        {
+            std::size_t const n = mNumAssets;
+            std::size_t const k = views.numViews;
+            if (views.pick.size() != k * n || views.returns.size() != k || (!views.omega.empty() && views.omega.size() != k * k))
+                throw std::invalid_argument("view set dimensions do not match");
+
+            BlackLittermanPosterior posterior;
+            posterior.mean = mImplied;
+            if (covariance)
+            {
+                posterior.covariance = mCovariance;
+                for (auto& c : posterior.covariance)
+                    c *= 1.0 + mTau;
+            }
+            if (k == 0)
+                return posterior;
+
+            // B = P L, a row per view; L is lower triangular, so row m of L contributes to columns 0..m
+            std::vector<double>& b = workspace.b;
+            b.assign(k * n, 0.0);
+            for (std::size_t v = 0; v < k; ++v)
+            {
+                double const* p = &views.pick[v * n];
+                double* row = &b[v * n];
+                for (std::size_t m = 0; m < n; ++m)
+                {
+                    double const weight = p[m];
+                    if (weight == 0.0)
+                        continue;
+                    double const* l = &mFactor[m * n];
+                    for (std::size_t j = 0; j <= m; ++j)
+                        row[j] += weight * l[j];
+                }
+            }
+
+            // M = B B' + Omega = P tau Sigma P' + Omega, factored in place
+            std::vector<double>& m = workspace.m;
+            m.resize(k * k);
+            for (std::size_t v = 0; v < k; ++v)
+                for (std::size_t w = 0; w <= v; ++w)
+                    m[v * k + w] = m[w * k + v] = Dot(&b[v * n], &b[w * n], n);
+            for (std::size_t v = 0; v < k; ++v)
+                for (std::size_t w = 0; w < k; ++w)
+                    m[v * k + w] += views.omega.empty() ? (v == w ? m[v * k + v] : 0.0) : views.omega[v * k + w];
+            if (!CholeskyDecompose(m.data(), k))
+                throw std::invalid_argument("view covariance is not positive definite");
+
+            // mean = Pi + L B' M^-1 (Q - P Pi)
+            std::vector<double>& residual = workspace.residual;
+            residual.resize(k);
+            for (std::size_t v = 0; v < k; ++v)
+                residual[v] = views.returns[v] - Dot(&views.pick[v * n], mImplied.data(), n);
+            CholeskySolve(m.data(), k, residual.data());
+
+            std::vector<double>& u = workspace.u;
+            u.assign(n, 0.0);
+            for (std::size_t v = 0; v < k; ++v)
+                for (std::size_t j = 0; j < n; ++j)
+                    u[j] += b[v * n + j] * residual[v];
+            for (std::size_t i = 0; i < n; ++i)
+                posterior.mean[i] += Dot(&mFactor[i * n], u.data(), i + 1);
+
+            if (covariance)
+            {
+                // With M = R R' and C = R^-1 B, the update is G G' for G = L C' (numAssets x numViews)
+                std::vector<double>& column = workspace.column;
+                column.resize(k);
+                for (std::size_t j = 0; j < n; ++j)
+                {
+                    for (std::size_t v = 0; v < k; ++v)
+                        column[v] = b[v * n + j];
+                    ForwardSubstitute(m.data(), k, column.data());
+                    for (std::size_t v = 0; v < k; ++v)
+                        b[v * n + j] = column[v];
+                }
+
+                // Columns of G held as rows, so the update is k rank one updates of contiguous rows
+                std::vector<double>& g = workspace.g;
+                g.resize(k * n);
+                for (std::size_t v = 0; v < k; ++v)
+                    for (std::size_t i = 0; i < n; ++i)
+                        g[v * n + i] = Dot(&mFactor[i * n], &b[v * n], i + 1);
+
+                double* const result = posterior.covariance.data();
+                for (std::size_t v = 0; v < k; ++v)
+                {
+                    double const* column = &g[v * n];
+                    for (std::size_t i = 0; i < n; ++i)
+                    {
+                        double const gi = column[i];
+                        double* row = result + i * n;
+                        for (std::size_t j = 0; j <= i; ++j)
+                            row[j] -= gi * column[j];
+                    }
+                }
+
+                for (std::size_t i = 0; i < n; ++i)
+                    for (std::size_t j = 0; j < i; ++j)
+                        result[j * n + i] = result[i * n + j];
+            }
+
+            return posterior;
+        }
+
+        BlackLittermanPosterior Posterior(ViewSet const& views, bool covariance = true) const
+        {
+            Workspace workspace;
+            return Posterior(views, covariance, workspace);
+        }
+
+        // Posteriors of many view sets, in parallel over view sets. numThreads = 0 uses all cores.
+        std::vector<BlackLittermanPosterior> Posteriors(std::vector<ViewSet> const& viewSets, bool covariance, unsigned numThreads = 0) const
+        {
+            std::vector<BlackLittermanPosterior> posteriors(viewSets.size());
+
+            std::atomic<std::size_t> next(0);
+            RunParallel(ThreadCount(numThreads, viewSets.size()), [&] (std::size_t, std::atomic<bool> const& failed)
+            {
+                Workspace workspace;
+                for (std::size_t s = next++; s < viewSets.size() && !failed; s = next++)
+                    posteriors[s] = Posterior(viewSets[s], covariance, workspace);
+            });
+
+            return posteriors;
+        }
+
+    private:
+        std::size_t mNumAssets;
+        double mTau;
+        std::vector<double> mCovariance;
+
+        /// Lower Cholesky factor of tau Sigma
+        std::vector<double> mFactor;
+
+        std::vector<double> mImplied;
+    };
+}
+
+#endif
@@ -0,0 +1,299 @@
+#ifndef BLACKLIT_COVARIANCE_HPP
+#define BLACKLIT_COVARIANCE_HPP
+
+#include "../coint/linearAlgebra.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+namespace CqfProject
+{
+    // row[0:n] += c[0] d0[0:n] + c[1] d1[0:n] + c[2] d2[0:n] + c[3] d3[0:n]: one pass over the row for four
+    // observations, so a block of observations loads and stores the cross products once
+    inline void RankFourUpdate(double* row, double const* d0, double const* d1, double const* d2, double const* d3, double const* c, std::size_t n)
+    {
+        std::size_t j = 0;
+
+#if defined (__AVX__)
+        __m256d const c0 = _mm256_set1_pd(c[0]), c1 = _mm256_set1_pd(c[1]), c2 = _mm256_set1_pd(c[2]), c3 = _mm256_set1_pd(c[3]);
+        for (; j + 4 <= n; j += 4)
+        {
+#   if defined (__FMA__)
+            __m256d sum = _mm256_fmadd_pd(c0, _mm256_loadu_pd(d0 + j), _mm256_loadu_pd(row + j));
+            sum = _mm256_fmadd_pd(c1, _mm256_loadu_pd(d1 + j), sum);
+            sum = _mm256_fmadd_pd(c2, _mm256_loadu_pd(d2 + j), sum);
+            sum = _mm256_fmadd_pd(c3, _mm256_loadu_pd(d3 + j), sum);
+#   else
+            __m256d const sum01 = _mm256_add_pd(_mm256_mul_pd(c0, _mm256_loadu_pd(d0 + j)), _mm256_mul_pd(c1, _mm256_loadu_pd(d1 + j)));
+            __m256d const sum23 = _mm256_add_pd(_mm256_mul_pd(c2, _mm256_loadu_pd(d2 + j)), _mm256_mul_pd(c3, _mm256_loadu_pd(d3 + j)));
+            __m256d const sum = _mm256_add_pd(_mm256_loadu_pd(row + j), _mm256_add_pd(sum01, sum23));
+#   endif
+            _mm256_storeu_pd(row + j, sum);
+        }
+#elif defined (COINT_USE_SSE2)
+        __m128d const c0 = _mm_set1_pd(c[0]), c1 = _mm_set1_pd(c[1]), c2 = _mm_set1_pd(c[2]), c3 = _mm_set1_pd(c[3]);
+        for (; j + 2 <= n; j += 2)
+        {
+            __m128d const sum01 = _mm_add_pd(_mm_mul_pd(c0, _mm_loadu_pd(d0 + j)), _mm_mul_pd(c1, _mm_loadu_pd(d1 + j)));
+            __m128d const sum23 = _mm_add_pd(_mm_mul_pd(c2, _mm_loadu_pd(d2 + j)), _mm_mul_pd(c3, _mm_loadu_pd(d3 + j)));
+            _mm_storeu_pd(row + j, _mm_add_pd(_mm_loadu_pd(row + j), _mm_add_pd(sum01, sum23)));
+        }
+#endif
+
+        for (; j < n; ++j)
+            row[j] += (c[0] * d0[j] + c[1] * d1[j]) + (c[2] * d2[j] + c[3] * d3[j]);
+    }
+
+    // Covariance of a matrix with Ledoit-Wolf shrinkage towards a multiple of the identity
+    struct ShrunkCovariance
+    {
+        ShrunkCovariance()
+            : shrinkage(0.0)
+            , target(0.0)
+        {}
+
+        /// numAssets x numAssets, row major
+        std::vector<double> covariance;
+
+        /// Weight of the target, in [0, 1]
+        double shrinkage;
+
+        /// Average variance, the diagonal of the target
+        double target;
+    };
+
+    // Single pass covariance of observations (rows of returns, one value per asset) that can be added and
+    // removed in any order, e.g. a rolling window. Observations are taken relative to the first one added,
+    // which keeps the raw cross products small, and buffered BLOCK_ROWS at a time so the n^2 / 2 cross
+    // products are read and written once per block rather than once per observation. Memory is O(n^2) whatever the number of observations.
+    //
+    // Alongside the cross products it keeps the sums of |x|^2, |x|^4 and |x|^2 x that Ledoit and Wolf's
+    // estimate of the shrinkage intensity needs, so the shrunk estimate comes from the same single pass.
+    class CovarianceAccumulator
+    {
+    public:
+        /// Observations buffered before updating the cross products, a multiple of four. Each row of the
+        /// cross products takes the whole block while it is in L1 cache.
+        static std::size_t const BLOCK_ROWS = 32;
+
+        explicit CovarianceAccumulator(std::size_t numAssets)
+            : mNumAssets(numAssets)
+            , mReference(numAssets)
+            , mCount(0)
+            , mSum(numAssets)
+            , mNormSum(0.0)
+            , mNormSquareSum(0.0)
+            , mNormCross(numAssets)
+            , mCross(numAssets * numAssets)
+            , mPending(BLOCK_ROWS * numAssets)
+            , mPendingCount(0)
+        {
+            if (numAssets == 0)
+                throw std::invalid_argument("covariance needs at least one asset");
+        }
+
+        std::size_t NumAssets() const
+        {
+            return mNumAssets;
+        }
+
+        // Observations currently held
+        std::size_t Count() const
+        {
+            return mCount;
+        }
+
+        // Adds an observation, x[0], x[stride], ... one per asset, e.g. a row of a column major matrix
+        void Add(double const* x, std::size_t stride = 1)
+        {
+            // Once all observations are removed the sums are zero up to rounding; start afresh from this one
+            if (mCount == 0)
+            {
+                Reset();
+                Rebase(x, stride);
+            }
+            Accumulate(x, stride, 1.0);
+        }
+
+        // Removes an observation added before, e.g. the oldest of a rolling window
+        void Remove(double const* x, std::size_t stride = 1)
+        {
+            if (mCount == 0)
+                throw std::logic_error("no observation to remove");
+            Accumulate(x, stride, -1.0);
+        }
+
+        void Reset()
+        {
+            mCount = 0;
+            mPendingCount = 0;
+            std::fill(mSum.begin(), mSum.end(), 0.0);
+            std::fill(mNormCross.begin(), mNormCross.end(), 0.0);
+            std::fill(mCross.begin(), mCross.end(), 0.0);
+            mNormSum = mNormSquareSum = 0.0;
+        }
+
+        std::vector<double> Mean() const
+        {
+            std::vector<double> mean(mNumAssets);
+            for (std::size_t i = 0; i < mNumAssets; ++i)
+                mean[i] = mReference[i] + mSum[i] / mCount;
+            return mean;
+        }
+
+        // Sample covariance (numAssets x numAssets, row major), divided by Count() - 1, or by Count() for
+        // the maximum likelihood estimate. Not const, as it first folds buffered observations into the
+        // cross products, so concurrent queries of one accumulator need external locking.
+        std::vector<double> Covariance(bool unbiased = true)
+        {
+            double const m = static_cast<double>(mCount);
+            if (mCount < (unbiased ? 2u : 1u))
+                throw std::logic_error("too few observations for a covariance");
+
+            Flush();
+
+            std::size_t const n = mNumAssets;
+            std::vector<double> covariance(n * n);
+            double const scale = 1.0 / (unbiased ? m - 1.0 : m);
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                double const meanI = mSum[i] / m;
+                for (std::size_t j = 0; j <= i; ++j)
+                    covariance[i * n + j] = covariance[j * n + i] = (mCross[i * n + j] - meanI * mSum[j]) * scale;
+            }
+            return covariance;
+        }
+
+        // Ledoit and Wolf, "A well-conditioned estimator for large-dimensional covariance matrices" (2004):
+        // delta mu I + (1 - delta) S, for S the maximum likelihood covariance, mu = tr(S) / n and the
+        // intensity delta = min(b^2, d^2) / d^2 with, in the norm |A|^2 = tr(A A') / n,
+        //     d^2 = |S - mu I|^2,   b^2 = sum over t of |y_t y_t' - S|^2 / m^2,
+        // y_t the demeaned observations. |y_t|^2 = |x_t|^2 - 2 xbar'x_t + |xbar|^2, so the sum of |y_t|^4
+        // in b^2 expands into the moments kept.
+        ShrunkCovariance LedoitWolf()
+        {
+            std::size_t const n = mNumAssets;
+            double const m = static_cast<double>(mCount);
+
+            ShrunkCovariance result;
+            result.covariance = Covariance(false);
+            std::vector<double>& s = result.covariance;
+
+            double trace = 0.0, squareNorm = 0.0;
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                trace += s[i * n + i];
+                squareNorm += Dot(&s[i * n], &s[i * n], n);
+            }
+            double const mu = trace / n;
+
+            // |S - mu I|^2 = (|S|^2 - 2 mu tr(S) + n mu^2) / n
+            double const d2 = (squareNorm - 2.0 * mu * trace + n * mu * mu) / n;
+
+            std::vector<double> mean(n);
+            for (std::size_t i = 0; i < n; ++i)
+                mean[i] = mSum[i] / m;
+            double const meanNorm = Dot(mean.data(), mean.data(), n);
+
+            // mean' C mean, with C the symmetric cross products held in the lower triangle
+            double quadratic = 0.0;
+            for (std::size_t i = 0; i < n; ++i)
+                quadratic += mean[i] * (Dot(&mCross[i * n], mean.data(), i) * 2.0 + mCross[i * n + i] * mean[i]);
+
+            double const fourthMoments = mNormSquareSum - 4.0 * Dot(mean.data(), mNormCross.data(), n) + 2.0 * meanNorm * mNormSum
+                + 4.0 * quadratic - 3.0 * m * meanNorm * meanNorm;
+            double const b2Bar = std::max(0.0, (fourthMoments - m * squareNorm) / (m * m * n));
+            double const b2 = std::min(b2Bar, d2);
+
+            result.target = mu;
+            result.shrinkage = d2 > 0.0 ? b2 / d2 : 0.0;
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                for (std::size_t j = 0; j < n; ++j)
+                    s[i * n + j] *= 1.0 - result.shrinkage;
+                s[i * n + i] += result.shrinkage * mu;
+            }
+
+            return result;
+        }
+
+    private:
+        void Rebase(double const* x, std::size_t stride)
+        {
+            for (std::size_t i = 0; i < mNumAssets; ++i)
+                mReference[i] = x[i * stride];
+        }
+
+        void Accumulate(double const* x, std::size_t stride, double weight)
+        {
+            double* d = &mPending[mPendingCount * mNumAssets];
+            double norm = 0.0;
+            for (std::size_t i = 0; i < mNumAssets; ++i)
+            {
+                d[i] = x[i * stride] - mReference[i];
+                norm += d[i] * d[i];
+            }
+
+            for (std::size_t i = 0; i < mNumAssets; ++i)
+            {
+                mSum[i] += weight * d[i];
+                mNormCross[i] += weight * norm * d[i];
+            }
+            mNormSum += weight * norm;
+            mNormSquareSum += weight * norm * norm;
+            if (weight > 0.0)
+                ++mCount;
+            else
+                --mCount;
+
+            mWeights[mPendingCount] = weight;
+            if (++mPendingCount == BLOCK_ROWS)
+                Flush();
+        }
+
+        // Cross products of the pending block into the lower triangle, row by row
+        void Flush()
+        {
+            if (mPendingCount == 0)
+                return;
+
+            // Groups of four observations; rows past the pending count repeat the first with a zero coefficient
+            std::size_t const n = mNumAssets;
+            std::size_t const numRows = (mPendingCount + 3) / 4 * 4;
+            double const* rows[BLOCK_ROWS];
+            for (std::size_t r = 0; r < numRows; ++r)
+                rows[r] = &mPending[(r < mPendingCount ? r : 0) * n];
+
+            double coefficients[BLOCK_ROWS];
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                for (std::size_t r = 0; r < numRows; ++r)
+                    coefficients[r] = r < mPendingCount ? mWeights[r] * rows[r][i] : 0.0;
+                for (std::size_t r = 0; r < numRows; r += 4)
+                    RankFourUpdate(&mCross[i * n], rows[r], rows[r + 1], rows[r + 2], rows[r + 3], coefficients + r, i + 1);
+            }
+
+            mPendingCount = 0;
+        }
+
+        std::size_t mNumAssets;
+        std::vector<double> mReference;
+        std::size_t mCount;
+        std::vector<double> mSum;
+
+        /// Sums of |d|^2, |d|^4 and |d|^2 d for the shrinkage intensity
+        double mNormSum;
+        double mNormSquareSum;
+        std::vector<double> mNormCross;
+
+        /// Sum of d d', lower triangle, excluding the pending block until it is flushed
+        std::vector<double> mCross;
+        std::vector<double> mPending;
+        double mWeights[BLOCK_ROWS];
+        std::size_t mPendingCount;
+    };
+}
+
+#endif
@@ -0,0 +1,439 @@
+#ifndef BLACKLIT_PORTFOLIO_OPTIMIZER_HPP
+#define BLACKLIT_PORTFOLIO_OPTIMIZER_HPP
+
+#include "../coint/linearAlgebra.hpp"
+#include "../coint/parallel.hpp"
+#include "../thirdparty/nloptThreads.hpp"
+
+#include <nlopt.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+namespace CqfProject
+{
+    enum class PortfolioAlgorithm
+    {
+        /// Sequential quadratic programming, with the budget as an equality constraint
+        SLSQP,
+
+        /// Method of moving asymptotes, which takes inequality constraints only; the budget is met by
+        /// eliminating a variable
+        MMA
+    };
+
+    struct PortfolioConstraints
+    {
+        PortfolioConstraints()
+            : budget(1.0)
+            , longOnly(true)
+            , leverage(1.0)
+            , maxWeight(1.0)
+        {}
+
+        /// Sum of the weights
+        double budget;
+
+        /// No short positions. Otherwise each weight is a long and a short part, so gross exposure is linear.
+        bool longOnly;
+
+        /// Cap on the sum of absolute weights when short positions are allowed
+        double leverage;
+
+        /// Cap on each long, and each short, position
+        double maxWeight;
+
+        /// Sector of each asset, -1 for none; empty for no sector caps
+        std::vector<int> sectors;
+
+        /// Cap on the net weight of each sector
+        std::vector<double> sectorCaps;
+    };
+
+    struct OptimizerSettings
+    {
+        OptimizerSettings()
+            : algorithm(PortfolioAlgorithm::SLSQP)
+            , relativeTolerance(1e-12)
+            , maxEvaluations(5000)
+            , numThreads(0)
+        {}
+
+        PortfolioAlgorithm algorithm;
+
+        /// Relative tolerance on the objective and the weights
+        double relativeTolerance;
+
+        int maxEvaluations;
+
+        /// Frontier threads, 0 for all cores
+        unsigned numThreads;
+    };
+
+    struct PortfolioSolution
+    {
+        PortfolioSolution()
+            : riskAversion(0.0)
+            , expectedReturn(0.0)
+            , variance(0.0)
+            , status(NLOPT_FAILURE)
+            , evaluations(0)
+        {}
+
+        bool Converged() const
+        {
+            return status > 0;
+        }
+
+        double riskAversion;
+        std::vector<double> weights;
+        double expectedReturn;
+        double variance;
+
+        /// nlopt's result; positive on convergence
+        nlopt_result status;
+
+        /// Objective evaluations, each with its gradient
+        int evaluations;
+    };
+
+    // Mean-variance optimizer: maximizes mean'w - (riskAversion / 2) w' Sigma w over the constrained
+    // weights with nlopt's gradient based local solvers. The objective and all constraints are given
+    // with analytic gradients; the problem is convex, so the local optimum is the global one.
+    //
+    // Solutions warm start the next solve, and a frontier of risk aversions is split into contiguous runs
+    // per thread, each run warm started point to point.
+    class MeanVarianceOptimizer
+    {
+    public:
+        MeanVarianceOptimizer(std::vector<double> const& mean, std::vector<double> const& covariance, PortfolioConstraints const& constraints,
+            OptimizerSettings const& settings = OptimizerSettings())
+            : mNumAssets(mean.size())
+            , mMean(mean)
+            , mCovariance(covariance)
+            , mConstraints(constraints)
+            , mSettings(settings)
+            , mNumSectors(0)
+        {
+            std::size_t const n = mNumAssets;
+            if (n == 0 || covariance.size() != n * n)
+                throw std::invalid_argument("covariance does not match the mean");
+            if (!constraints.sectors.empty() && constraints.sectors.size() != n)
+                throw std::invalid_argument("one sector per asset expected");
+            if (!(constraints.maxWeight > 0.0) || (!constraints.longOnly && !(constraints.leverage > 0.0)))
+                throw std::invalid_argument("weight and leverage caps must be positive");
+
+            for (int sector : constraints.sectors)
+            {
+                if (sector >= static_cast<int>(constraints.sectorCaps.size()))
+                    throw std::invalid_argument("sector without a cap");
+                mNumSectors = std::max(mNumSectors, static_cast<std::size_t>(sector + 1));
+            }
+        }
+
+        std::size_t NumAssets() const
+        {
+            return mNumAssets;
+        }
+
+        // Optimum for one risk aversion, started from start (weights, e.g. a previous solution) or else
+        // from the last solution found, or equal weights
+        PortfolioSolution Solve(double riskAversion, std::vector<double> const& start = std::vector<double>())
+        {
+            SeedNloptOnce();
+            Solver solver(*this);
+            PortfolioSolution const solution = solver.Solve(riskAversion, !start.empty() ? start : mLast);
+            if (solution.Converged())
+                mLast = solution.weights;
+            return solution;
+        }
+
+        // Optimal portfolios for each risk aversion, in parallel. Each thread takes a contiguous run of the
+        // points, so pass them sorted for the warm starts to help.
+        std::vector<PortfolioSolution> Frontier(std::vector<double> const& riskAversions) const
+        {
+            std::size_t const numPoints = riskAversions.size();
+            std::vector<PortfolioSolution> solutions(numPoints);
+
+            std::size_t const numThreads = ThreadCount(mSettings.numThreads, numPoints);
+
+            SeedNloptOnce();
+
+            RunParallel(numThreads, [&] (std::size_t thread, std::atomic<bool> const& failed)
+            {
+                Solver solver(*this);
+                std::vector<double> start = mLast;
+                for (std::size_t p = thread * numPoints / numThreads; p < (thread + 1) * numPoints / numThreads && !failed; ++p)
+                {
+                    solutions[p] = solver.Solve(riskAversions[p], start);
+                    if (solutions[p].Converged())
+                        start = solutions[p].weights;
+                }
+            });
+
+            return solutions;
+        }
+
+    private:
+        // One nlopt problem, reused for successive solves on one thread.
+        //
+        // The variables are the long parts of the weights, followed when shorting by the short parts. SLSQP
+        // takes the budget as an equality constraint. MMA takes inequalities only, and as a pair from both
+        // sides the budget leaves it no strictly feasible point to move through, so for MMA the long part
+        // of the last asset is eliminated instead: it is whatever meets the budget, and its bounds become
+        // two linear inequalities.
+        class Solver
+        {
+        public:
+            explicit Solver(MeanVarianceOptimizer const& optimizer)
+                : mOptimizer(optimizer)
+                , mEliminate(optimizer.mSettings.algorithm == PortfolioAlgorithm::MMA)
+                , mNumLong(mEliminate ? optimizer.mNumAssets - 1 : optimizer.mNumAssets)
+                , mNumVariables(optimizer.mConstraints.longOnly ? mNumLong : mNumLong + optimizer.mNumAssets)
+                , mOpt(nullptr)
+                , mRiskAversion(0.0)
+                , mScale(1.0)
+                , mEvaluations(0)
+                , mWeights(optimizer.mNumAssets)
+                , mGradient(optimizer.mNumAssets)
+                , mProduct(optimizer.mNumAssets)
+            {
+                if (mNumVariables == 0)
+                    throw std::invalid_argument("MMA needs more than one asset when long only");
+
+                mOpt = nlopt_create(mEliminate ? NLOPT_LD_MMA : NLOPT_LD_SLSQP, static_cast<unsigned>(mNumVariables));
+                if (mOpt == nullptr)
+                    throw std::runtime_error("failed to create the nlopt problem");
+
+                PortfolioConstraints const& constraints = optimizer.mConstraints;
+                nlopt_set_lower_bounds1(mOpt, 0.0);
+                nlopt_set_upper_bounds1(mOpt, constraints.maxWeight);
+                nlopt_set_min_objective(mOpt, &Solver::Objective, this);
+                nlopt_set_ftol_rel(mOpt, optimizer.mSettings.relativeTolerance);
+                nlopt_set_xtol_rel(mOpt, optimizer.mSettings.relativeTolerance);
+                nlopt_set_maxeval(mOpt, optimizer.mSettings.maxEvaluations);
+
+                if (!mEliminate)
+                    nlopt_add_equality_constraint(mOpt, &Solver::Budget, this, 1e-12);
+
+                // Inequalities: gross exposure, sector caps, and the bounds of the eliminated long part
+                std::size_t const numInequalities = (constraints.longOnly ? 0 : 1) + optimizer.mNumSectors + (mEliminate ? 2 : 0);
+                std::vector<double> const tolerances(numInequalities, 1e-12);
+                if (numInequalities != 0)
+                    nlopt_add_inequality_mconstraint(mOpt, static_cast<unsigned>(numInequalities), &Solver::Inequalities, this, tolerances.data());
+            }
+
+            Solver(Solver const&) = delete;
+            Solver& operator=(Solver const&) = delete;
+
+            ~Solver()
+            {
+                nlopt_destroy(mOpt);
+            }
+
+            PortfolioSolution Solve(double riskAversion, std::vector<double> const& start)
+            {
+                std::size_t const n = mOptimizer.mNumAssets;
+                PortfolioConstraints const& constraints = mOptimizer.mConstraints;
+
+                // Start from the given weights clipped to the bounds, or equal weights
+                std::vector<double> x(mNumVariables, 0.0);
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    double const w = start.size() == n ? start[i] : constraints.budget / n;
+                    if (i < mNumLong)
+                        x[i] = std::min(std::max(w, 0.0), constraints.maxWeight);
+                    if (!constraints.longOnly)
+                        x[mNumLong + i] = std::min(std::max(-w, 0.0), constraints.maxWeight);
+                }
+
+                // Scale the objective so its gradient is of order one at unit weights. Daily variances and returns
+                // leave it of order 1e-4, where MMA's damping, floored at 1e-5, would dwarf it and stall the steps.
+                double largest = 0.0;
+                for (std::size_t i = 0; i < n; ++i)
+                    largest = std::max(largest, riskAversion * mOptimizer.mCovariance[i * n + i] + std::abs(mOptimizer.mMean[i]));
+                mScale = largest > 0.0 ? 1.0 / largest : 1.0;
+
+                mRiskAversion = riskAversion;
+                mEvaluations = 0;
+                double objective = 0.0;
+                PortfolioSolution solution;
+                solution.riskAversion = riskAversion;
+                solution.status = nlopt_optimize(mOpt, x.data(), &objective);
+                solution.evaluations = mEvaluations;
+
+                ToWeights(x.data(), solution.weights);
+                std::vector<double> product(n);
+                for (std::size_t i = 0; i < n; ++i)
+                    product[i] = Dot(&mOptimizer.mCovariance[i * n], solution.weights.data(), n);
+                solution.expectedReturn = Dot(mOptimizer.mMean.data(), solution.weights.data(), n);
+                solution.variance = Dot(product.data(), solution.weights.data(), n);
+                return solution;
+            }
+
+        private:
+            void ToWeights(double const* x, std::vector<double>& weights) const
+            {
+                std::size_t const n = mOptimizer.mNumAssets;
+                weights.assign(n, 0.0);
+                std::copy(x, x + mNumLong, weights.begin());
+                if (!mOptimizer.mConstraints.longOnly)
+                    for (std::size_t i = 0; i < n; ++i)
+                        weights[i] -= x[mNumLong + i];
+                if (mEliminate)
+                    weights[n - 1] = mOptimizer.mConstraints.budget - Sum(weights.data(), n - 1);
+            }
+
+            // Long part of the eliminated asset: its weight plus its short part
+            double EliminatedLong(double const* x, std::vector<double> const& weights) const
+            {
+                std::size_t const n = mOptimizer.mNumAssets;
+                return weights[n - 1] + (mOptimizer.mConstraints.longOnly ? 0.0 : x[mNumLong + n - 1]);
+            }
+
+            // Gradient in the variables of a function of the weights with gradient g: short parts enter with
+            // the opposite sign, and each weight moved is taken from the eliminated one
+            void ToVariables(double const* g, double* gradient) const
+            {
+                std::size_t const n = mOptimizer.mNumAssets;
+                double const eliminated = mEliminate ? g[n - 1] : 0.0;
+                for (std::size_t i = 0; i < mNumLong; ++i)
+                    gradient[i] = g[i] - eliminated;
+                if (!mOptimizer.mConstraints.longOnly)
+                    for (std::size_t i = 0; i < n; ++i)
+                        gradient[mNumLong + i] = eliminated - g[i];
+            }
+
+            // (riskAversion / 2) w' Sigma w - mean'w, with gradient riskAversion Sigma w - mean, both scaled
+            static double Objective(unsigned, double const* x, double* gradient, void* data)
+            {
+                Solver& solver = *static_cast<Solver*>(data);
+                MeanVarianceOptimizer const& optimizer = solver.mOptimizer;
+                std::size_t const n = optimizer.mNumAssets;
+                ++solver.mEvaluations;
+
+                solver.ToWeights(x, solver.mWeights);
+                double const* w = solver.mWeights.data();
+                for (std::size_t i = 0; i < n; ++i)
+                    solver.mProduct[i] = Dot(&optimizer.mCovariance[i * n], w, n);
+
+                if (gradient != nullptr)
+                {
+                    for (std::size_t i = 0; i < n; ++i)
+                        solver.mGradient[i] = solver.mScale * (solver.mRiskAversion * solver.mProduct[i] - optimizer.mMean[i]);
+                    solver.ToVariables(solver.mGradient.data(), gradient);
+                }
+
+                return solver.mScale * (0.5 * solver.mRiskAversion * Dot(solver.mProduct.data(), w, n) - Dot(optimizer.mMean.data(), w, n));
+            }
+
+            // sum(w) - budget
+            static double Budget(unsigned, double const* x, double* gradient, void* data)
+            {
+                Solver& solver = *static_cast<Solver*>(data);
+                std::size_t const n = solver.mOptimizer.mNumAssets;
+                solver.ToWeights(x, solver.mWeights);
+                if (gradient != nullptr)
+                {
+                    std::fill(solver.mGradient.begin(), solver.mGradient.end(), 1.0);
+                    solver.ToVariables(solver.mGradient.data(), gradient);
+                }
+                return Sum(solver.mWeights.data(), n) - solver.mOptimizer.mConstraints.budget;
+            }
+
+            // Rows of result <= 0, with the m x numVariables row major gradient
+            static void Inequalities(unsigned m, double* result, unsigned numVariables, double const* x, double* gradient, void* data)
+            {
+                Solver& solver = *static_cast<Solver*>(data);
+                MeanVarianceOptimizer const& optimizer = solver.mOptimizer;
+                PortfolioConstraints const& constraints = optimizer.mConstraints;
+                std::size_t const n = optimizer.mNumAssets;
+                solver.ToWeights(x, solver.mWeights);
+                if (gradient != nullptr)
+                    std::fill(gradient, gradient + static_cast<std::size_t>(m) * numVariables, 0.0);
+
+                // The eliminated long part falls one for one with the other long parts and rises with the short parts
+                double const eliminated = solver.mEliminate ? solver.EliminatedLong(x, solver.mWeights) : 0.0;
+                auto const eliminatedGradient = [&] (double sign, double* row)
+                {
+                    for (std::size_t j = 0; j < numVariables; ++j)
+                        row[j] += j < solver.mNumLong ? -sign : sign;
+                };
+
+                std::size_t row = 0;
+                if (!constraints.longOnly)
+                {
+                    // Gross exposure: sum of long and short parts
+                    result[row] = Sum(x, numVariables) + eliminated - constraints.leverage;
+                    if (gradient != nullptr)
+                    {
+                        std::fill(gradient, gradient + numVariables, 1.0);
+                        if (solver.mEliminate)
+                            eliminatedGradient(1.0, gradient);
+                    }
+                    ++row;
+                }
+
+                for (std::size_t s = 0; s < optimizer.mNumSectors; ++s, ++row)
+                {
+                    result[row] = -constraints.sectorCaps[s];
+                    std::fill(solver.mGradient.begin(), solver.mGradient.end(), 0.0);
+                    for (std::size_t i = 0; i < n; ++i)
+                    {
+                        if (constraints.sectors[i] == static_cast<int>(s))
+                        {
+                            result[row] += solver.mWeights[i];
+                            solver.mGradient[i] = 1.0;
+                        }
+                    }
+                    if (gradient != nullptr)
+                        solver.ToVariables(solver.mGradient.data(), gradient + row * numVariables);
+                }
+
+                if (solver.mEliminate)
+                {
+                    // 0 <= eliminated long part <= maxWeight
+                    result[row] = -eliminated;
+                    result[row + 1] = eliminated - constraints.maxWeight;
+                    if (gradient != nullptr)
+                    {
+                        eliminatedGradient(-1.0, gradient + row * numVariables);
+                        eliminatedGradient(1.0, gradient + (row + 1) * numVariables);
+                    }
+                }
+            }
+
+            MeanVarianceOptimizer const& mOptimizer;
+
+            /// MMA: the last asset's long part is implied by the budget
+            bool mEliminate;
+
+            std::size_t mNumLong;
+            std::size_t mNumVariables;
+            nlopt_opt mOpt;
+            double mRiskAversion;
+            double mScale;
+            int mEvaluations;
+
+            /// Scratch for the callbacks
+            std::vector<double> mWeights;
+            std::vector<double> mGradient;
+            std::vector<double> mProduct;
+        };
+
+        std::size_t mNumAssets;
+        std::vector<double> mMean;
+        std::vector<double> mCovariance;
+        PortfolioConstraints mConstraints;
+        OptimizerSettings mSettings;
+        std::size_t mNumSectors;
+
+        /// Last converged weights of Solve, the default start
+        std::vector<double> mLast;
+    };
+}
+
+#endif
@@ -0,0 +1,513 @@
+#include "blackLitterman.hpp"
+#include "covariance.hpp"
+#include "portfolioOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace CqfProject;
+
+namespace
+{
+    // Inverse of a small row major matrix by Gauss-Jordan elimination with partial pivoting
+    std::vector<double> Inverse(std::vector<double> a, std::size_t n)
+    {
+        std::vector<double> inverse(n * n, 0.0);
+        for (std::size_t i = 0; i < n; ++i)
+            inverse[i * n + i] = 1.0;
+
+        for (std::size_t c = 0; c < n; ++c)
+        {
+            std::size_t pivot = c;
+            for (std::size_t r = c + 1; r < n; ++r)
+                if (std::abs(a[r * n + c]) > std::abs(a[pivot * n + c]))
+                    pivot = r;
+            for (std::size_t j = 0; j < n; ++j)
+            {
+                std::swap(a[c * n + j], a[pivot * n + j]);
+                std::swap(inverse[c * n + j], inverse[pivot * n + j]);
+            }
+
+            double const scale = 1.0 / a[c * n + c];
+            for (std::size_t j = 0; j < n; ++j)
+            {
+                a[c * n + j] *= scale;
+                inverse[c * n + j] *= scale;
+            }
+
+            for (std::size_t r = 0; r < n; ++r)
+            {
+                double const factor = a[r * n + c];
+                if (r == c || factor == 0.0)
+                    continue;
+                for (std::size_t j = 0; j < n; ++j)
+                {
+                    a[r * n + j] -= factor * a[c * n + j];
+                    inverse[r * n + j] -= factor * inverse[c * n + j];
+                }
+            }
+        }
+
+        return inverse;
+    }
+
+    // Product of row major a (n x m) and b (m x p)
+    std::vector<double> Multiply(std::vector<double> const& a, std::vector<double> const& b, std::size_t n, std::size_t m, std::size_t p)
+    {
+        std::vector<double> c(n * p, 0.0);
+        for (std::size_t i = 0; i < n; ++i)
+            for (std::size_t k = 0; k < m; ++k)
+                for (std::size_t j = 0; j < p; ++j)
+                    c[i * p + j] += a[i * m + k] * b[k * p + j];
+        return c;
+    }
+
+    std::vector<double> Transpose(std::vector<double> const& a, std::size_t n, std::size_t m)
+    {
+        std::vector<double> t(m * n);
+        for (std::size_t i = 0; i < n; ++i)
+            for (std::size_t j = 0; j < m; ++j)
+                t[j * n + i] = a[i * m + j];
+        return t;
+    }
+
+    // Posterior by the precision form: mean = [(tau S)^-1 + P' O^-1 P]^-1 [(tau S)^-1 Pi + P' O^-1 Q],
+    // covariance = S + [(tau S)^-1 + P' O^-1 P]^-1
+    BlackLittermanPosterior ReferencePosterior(std::vector<double> const& sigma, std::vector<double> const& implied, double tau,
+        ViewSet const& views, std::vector<double> const& omega)
+    {
+        std::size_t const n = implied.size(), k = views.numViews;
+        std::vector<double> tauSigma(sigma);
+        for (auto& s : tauSigma)
+            s *= tau;
+
+        std::vector<double> const priorPrecision = Inverse(tauSigma, n);
+        std::vector<double> const pt = Transpose(views.pick, k, n);
+        std::vector<double> const ptOmegaInverse = Multiply(pt, Inverse(omega, k), n, k, k);
+        std::vector<double> precision = Multiply(ptOmegaInverse, views.pick, n, k, n);
+        for (std::size_t i = 0; i < n * n; ++i)
+            precision[i] += priorPrecision[i];
+        std::vector<double> const posteriorCovariance = Inverse(precision, n);
+
+        std::vector<double> rhs = Multiply(priorPrecision, implied, n, n, 1);
+        std::vector<double> const viewTerm = Multiply(ptOmegaInverse, views.returns, n, k, 1);
+        for (std::size_t i = 0; i < n; ++i)
+            rhs[i] += viewTerm[i];
+
+        BlackLittermanPosterior posterior;
+        posterior.mean = Multiply(posteriorCovariance, rhs, n, n, 1);
+        posterior.covariance = sigma;
+        for (std::size_t i = 0; i < n * n; ++i)
+            posterior.covariance[i] += posteriorCovariance[i];
+        return posterior;
+    }
+
+    double MaxDifference(std::vector<double> const& a, std::vector<double> const& b)
+    {
+        double difference = a.size() == b.size() ? 0.0 : HUGE_VAL;
+        for (std::size_t i = 0; i < a.size() && i < b.size(); ++i)
+            difference = std::max(difference, std::abs(a[i] - b[i]));
+        return difference;
+    }
+
+    // Returns of numAssets correlated through one market factor, column major
+    std::vector<double> SimulateReturns(std::size_t numObservations, std::size_t numAssets, std::mt19937_64& generator)
+    {
+        std::normal_distribution<double> normal;
+        std::vector<double> returns(numObservations * numAssets);
+        for (std::size_t t = 0; t < numObservations; ++t)
+        {
+            double const market = 0.01 * normal(generator);
+            for (std::size_t a = 0; a < numAssets; ++a)
+                returns[a * numObservations + t] = (0.5 + 0.1 * a) * market + 0.01 * normal(generator);
+        }
+        return returns;
+    }
+}
+
+// Check the sample covariance against a direct two pass computation
+int TestSampleCovariance()
+{
+    int errorCount = 0;
+
+    std::mt19937_64 generator(3);
+    std::size_t const numObservations = 101, numAssets = 5;
+    std::vector<double> const returns = SimulateReturns(numObservations, numAssets, generator);
+    std::vector<double> const covariance = SampleCovariance(returns.data(), numObservations, numAssets);
+
+    for (std::size_t a = 0; a < numAssets; ++a)
+    {
+        for (std::size_t b = 0; b < numAssets; ++b)
+        {
+            double meanA = 0.0, meanB = 0.0;
+            for (std::size_t t = 0; t < numObservations; ++t)
+            {
+                meanA += returns[a * numObservations + t] / numObservations;
+                meanB += returns[b * numObservations + t] / numObservations;
+            }
+            double expected = 0.0;
+            for (std::size_t t = 0; t < numObservations; ++t)
+                expected += (returns[a * numObservations + t] - meanA) * (returns[b * numObservations + t] - meanB) / (numObservations - 1);
+
+            if (!(std::abs(covariance[a * numAssets + b] - expected) < 1e-18))
+            {
+                std::cout << "Covariance error. Entry " << a << ", " << b << ": " << covariance[a * numAssets + b] << " expected " << expected << std::endl;
+                errorCount++;
+            }
+        }
+    }
+
+    return errorCount;
+}
+
+// Check posteriors against the precision form, the limits of certain views, and batches against single view sets
+int TestPosterior()
+{
+    int errorCount = 0;
+
+    std::mt19937_64 generator(5);
+    std::size_t const numObservations = 500, numAssets = 8;
+    std::vector<double> const returns = SimulateReturns(numObservations, numAssets, generator);
+    std::vector<double> const sigma = SampleCovariance(returns.data(), numObservations, numAssets);
+    std::vector<double> const weights(numAssets, 1.0 / numAssets);
+    double const tau = 0.05, delta = 2.5;
+    BlackLitterman const model(sigma, weights, delta, tau);
+
+    // Implied returns are delta Sigma w
+    std::vector<double> const implied = Multiply(sigma, weights, numAssets, numAssets, 1);
+    for (std::size_t i = 0; i < numAssets; ++i)
+    {
+        if (!(std::abs(model.ImpliedReturns()[i] - delta * implied[i]) < 1e-15))
+        {
+            std::cout << "Posterior error. Implied return " << i << std::endl;
+            errorCount++;
+        }
+    }
+
+    // An absolute view on asset 0 and a relative view of asset 2 over asset 5, with Omega given and default
+    ViewSet views;
+    views.numViews = 2;
+    views.pick.assign(2 * numAssets, 0.0);
+    views.pick[0] = 1.0;
+    views.pick[numAssets + 2] = 1.0;
+    views.pick[numAssets + 5] = -1.0;
+    views.returns = { 0.002, 0.001 };
+    views.omega = { 1e-5, 2e-6, 2e-6, 4e-5 };
+
+    std::vector<double> heLitterman(4, 0.0);
+    for (std::size_t v = 0; v < 2; ++v)
+    {
+        std::vector<double> const p(views.pick.begin() + v * numAssets, views.pick.begin() + (v + 1) * numAssets);
+        std::vector<double> const sp = Multiply(sigma, p, numAssets, numAssets, 1);
+        for (std::size_t i = 0; i < numAssets; ++i)
+            heLitterman[v * 2 + v] += tau * p[i] * sp[i];
+    }
+
+    for (int form = 0; form < 2; ++form)
+    {
+        ViewSet set = views;
+        if (form == 1)
+            set.omega.clear();
+
+        BlackLittermanPosterior const posterior = model.Posterior(set);
+        BlackLittermanPosterior const reference = ReferencePosterior(sigma, model.ImpliedReturns(), tau, set, form == 0 ? views.omega : heLitterman);
+        double const meanError = MaxDifference(posterior.mean, reference.mean);
+        double const covarianceError = MaxDifference(posterior.covariance, reference.covariance);
+        if (!(meanError < 1e-12) || !(covarianceError < 1e-12))
+        {
+            std::cout << "Posterior error. Form " << form << " differs by " << meanError << " in mean, " << covarianceError << " in covariance" << std::endl;
+            errorCount++;
+        }
+    }
+
+    // Nearly certain views are met by the posterior mean
+    ViewSet certain = views;
+    certain.omega = { 1e-14, 0.0, 0.0, 1e-14 };
+    BlackLittermanPosterior const posterior = model.Posterior(certain, false);
+    double const relative = posterior.mean[2] - posterior.mean[5];
+    if (!(std::abs(posterior.mean[0] - 0.002) < 1e-8) || !(std::abs(relative - 0.001) < 1e-8) || !posterior.covariance.empty())
+    {
+        std::cout << "Posterior error. Certain views give " << posterior.mean[0] << " and " << relative << std::endl;
+        errorCount++;
+    }
+
+    // A batch of random view sets on several threads matches one at a time
+    std::vector<ViewSet> batch(50);
+    std::normal_distribution<double> normal;
+    for (std::size_t s = 0; s < batch.size(); ++s)
+    {
+        batch[s].numViews = 1 + s % 4;
+        for (std::size_t i = 0; i < batch[s].numViews * numAssets; ++i)
+            batch[s].pick.push_back(normal(generator));
+        for (std::size_t v = 0; v < batch[s].numViews; ++v)
+            batch[s].returns.push_back(0.001 * normal(generator));
+    }
+
+    std::vector<BlackLittermanPosterior> const posteriors = model.Posteriors(batch, true, 3);
+    for (std::size_t s = 0; s < batch.size(); ++s)
+    {
+        BlackLittermanPosterior const single = model.Posterior(batch[s]);
+        if (posteriors[s].mean != single.mean || posteriors[s].covariance != single.covariance)
+        {
+            std::cout << "Posterior error. Batch differs at view set " << s << std::endl;
+            errorCount++;
+        }
+    }
+
+    return errorCount;
+}
+
+// Check the streaming covariance against SampleCovariance, over a rolling window, and Ledoit-Wolf against a two pass computation
+int TestCovarianceAccumulator()
+{
+    int errorCount = 0;
+
+    std::mt19937_64 generator(7);
+    std::size_t const numObservations = 203, numAssets = 13;
+    std::vector<double> returns = SimulateReturns(numObservations, numAssets, generator);
+    for (auto& r : returns)
+        r += 0.05;
+
+    // Rows of the column major matrix by stride; a window of the last 150 rows after removing the first 53
+    CovarianceAccumulator accumulator(numAssets);
+    for (std::size_t t = 0; t < numObservations; ++t)
+        accumulator.Add(&returns[t], numObservations);
+    std::vector<double> const covariance = accumulator.Covariance();
+    double const fullError = MaxDifference(covariance, SampleCovariance(returns.data(), numObservations, numAssets));
+
+    std::size_t const window = 150, first = numObservations - window;
+    for (std::size_t t = 0; t < first; ++t)
+        accumulator.Remove(&returns[t], numObservations);
+
+    std::vector<double> windowReturns(window * numAssets);
+    for (std::size_t a = 0; a < numAssets; ++a)
+        for (std::size_t t = 0; t < window; ++t)
+            windowReturns[a * window + t] = returns[a * numObservations + first + t];
+    std::vector<double> const expected = SampleCovariance(windowReturns.data(), window, numAssets);
+    double const windowError = MaxDifference(accumulator.Covariance(), expected);
+    if (!(fullError < 1e-17) || !(windowError < 1e-17) || accumulator.Count() != window ||
+        !(std::abs(accumulator.Mean()[3] - Sum(&windowReturns[3 * window], window) / window) < 1e-15))
+    {
+        std::cout << "Covariance accumulator error. Differs by " << fullError << " over all rows, " << windowError << " over the window" << std::endl;
+        errorCount++;
+    }
+
+    // Ledoit-Wolf of the window, directly from the demeaned observations
+    std::size_t const n = numAssets;
+    double const m = static_cast<double>(window);
+    std::vector<double> sample(expected);
+    for (auto& x : sample)
+        x *= (m - 1.0) / m;
+
+    double mu = 0.0;
+    for (std::size_t i = 0; i < n; ++i)
+        mu += sample[i * n + i] / n;
+
+    double d2 = 0.0;
+    for (std::size_t i = 0; i < n; ++i)
+        for (std::size_t j = 0; j < n; ++j)
+            d2 += std::pow(sample[i * n + j] - (i == j ? mu : 0.0), 2) / n;
+
+    double b2 = 0.0;
+    for (std::size_t t = 0; t < window; ++t)
+    {
+        std::vector<double> y(n);
+        for (std::size_t i = 0; i < n; ++i)
+            y[i] = windowReturns[i * window + t] - Sum(&windowReturns[i * window], window) / m;
+        for (std::size_t i = 0; i < n; ++i)
+            for (std::size_t j = 0; j < n; ++j)
+                b2 += std::pow(y[i] * y[j] - sample[i * n + j], 2) / (n * m * m);
+    }
+    double const shrinkage = std::min(b2, d2) / d2;
+
+    ShrunkCovariance const shrunk = accumulator.LedoitWolf();
+    std::vector<double> target(sample);
+    for (std::size_t i = 0; i < n; ++i)
+        for (std::size_t j = 0; j < n; ++j)
+            target[i * n + j] = (1.0 - shrinkage) * sample[i * n + j] + (i == j ? shrinkage * mu : 0.0);
+
+    if (!(std::abs(shrunk.shrinkage - shrinkage) < 1e-9) || !(shrinkage > 0.0 && shrinkage < 1.0) || !(MaxDifference(shrunk.covariance, target) < 1e-15))
+    {
+        std::cout << "Covariance accumulator error. Shrinkage " << shrunk.shrinkage << " expected " << shrinkage << std::endl;
+        errorCount++;
+    }
+
+    return errorCount;
+}
+
+// Check the optimizer against the closed form budget constrained optimum, the long only optimality conditions, a binding
+// sector cap, MMA against SLSQP and the parallel frontier against serial solves
+int TestPortfolioOptimizer()
+{
+    int errorCount = 0;
+
+    std::mt19937_64 generator(11);
+    std::size_t const numObservations = 500, n = 8;
+    std::vector<double> const returns = SimulateReturns(numObservations, n, generator);
+    std::vector<double> const covariance = SampleCovariance(returns.data(), numObservations, n);
+    std::vector<double> mean(n);
+    for (std::size_t a = 0; a < n; ++a)
+        mean[a] = 1e-4 * (1.0 + (a * 5) % 7);
+
+    auto const objective = [&] (std::vector<double> const& w, double riskAversion)
+    {
+        std::vector<double> const product = Multiply(covariance, w, n, n, 1);
+        return 0.5 * riskAversion * Dot(product.data(), w.data(), n) - Dot(mean.data(), w.data(), n);
+    };
+
+    // Long-short with slack caps: w = Sigma^-1 (mean - gamma 1) / riskAversion, gamma meeting the budget
+    double const riskAversion = 20.0;
+    PortfolioConstraints longShort;
+    longShort.longOnly = false;
+    longShort.leverage = 100.0;
+    longShort.maxWeight = 50.0;
+
+    std::vector<double> const inverse = Inverse(covariance, n);
+    std::vector<double> const inverseMean = Multiply(inverse, mean, n, n, 1);
+    std::vector<double> const inverseOne = Multiply(inverse, std::vector<double>(n, 1.0), n, n, 1);
+    double const gamma = (Sum(inverseMean.data(), n) - riskAversion) / Sum(inverseOne.data(), n);
+    std::vector<double> expected(n);
+    for (std::size_t i = 0; i < n; ++i)
+        expected[i] = (inverseMean[i] - gamma * inverseOne[i]) / riskAversion;
+
+    for (PortfolioAlgorithm algorithm : { PortfolioAlgorithm::SLSQP, PortfolioAlgorithm::MMA })
+    {
+        OptimizerSettings settings;
+        settings.algorithm = algorithm;
+        MeanVarianceOptimizer optimizer(mean, covariance, longShort, settings);
+        PortfolioSolution const solution = optimizer.Solve(riskAversion);
+        double const difference = MaxDifference(solution.weights, expected);
+        if (!solution.Converged() || !(difference < 1e-4))
+        {
+            std::cout << "Portfolio optimizer error. Long-short weights differ by " << difference << " status " << solution.status << std::endl;
+            errorCount++;
+        }
+    }
+
+    // Long only: the gradient is -gamma on held assets and no lower on the rest
+    PortfolioConstraints longOnly;
+    MeanVarianceOptimizer optimizer(mean, covariance, longOnly);
+    PortfolioSolution const solution = optimizer.Solve(riskAversion);
+    std::vector<double> gradient = Multiply(covariance, solution.weights, n, n, 1);
+    double held = HUGE_VAL, lowest = HUGE_VAL, highest = -HUGE_VAL, numHeld = 0;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        gradient[i] = riskAversion * gradient[i] - mean[i];
+        lowest = std::min(lowest, gradient[i]);
+        if (solution.weights[i] > 1e-6)
+        {
+            held = std::min(held, gradient[i]);
+            highest = std::max(highest, gradient[i]);
+            ++numHeld;
+        }
+    }
+    if (!solution.Converged() || !(std::abs(Sum(solution.weights.data(), n) - 1.0) < 1e-9) || !(highest - held < 1e-7) ||
+        !(lowest > held - 1e-7) || numHeld == n || !(*std::min_element(solution.weights.begin(), solution.weights.end()) >= 0.0))
+    {
+        std::cout << "Portfolio optimizer error. Long only gradient on held assets in [" << held << ", " << highest << "], lowest " << lowest << std::endl;
+        errorCount++;
+    }
+
+    // Cap the sector holding most of the portfolio with weights capped at 0.4; MMA and SLSQP must agree on the optimum
+    PortfolioConstraints capped;
+    capped.maxWeight = 0.4;
+    capped.sectors.resize(n);
+    for (std::size_t i = 0; i < n; ++i)
+        capped.sectors[i] = i < 2 ? -1 : static_cast<int>(i % 2);
+    capped.sectorCaps.assign(2, 1.0);
+    std::vector<double> const uncapped = MeanVarianceOptimizer(mean, covariance, capped).Solve(riskAversion).weights;
+    double sectorWeight[2] = { 0.0, 0.0 };
+    for (std::size_t i = 2; i < n; ++i)
+        sectorWeight[i % 2] += uncapped[i];
+    std::size_t const sector = sectorWeight[1] > sectorWeight[0] ? 1 : 0;
+    capped.sectorCaps[sector] = 0.5 * sectorWeight[sector];
+
+    double objectives[2];
+    for (PortfolioAlgorithm algorithm : { PortfolioAlgorithm::SLSQP, PortfolioAlgorithm::MMA })
+    {
+        OptimizerSettings settings;
+        settings.algorithm = algorithm;
+        MeanVarianceOptimizer cappedOptimizer(mean, covariance, capped, settings);
+        PortfolioSolution const cappedSolution = cappedOptimizer.Solve(riskAversion);
+        double weight = 0.0;
+        for (std::size_t i = 0; i < n; ++i)
+            if (capped.sectors[i] == static_cast<int>(sector))
+                weight += cappedSolution.weights[i];
+        objectives[algorithm == PortfolioAlgorithm::MMA] = objective(cappedSolution.weights, riskAversion);
+
+        // MMA approaches the optimum from outside the constraints, so is held to a looser slack
+        double const slack = algorithm == PortfolioAlgorithm::MMA ? 1e-6 : 1e-10;
+        if (!cappedSolution.Converged() || !(weight < capped.sectorCaps[sector] + slack) || !(weight > capped.sectorCaps[sector] - 1e-6) ||
+            !(*std::max_element(cappedSolution.weights.begin(), cappedSolution.weights.end()) < 0.4 + slack) ||
+            !(*std::min_element(cappedSolution.weights.begin(), cappedSolution.weights.end()) > -slack) ||
+            !(std::abs(Sum(cappedSolution.weights.data(), n) - 1.0) < 1e-10))
+        {
+            std::cout << "Portfolio optimizer error. Sector weight " << weight << " capped at " << capped.sectorCaps[sector] << std::endl;
+            errorCount++;
+        }
+    }
+    if (!(std::abs(objectives[1] - objectives[0]) < 1e-6 * std::abs(objectives[0])))
+    {
+        std::cout << "Portfolio optimizer error. MMA objective " << objectives[1] << " SLSQP " << objectives[0] << std::endl;
+        errorCount++;
+    }
+
+    // Frontier over threads matches serial solves, and expected return falls as risk aversion rises
+    std::vector<double> riskAversions;
+    for (int p = 0; p < 24; ++p)
+        riskAversions.push_back(2.0 * std::pow(1.25, p));
+    OptimizerSettings threaded;
+    threaded.numThreads = 4;
+    std::vector<PortfolioSolution> const frontier = MeanVarianceOptimizer(mean, covariance, capped, threaded).Frontier(riskAversions);
+    MeanVarianceOptimizer serial(mean, covariance, capped);
+    for (std::size_t p = 0; p < riskAversions.size(); ++p)
+    {
+        PortfolioSolution const point = serial.Solve(riskAversions[p], std::vector<double>(n, 1.0 / n));
+        double const difference = std::abs(objective(point.weights, riskAversions[p]) - objective(frontier[p].weights, riskAversions[p]));
+        if (!frontier[p].Converged() || !(difference < 1e-6 * std::abs(objective(point.weights, riskAversions[p]))) ||
+            (p > 0 && !(frontier[p].expectedReturn <= frontier[p - 1].expectedReturn + 1e-10)))
+        {
+            std::cout << "Portfolio optimizer error. Frontier point " << p << " objective differs by " << difference << std::endl;
+            errorCount++;
+        }
+    }
+
+    return errorCount;
+}
+
+int main()
+{
+    std::cout << "Testing sample covariance" << std::endl;
+    int c0 = TestSampleCovariance();
+    if (c0 == 0)
+        std::cout << "Sample covariance tests passed!" << std::endl;
+    else
+        std::cout << "Sample covariance tests failed! " << c0 << " errors" << std::endl;
+
+    std::cout << "Testing Black-Litterman posterior" << std::endl;
+    int c1 = TestPosterior();
+    if (c1 == 0)
+        std::cout << "Black-Litterman posterior tests passed!" << std::endl;
+    else
+        std::cout << "Black-Litterman posterior tests failed! " << c1 << " errors" << std::endl;
+
+    std::cout << "Testing covariance accumulator" << std::endl;
+    int c2 = TestCovarianceAccumulator();
+    if (c2 == 0)
+        std::cout << "Covariance accumulator tests passed!" << std::endl;
+    else
+        std::cout << "Covariance accumulator tests failed! " << c2 << " errors" << std::endl;
+
+    std::cout << "Testing portfolio optimizer" << std::endl;
+    int c3 = TestPortfolioOptimizer();
+    if (c3 == 0)
+        std::cout << "Portfolio optimizer tests passed!" << std::endl;
+    else
+        std::cout << "Portfolio optimizer tests failed! " << c3 << " errors" << std::endl;
+
+    return c0 + c1 + c2 + c3;
+}
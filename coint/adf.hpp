@@ -0,0 +1,179 @@
+#ifndef COINT_ADF_HPP
+#define COINT_ADF_HPP
+
+#include "linearAlgebra.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace CqfProject
+{
+    // Deterministic terms in a unit root or cointegrating regression
+    enum class Deterministic
+    {
+        NONE,
+        CONSTANT,
+        TREND
+    };
+
+    enum class SignificanceLevel
+    {
+        ONE_PERCENT,
+        FIVE_PERCENT,
+        TEN_PERCENT
+    };
+
+    // MacKinnon (2010) response surface critical value of the (augmented) Dickey-Fuller t statistic,
+    // cv(T) = b0 + b1 / T + b2 / T^2 + b3 / T^3, for T observations in the test regression.
+    // numVariables is 1 for a unit root test, or the number of series in an Engle-Granger cointegrating
+    // regression, whose deterministic terms are the ones given. Tabulated for 1 and 2 variables.
+    inline double MacKinnonCriticalValue(std::size_t numVariables, Deterministic deterministic, SignificanceLevel level, std::size_t numObservations)
+    {
+        // [variables - 1][deterministic][level][coefficient], MacKinnon (2010) table 2
+        static double const coefficients[2][3][3][4] =
+        {
+            {
+                { { -2.56574, -2.2358, -3.627, 0.0 }, { -1.94100, -0.2686, -3.365, 31.223 }, { -1.61682, 0.2656, -2.714, 25.364 } },
+                { { -3.43035, -6.5393, -16.786, -79.433 }, { -2.86154, -2.8903, -4.234, -40.040 }, { -2.56677, -1.5384, -2.809, 0.0 } },
+                { { -3.95877, -9.0531, -28.428, -134.155 }, { -3.41049, -4.3904, -9.036, -45.374 }, { -3.12705, -2.5856, -3.925, -22.380 } }
+            },
+            {
+                // Without deterministic terms the cointegrating regression is not tabulated
+                { { std::numeric_limits<double>::quiet_NaN(), 0.0, 0.0, 0.0 },
+                  { std::numeric_limits<double>::quiet_NaN(), 0.0, 0.0, 0.0 },
+                  { std::numeric_limits<double>::quiet_NaN(), 0.0, 0.0, 0.0 } },
+                { { -3.89644, -10.9519, -22.527, 0.0 }, { -3.33613, -6.1101, -6.823, 0.0 }, { -3.04445, -4.2412, -2.720, 0.0 } },
+                { { -4.32762, -15.4387, -35.679, 0.0 }, { -3.78057, -9.5106, -12.074, 0.0 }, { -3.49631, -7.0815, -7.538, 21.892 } }
+            }
+        };
+
+        if (numVariables < 1 || numVariables > 2)
+            throw std::runtime_error("MacKinnon critical values are tabulated for 1 or 2 variables");
+
+        double const* b = coefficients[numVariables - 1][static_cast<int>(deterministic)][static_cast<int>(level)];
+        double const invT = 1.0 / static_cast<double>(numObservations);
+        return b[0] + invT * (b[1] + invT * (b[2] + invT * b[3]));
+    }
+
+    struct AdfResult
+    {
+        AdfResult()
+            : statistic(std::numeric_limits<double>::quiet_NaN())
+            , rho(std::numeric_limits<double>::quiet_NaN())
+            , numObservations(0)
+        {}
+
+        /// t statistic of rho
+        double statistic;
+
+        /// Coefficient of the lagged level, negative when mean reverting
+        double rho;
+
+        /// Observations in the test regression
+        std::size_t numObservations;
+    };
+
+    // Scratch space for AdfTest, reused across calls to avoid allocation in scans
+    struct AdfWorkspace
+    {
+        std::vector<double> differences;
+        std::vector<double> columns;
+        std::vector<double> gram;
+        std::vector<double> rhs;
+        std::vector<double> xty;
+        std::vector<double> unit;
+        std::vector<double const*> column;
+    };
+
+    // ADF regression from its moments: the k x k Gram matrix of the regressors, lagged level first, their
+    // products with the differences and the sum of squared differences, over m observations. gram and rhs
+    // are overwritten. For callers that keep the moments up to date themselves.
+    inline AdfResult AdfFromMoments(double* gram, double* rhs, double targetSq, std::size_t k, std::size_t m, AdfWorkspace& workspace)
+    {
+        AdfResult result;
+        if (m <= k || !CholeskyDecompose(gram, k))
+            return result;
+
+        std::vector<double>& xty = workspace.xty;
+        xty.assign(rhs, rhs + k);
+        CholeskySolve(gram, k, rhs);
+
+        // Residual sum of squares from the normal equations
+        double ssr = targetSq;
+        for (std::size_t a = 0; a < k; ++a)
+            ssr -= rhs[a] * xty[a];
+
+        std::size_t const dof = m - k;
+        double const sigmaSq = std::max(ssr, 0.0) / dof;
+
+        // (X'X)^-1[0, 0]
+        std::vector<double>& unit = workspace.unit;
+        unit.assign(k, 0.0);
+        unit[0] = 1.0;
+        CholeskySolve(gram, k, unit.data());
+
+        result.rho = rhs[0];
+        result.statistic = rhs[0] / std::sqrt(sigmaSq * unit[0]);
+        result.numObservations = m;
+        return result;
+    }
+
+    // Augmented Dickey-Fuller regression of
+    //     dy[t] = rho y[t-1] + deterministic terms + sum_i gamma_i dy[t-i], i = 1..lags
+    // by least squares over the normal equations. Returns NaN statistics if the regression is singular
+    // or has no degrees of freedom.
+    inline AdfResult AdfTest(double const* y, std::size_t n, std::size_t lags, Deterministic deterministic, AdfWorkspace& workspace)
+    {
+        AdfResult result;
+        std::size_t const numDeterministic = static_cast<std::size_t>(deterministic);
+        std::size_t const k = 1 + numDeterministic + lags;
+        if (n < lags + 2 + k)
+            return result;
+
+        // dy[t] for t = 1..n-1, stored at t - 1
+        std::vector<double>& dy = workspace.differences;
+        dy.resize(n - 1);
+        for (std::size_t t = 1; t < n; ++t)
+            dy[t - 1] = y[t] - y[t - 1];
+
+        // Regression over t = lags + 1 .. n - 1
+        std::size_t const m = n - 1 - lags;
+        double const* const target = dy.data() + lags;
+
+        // Regressor columns: lagged level, deterministic terms, lagged differences
+        std::vector<double>& columns = workspace.columns;
+        columns.resize(k * m);
+        std::vector<double const*>& column = workspace.column;
+        column.resize(k);
+
+        column[0] = y + lags;
+        for (std::size_t j = 0; j < numDeterministic; ++j)
+        {
+            double* c = columns.data() + j * m;
+            for (std::size_t t = 0; t < m; ++t)
+                c[t] = j == 0 ? 1.0 : static_cast<double>(t + lags + 1);
+            column[1 + j] = c;
+        }
+        for (std::size_t i = 1; i <= lags; ++i)
+            column[numDeterministic + i] = dy.data() + lags - i;
+
+        std::vector<double>& gram = workspace.gram;
+        std::vector<double>& rhs = workspace.rhs;
+        gram.resize(k * k);
+        rhs.resize(k);
+        for (std::size_t a = 0; a < k; ++a)
+        {
+            rhs[a] = Dot(column[a], target, m);
+            for (std::size_t b = 0; b <= a; ++b)
+                gram[a * k + b] = gram[b * k + a] = Dot(column[a], column[b], m);
+        }
+
+        return AdfFromMoments(gram.data(), rhs.data(), Dot(target, target, m), k, m, workspace);
+    }
+}
+
+#endif
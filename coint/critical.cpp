@@ -0,0 +1,135 @@
+#include "criticalValues.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace CqfProject;
+
+// coint-critical: empirical critical values of the ADF, Engle-Granger or Johansen statistic for a sample
+// size and deterministic terms, by simulating independent random walks. Writes statistic,probability,value
+// rows to stdout and the timing to stderr. With --cache, tables are read from and added to a CSV file.
+
+void PrintUsage()
+{
+    std::cerr
+        << "Usage: coint-critical [options]" << std::endl
+        << "Simulated critical values of cointegration test statistics under the null of no cointegration" << std::endl
+        << "  --test T              adf (default), engle-granger or johansen" << std::endl
+        << "  --observations N      price observations per sample (default 250)" << std::endl
+        << "  --variables K         random walks per sample, 1 for adf, 2 for engle-granger, the basket size" << std::endl
+        << "                        less the rank for johansen (default 1, 2 or 2)" << std::endl
+        << "  --deterministic D     none, constant (default) or trend terms, adf and johansen" << std::endl
+        << "  --lags N              lagged differences in the ADF regression or VECM (default 1)" << std::endl
+        << "  --one-direction       engle-granger of one regression only, as coint-scan --one-direction" << std::endl
+        << "  --replications N      simulated samples (default 10000)" << std::endl
+        << "  --seed N              Philox key (default 20101)" << std::endl
+        << "  --threads N           simulation threads, 0 for all cores (default)" << std::endl
+        << "  --cache FILE          reuse and save tables in FILE" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    SimulationSettings settings;
+    bool variablesSet = false;
+    std::size_t replications = 10000;
+    std::uint64_t seed = 20101;
+    unsigned numThreads = 0;
+    std::string cachePath;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const arg = argv[i];
+        bool const hasValue = i + 1 < argc;
+
+        if (arg == "--test" && hasValue)
+        {
+            std::string const value = argv[++i];
+            if (value != "adf" && value != "engle-granger" && value != "johansen")
+            {
+                PrintUsage();
+                return 1;
+            }
+            settings.test = value == "adf" ? SimulatedTest::ADF :
+                value == "engle-granger" ? SimulatedTest::ENGLE_GRANGER : SimulatedTest::JOHANSEN;
+        }
+        else if (arg == "--observations" && hasValue)
+            settings.numObservations = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--variables" && hasValue)
+        {
+            settings.numVariables = std::strtoul(argv[++i], nullptr, 10);
+            variablesSet = true;
+        }
+        else if (arg == "--deterministic" && hasValue)
+        {
+            std::string const value = argv[++i];
+            if (value != "none" && value != "constant" && value != "trend")
+            {
+                PrintUsage();
+                return 1;
+            }
+            settings.deterministic = value == "none" ? Deterministic::NONE :
+                value == "constant" ? Deterministic::CONSTANT : Deterministic::TREND;
+        }
+        else if (arg == "--lags" && hasValue)
+            settings.lags = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--one-direction")
+            settings.bothDirections = false;
+        else if (arg == "--replications" && hasValue)
+            replications = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && hasValue)
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--threads" && hasValue)
+            numThreads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--cache" && hasValue)
+            cachePath = argv[++i];
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (!variablesSet)
+        settings.numVariables = settings.test == SimulatedTest::ADF ? 1 : 2;
+
+    // Engle-Granger always regresses with a constant
+    if (settings.test == SimulatedTest::ENGLE_GRANGER)
+        settings.deterministic = Deterministic::CONSTANT;
+
+    if (replications < 10 || settings.numObservations < settings.numVariables * (settings.lags + 2) + 10)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        auto const start = std::chrono::steady_clock::now();
+
+        CriticalValueCache cache(cachePath);
+        std::vector<CriticalValueTable> tables;
+        for (auto const& statistic : SimulatedStatistics(settings.test))
+            tables.push_back(cache.Get(settings, statistic, replications, seed, numThreads));
+
+        double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "statistic,probability,value" << std::endl;
+        for (auto const& table : tables)
+            for (std::size_t i = 0; i < table.values.size(); ++i)
+                std::cout << table.statistic << ',' << CriticalValueProbabilities()[i] << ',' << table.values[i] << '\n';
+
+        std::cerr << tables.front().replications << " replications of " << SimulatedTestName(settings.test) << " at T = "
+            << settings.numObservations << " in " << seconds << " s" << std::endl;
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,409 @@
+#ifndef COINT_CRITICAL_VALUES_HPP
+#define COINT_CRITICAL_VALUES_HPP
+
+#include "adf.hpp"
+#include "engleGranger.hpp"
+#include "johansen.hpp"
+#include "parallel.hpp"
+#include "philox.hpp"
+#include "priceMatrix.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace CqfProject
+{
+    enum class SimulatedTest
+    {
+        /// Dickey-Fuller t statistic of one random walk
+        ADF,
+
+        /// Engle-Granger statistic of two independent random walks
+        ENGLE_GRANGER,
+
+        /// Johansen trace and maximum eigenvalue statistics of rank 0, for numVariables independent random
+        /// walks; critical values of rank r in a basket of n are those of n - r variables
+        JOHANSEN
+    };
+
+    // What is simulated: the statistic of a test under its null, for samples as the test sees them
+    struct SimulationSettings
+    {
+        SimulationSettings()
+            : test(SimulatedTest::ADF)
+            , numObservations(250)
+            , numVariables(1)
+            , deterministic(Deterministic::CONSTANT)
+            , lags(1)
+            , bothDirections(true)
+        {}
+
+        SimulatedTest test;
+
+        /// Length of each simulated series, i.e. the price observations of the tested sample
+        std::size_t numObservations;
+
+        std::size_t numVariables;
+
+        /// ADF and Johansen deterministic terms; Engle-Granger always has a constant
+        Deterministic deterministic;
+
+        std::size_t lags;
+
+        /// Engle-Granger only, as in EngleGrangerSettings
+        bool bothDirections;
+    };
+
+    // Names of the statistics a simulation of the test produces, in sample order
+    inline std::vector<std::string> SimulatedStatistics(SimulatedTest test)
+    {
+        std::vector<std::string> names;
+        if (test == SimulatedTest::JOHANSEN)
+        {
+            names.push_back("trace");
+            names.push_back("max-eigen");
+        }
+        else
+            names.push_back("t");
+        return names;
+    }
+
+    // Probabilities tabulated, lower tail for ADF and Engle-Granger, upper tail for Johansen
+    inline std::vector<double> const& CriticalValueProbabilities()
+    {
+        static std::vector<double> const probabilities = { 0.01, 0.025, 0.05, 0.10, 0.50, 0.90, 0.95, 0.975, 0.99 };
+        return probabilities;
+    }
+
+    // Statistics of one replication, written to out. Independent of any other replication.
+    inline void SimulateReplication(SimulationSettings const& settings, std::uint64_t seed, std::uint64_t replication, double* out)
+    {
+        std::size_t const n = settings.numObservations;
+        std::size_t const k = settings.numVariables;
+        PhiloxNormalStream normal(seed, replication);
+
+        PriceMatrix walks;
+        walks.numObservations = n;
+        walks.logPrices.resize(n * k);
+        for (std::size_t s = 0; s < k; ++s)
+        {
+            walks.symbols.push_back(std::string(1, static_cast<char>('a' + s % 26)));
+            double level = 0.0;
+            double* column = walks.logPrices.data() + s * n;
+            for (std::size_t t = 0; t < n; ++t)
+                column[t] = level += normal.Next();
+        }
+
+        switch (settings.test)
+        {
+        case SimulatedTest::ADF:
+            {
+                AdfWorkspace workspace;
+                out[0] = AdfTest(walks.Column(0), n, settings.lags, settings.deterministic, workspace).statistic;
+            }
+            break;
+
+        case SimulatedTest::ENGLE_GRANGER:
+            {
+                EngleGrangerSettings egSettings;
+                egSettings.lags = settings.lags;
+                egSettings.bothDirections = settings.bothDirections;
+                EngleGrangerScanner::Workspace workspace;
+                out[0] = EngleGrangerScanner(walks).TestPair(0, 1, egSettings, workspace).statistic;
+            }
+            break;
+
+        case SimulatedTest::JOHANSEN:
+            {
+                JohansenSettings johansenSettings;
+                johansenSettings.lags = settings.lags;
+                johansenSettings.deterministic = settings.deterministic;
+                johansenSettings.numThreads = 1;
+                std::vector<std::size_t> basket(k);
+                for (std::size_t s = 0; s < k; ++s)
+                    basket[s] = s;
+
+                JohansenResult const result = JohansenScanner(walks, johansenSettings).Test(basket);
+                out[0] = result.traceStatistics.empty() ? std::numeric_limits<double>::quiet_NaN() : result.traceStatistics[0];
+                out[1] = result.maxEigenStatistics.empty() ? std::numeric_limits<double>::quiet_NaN() : result.maxEigenStatistics[0];
+            }
+            break;
+        }
+    }
+
+    // Statistics of all replications, replication major. Replication r always uses Philox stream r of the
+    // seed, so the samples do not depend on the number of threads.
+    inline std::vector<double> SimulateStatistics(SimulationSettings const& settings, std::size_t replications, std::uint64_t seed, unsigned numThreads = 0)
+    {
+        if (settings.test == SimulatedTest::ADF ? settings.numVariables != 1 :
+            settings.test == SimulatedTest::ENGLE_GRANGER ? settings.numVariables != 2 : settings.numVariables == 0)
+            throw std::invalid_argument("number of variables does not fit the test");
+
+        std::size_t const numStatistics = SimulatedStatistics(settings.test).size();
+        std::vector<double> samples(replications * numStatistics);
+
+        std::size_t const chunk = 64;
+        std::atomic<std::size_t> nextChunk(0);
+        RunParallel(ThreadCount(numThreads, (replications + chunk - 1) / chunk), [&] (std::size_t, std::atomic<bool> const& failed)
+        {
+            for (std::size_t begin = chunk * nextChunk++; begin < replications && !failed; begin = chunk * nextChunk++)
+                for (std::size_t r = begin; r < std::min(begin + chunk, replications); ++r)
+                    SimulateReplication(settings, seed, r, &samples[r * numStatistics]);
+        });
+
+        return samples;
+    }
+
+    // Empirical quantiles of one statistic of a simulation
+    struct CriticalValueTable
+    {
+        CriticalValueTable()
+            : replications(0)
+            , seed(0)
+        {}
+
+        // Critical value for a tabulated probability, e.g. 0.05 for the 5% lower tail of ADF or 0.95 for
+        // the 5% upper tail of Johansen
+        double Quantile(double probability) const
+        {
+            std::vector<double> const& probabilities = CriticalValueProbabilities();
+            for (std::size_t i = 0; i < probabilities.size(); ++i)
+                if (std::abs(probabilities[i] - probability) < 1e-12)
+                    return values[i];
+
+            throw std::invalid_argument("probability not tabulated");
+        }
+
+        SimulationSettings settings;
+        std::string statistic;
+        std::size_t replications;
+        std::uint64_t seed;
+
+        /// Quantile for each of CriticalValueProbabilities()
+        std::vector<double> values;
+    };
+
+    // Quantile by linear interpolation between order statistics, of finite samples only
+    inline double EmpiricalQuantile(std::vector<double>& sorted, double probability)
+    {
+        if (sorted.empty())
+            return std::numeric_limits<double>::quiet_NaN();
+
+        double const position = probability * (sorted.size() - 1);
+        std::size_t const below = static_cast<std::size_t>(position);
+        std::size_t const above = std::min(below + 1, sorted.size() - 1);
+        return sorted[below] + (position - below) * (sorted[above] - sorted[below]);
+    }
+
+    // Tables of every statistic of the test
+    inline std::vector<CriticalValueTable> SimulateCriticalValues(SimulationSettings const& settings, std::size_t replications, std::uint64_t seed, unsigned numThreads = 0)
+    {
+        std::vector<std::string> const names = SimulatedStatistics(settings.test);
+        std::vector<double> const samples = SimulateStatistics(settings, replications, seed, numThreads);
+
+        std::vector<CriticalValueTable> tables;
+        for (std::size_t s = 0; s < names.size(); ++s)
+        {
+            std::vector<double> sorted;
+            sorted.reserve(replications);
+            for (std::size_t r = 0; r < replications; ++r)
+                if (std::isfinite(samples[r * names.size() + s]))
+                    sorted.push_back(samples[r * names.size() + s]);
+            std::sort(sorted.begin(), sorted.end());
+
+            CriticalValueTable table;
+            table.settings = settings;
+            table.statistic = names[s];
+            table.replications = replications;
+            table.seed = seed;
+            for (double probability : CriticalValueProbabilities())
+                table.values.push_back(EmpiricalQuantile(sorted, probability));
+            tables.push_back(table);
+        }
+
+        return tables;
+    }
+
+    inline char const* SimulatedTestName(SimulatedTest test)
+    {
+        return test == SimulatedTest::ADF ? "adf" : test == SimulatedTest::ENGLE_GRANGER ? "engle-granger" : "johansen";
+    }
+
+    inline char const* DeterministicName(Deterministic deterministic)
+    {
+        return deterministic == Deterministic::NONE ? "none" : deterministic == Deterministic::CONSTANT ? "constant" : "trend";
+    }
+
+    // Simulated critical value tables kept in a CSV file of one row per table:
+    //     test,statistic,observations,variables,deterministic,lags,directions,replications,seed,q0.01,...
+    // Tables are simulated on first use and the file rewritten, so later runs with the same sample size
+    // and settings read them back. A table with at least the replications asked for is reused.
+    class CriticalValueCache
+    {
+    public:
+        // Empty path for a cache in memory only. Unreadable rows are ignored.
+        explicit CriticalValueCache(std::string const& path)
+            : mPath(path)
+        {
+            if (mPath.empty())
+                return;
+
+            std::ifstream file(mPath.c_str());
+            std::string line;
+            std::getline(file, line);
+            while (std::getline(file, line))
+            {
+                CriticalValueTable table;
+                if (ParseRow(line, table))
+                    mTables.push_back(table);
+            }
+        }
+
+        // Table of the statistic, simulating every statistic of the test and saving them if not cached.
+        // Returned by value, as later simulations may reallocate the cache.
+        CriticalValueTable Get(SimulationSettings const& settings, std::string const& statistic, std::size_t replications,
+            std::uint64_t seed = 20101, unsigned numThreads = 0)
+        {
+            CriticalValueTable const* table = Find(settings, statistic, replications);
+            if (table != nullptr)
+                return *table;
+
+            std::vector<CriticalValueTable> const tables = SimulateCriticalValues(settings, replications, seed, numThreads);
+            for (auto const& simulated : tables)
+            {
+                auto const it = std::find_if(mTables.begin(), mTables.end(), [&] (CriticalValueTable const& cached)
+                {
+                    return Matches(cached, simulated.settings, simulated.statistic);
+                });
+                if (it != mTables.end())
+                    *it = simulated;
+                else
+                    mTables.push_back(simulated);
+            }
+
+            Save();
+
+            table = Find(settings, statistic, replications);
+            if (table == nullptr)
+                throw std::invalid_argument("test has no statistic " + statistic);
+            return *table;
+        }
+
+        CriticalValueTable const* Find(SimulationSettings const& settings, std::string const& statistic, std::size_t minReplications) const
+        {
+            for (auto const& table : mTables)
+                if (Matches(table, settings, statistic) && table.replications >= minReplications)
+                    return &table;
+            return nullptr;
+        }
+
+        std::size_t Size() const
+        {
+            return mTables.size();
+        }
+
+    private:
+        static bool Matches(CriticalValueTable const& table, SimulationSettings const& settings, std::string const& statistic)
+        {
+            SimulationSettings const& cached = table.settings;
+            return table.statistic == statistic && cached.test == settings.test &&
+                cached.numObservations == settings.numObservations && cached.numVariables == settings.numVariables &&
+                cached.deterministic == settings.deterministic && cached.lags == settings.lags &&
+                (settings.test != SimulatedTest::ENGLE_GRANGER || cached.bothDirections == settings.bothDirections);
+        }
+
+        static bool ParseRow(std::string const& line, CriticalValueTable& table)
+        {
+            std::istringstream is(line);
+            std::string field;
+            std::vector<std::string> fields;
+            while (std::getline(is, field, ','))
+                fields.push_back(field);
+
+            std::size_t const numValues = CriticalValueProbabilities().size();
+            if (fields.size() != 9 + numValues)
+                return false;
+
+            SimulationSettings& settings = table.settings;
+            if (fields[0] == "adf")
+                settings.test = SimulatedTest::ADF;
+            else if (fields[0] == "engle-granger")
+                settings.test = SimulatedTest::ENGLE_GRANGER;
+            else if (fields[0] == "johansen")
+                settings.test = SimulatedTest::JOHANSEN;
+            else
+                return false;
+
+            if (fields[4] == "none")
+                settings.deterministic = Deterministic::NONE;
+            else if (fields[4] == "constant")
+                settings.deterministic = Deterministic::CONSTANT;
+            else if (fields[4] == "trend")
+                settings.deterministic = Deterministic::TREND;
+            else
+                return false;
+
+            table.statistic = fields[1];
+            settings.numObservations = std::strtoul(fields[2].c_str(), nullptr, 10);
+            settings.numVariables = std::strtoul(fields[3].c_str(), nullptr, 10);
+            settings.lags = std::strtoul(fields[5].c_str(), nullptr, 10);
+            settings.bothDirections = fields[6] == "2";
+            table.replications = std::strtoul(fields[7].c_str(), nullptr, 10);
+            table.seed = std::strtoull(fields[8].c_str(), nullptr, 10);
+            for (std::size_t i = 0; i < numValues; ++i)
+                table.values.push_back(std::strtod(fields[9 + i].c_str(), nullptr));
+
+            return true;
+        }
+
+        // Write to a temporary file then rename, so readers never see a partial table
+        void Save() const
+        {
+            if (mPath.empty())
+                return;
+
+            std::string const temporary = mPath + ".tmp";
+            {
+                std::ofstream file(temporary.c_str());
+                file << "test,statistic,observations,variables,deterministic,lags,directions,replications,seed";
+                for (double probability : CriticalValueProbabilities())
+                    file << ",q" << probability;
+                file << '\n';
+
+                file.precision(std::numeric_limits<double>::max_digits10);
+
+                for (auto const& table : mTables)
+                {
+                    SimulationSettings const& settings = table.settings;
+                    file << SimulatedTestName(settings.test) << ',' << table.statistic << ',' << settings.numObservations << ','
+                        << settings.numVariables << ',' << DeterministicName(settings.deterministic) << ',' << settings.lags << ','
+                        << (settings.bothDirections ? 2 : 1) << ',' << table.replications << ',' << table.seed;
+                    for (double value : table.values)
+                        file << ',' << value;
+                    file << '\n';
+                }
+
+                if (!file)
+                    throw std::runtime_error("failed to write " + temporary);
+            }
+
+            if (std::rename(temporary.c_str(), mPath.c_str()) != 0)
+                throw std::runtime_error("failed to replace " + mPath);
+        }
+
+        std::string mPath;
+        std::vector<CriticalValueTable> mTables;
+    };
+}
+
+#endif
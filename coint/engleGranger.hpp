@@ -0,0 +1,197 @@
+#ifndef COINT_ENGLE_GRANGER_HPP
+#define COINT_ENGLE_GRANGER_HPP
+
+#include "adf.hpp"
+#include "linearAlgebra.hpp"
+#include "parallel.hpp"
+#include "priceMatrix.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+namespace CqfProject
+{
+    struct EngleGrangerSettings
+    {
+        EngleGrangerSettings()
+            : lags(1)
+            , bothDirections(true)
+            , numThreads(0)
+        {}
+
+        /// Lagged differences in the ADF regression on the residuals
+        std::size_t lags;
+
+        /// Regress each symbol of a pair on the other and keep the more negative statistic;
+        /// otherwise the later symbol is regressed on the earlier one only
+        bool bothDirections;
+
+        /// 0 for all cores
+        unsigned numThreads;
+    };
+
+    // Engle-Granger test of one pair: dependent = intercept + hedgeRatio * independent + residual,
+    // then an ADF test without deterministic terms on the residuals
+    struct PairResult
+    {
+        PairResult()
+            : dependent(0)
+            , independent(0)
+            , hedgeRatio(std::numeric_limits<double>::quiet_NaN())
+            , intercept(std::numeric_limits<double>::quiet_NaN())
+            , spreadStd(std::numeric_limits<double>::quiet_NaN())
+            , statistic(std::numeric_limits<double>::quiet_NaN())
+            , numObservations(0)
+        {}
+
+        std::size_t dependent;
+        std::size_t independent;
+        double hedgeRatio;
+        double intercept;
+
+        /// Standard deviation of the residuals
+        double spreadStd;
+
+        /// ADF t statistic of the residuals, to compare with EngleGrangerCriticalValue
+        double statistic;
+
+        /// Observations in the ADF regression
+        std::size_t numObservations;
+    };
+
+    // Critical value of the Engle-Granger statistic for a pair, whose cointegrating regression has a constant
+    inline double EngleGrangerCriticalValue(SignificanceLevel level, std::size_t numObservations)
+    {
+        return MacKinnonCriticalValue(2, Deterministic::CONSTANT, level, numObservations);
+    }
+
+    // Pairs (i, j), i < j, are numbered row by row: (0, 1), (0, 2), ..., (0, n-1), (1, 2), ...
+    inline std::size_t NumPairs(std::size_t numSymbols)
+    {
+        return numSymbols < 2 ? 0 : numSymbols * (numSymbols - 1) / 2;
+    }
+
+    inline std::size_t PairIndex(std::size_t i, std::size_t j, std::size_t numSymbols)
+    {
+        return i * (2 * numSymbols - i - 1) / 2 + (j - i - 1);
+    }
+
+    // Engle-Granger tests over all pairs of a price matrix. The columns are centred once up front, so
+    // each pair's hedge ratio costs one inner product and its residuals one pass over the data.
+    class EngleGrangerScanner
+    {
+    public:
+        // Scratch space per thread
+        struct Workspace
+        {
+            AdfWorkspace adf;
+            std::vector<double> residuals;
+        };
+
+        explicit EngleGrangerScanner(PriceMatrix const& prices)
+            : mNumSymbols(prices.NumSymbols())
+            , mNumObservations(prices.numObservations)
+            , mCentred(prices.logPrices.size())
+            , mMeans(mNumSymbols)
+            , mSumSquares(mNumSymbols)
+        {
+            for (std::size_t s = 0; s < mNumSymbols; ++s)
+            {
+                double const* column = prices.Column(s);
+                double* centred = &mCentred[s * mNumObservations];
+                double const mean = mNumObservations == 0 ? 0.0 : Sum(column, mNumObservations) / mNumObservations;
+                for (std::size_t t = 0; t < mNumObservations; ++t)
+                    centred[t] = column[t] - mean;
+
+                mMeans[s] = mean;
+                mSumSquares[s] = Dot(centred, centred, mNumObservations);
+            }
+        }
+
+        std::size_t NumSymbols() const
+        {
+            return mNumSymbols;
+        }
+
+        // Test of symbols i < j, as configured by settings
+        PairResult TestPair(std::size_t i, std::size_t j, EngleGrangerSettings const& settings, Workspace& workspace) const
+        {
+            double const crossProduct = Dot(Centred(i), Centred(j), mNumObservations);
+            PairResult result = TestDirection(j, i, crossProduct, settings.lags, workspace);
+            if (settings.bothDirections)
+            {
+                PairResult const reverse = TestDirection(i, j, crossProduct, settings.lags, workspace);
+                if (std::isnan(result.statistic) || reverse.statistic < result.statistic)
+                    result = reverse;
+            }
+
+            return result;
+        }
+
+        // All pairs, indexed by PairIndex. Threads take rows i in turn, reusing column i across its pairs.
+        std::vector<PairResult> Scan(EngleGrangerSettings const& settings) const
+        {
+            std::vector<PairResult> results(NumPairs(mNumSymbols));
+            std::atomic<std::size_t> nextRow(0);
+            RunParallel(ThreadCount(settings.numThreads, mNumSymbols), [&] (std::size_t, std::atomic<bool> const& failed)
+            {
+                Workspace workspace;
+                for (std::size_t i = nextRow++; i + 1 < mNumSymbols && !failed; i = nextRow++)
+                {
+                    PairResult* row = &results[PairIndex(i, i + 1, mNumSymbols)];
+                    for (std::size_t j = i + 1; j < mNumSymbols; ++j)
+                        row[j - i - 1] = TestPair(i, j, settings, workspace);
+                }
+            });
+
+            return results;
+        }
+
+    private:
+        double const* Centred(std::size_t s) const
+        {
+            return &mCentred[s * mNumObservations];
+        }
+
+        PairResult TestDirection(std::size_t y, std::size_t x, double crossProduct, std::size_t lags, Workspace& workspace) const
+        {
+            PairResult result;
+            result.dependent = y;
+            result.independent = x;
+            if (!(mSumSquares[x] > 0.0) || mNumObservations < 3)
+                return result;
+
+            double const beta = crossProduct / mSumSquares[x];
+            result.hedgeRatio = beta;
+            result.intercept = mMeans[y] - beta * mMeans[x];
+
+            // Residuals of centred data have mean zero, so the ADF regression needs no constant
+            double const* cy = Centred(y);
+            double const* cx = Centred(x);
+            std::vector<double>& residuals = workspace.residuals;
+            residuals.resize(mNumObservations);
+            for (std::size_t t = 0; t < mNumObservations; ++t)
+                residuals[t] = cy[t] - beta * cx[t];
+
+            double const ssr = std::max(mSumSquares[y] - beta * crossProduct, 0.0);
+            result.spreadStd = std::sqrt(ssr / (mNumObservations - 2));
+
+            AdfResult const adf = AdfTest(residuals.data(), mNumObservations, lags, Deterministic::NONE, workspace.adf);
+            result.statistic = adf.statistic;
+            result.numObservations = adf.numObservations;
+            return result;
+        }
+
+        std::size_t mNumSymbols;
+        std::size_t mNumObservations;
+        std::vector<double> mCentred;
+        std::vector<double> mMeans;
+        std::vector<double> mSumSquares;
+    };
+}
+
+#endif
@@ -0,0 +1,486 @@
+#ifndef COINT_JOHANSEN_HPP
+#define COINT_JOHANSEN_HPP
+
+#include "adf.hpp"
+#include "engleGranger.hpp"
+#include "linearAlgebra.hpp"
+#include "parallel.hpp"
+#include "priceMatrix.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace CqfProject
+{
+    struct JohansenSettings
+    {
+        JohansenSettings()
+            : lags(1)
+            , deterministic(Deterministic::CONSTANT)
+            , numThreads(0)
+        {}
+
+        /// Lagged differences in the VECM, i.e. VAR order - 1
+        std::size_t lags;
+
+        /// Deterministic terms, entering the VECM unrestricted
+        Deterministic deterministic;
+
+        /// 0 for all cores
+        unsigned numThreads;
+    };
+
+    // Johansen test of a basket of n symbols, from the VECM
+    //     dy[t] = alpha beta' y[t-1] + sum_i Gamma_i dy[t-i] + deterministic terms + e[t]
+    struct JohansenResult
+    {
+        JohansenResult()
+            : numObservations(0)
+        {}
+
+        /// Symbol indices
+        std::vector<std::size_t> basket;
+
+        /// Observations in the VECM regression
+        std::size_t numObservations;
+
+        /// Squared canonical correlations of dy[t] and y[t-1], decreasing; empty if the test failed
+        std::vector<double> eigenvalues;
+
+        /// Trace statistic of rank <= r against rank n, for r = 0..n-1
+        std::vector<double> traceStatistics;
+
+        /// Maximum eigenvalue statistic of rank r against rank r + 1, for r = 0..n-1
+        std::vector<double> maxEigenStatistics;
+
+        /// Cointegrating vector for each eigenvalue, n x n row major, normalized so beta' S11 beta = 1
+        /// for the residual moment matrix S11 of y[t-1]
+        std::vector<double> vectors;
+    };
+
+    // Number of combinations of k of n, throwing if it does not fit in 64 bits
+    inline std::uint64_t BinomialCoefficient(std::uint64_t n, std::uint64_t k)
+    {
+        if (k > n)
+            return 0;
+
+        k = std::min(k, n - k);
+        std::uint64_t result = 1;
+        for (std::uint64_t i = 1; i <= k; ++i)
+        {
+            // result * (n - k + i) / i is exact at each step
+            if (result > std::numeric_limits<std::uint64_t>::max() / (n - k + i))
+                throw std::overflow_error("too many combinations");
+            result = result * (n - k + i) / i;
+        }
+
+        return result;
+    }
+
+    // The combination of rank r in lexicographic order of k of n indices, in increasing order
+    inline void CombinationFromRank(std::uint64_t rank, std::size_t n, std::size_t k, std::size_t* combination)
+    {
+        std::size_t next = 0;
+        for (std::size_t i = 0; i < k; ++i)
+        {
+            for (;; ++next)
+            {
+                std::uint64_t const count = BinomialCoefficient(n - next - 1, k - i - 1);
+                if (rank < count)
+                    break;
+                rank -= count;
+            }
+            combination[i] = next++;
+        }
+    }
+
+    // Next combination of k of n indices in lexicographic order, false after the last
+    inline bool NextCombination(std::size_t* combination, std::size_t n, std::size_t k)
+    {
+        std::size_t i = k;
+        while (i > 0 && combination[i - 1] == n - k + i - 1)
+            --i;
+        if (i == 0)
+            return false;
+
+        ++combination[i - 1];
+        for (std::size_t j = i; j < k; ++j)
+            combination[j] = combination[j - 1] + 1;
+        return true;
+    }
+
+    // Johansen tests of baskets from a price matrix. The product moments of every regressor the VECM of
+    // any basket can use (differences, lagged levels and lagged differences of all symbols, and the
+    // deterministic terms) are accumulated once, in blocked vectorized passes over contiguous columns.
+    // A basket then gathers its moments and partials out the short run terms by the normal equations,
+    // at a cost independent of the number of observations. The moment matrix takes
+    // (numSymbols * (lags + 2) + deterministic terms)^2 doubles.
+    class JohansenScanner
+    {
+    public:
+        // Scratch space per thread
+        struct Workspace
+        {
+            std::vector<std::size_t> index;
+            std::vector<double> moments;
+            std::vector<double> partial;
+            std::vector<double> s;
+            std::vector<double> s00;
+            std::vector<double> s11;
+            std::vector<double> a;
+            std::vector<double> column;
+            std::vector<double> vectors;
+        };
+
+        JohansenScanner(PriceMatrix const& prices, JohansenSettings const& settings)
+            : mSettings(settings)
+            , mNumSymbols(prices.NumSymbols())
+            , mNumDeterministic(static_cast<std::size_t>(settings.deterministic))
+            , mNumObservations(prices.numObservations > settings.lags + 1 ? prices.numObservations - 1 - settings.lags : 0)
+        {
+            std::size_t const numObservations = prices.numObservations;
+            std::size_t const m = mNumObservations;
+            if (m == 0)
+                return;
+
+            // Differences d[t] = y[t + 1] - y[t], and levels centred when a constant absorbs the shift
+            mDifferences.resize(mNumSymbols * (numObservations - 1));
+            mLevels.resize(mNumSymbols * numObservations);
+            for (std::size_t s = 0; s < mNumSymbols; ++s)
+            {
+                double const* y = prices.Column(s);
+                double* d = &mDifferences[s * (numObservations - 1)];
+                double* level = &mLevels[s * numObservations];
+                for (std::size_t t = 0; t + 1 < numObservations; ++t)
+                    d[t] = y[t + 1] - y[t];
+
+                double const mean = mNumDeterministic > 0 ? Sum(y + settings.lags, m) / m : 0.0;
+                for (std::size_t t = 0; t < numObservations; ++t)
+                    level[t] = y[t] - mean;
+            }
+
+            // Constant and a trend scaled to [0, 1]
+            mDeterministic.resize(mNumDeterministic * m);
+            for (std::size_t j = 0; j < mNumDeterministic; ++j)
+                for (std::size_t t = 0; t < m; ++t)
+                    mDeterministic[j * m + t] = j == 0 ? 1.0 : static_cast<double>(t + 1) / m;
+
+            // Regression rows are t = lags + 1 .. T - 1 of the levels:
+            // dy[t] = d[t - 1], y[t - 1], dy[t - i] = d[t - 1 - i]
+            std::size_t const q = NumColumns();
+            std::vector<double const*> columns(q);
+            for (std::size_t s = 0; s < mNumSymbols; ++s)
+            {
+                double const* d = &mDifferences[s * (numObservations - 1)];
+                columns[DifferenceColumn(s)] = d + settings.lags;
+                columns[LevelColumn(s)] = &mLevels[s * numObservations] + settings.lags;
+                for (std::size_t i = 1; i <= settings.lags; ++i)
+                    columns[LaggedDifferenceColumn(s, i)] = d + settings.lags - i;
+            }
+            for (std::size_t j = 0; j < mNumDeterministic; ++j)
+                columns[DeterministicColumn(j)] = &mDeterministic[j * m];
+
+            // Pairs of rows of the moment matrix are independent, shared out through a counter
+            mMoments.resize(q * q);
+            std::atomic<std::size_t> nextRow(0);
+            RunParallel(ThreadCount(settings.numThreads, (q + 1) / 2), [&] (std::size_t, std::atomic<bool> const& failed)
+            {
+                for (std::size_t a = 2 * nextRow++; a < q && !failed; a = 2 * nextRow++)
+                    GramRows(columns.data(), q, m, a, mMoments.data());
+            });
+        }
+
+        std::size_t NumSymbols() const
+        {
+            return mNumSymbols;
+        }
+
+        std::size_t NumObservations() const
+        {
+            return mNumObservations;
+        }
+
+        // Test of the given symbols. Returns no eigenvalues if the moment matrices are singular.
+        JohansenResult Test(std::size_t const* basket, std::size_t n, Workspace& workspace) const
+        {
+            JohansenResult result;
+            result.basket.assign(basket, basket + n);
+            result.numObservations = mNumObservations;
+
+            std::size_t const p = n * mSettings.lags + mNumDeterministic;
+            if (n == 0 || mNumObservations <= 2 * n + p)
+                return result;
+
+            // Moments of [dy, y[t-1], short run terms]
+            std::size_t const q = 2 * n + p;
+            std::size_t const numColumns = NumColumns();
+            std::vector<std::size_t>& index = workspace.index;
+            index.clear();
+            for (std::size_t i = 0; i < n; ++i)
+                index.push_back(DifferenceColumn(basket[i]));
+            for (std::size_t i = 0; i < n; ++i)
+                index.push_back(LevelColumn(basket[i]));
+            for (std::size_t lag = 1; lag <= mSettings.lags; ++lag)
+                for (std::size_t i = 0; i < n; ++i)
+                    index.push_back(LaggedDifferenceColumn(basket[i], lag));
+            for (std::size_t j = 0; j < mNumDeterministic; ++j)
+                index.push_back(DeterministicColumn(j));
+
+            std::vector<double>& moments = workspace.moments;
+            moments.resize(q * q);
+            for (std::size_t i = 0; i < q; ++i)
+                for (std::size_t j = 0; j < q; ++j)
+                    moments[i * q + j] = mMoments[index[i] * numColumns + index[j]];
+
+            // Residual moments S = M_aa - M_a2 M22^-1 M_2a over a = [dy, y[t-1]], with M22 = L L' and
+            // X = L^-1 M_2a, so S = M_aa - X'X
+            std::size_t const k = 2 * n;
+            std::vector<double>& s = workspace.s;
+            s.resize(k * k);
+            for (std::size_t i = 0; i < k; ++i)
+                for (std::size_t j = 0; j < k; ++j)
+                    s[i * k + j] = moments[i * q + j];
+
+            if (p > 0)
+            {
+                std::vector<double>& partial = workspace.partial;
+                partial.resize(p * p + k * p);
+                double* const l22 = partial.data();
+                double* const x = partial.data() + p * p;
+                for (std::size_t i = 0; i < p; ++i)
+                    for (std::size_t j = 0; j < p; ++j)
+                        l22[i * p + j] = moments[(k + i) * q + k + j];
+
+                if (!CholeskyDecompose(l22, p))
+                    return result;
+
+                // Row i of x holds column i of X
+                for (std::size_t i = 0; i < k; ++i)
+                {
+                    for (std::size_t j = 0; j < p; ++j)
+                        x[i * p + j] = moments[(k + j) * q + i];
+                    ForwardSubstitute(l22, p, x + i * p);
+                }
+
+                for (std::size_t i = 0; i < k; ++i)
+                    for (std::size_t j = 0; j <= i; ++j)
+                        s[i * k + j] = s[j * k + i] = s[i * k + j] - Dot(x + i * p, x + j * p, p);
+            }
+
+            // A = S10 S00^-1 S01 = Y'Y for Y = L00^-1 S01
+            std::vector<double>& s00 = workspace.s00;
+            std::vector<double>& s11 = workspace.s11;
+            std::vector<double>& a = workspace.a;
+            std::vector<double>& column = workspace.column;
+            s00.resize(n * n);
+            s11.resize(n * n);
+            a.resize(n * n);
+            column.resize(2 * n * n);
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                for (std::size_t j = 0; j < n; ++j)
+                {
+                    s00[i * n + j] = s[i * k + j];
+                    s11[i * n + j] = s[(n + i) * k + n + j];
+                }
+            }
+
+            if (!CholeskyDecompose(s00.data(), n) || !CholeskyDecompose(s11.data(), n))
+                return result;
+
+            // Row j of y holds column j of Y
+            double* const y = column.data();
+            for (std::size_t j = 0; j < n; ++j)
+            {
+                for (std::size_t i = 0; i < n; ++i)
+                    y[j * n + i] = s[i * k + n + j];
+                ForwardSubstitute(s00.data(), n, y + j * n);
+            }
+            for (std::size_t i = 0; i < n; ++i)
+                for (std::size_t j = 0; j <= i; ++j)
+                    a[i * n + j] = a[j * n + i] = Dot(y + i * n, y + j * n, n);
+
+            // The generalized problem A b = lambda S11 b is C v = lambda v for C = L11^-1 A L11^-T,
+            // b = L11^-T v. With B = L11^-1 A, C = L11^-1 B', both column by column.
+            double* const b = column.data() + n * n;
+            for (std::size_t j = 0; j < n; ++j)
+            {
+                for (std::size_t i = 0; i < n; ++i)
+                    b[j * n + i] = a[i * n + j];
+                ForwardSubstitute(s11.data(), n, b + j * n);
+            }
+            // Column j of B' is row j of B, so row j of y becomes column j of C
+            for (std::size_t j = 0; j < n; ++j)
+            {
+                for (std::size_t i = 0; i < n; ++i)
+                    y[j * n + i] = b[i * n + j];
+                ForwardSubstitute(s11.data(), n, y + j * n);
+            }
+            for (std::size_t i = 0; i < n; ++i)
+                for (std::size_t j = 0; j < n; ++j)
+                    a[i * n + j] = 0.5 * (y[j * n + i] + y[i * n + j]);
+
+            result.eigenvalues.resize(n);
+            std::vector<double>& vectors = workspace.vectors;
+            vectors.resize(n * n);
+            SymmetricEigen(a.data(), n, result.eigenvalues.data(), vectors.data());
+
+            // S11 above is the sum of squares, m times the moment matrix
+            double const scale = static_cast<double>(mNumObservations);
+            result.vectors.resize(n * n);
+            for (std::size_t r = 0; r < n; ++r)
+            {
+                BackSubstitute(s11.data(), n, vectors.data() + r * n);
+                for (std::size_t i = 0; i < n; ++i)
+                    result.vectors[r * n + i] = std::sqrt(scale) * vectors[r * n + i];
+            }
+
+            // Statistics, with eigenvalues clamped into [0, 1) against rounding
+            result.traceStatistics.assign(n, 0.0);
+            result.maxEigenStatistics.resize(n);
+            for (std::size_t r = n; r-- > 0;)
+            {
+                double& lambda = result.eigenvalues[r];
+                lambda = std::min(std::max(lambda, 0.0), 1.0 - std::numeric_limits<double>::epsilon());
+                result.maxEigenStatistics[r] = -scale * std::log1p(-lambda);
+                result.traceStatistics[r] = result.maxEigenStatistics[r] + (r + 1 < n ? result.traceStatistics[r + 1] : 0.0);
+            }
+
+            return result;
+        }
+
+        JohansenResult Test(std::vector<std::size_t> const& basket) const
+        {
+            Workspace workspace;
+            return Test(basket.data(), basket.size(), workspace);
+        }
+
+        // Tests of the given baskets, in parallel
+        std::vector<JohansenResult> TestBaskets(std::vector<std::vector<std::size_t> > const& baskets) const
+        {
+            std::vector<JohansenResult> results(baskets.size());
+            std::atomic<std::size_t> next(0);
+            RunParallel(ThreadCount(mSettings.numThreads, baskets.size()), [&] (std::size_t, std::atomic<bool> const& failed)
+            {
+                Workspace workspace;
+                for (std::size_t i = next++; i < baskets.size() && !failed; i = next++)
+                    results[i] = Test(baskets[i].data(), baskets[i].size(), workspace);
+            });
+
+            return results;
+        }
+
+        // The top baskets of size n by trace statistic of rank 0, over all combinations of the symbols,
+        // in decreasing order. Threads take chunks of combinations by rank and keep their own top.
+        std::vector<JohansenResult> ScanCombinations(std::size_t n, std::size_t top) const
+        {
+            std::uint64_t const count = BinomialCoefficient(mNumSymbols, n);
+            std::uint64_t const chunk = 256;
+            std::atomic<std::uint64_t> nextChunk(0);
+
+            auto const better = [] (JohansenResult const& x, JohansenResult const& y)
+            {
+                return TraceKey(x) > TraceKey(y);
+            };
+
+            std::uint64_t const numChunks = (count + chunk - 1) / chunk;
+            std::size_t const numThreads = ThreadCount(mSettings.numThreads,
+                static_cast<std::size_t>(std::min<std::uint64_t>(numChunks, std::numeric_limits<std::size_t>::max())));
+
+            std::vector<std::vector<JohansenResult> > tops(numThreads);
+            RunParallel(numThreads, [&] (std::size_t thread, std::atomic<bool> const& failed)
+            {
+                std::vector<JohansenResult>& best = tops[thread];
+                Workspace workspace;
+                std::vector<std::size_t> basket(n);
+                for (std::uint64_t begin = chunk * nextChunk++; begin < count && !failed; begin = chunk * nextChunk++)
+                {
+                    std::uint64_t const end = std::min(begin + chunk, count);
+                    CombinationFromRank(begin, mNumSymbols, n, basket.data());
+                    for (std::uint64_t rank = begin; rank < end; ++rank)
+                    {
+                        JohansenResult result = Test(basket.data(), n, workspace);
+                        if (best.size() < top)
+                        {
+                            best.push_back(std::move(result));
+                            std::push_heap(best.begin(), best.end(), better);
+                        }
+                        else if (top > 0 && better(result, best.front()))
+                        {
+                            std::pop_heap(best.begin(), best.end(), better);
+                            best.back() = std::move(result);
+                            std::push_heap(best.begin(), best.end(), better);
+                        }
+
+                        NextCombination(basket.data(), mNumSymbols, n);
+                    }
+                }
+            });
+
+            std::vector<JohansenResult> results;
+            for (auto& best : tops)
+                for (auto& result : best)
+                    results.push_back(std::move(result));
+
+            // Ties broken by basket, so the order does not depend on the threads
+            std::sort(results.begin(), results.end(), [] (JohansenResult const& x, JohansenResult const& y)
+            {
+                return TraceKey(x) != TraceKey(y) ? TraceKey(x) > TraceKey(y) : x.basket < y.basket;
+            });
+            if (results.size() > top)
+                results.resize(top);
+
+            return results;
+        }
+
+    private:
+        static double TraceKey(JohansenResult const& result)
+        {
+            return result.traceStatistics.empty() ? -std::numeric_limits<double>::infinity() : result.traceStatistics[0];
+        }
+
+        std::size_t NumColumns() const
+        {
+            return mNumSymbols * (mSettings.lags + 2) + mNumDeterministic;
+        }
+
+        std::size_t DifferenceColumn(std::size_t symbol) const
+        {
+            return symbol;
+        }
+
+        std::size_t LevelColumn(std::size_t symbol) const
+        {
+            return mNumSymbols + symbol;
+        }
+
+        std::size_t LaggedDifferenceColumn(std::size_t symbol, std::size_t lag) const
+        {
+            return (lag + 1) * mNumSymbols + symbol;
+        }
+
+        std::size_t DeterministicColumn(std::size_t j) const
+        {
+            return (mSettings.lags + 2) * mNumSymbols + j;
+        }
+
+        JohansenSettings mSettings;
+        std::size_t mNumSymbols;
+        std::size_t mNumDeterministic;
+        std::size_t mNumObservations;
+        std::vector<double> mDifferences;
+        std::vector<double> mLevels;
+        std::vector<double> mDeterministic;
+
+        /// Product moments of all regressor columns, NumColumns() x NumColumns()
+        std::vector<double> mMoments;
+    };
+}
+
+#endif
@@ -0,0 +1,331 @@
+#ifndef COINT_LINEAR_ALGEBRA_HPP
+#define COINT_LINEAR_ALGEBRA_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#if defined (__AVX__)
+#   include <immintrin.h>
+#elif defined (__SSE2__) || defined (_M_X64)
+#   include <emmintrin.h>
+#   define COINT_USE_SSE2
+#endif
+
+namespace CqfProject
+{
+    // Inner product of a[0:n] and b[0:n], with independent vector accumulators so the adds pipeline.
+    // Unaligned input is fine, e.g. lagged views into the same series.
+    inline double Dot(double const* a, double const* b, std::size_t n)
+    {
+        std::size_t i = 0;
+        double sum = 0.0;
+
+#if defined (__AVX__)
+        __m256d acc0 = _mm256_setzero_pd();
+        __m256d acc1 = _mm256_setzero_pd();
+        for (; i + 8 <= n; i += 8)
+        {
+#   if defined (__FMA__)
+            acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), acc0);
+            acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4), acc1);
+#   else
+            acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+            acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+#   endif
+        }
+
+        __m256d const acc = _mm256_add_pd(acc0, acc1);
+        __m128d const half = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+        sum = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+#elif defined (COINT_USE_SSE2)
+        __m128d acc0 = _mm_setzero_pd();
+        __m128d acc1 = _mm_setzero_pd();
+        __m128d acc2 = _mm_setzero_pd();
+        __m128d acc3 = _mm_setzero_pd();
+        for (; i + 8 <= n; i += 8)
+        {
+            acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+            acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+            acc2 = _mm_add_pd(acc2, _mm_mul_pd(_mm_loadu_pd(a + i + 4), _mm_loadu_pd(b + i + 4)));
+            acc3 = _mm_add_pd(acc3, _mm_mul_pd(_mm_loadu_pd(a + i + 6), _mm_loadu_pd(b + i + 6)));
+        }
+
+        __m128d const acc = _mm_add_pd(_mm_add_pd(acc0, acc1), _mm_add_pd(acc2, acc3));
+        sum = _mm_cvtsd_f64(_mm_add_sd(acc, _mm_unpackhi_pd(acc, acc)));
+#else
+        double sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+        for (; i + 4 <= n; i += 4)
+        {
+            sum += a[i] * b[i];
+            sum1 += a[i + 1] * b[i + 1];
+            sum2 += a[i + 2] * b[i + 2];
+            sum3 += a[i + 3] * b[i + 3];
+        }
+        sum += sum1 + sum2 + sum3;
+#endif
+
+        for (; i < n; ++i)
+            sum += a[i] * b[i];
+
+        return sum;
+    }
+
+    // The four inner products of a0, a1 with b0, b1 over [0:n], as { a0.b0, a0.b1, a1.b0, a1.b1 }.
+    // Each value loaded feeds two products, so a block of columns costs half the loads of separate Dot calls.
+    inline void Dot2x2(double const* a0, double const* a1, double const* b0, double const* b1, std::size_t n, double* out)
+    {
+        std::size_t i = 0;
+        double s00 = 0.0, s01 = 0.0, s10 = 0.0, s11 = 0.0;
+
+#if defined (__AVX__)
+        __m256d acc00 = _mm256_setzero_pd();
+        __m256d acc01 = _mm256_setzero_pd();
+        __m256d acc10 = _mm256_setzero_pd();
+        __m256d acc11 = _mm256_setzero_pd();
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256d const x0 = _mm256_loadu_pd(a0 + i);
+            __m256d const x1 = _mm256_loadu_pd(a1 + i);
+            __m256d const y0 = _mm256_loadu_pd(b0 + i);
+            __m256d const y1 = _mm256_loadu_pd(b1 + i);
+#   if defined (__FMA__)
+            acc00 = _mm256_fmadd_pd(x0, y0, acc00);
+            acc01 = _mm256_fmadd_pd(x0, y1, acc01);
+            acc10 = _mm256_fmadd_pd(x1, y0, acc10);
+            acc11 = _mm256_fmadd_pd(x1, y1, acc11);
+#   else
+            acc00 = _mm256_add_pd(acc00, _mm256_mul_pd(x0, y0));
+            acc01 = _mm256_add_pd(acc01, _mm256_mul_pd(x0, y1));
+            acc10 = _mm256_add_pd(acc10, _mm256_mul_pd(x1, y0));
+            acc11 = _mm256_add_pd(acc11, _mm256_mul_pd(x1, y1));
+#   endif
+        }
+
+        // Horizontal sums of the four accumulators at once
+        __m256d const h0 = _mm256_hadd_pd(acc00, acc01);
+        __m256d const h1 = _mm256_hadd_pd(acc10, acc11);
+        __m128d const sum0 = _mm_add_pd(_mm256_castpd256_pd128(h0), _mm256_extractf128_pd(h0, 1));
+        __m128d const sum1 = _mm_add_pd(_mm256_castpd256_pd128(h1), _mm256_extractf128_pd(h1, 1));
+        s00 = _mm_cvtsd_f64(sum0);
+        s01 = _mm_cvtsd_f64(_mm_unpackhi_pd(sum0, sum0));
+        s10 = _mm_cvtsd_f64(sum1);
+        s11 = _mm_cvtsd_f64(_mm_unpackhi_pd(sum1, sum1));
+#elif defined (COINT_USE_SSE2)
+        __m128d acc00 = _mm_setzero_pd();
+        __m128d acc01 = _mm_setzero_pd();
+        __m128d acc10 = _mm_setzero_pd();
+        __m128d acc11 = _mm_setzero_pd();
+        for (; i + 2 <= n; i += 2)
+        {
+            __m128d const x0 = _mm_loadu_pd(a0 + i);
+            __m128d const x1 = _mm_loadu_pd(a1 + i);
+            __m128d const y0 = _mm_loadu_pd(b0 + i);
+            __m128d const y1 = _mm_loadu_pd(b1 + i);
+            acc00 = _mm_add_pd(acc00, _mm_mul_pd(x0, y0));
+            acc01 = _mm_add_pd(acc01, _mm_mul_pd(x0, y1));
+            acc10 = _mm_add_pd(acc10, _mm_mul_pd(x1, y0));
+            acc11 = _mm_add_pd(acc11, _mm_mul_pd(x1, y1));
+        }
+
+        s00 = _mm_cvtsd_f64(_mm_add_sd(acc00, _mm_unpackhi_pd(acc00, acc00)));
+        s01 = _mm_cvtsd_f64(_mm_add_sd(acc01, _mm_unpackhi_pd(acc01, acc01)));
+        s10 = _mm_cvtsd_f64(_mm_add_sd(acc10, _mm_unpackhi_pd(acc10, acc10)));
+        s11 = _mm_cvtsd_f64(_mm_add_sd(acc11, _mm_unpackhi_pd(acc11, acc11)));
+#endif
+
+        for (; i < n; ++i)
+        {
+            s00 += a0[i] * b0[i];
+            s01 += a0[i] * b1[i];
+            s10 += a1[i] * b0[i];
+            s11 += a1[i] * b1[i];
+        }
+
+        out[0] = s00;
+        out[1] = s01;
+        out[2] = s10;
+        out[3] = s11;
+    }
+
+    /// Rows per panel in GramRows, so a panel of a few dozen columns stays in L1/L2 cache
+    std::size_t const GRAM_PANEL_ROWS = 256;
+
+    // Rows a and a + 1 (if below q) of the lower triangle of the q x q row major Gram matrix W'W, where
+    // column j of W is columns[j][0:n], mirrored to the upper triangle. Columns are taken two by two over
+    // panels of rows. Calls for different a write disjoint entries, so they can run on different threads.
+    inline void GramRows(double const* const* columns, std::size_t q, std::size_t n, std::size_t a, double* gram)
+    {
+        std::size_t const last = std::min(a + 2, q);
+        for (std::size_t i = a; i < last; ++i)
+            for (std::size_t j = 0; j <= i; ++j)
+                gram[i * q + j] = 0.0;
+
+        // An odd last column is paired with itself and the duplicate products dropped
+        double const* const a0 = columns[a];
+        double const* const a1 = columns[last - 1];
+        double block[4];
+        for (std::size_t r = 0; r < n; r += GRAM_PANEL_ROWS)
+        {
+            std::size_t const length = std::min(GRAM_PANEL_ROWS, n - r);
+            for (std::size_t b = 0; b < last; b += 2)
+            {
+                std::size_t const bLast = std::min(b + 2, last);
+                Dot2x2(a0 + r, a1 + r, columns[b] + r, columns[bLast - 1] + r, length, block);
+
+                gram[a * q + b] += block[0];
+                if (bLast - b == 2 && b + 1 <= a)
+                    gram[a * q + b + 1] += block[1];
+                if (last - a == 2)
+                {
+                    gram[(a + 1) * q + b] += block[2];
+                    if (bLast - b == 2)
+                        gram[(a + 1) * q + b + 1] += block[3];
+                }
+            }
+        }
+
+        for (std::size_t i = a; i < last; ++i)
+            for (std::size_t j = 0; j < i; ++j)
+                gram[j * q + i] = gram[i * q + j];
+    }
+
+    inline void GramMatrix(double const* const* columns, std::size_t q, std::size_t n, double* gram)
+    {
+        for (std::size_t a = 0; a < q; a += 2)
+            GramRows(columns, q, n, a, gram);
+    }
+
+    inline double Sum(double const* a, std::size_t n)
+    {
+        double sum = 0.0;
+        for (std::size_t i = 0; i < n; ++i)
+            sum += a[i];
+        return sum;
+    }
+
+    // Cholesky factor of the symmetric positive definite n x n row major matrix a, in place in its lower
+    // triangle. False if a is not positive definite (to working precision).
+    inline bool CholeskyDecompose(double* a, std::size_t n)
+    {
+        for (std::size_t j = 0; j < n; ++j)
+        {
+            double diagonal = a[j * n + j] - Dot(a + j * n, a + j * n, j);
+            if (!(diagonal > 0.0))
+                return false;
+
+            diagonal = std::sqrt(diagonal);
+            a[j * n + j] = diagonal;
+            for (std::size_t i = j + 1; i < n; ++i)
+                a[i * n + j] = (a[i * n + j] - Dot(a + i * n, a + j * n, j)) / diagonal;
+        }
+
+        return true;
+    }
+
+    // Solve L x = b in place, for a lower Cholesky factor from CholeskyDecompose
+    inline void ForwardSubstitute(double const* l, std::size_t n, double* b)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            b[i] = (b[i] - Dot(l + i * n, b, i)) / l[i * n + i];
+    }
+
+    // Solve L' x = b in place, for a lower Cholesky factor from CholeskyDecompose
+    inline void BackSubstitute(double const* l, std::size_t n, double* b)
+    {
+        for (std::size_t i = n; i-- > 0;)
+        {
+            double sum = b[i];
+            for (std::size_t k = i + 1; k < n; ++k)
+                sum -= l[k * n + i] * b[k];
+            b[i] = sum / l[i * n + i];
+        }
+    }
+
+    // Solve L L' x = b in place, for a lower Cholesky factor from CholeskyDecompose
+    inline void CholeskySolve(double const* l, std::size_t n, double* b)
+    {
+        ForwardSubstitute(l, n, b);
+        BackSubstitute(l, n, b);
+    }
+
+    // Eigenvalues and eigenvectors of the symmetric n x n row major matrix a by cyclic Jacobi rotations,
+    // which is accurate and simple for the small matrices here. a is overwritten; eigenvalues are sorted
+    // in decreasing order, with the matching unit eigenvectors in the rows of vectors (n x n).
+    inline void SymmetricEigen(double* a, std::size_t n, double* eigenvalues, double* vectors)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            for (std::size_t j = 0; j < n; ++j)
+                vectors[i * n + j] = i == j ? 1.0 : 0.0;
+
+        for (int sweep = 0; sweep < 100; ++sweep)
+        {
+            double offDiagonal = 0.0, diagonal = 0.0;
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                diagonal += a[i * n + i] * a[i * n + i];
+                for (std::size_t j = i + 1; j < n; ++j)
+                    offDiagonal += a[i * n + j] * a[i * n + j];
+            }
+            if (!(offDiagonal > 1e-30 * diagonal))
+                break;
+
+            for (std::size_t p = 0; p < n; ++p)
+            {
+                for (std::size_t q = p + 1; q < n; ++q)
+                {
+                    double const apq = a[p * n + q];
+                    if (apq == 0.0)
+                        continue;
+
+                    // Rotation zeroing a[p, q]: t = tan(phi) is the smaller root of t^2 + 2 theta t - 1 = 0
+                    double const theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+                    double const t = (theta >= 0.0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+                    double const c = 1.0 / std::sqrt(t * t + 1.0);
+                    double const s = t * c;
+
+                    for (std::size_t k = 0; k < n; ++k)
+                    {
+                        double const akp = a[k * n + p];
+                        double const akq = a[k * n + q];
+                        a[k * n + p] = c * akp - s * akq;
+                        a[k * n + q] = s * akp + c * akq;
+                    }
+                    for (std::size_t k = 0; k < n; ++k)
+                    {
+                        double const apk = a[p * n + k];
+                        double const aqk = a[q * n + k];
+                        a[p * n + k] = c * apk - s * aqk;
+                        a[q * n + k] = s * apk + c * aqk;
+                    }
+                    for (std::size_t k = 0; k < n; ++k)
+                    {
+                        double const vpk = vectors[p * n + k];
+                        double const vqk = vectors[q * n + k];
+                        vectors[p * n + k] = c * vpk - s * vqk;
+                        vectors[q * n + k] = s * vpk + c * vqk;
+                    }
+                }
+            }
+        }
+
+        // Selection sort, decreasing
+        for (std::size_t i = 0; i < n; ++i)
+            eigenvalues[i] = a[i * n + i];
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::size_t largest = i;
+            for (std::size_t j = i + 1; j < n; ++j)
+                if (eigenvalues[j] > eigenvalues[largest])
+                    largest = j;
+            if (largest != i)
+            {
+                std::swap(eigenvalues[i], eigenvalues[largest]);
+                std::swap_ranges(vectors + i * n, vectors + (i + 1) * n, vectors + largest * n);
+            }
+        }
+    }
+}
+
+#endif
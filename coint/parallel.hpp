@@ -0,0 +1,61 @@
+#ifndef COINT_PARALLEL_HPP
+#define COINT_PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace CqfProject
+{
+    inline unsigned DefaultThreadCount()
+    {
+        unsigned const n = std::thread::hardware_concurrency();
+        return n == 0 ? 1 : n;
+    }
+
+    // Threads for numTasks tasks: numThreads, or all cores if 0, but no more than the tasks and at least one
+    inline std::size_t ThreadCount(unsigned numThreads, std::size_t numTasks)
+    {
+        return std::max<std::size_t>(1, std::min<std::size_t>(numThreads != 0 ? numThreads : DefaultThreadCount(), numTasks));
+    }
+
+    // Runs worker(thread, failed) for thread in [0, numThreads), thread 0 on the calling thread, and once
+    // all have returned rethrows the first exception any of them threw. failed is set as soon as one
+    // throws, so the others can stop taking work.
+    template<typename Worker>
+    void RunParallel(std::size_t numThreads, Worker worker)
+    {
+        std::exception_ptr error;
+        std::atomic<bool> failed(false);
+        auto const run = [&] (std::size_t thread)
+        {
+            try
+            {
+                worker(thread, static_cast<std::atomic<bool> const&>(failed));
+            }
+            catch (...)
+            {
+                if (!failed.exchange(true))
+                    error = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(numThreads > 0 ? numThreads - 1 : 0);
+        for (std::size_t t = 1; t < numThreads; ++t)
+            threads.emplace_back(run, t);
+
+        run(0);
+
+        for (auto& thread : threads)
+            thread.join();
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+#endif
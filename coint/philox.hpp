@@ -0,0 +1,101 @@
+#ifndef COINT_PHILOX_HPP
+#define COINT_PHILOX_HPP
+
+#include <cmath>
+#include <cstdint>
+
+namespace CqfProject
+{
+    // Philox4x32-10 counter based generator (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3",
+    // SC 2011): a keyed bijection of 128 bit counters, so any element of any stream can be computed
+    // directly. Streams are distinguished by counter words, so simulations give the same numbers however
+    // the work is split over threads.
+    struct Philox4x32
+    {
+        static void Generate(std::uint32_t const counter[4], std::uint32_t const key[2], std::uint32_t out[4])
+        {
+            std::uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+            std::uint32_t k0 = key[0], k1 = key[1];
+
+            for (int round = 0; round < 10; ++round)
+            {
+                std::uint64_t const product0 = static_cast<std::uint64_t>(0xD2511F53u) * c0;
+                std::uint64_t const product1 = static_cast<std::uint64_t>(0xCD9E8D57u) * c2;
+                std::uint32_t const hi0 = static_cast<std::uint32_t>(product0 >> 32), lo0 = static_cast<std::uint32_t>(product0);
+                std::uint32_t const hi1 = static_cast<std::uint32_t>(product1 >> 32), lo1 = static_cast<std::uint32_t>(product1);
+
+                c0 = hi1 ^ c1 ^ k0;
+                c1 = lo1;
+                c2 = hi0 ^ c3 ^ k1;
+                c3 = lo0;
+
+                k0 += 0x9E3779B9u;
+                k1 += 0xBB67AE85u;
+            }
+
+            out[0] = c0;
+            out[1] = c1;
+            out[2] = c2;
+            out[3] = c3;
+        }
+    };
+
+    // Standard normal variates of one stream of a seed, by Box-Muller on Philox output: the i-th block
+    // of two variates is a function of (seed, stream, i) only.
+    class PhiloxNormalStream
+    {
+    public:
+        PhiloxNormalStream(std::uint64_t seed, std::uint64_t stream)
+            : mBlock(0)
+            , mStream(stream)
+            , mHasSpare(false)
+            , mSpare(0.0)
+        {
+            mKey[0] = static_cast<std::uint32_t>(seed);
+            mKey[1] = static_cast<std::uint32_t>(seed >> 32);
+        }
+
+        double Next()
+        {
+            if (mHasSpare)
+            {
+                mHasSpare = false;
+                return mSpare;
+            }
+
+            std::uint32_t const counter[4] =
+            {
+                static_cast<std::uint32_t>(mBlock), static_cast<std::uint32_t>(mBlock >> 32),
+                static_cast<std::uint32_t>(mStream), static_cast<std::uint32_t>(mStream >> 32)
+            };
+            std::uint32_t bits[4];
+            Philox4x32::Generate(counter, mKey, bits);
+            ++mBlock;
+
+            // Two uniforms of 53 bits in (0, 1)
+            double const u1 = ToUniform(bits[0], bits[1]);
+            double const u2 = ToUniform(bits[2], bits[3]);
+            double const radius = std::sqrt(-2.0 * std::log(u1));
+            double const angle = 6.283185307179586476925 * u2;
+
+            mSpare = radius * std::sin(angle);
+            mHasSpare = true;
+            return radius * std::cos(angle);
+        }
+
+    private:
+        static double ToUniform(std::uint32_t hi, std::uint32_t lo)
+        {
+            std::uint64_t const bits = (static_cast<std::uint64_t>(hi) << 21) ^ (lo >> 11);
+            return (static_cast<double>(bits & ((std::uint64_t(1) << 53) - 1)) + 0.5) * (1.0 / 9007199254740992.0);
+        }
+
+        std::uint64_t mBlock;
+        std::uint64_t mStream;
+        std::uint32_t mKey[2];
+        bool mHasSpare;
+        double mSpare;
+    };
+}
+
+#endif
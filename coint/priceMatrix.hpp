@@ -0,0 +1,246 @@
+#ifndef COINT_PRICE_MATRIX_HPP
+#define COINT_PRICE_MATRIX_HPP
+
+#include "../marketdata/columnStore.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <istream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace CqfProject
+{
+    // Log prices of a symbol universe, one contiguous column of numObservations per symbol
+    struct PriceMatrix
+    {
+        PriceMatrix()
+            : numObservations(0)
+        {}
+
+        std::size_t NumSymbols() const
+        {
+            return symbols.size();
+        }
+
+        double const* Column(std::size_t symbol) const
+        {
+            return logPrices.data() + symbol * numObservations;
+        }
+
+        std::size_t numObservations;
+        std::vector<std::string> symbols;
+        std::vector<double> logPrices;
+    };
+
+    namespace Detail
+    {
+        inline void SplitCsvLine(std::string const& line, std::vector<std::string>& fields)
+        {
+            fields.clear();
+            std::string::size_type start = 0;
+            for (;;)
+            {
+                std::string::size_type const end = line.find(',', start);
+                fields.push_back(line.substr(start, end == std::string::npos ? std::string::npos : end - start));
+                if (end == std::string::npos)
+                    break;
+                start = end + 1;
+            }
+
+            // Tolerate CRLF files
+            if (!fields.back().empty() && fields.back().back() == '\r')
+                fields.back().pop_back();
+        }
+    }
+
+    // Wide CSV of prices: a header of
+    //     date,SYM1,SYM2,...
+    // then one row per date, oldest first. The first column is a label and is not parsed.
+    // Rows with a missing or non-positive price are dropped, so all columns stay aligned; the number
+    // dropped is returned in droppedRows if given.
+    inline PriceMatrix ReadPriceCsv(std::istream& is, std::size_t* droppedRows = nullptr)
+    {
+        PriceMatrix matrix;
+        std::vector<std::string> fields;
+        std::string line;
+
+        if (!std::getline(is, line))
+            throw std::runtime_error("price file is empty");
+
+        Detail::SplitCsvLine(line, fields);
+        if (fields.size() < 2)
+            throw std::runtime_error("price file header has no symbols");
+        matrix.symbols.assign(fields.begin() + 1, fields.end());
+
+        std::size_t const numSymbols = matrix.symbols.size();
+        std::vector<std::vector<double> > columns(numSymbols);
+        std::vector<double> row(numSymbols);
+        std::size_t dropped = 0;
+        std::size_t lineNumber = 1;
+
+        while (std::getline(is, line))
+        {
+            ++lineNumber;
+            if (line.empty() || line == "\r")
+                continue;
+
+            Detail::SplitCsvLine(line, fields);
+            if (fields.size() != numSymbols + 1)
+            {
+                std::ostringstream os;
+                os << "line " << lineNumber << ": expected " << numSymbols + 1 << " fields, found " << fields.size();
+                throw std::runtime_error(os.str());
+            }
+
+            bool complete = true;
+            for (std::size_t s = 0; s < numSymbols && complete; ++s)
+            {
+                char const* begin = fields[s + 1].c_str();
+                char* end = nullptr;
+                double const price = std::strtod(begin, &end);
+                complete = end != begin && *end == '\0' && price > 0.0 && std::isfinite(price);
+                row[s] = price;
+            }
+
+            if (!complete)
+            {
+                ++dropped;
+                continue;
+            }
+
+            for (std::size_t s = 0; s < numSymbols; ++s)
+                columns[s].push_back(std::log(row[s]));
+        }
+
+        matrix.numObservations = columns[0].size();
+        matrix.logPrices.reserve(numSymbols * matrix.numObservations);
+        for (auto const& column : columns)
+            matrix.logPrices.insert(matrix.logPrices.end(), column.begin(), column.end());
+
+        if (droppedRows != nullptr)
+            *droppedRows = dropped;
+
+        return matrix;
+    }
+
+    // Symbols from the last column of a CSV with a header, e.g. blacklit/symbols.csv (Company,Symbol)
+    inline std::vector<std::string> ReadSymbolList(std::istream& is)
+    {
+        std::vector<std::string> symbols;
+        std::vector<std::string> fields;
+        std::string line;
+
+        if (!std::getline(is, line))
+            return symbols;
+
+        while (std::getline(is, line))
+        {
+            Detail::SplitCsvLine(line, fields);
+            if (!fields.back().empty())
+                symbols.push_back(fields.back());
+        }
+
+        return symbols;
+    }
+
+    // Columns of matrix for the given symbols, in their order. Throws if any is missing.
+    inline PriceMatrix SelectSymbols(PriceMatrix const& matrix, std::vector<std::string> const& symbols)
+    {
+        PriceMatrix selected;
+        selected.numObservations = matrix.numObservations;
+        selected.symbols = symbols;
+        selected.logPrices.reserve(symbols.size() * matrix.numObservations);
+
+        for (auto const& symbol : symbols)
+        {
+            std::size_t s = 0;
+            while (s < matrix.NumSymbols() && matrix.symbols[s] != symbol)
+                ++s;
+            if (s == matrix.NumSymbols())
+                throw std::runtime_error("no prices for symbol " + symbol);
+
+            selected.logPrices.insert(selected.logPrices.end(), matrix.Column(s), matrix.Column(s) + matrix.numObservations);
+        }
+
+        return selected;
+    }
+
+    // Log prices of the symbols from a column store (see marketdata/columnStore.hpp), or of all its
+    // symbols if none are given, on the dates where all of them are priced. Throws if any is missing.
+    inline PriceMatrix ReadPriceStore(ColumnStore const& store, std::vector<std::string> const& symbols = std::vector<std::string>(),
+        std::size_t* droppedRows = nullptr)
+    {
+        PriceMatrix matrix;
+        if (symbols.empty())
+        {
+            for (std::size_t c = 0; c < store.NumSymbols(); ++c)
+                matrix.symbols.push_back(store.Symbol(c));
+        }
+        else
+            matrix.symbols = symbols;
+
+        std::vector<std::size_t> const columns = store.Columns(matrix.symbols);
+        std::vector<std::size_t> const rows = store.CompleteRows(columns);
+        matrix.numObservations = rows.size();
+        matrix.logPrices.resize(columns.size() * rows.size());
+        store.LogPrices(columns, rows, matrix.logPrices.data());
+
+        if (droppedRows != nullptr)
+            *droppedRows = store.NumDates() - rows.size();
+
+        return matrix;
+    }
+
+    // Random walk log prices with 1% daily volatility, where each of the first numPairs pairs of symbols
+    // (S0, S1), (S2, S3), ... is cointegrated: S(2k+1) = 0.5 + beta S(2k) + AR(1) noise with coefficient
+    // 0.9, for beta from 0.5 to 1.5. For tests and benchmarks without market data.
+    inline PriceMatrix SimulatePriceMatrix(std::size_t numSymbols, std::size_t numObservations, std::size_t numPairs, std::uint64_t seed = 42)
+    {
+        if (2 * numPairs > numSymbols)
+            throw std::runtime_error("more cointegrated pairs than symbols allow");
+
+        PriceMatrix matrix;
+        matrix.numObservations = numObservations;
+        matrix.logPrices.resize(numSymbols * numObservations);
+
+        std::mt19937_64 generator(seed);
+        std::normal_distribution<double> normal;
+
+        for (std::size_t s = 0; s < numSymbols; ++s)
+        {
+            matrix.symbols.push_back("S" + std::to_string(s));
+            double* column = matrix.logPrices.data() + s * numObservations;
+
+            if (s % 2 == 1 && s / 2 < numPairs)
+            {
+                double const beta = numPairs == 1 ? 1.0 : 0.5 + static_cast<double>(s / 2) / (numPairs - 1);
+                double const* x = column - numObservations;
+                double noise = 0.0;
+                for (std::size_t t = 0; t < numObservations; ++t)
+                {
+                    noise = 0.9 * noise + 0.01 * normal(generator);
+                    column[t] = 0.5 + beta * x[t] + noise;
+                }
+            }
+            else
+            {
+                double level = std::log(100.0);
+                for (std::size_t t = 0; t < numObservations; ++t)
+                {
+                    level += 0.01 * normal(generator);
+                    column[t] = level;
+                }
+            }
+        }
+
+        return matrix;
+    }
+}
+
+#endif
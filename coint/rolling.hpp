@@ -0,0 +1,365 @@
+#ifndef COINT_ROLLING_HPP
+#define COINT_ROLLING_HPP
+
+#include "adf.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace CqfProject
+{
+    struct RollingStatistics
+    {
+        RollingStatistics()
+            : hedgeRatio(std::numeric_limits<double>::quiet_NaN())
+            , intercept(std::numeric_limits<double>::quiet_NaN())
+            , spreadStd(std::numeric_limits<double>::quiet_NaN())
+            , zScore(std::numeric_limits<double>::quiet_NaN())
+            , adfStatistic(std::numeric_limits<double>::quiet_NaN())
+            , numObservations(0)
+        {}
+
+        double hedgeRatio;
+        double intercept;
+
+        /// Standard deviation of the residuals over the window
+        double spreadStd;
+
+        /// Latest residual in standard deviations
+        double zScore;
+
+        /// ADF t statistic of the residuals, to compare with EngleGrangerCriticalValue
+        double adfStatistic;
+
+        /// Observations in the ADF regression
+        std::size_t numObservations;
+    };
+
+    // Engle-Granger statistics of y on x over a rolling window, updated in constant time per observation.
+    //
+    // The residual e = y - a - b x is linear in z = (1, x, y), and every term of the ADF regression on the
+    // residuals (de[t], e[t-1], de[t-1] .. de[t-lags]) is linear in the stacked vector
+    // Z[t] = (z[t], z[t-1], .. z[t-lags-1]). So the window keeps the sums of z z' over its observations
+    // and of Z Z' over its ADF rows, adding the newest and removing the oldest on each update; the
+    // hedge ratio then comes from the first and the ADF moments from quadratic forms of the second,
+    // whatever the current hedge ratio. Statistics match a full Engle-Granger test of the window
+    // (EngleGrangerScanner, one direction) to rounding.
+    //
+    // Values are shifted by a reference point, and the sums recomputed from the window every window length
+    // updates, so rounding in the running sums cannot accumulate; this adds a constant amortized cost.
+    class RollingCointegration
+    {
+    public:
+        RollingCointegration(std::size_t window, std::size_t lags = 1)
+            : mWindow(window)
+            , mLags(lags)
+            , mRowSize(3 * (lags + 2))
+            , mX(window)
+            , mY(window)
+            , mStart(0)
+            , mCount(0)
+            , mUpdatesSinceRefresh(0)
+            , mX0(0.0)
+            , mY0(0.0)
+            , mObservationMoments(9, 0.0)
+            , mRowMoments(mRowSize * mRowSize, 0.0)
+            , mRow(mRowSize)
+        {
+            if (window < lags + 5)
+                throw std::invalid_argument("rolling window too short for the ADF lags");
+        }
+
+        std::size_t Window() const
+        {
+            return mWindow;
+        }
+
+        std::size_t Count() const
+        {
+            return mCount;
+        }
+
+        bool Full() const
+        {
+            return mCount == mWindow;
+        }
+
+        void Reset()
+        {
+            mStart = 0;
+            mCount = 0;
+            mUpdatesSinceRefresh = 0;
+        }
+
+        // Add an observation, removing the oldest once the window is full
+        void Update(double x, double y)
+        {
+            if (mCount == 0)
+            {
+                // First observation is the reference point until the next refresh
+                mX0 = x;
+                mY0 = y;
+                std::fill(mObservationMoments.begin(), mObservationMoments.end(), 0.0);
+                std::fill(mRowMoments.begin(), mRowMoments.end(), 0.0);
+            }
+
+            if (mCount == mWindow)
+            {
+                // The oldest observation is the deepest lag of the oldest ADF row
+                AccumulateRow(mLags + 1, -1.0);
+                AccumulateObservation(0, -1.0);
+                mStart = mStart + 1 == mWindow ? 0 : mStart + 1;
+                --mCount;
+            }
+
+            std::size_t const slot = Position(mCount);
+            mX[slot] = x;
+            mY[slot] = y;
+            ++mCount;
+
+            AccumulateObservation(mCount - 1, 1.0);
+            if (mCount >= mLags + 2)
+                AccumulateRow(mCount - 1, 1.0);
+
+            if (++mUpdatesSinceRefresh >= mWindow)
+                Refresh();
+        }
+
+        // Statistics of the observations in the window. NaN until the window holds enough for the ADF regression.
+        RollingStatistics Statistics(AdfWorkspace& workspace) const
+        {
+            RollingStatistics statistics;
+            std::size_t const n = mCount;
+            if (n < mLags + 5)
+                return statistics;
+
+            // Hedge regression, in shifted coordinates
+            double const count = static_cast<double>(n);
+            double const sx = ObservationMoment(0, 1);
+            double const sy = ObservationMoment(0, 2);
+            double const cxx = ObservationMoment(1, 1) - sx * sx / count;
+            double const cxy = ObservationMoment(1, 2) - sx * sy / count;
+            double const cyy = ObservationMoment(2, 2) - sy * sy / count;
+            if (!(cxx > 0.0))
+                return statistics;
+
+            double const beta = cxy / cxx;
+            double const alpha = (sy - beta * sx) / count;
+            statistics.hedgeRatio = beta;
+            statistics.intercept = alpha + mY0 - beta * mX0;
+            statistics.spreadStd = std::sqrt(std::max(cyy - beta * cxy, 0.0) / (count - 2.0));
+
+            std::size_t const newest = Position(n - 1);
+            double const residual = (mY[newest] - mY0) - alpha - beta * (mX[newest] - mX0);
+            statistics.zScore = residual / statistics.spreadStd;
+
+            // e[t - i] = w' z[t - i]; E(i, j) = sum over rows of e[t - i] e[t - j]
+            double const w[3] = { -alpha, -beta, 1.0 };
+            std::size_t const numLags = mLags + 2;
+            std::vector<double>& scratch = workspace.columns;
+            scratch.resize(3 * numLags * numLags);
+            double* const quadratic = scratch.data();
+            for (std::size_t i = 0; i < numLags; ++i)
+            {
+                for (std::size_t j = i; j < numLags; ++j)
+                {
+                    double sum = 0.0;
+                    for (std::size_t a = 0; a < 3; ++a)
+                        for (std::size_t b = 0; b < 3; ++b)
+                            sum += w[a] * w[b] * RowMoment(3 * i + a, 3 * j + b);
+                    quadratic[i * numLags + j] = quadratic[j * numLags + i] = sum;
+                }
+            }
+
+            // Regression terms v = (de[t], e[t-1], de[t-1], .., de[t-lags]) as combinations of e[t - i]
+            // and their moments G = C E C'
+            double* const g = quadratic + numLags * numLags;
+            for (std::size_t k = 0; k < numLags; ++k)
+            {
+                for (std::size_t l = 0; l <= k; ++l)
+                {
+                    double sum = 0.0;
+                    for (int p = 0; p < 2; ++p)
+                        for (int q = 0; q < 2; ++q)
+                            sum += TermCoefficient(k, p) * TermCoefficient(l, q) * quadratic[TermLag(k, p) * numLags + TermLag(l, q)];
+                    g[k * numLags + l] = g[l * numLags + k] = sum;
+                }
+            }
+
+            // Regressors v[1..], target v[0]
+            std::size_t const k = numLags - 1;
+            double* const gram = g + numLags * numLags;
+            std::vector<double>& rhs = workspace.rhs;
+            rhs.resize(k);
+            for (std::size_t a = 0; a < k; ++a)
+            {
+                rhs[a] = g[(a + 1) * numLags];
+                for (std::size_t b = 0; b < k; ++b)
+                    gram[a * k + b] = g[(a + 1) * numLags + b + 1];
+            }
+
+            AdfResult const adf = AdfFromMoments(gram, rhs.data(), g[0], k, n - 1 - mLags, workspace);
+            statistics.adfStatistic = adf.statistic;
+            statistics.numObservations = adf.numObservations;
+            return statistics;
+        }
+
+    private:
+        // Index in the ring of the k-th oldest observation
+        std::size_t Position(std::size_t k) const
+        {
+            std::size_t const position = mStart + k;
+            return position >= mWindow ? position - mWindow : position;
+        }
+
+        // Term k of the regression is the sum of TermCoefficient(k, p) e[t - TermLag(k, p)], p = 0, 1
+        std::size_t TermLag(std::size_t k, int p) const
+        {
+            return k == 0 ? static_cast<std::size_t>(p) : k == 1 ? 1 : k - 1 + static_cast<std::size_t>(p);
+        }
+
+        static double TermCoefficient(std::size_t k, int p)
+        {
+            return k == 1 ? (p == 0 ? 1.0 : 0.0) : (p == 0 ? 1.0 : -1.0);
+        }
+
+        double ObservationMoment(std::size_t a, std::size_t b) const
+        {
+            return mObservationMoments[a * 3 + b];
+        }
+
+        double RowMoment(std::size_t a, std::size_t b) const
+        {
+            return a <= b ? mRowMoments[a * mRowSize + b] : mRowMoments[b * mRowSize + a];
+        }
+
+        void AccumulateObservation(std::size_t k, double sign)
+        {
+            std::size_t const position = Position(k);
+            double const z[3] = { 1.0, mX[position] - mX0, mY[position] - mY0 };
+            for (std::size_t a = 0; a < 3; ++a)
+                for (std::size_t b = a; b < 3; ++b)
+                    mObservationMoments[a * 3 + b] += sign * z[a] * z[b];
+
+            mObservationMoments[3] = mObservationMoments[1];
+            mObservationMoments[6] = mObservationMoments[2];
+            mObservationMoments[7] = mObservationMoments[5];
+        }
+
+        // Add or remove the ADF row whose newest observation is the k-th oldest, upper triangle only
+        void AccumulateRow(std::size_t k, double sign)
+        {
+            double* const row = mRow.data();
+            for (std::size_t i = 0; i <= mLags + 1; ++i)
+            {
+                std::size_t const position = Position(k - i);
+                row[3 * i] = 1.0;
+                row[3 * i + 1] = mX[position] - mX0;
+                row[3 * i + 2] = mY[position] - mY0;
+            }
+
+            for (std::size_t a = 0; a < mRowSize; ++a)
+            {
+                double const scaled = sign * row[a];
+                double* const moments = &mRowMoments[a * mRowSize];
+                for (std::size_t b = a; b < mRowSize; ++b)
+                    moments[b] += scaled * row[b];
+            }
+        }
+
+        // Recompute the sums from the window, about its newest observation
+        void Refresh()
+        {
+            std::size_t const newest = Position(mCount - 1);
+            mX0 = mX[newest];
+            mY0 = mY[newest];
+            std::fill(mObservationMoments.begin(), mObservationMoments.end(), 0.0);
+            std::fill(mRowMoments.begin(), mRowMoments.end(), 0.0);
+
+            for (std::size_t k = 0; k < mCount; ++k)
+            {
+                AccumulateObservation(k, 1.0);
+                if (k >= mLags + 1)
+                    AccumulateRow(k, 1.0);
+            }
+
+            mUpdatesSinceRefresh = 0;
+        }
+
+        std::size_t mWindow;
+        std::size_t mLags;
+        std::size_t mRowSize;
+
+        /// Ring of the observations in the window, oldest at mStart
+        std::vector<double> mX;
+        std::vector<double> mY;
+        std::size_t mStart;
+        std::size_t mCount;
+        std::size_t mUpdatesSinceRefresh;
+
+        /// Reference point subtracted from the observations
+        double mX0;
+        double mY0;
+
+        /// Sums of z z' over the observations, 3 x 3
+        std::vector<double> mObservationMoments;
+
+        /// Sums of Z Z' over the ADF rows, upper triangle of mRowSize x mRowSize
+        std::vector<double> mRowMoments;
+        std::vector<double> mRow;
+    };
+
+    // Rolling Engle-Granger statistics of many pairs fed by bars of prices of a symbol universe
+    class RollingPairMonitor
+    {
+    public:
+        // Pairs of (dependent, independent) symbol indices
+        RollingPairMonitor(std::vector<std::pair<std::size_t, std::size_t> > const& pairs, std::size_t window, std::size_t lags = 1)
+            : mPairs(pairs)
+            , mStatistics(pairs.size())
+        {
+            mStates.reserve(pairs.size());
+            for (std::size_t p = 0; p < pairs.size(); ++p)
+                mStates.emplace_back(window, lags);
+        }
+
+        std::size_t NumPairs() const
+        {
+            return mPairs.size();
+        }
+
+        std::pair<std::size_t, std::size_t> const& Pair(std::size_t p) const
+        {
+            return mPairs[p];
+        }
+
+        // Add a bar of log prices, indexed by symbol, and update the statistics of every pair
+        void Update(double const* logPrices)
+        {
+            for (std::size_t p = 0; p < mPairs.size(); ++p)
+            {
+                RollingCointegration& state = mStates[p];
+                state.Update(logPrices[mPairs[p].second], logPrices[mPairs[p].first]);
+                mStatistics[p] = state.Statistics(mWorkspace);
+            }
+        }
+
+        RollingStatistics const& Statistics(std::size_t p) const
+        {
+            return mStatistics[p];
+        }
+
+    private:
+        std::vector<std::pair<std::size_t, std::size_t> > mPairs;
+        std::vector<RollingCointegration> mStates;
+        std::vector<RollingStatistics> mStatistics;
+        AdfWorkspace mWorkspace;
+    };
+}
+
+#endif
@@ -0,0 +1,390 @@
+#include "engleGranger.hpp"
+#include "johansen.hpp"
+#include "priceMatrix.hpp"
+#include "rolling.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace CqfProject;
+
+// coint-scan: Engle-Granger tests of every pair in a price file (see priceMatrix.hpp for the format),
+// or Johansen tests of every basket of a given size or of listed baskets, or rolling window statistics of
+// every pair replayed bar by bar, writing one CSV row per pair or basket to stdout, most cointegrated
+// first. Timings go to stderr.
+
+struct ScanConfig
+{
+    ScanConfig()
+        : basketSize(0)
+        , top(0)
+        , rollingWindow(0)
+        , numSyntheticSymbols(0)
+        , numSyntheticObservations(0)
+    {}
+
+    EngleGrangerSettings settings;
+    JohansenSettings johansen;
+
+    /// Johansen tests of all baskets of this size, when set
+    std::size_t basketSize;
+
+    /// Johansen tests of these baskets of symbols, when set
+    std::vector<std::vector<std::string> > baskets;
+
+    /// Rows written, 0 for all pairs
+    std::size_t top;
+
+    /// Symbols file restricting the universe, e.g. blacklit/symbols.csv
+    std::string universe;
+
+    /// Replay the prices through rolling statistics of this window, when set
+    std::size_t rollingWindow;
+
+    /// Column store of prices instead of a CSV, when set
+    std::string store;
+
+    /// Simulated prices instead of a file, when set
+    std::size_t numSyntheticSymbols;
+    std::size_t numSyntheticObservations;
+
+    std::string input;
+};
+
+void PrintUsage()
+{
+    std::cerr
+        << "Usage: coint-scan [options] [FILE]" << std::endl
+        << "Engle-Granger tests of all pairs of a wide CSV of prices (date,SYM1,SYM2,...), or stdin if none or -" << std::endl
+        << "  --lags N              lagged differences in the ADF regression or VECM (default 1)" << std::endl
+        << "  --one-direction       only regress the later symbol of each pair on the earlier one" << std::endl
+        << "  --threads N           scanning threads, 0 for all cores (default)" << std::endl
+        << "  --top N               write the N most cointegrated pairs or baskets only (default all," << std::endl
+        << "                        or 100 for --johansen)" << std::endl
+        << "  --johansen K          Johansen tests of all baskets of K symbols instead of pairs" << std::endl
+        << "  --basket A,B,...      Johansen test of the listed symbols, repeatable" << std::endl
+        << "  --deterministic D     none, constant (default) or trend terms in the VECM" << std::endl
+        << "  --rolling W           replay the prices through rolling statistics of W bars for every pair," << std::endl
+        << "                        writing those of the last bar" << std::endl
+        << "  --universe FILE       only symbols in the last column of FILE, e.g. blacklit/symbols.csv" << std::endl
+        << "  --store FILE          read prices from a column store built by marketdata-import instead of a CSV" << std::endl
+        << "  --synthetic N T       scan N simulated symbols of T observations instead of a file" << std::endl;
+}
+
+void ScanPairs(ScanConfig const& config, PriceMatrix const& prices)
+{
+    auto const start = std::chrono::steady_clock::now();
+    EngleGrangerScanner const scanner(prices);
+    std::vector<PairResult> results = scanner.Scan(config.settings);
+    double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cerr << "Scanned " << results.size() << " pairs of " << prices.NumSymbols() << " symbols, "
+        << prices.numObservations << " observations, in " << seconds << " s ("
+        << (seconds > 0.0 ? results.size() / seconds : 0.0) << " pairs/s)" << std::endl;
+
+    // Most negative statistics first, untestable pairs last
+    auto const key = [] (PairResult const& r)
+    {
+        return std::isnan(r.statistic) ? std::numeric_limits<double>::infinity() : r.statistic;
+    };
+    std::size_t const count = config.top == 0 ? results.size() : std::min(config.top, results.size());
+    std::partial_sort(results.begin(), results.begin() + count, results.end(),
+        [&] (PairResult const& a, PairResult const& b) { return key(a) < key(b); });
+
+    std::cout << "dependent,independent,hedgeRatio,intercept,spreadStd,adf,cv1,cv5,cv10,observations" << '\n';
+    for (std::size_t r = 0; r < count; ++r)
+    {
+        PairResult const& result = results[r];
+        std::cout << prices.symbols[result.dependent] << ','
+            << prices.symbols[result.independent] << ','
+            << result.hedgeRatio << ','
+            << result.intercept << ','
+            << result.spreadStd << ','
+            << result.statistic << ','
+            << EngleGrangerCriticalValue(SignificanceLevel::ONE_PERCENT, result.numObservations) << ','
+            << EngleGrangerCriticalValue(SignificanceLevel::FIVE_PERCENT, result.numObservations) << ','
+            << EngleGrangerCriticalValue(SignificanceLevel::TEN_PERCENT, result.numObservations) << ','
+            << result.numObservations << '\n';
+    }
+}
+
+// Rolling statistics of every pair, later symbol on earlier, updated bar by bar as a live monitor would
+void ReplayPairs(ScanConfig const& config, PriceMatrix const& prices)
+{
+    std::size_t const numSymbols = prices.NumSymbols();
+    std::vector<std::pair<std::size_t, std::size_t> > pairs;
+    for (std::size_t i = 0; i < numSymbols; ++i)
+        for (std::size_t j = i + 1; j < numSymbols; ++j)
+            pairs.push_back(std::make_pair(j, i));
+
+    RollingPairMonitor monitor(pairs, config.rollingWindow, config.settings.lags);
+    std::vector<double> bar(numSymbols);
+
+    auto const start = std::chrono::steady_clock::now();
+    for (std::size_t t = 0; t < prices.numObservations; ++t)
+    {
+        for (std::size_t s = 0; s < numSymbols; ++s)
+            bar[s] = prices.Column(s)[t];
+        monitor.Update(bar.data());
+    }
+    double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double const updates = static_cast<double>(pairs.size()) * prices.numObservations;
+    std::cerr << "Replayed " << prices.numObservations << " bars of " << pairs.size() << " pairs in " << seconds << " s ("
+        << (seconds > 0.0 ? updates / seconds : 0.0) << " pair updates/s)" << std::endl;
+
+    std::vector<std::size_t> order(pairs.size());
+    for (std::size_t p = 0; p < order.size(); ++p)
+        order[p] = p;
+    auto const key = [&] (std::size_t p)
+    {
+        double const statistic = monitor.Statistics(p).adfStatistic;
+        return std::isnan(statistic) ? std::numeric_limits<double>::infinity() : statistic;
+    };
+    std::size_t const count = config.top == 0 ? order.size() : std::min(config.top, order.size());
+    std::partial_sort(order.begin(), order.begin() + count, order.end(),
+        [&] (std::size_t a, std::size_t b) { return key(a) < key(b); });
+
+    std::cout << "dependent,independent,hedgeRatio,intercept,spreadStd,zScore,adf,cv5,observations" << '\n';
+    for (std::size_t r = 0; r < count; ++r)
+    {
+        RollingStatistics const& statistics = monitor.Statistics(order[r]);
+        std::cout << prices.symbols[pairs[order[r]].first] << ','
+            << prices.symbols[pairs[order[r]].second] << ','
+            << statistics.hedgeRatio << ','
+            << statistics.intercept << ','
+            << statistics.spreadStd << ','
+            << statistics.zScore << ','
+            << statistics.adfStatistic << ','
+            << EngleGrangerCriticalValue(SignificanceLevel::FIVE_PERCENT, statistics.numObservations) << ','
+            << statistics.numObservations << '\n';
+    }
+}
+
+// Johansen tests of listed baskets, or the top baskets of a size. False if a listed symbol is unknown.
+bool ScanBaskets(ScanConfig const& config, PriceMatrix const& prices)
+{
+    std::vector<std::vector<std::size_t> > baskets;
+    for (auto const& symbols : config.baskets)
+    {
+        std::vector<std::size_t> basket;
+        for (auto const& symbol : symbols)
+        {
+            auto const it = std::find(prices.symbols.begin(), prices.symbols.end(), symbol);
+            if (it == prices.symbols.end())
+            {
+                std::cerr << "No prices for symbol " << symbol << std::endl;
+                return false;
+            }
+            basket.push_back(static_cast<std::size_t>(it - prices.symbols.begin()));
+        }
+        baskets.push_back(basket);
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+    JohansenScanner const scanner(prices, config.johansen);
+    std::vector<JohansenResult> results;
+    std::uint64_t numBaskets = baskets.size();
+    if (config.basketSize != 0)
+    {
+        numBaskets = BinomialCoefficient(prices.NumSymbols(), config.basketSize);
+        results = scanner.ScanCombinations(config.basketSize, config.top == 0 ? 100 : config.top);
+    }
+    else
+        results = scanner.TestBaskets(baskets);
+    double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cerr << "Tested " << numBaskets << " baskets of " << prices.NumSymbols() << " symbols, "
+        << prices.numObservations << " observations, in " << seconds << " s ("
+        << (seconds > 0.0 ? numBaskets / seconds : 0.0) << " baskets/s)" << std::endl;
+
+    // Lists within a field are separated by spaces; the vector is the one of the largest eigenvalue
+    auto const writeList = [] (std::vector<double> const& values, std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i)
+            std::cout << (i == begin ? "" : " ") << values[i];
+    };
+
+    std::size_t const count = config.top == 0 ? results.size() : std::min(config.top, results.size());
+    std::cout << "basket,observations,eigenvalues,trace,maxEigen,vector" << '\n';
+    for (std::size_t r = 0; r < count; ++r)
+    {
+        JohansenResult const& result = results[r];
+        for (std::size_t i = 0; i < result.basket.size(); ++i)
+            std::cout << (i == 0 ? "" : " ") << prices.symbols[result.basket[i]];
+        std::cout << ',' << result.numObservations << ',';
+        writeList(result.eigenvalues, 0, result.eigenvalues.size());
+        std::cout << ',';
+        writeList(result.traceStatistics, 0, result.traceStatistics.size());
+        std::cout << ',';
+        writeList(result.maxEigenStatistics, 0, result.maxEigenStatistics.size());
+        std::cout << ',';
+        writeList(result.vectors, 0, result.eigenvalues.empty() ? 0 : result.basket.size());
+        std::cout << '\n';
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    ScanConfig config;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const arg = argv[i];
+        bool const hasValue = i + 1 < argc;
+
+        if (arg == "--lags" && hasValue)
+            config.settings.lags = config.johansen.lags = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--one-direction")
+            config.settings.bothDirections = false;
+        else if (arg == "--threads" && hasValue)
+            config.settings.numThreads = config.johansen.numThreads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--top" && hasValue)
+            config.top = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--johansen" && hasValue)
+            config.basketSize = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--basket" && hasValue)
+        {
+            std::vector<std::string> basket;
+            std::istringstream is(argv[++i]);
+            std::string symbol;
+            while (std::getline(is, symbol, ','))
+                basket.push_back(symbol);
+            config.baskets.push_back(basket);
+        }
+        else if (arg == "--deterministic" && hasValue)
+        {
+            std::string const value = argv[++i];
+            if (value != "none" && value != "constant" && value != "trend")
+            {
+                PrintUsage();
+                return 1;
+            }
+            config.johansen.deterministic = value == "none" ? Deterministic::NONE :
+                value == "constant" ? Deterministic::CONSTANT : Deterministic::TREND;
+        }
+        else if (arg == "--rolling" && hasValue)
+            config.rollingWindow = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--universe" && hasValue)
+            config.universe = argv[++i];
+        else if (arg == "--store" && hasValue)
+            config.store = argv[++i];
+        else if (arg == "--synthetic" && i + 2 < argc)
+        {
+            config.numSyntheticSymbols = std::strtoul(argv[++i], nullptr, 10);
+            config.numSyntheticObservations = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if ((arg == "-" || arg.compare(0, 2, "--") != 0) && config.input.empty())
+            config.input = arg;
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if ((config.numSyntheticSymbols != 0 && (config.numSyntheticSymbols < 2 || config.numSyntheticObservations < 10)) ||
+        (!config.store.empty() && (config.numSyntheticSymbols != 0 || !config.input.empty())) ||
+        (config.basketSize == 1 || (config.basketSize != 0 && !config.baskets.empty())) ||
+        (config.rollingWindow != 0 && (config.basketSize != 0 || !config.baskets.empty())))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    std::ios_base::sync_with_stdio(false);
+
+    PriceMatrix prices;
+    try
+    {
+        if (config.numSyntheticSymbols != 0)
+            prices = SimulatePriceMatrix(config.numSyntheticSymbols, config.numSyntheticObservations, config.numSyntheticSymbols / 10);
+        else if (!config.store.empty())
+        {
+            // Only the universe's columns are read from the mapped file
+            std::vector<std::string> symbols;
+            if (!config.universe.empty())
+            {
+                std::ifstream file(config.universe.c_str());
+                if (!file)
+                {
+                    std::cerr << "Failed to open " << config.universe << std::endl;
+                    return 1;
+                }
+                symbols = ReadSymbolList(file);
+            }
+
+            std::size_t dropped = 0;
+            prices = ReadPriceStore(ColumnStore(config.store), symbols, &dropped);
+            if (dropped != 0)
+                std::cerr << "Dropped " << dropped << " dates with missing prices" << std::endl;
+        }
+        else
+        {
+            std::ifstream file;
+            if (!config.input.empty() && config.input != "-")
+            {
+                file.open(config.input.c_str());
+                if (!file)
+                {
+                    std::cerr << "Failed to open " << config.input << std::endl;
+                    return 1;
+                }
+            }
+
+            std::size_t dropped = 0;
+            prices = ReadPriceCsv(file.is_open() ? file : std::cin, &dropped);
+            if (dropped != 0)
+                std::cerr << "Dropped " << dropped << " rows with missing prices" << std::endl;
+        }
+
+        if (!config.universe.empty() && config.store.empty())
+        {
+            std::ifstream file(config.universe.c_str());
+            if (!file)
+            {
+                std::cerr << "Failed to open " << config.universe << std::endl;
+                return 1;
+            }
+            prices = SelectSymbols(prices, ReadSymbolList(file));
+        }
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << (!config.store.empty() ? config.store : config.input.empty() ? "stdin" : config.input) << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout.precision(std::numeric_limits<double>::max_digits10);
+    try
+    {
+        if (config.rollingWindow != 0)
+            ReplayPairs(config, prices);
+        else if (config.basketSize != 0 || !config.baskets.empty())
+        {
+            if (!ScanBaskets(config, prices))
+                return 1;
+        }
+        else
+            ScanPairs(config, prices);
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout.flush();
+    return 0;
+}
@@ -0,0 +1,991 @@
+#include "adf.hpp"
+#include "criticalValues.hpp"
+#include "engleGranger.hpp"
+#include "johansen.hpp"
+#include "linearAlgebra.hpp"
+#include "philox.hpp"
+#include "priceMatrix.hpp"
+#include "rolling.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+using namespace CqfProject;
+
+// Check the vectorized inner product against a plain loop, for lengths around the vector widths and offsets
+int TestDot()
+{
+    int errorCount = 0;
+
+    std::mt19937_64 generator(1);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    std::vector<double> a(80), b(80);
+    for (std::size_t i = 0; i < a.size(); ++i)
+    {
+        a[i] = uniform(generator);
+        b[i] = uniform(generator);
+    }
+
+    for (std::size_t offset = 0; offset < 3; ++offset)
+    {
+        for (std::size_t n = 0; n + offset <= 77; ++n)
+        {
+            double expected = 0.0, scale = 0.0;
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                expected += a[offset + i] * b[i];
+                scale += std::abs(a[offset + i] * b[i]);
+            }
+
+            double const actual = Dot(a.data() + offset, b.data(), n);
+            if (!(std::abs(actual - expected) <= 1e-14 * (1.0 + scale)))
+            {
+                std::cout << "Dot error. n=" << n << ", offset=" << offset << ", expected=" << expected << ", actual=" << actual << std::endl;
+                errorCount++;
+            }
+        }
+    }
+
+    return errorCount;
+}
+
+// Check Cholesky solves a positive definite system and rejects an indefinite one
+int TestCholesky()
+{
+    int errorCount = 0;
+
+    std::size_t const n = 6;
+    std::mt19937_64 generator(2);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+    // A = M M' + I
+    std::vector<double> m(n * n), a(n * n, 0.0), x(n), b(n, 0.0);
+    for (auto& v : m)
+        v = uniform(generator);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        x[i] = uniform(generator);
+        for (std::size_t j = 0; j < n; ++j)
+        {
+            for (std::size_t k = 0; k < n; ++k)
+                a[i * n + j] += m[i * n + k] * m[j * n + k];
+            if (i == j)
+                a[i * n + j] += 1.0;
+        }
+    }
+    for (std::size_t i = 0; i < n; ++i)
+        for (std::size_t j = 0; j < n; ++j)
+            b[i] += a[i * n + j] * x[j];
+
+    if (!CholeskyDecompose(a.data(), n))
+    {
+        std::cout << "Cholesky error. Positive definite matrix rejected" << std::endl;
+        return 1;
+    }
+
+    CholeskySolve(a.data(), n, b.data());
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        if (!(std::abs(b[i] - x[i]) <= 1e-12))
+        {
+            std::cout << "Cholesky error. i=" << i << ", expected=" << x[i] << ", actual=" << b[i] << std::endl;
+            errorCount++;
+        }
+    }
+
+    double indefinite[4] = { 1.0, 2.0, 2.0, 1.0 };
+    if (CholeskyDecompose(indefinite, 2))
+    {
+        std::cout << "Cholesky error. Indefinite matrix accepted" << std::endl;
+        errorCount++;
+    }
+
+    return errorCount;
+}
+
+// Check the blocked Gram matrix against separate inner products, for an odd number of columns spanning panels
+int TestGramMatrix()
+{
+    int errorCount = 0;
+
+    std::size_t const q = 7;
+    std::size_t const n = 2 * GRAM_PANEL_ROWS + 37;
+    std::mt19937_64 generator(4);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    std::vector<double> data(q * n + q);
+    for (auto& v : data)
+        v = uniform(generator);
+
+    // Columns at odd offsets, as lagged views are
+    std::vector<double const*> columns(q);
+    for (std::size_t j = 0; j < q; ++j)
+        columns[j] = data.data() + j * n + j;
+
+    std::vector<double> gram(q * q, -1.0);
+    GramMatrix(columns.data(), q, n, gram.data());
+    for (std::size_t i = 0; i < q; ++i)
+    {
+        for (std::size_t j = 0; j < q; ++j)
+        {
+            double const expected = Dot(columns[i], columns[j], n);
+            if (!(std::abs(gram[i * q + j] - expected) <= 1e-12 * n))
+            {
+                std::cout << "Gram matrix error. i=" << i << ", j=" << j << ", expected=" << expected << ", actual=" << gram[i * q + j] << std::endl;
+                errorCount++;
+            }
+        }
+    }
+
+    return errorCount;
+}
+
+// Check Jacobi eigenvalues and eigenvectors of a random symmetric matrix
+int TestSymmetricEigen()
+{
+    int errorCount = 0;
+
+    std::size_t const n = 7;
+    std::mt19937_64 generator(5);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    std::vector<double> a(n * n), work(n * n), eigenvalues(n), vectors(n * n);
+    for (std::size_t i = 0; i < n; ++i)
+        for (std::size_t j = 0; j <= i; ++j)
+            a[i * n + j] = a[j * n + i] = uniform(generator);
+
+    work = a;
+    SymmetricEigen(work.data(), n, eigenvalues.data(), vectors.data());
+    for (std::size_t r = 0; r < n; ++r)
+    {
+        double const* v = &vectors[r * n];
+        double residual = 0.0;
+        for (std::size_t i = 0; i < n; ++i)
+            residual = std::max(residual, std::abs(Dot(&a[i * n], v, n) - eigenvalues[r] * v[i]));
+
+        if (!(residual < 1e-12) || !(std::abs(Dot(v, v, n) - 1.0) < 1e-12) || (r > 0 && eigenvalues[r] > eigenvalues[r - 1]))
+        {
+            std::cout << "Symmetric eigen error. r=" << r << ", eigenvalue=" << eigenvalues[r] << ", residual=" << residual << std::endl;
+            errorCount++;
+        }
+    }
+
+    return errorCount;
+}
+
+// ADF t statistic by explicit least squares: design matrix, Gauss-Jordan inverse of X'X, residuals
+double ReferenceAdfStatistic(std::vector<double> const& y, std::size_t lags, Deterministic deterministic)
+{
+    std::size_t const numDeterministic = static_cast<std::size_t>(deterministic);
+    std::size_t const k = 1 + numDeterministic + lags;
+    std::size_t const n = y.size();
+
+    std::vector<std::vector<double> > x;
+    std::vector<double> target;
+    for (std::size_t t = lags + 1; t < n; ++t)
+    {
+        std::vector<double> row;
+        row.push_back(y[t - 1]);
+        if (numDeterministic > 0)
+            row.push_back(1.0);
+        if (numDeterministic > 1)
+            row.push_back(static_cast<double>(t));
+        for (std::size_t i = 1; i <= lags; ++i)
+            row.push_back(y[t - i] - y[t - i - 1]);
+        x.push_back(row);
+        target.push_back(y[t] - y[t - 1]);
+    }
+
+    // [X'X | I] reduced to [I | (X'X)^-1]
+    std::vector<std::vector<double> > augmented(k, std::vector<double>(2 * k, 0.0));
+    for (std::size_t a = 0; a < k; ++a)
+    {
+        for (std::size_t b = 0; b < k; ++b)
+            for (std::size_t r = 0; r < x.size(); ++r)
+                augmented[a][b] += x[r][a] * x[r][b];
+        augmented[a][k + a] = 1.0;
+    }
+    for (std::size_t c = 0; c < k; ++c)
+    {
+        std::size_t pivot = c;
+        for (std::size_t r = c + 1; r < k; ++r)
+            if (std::abs(augmented[r][c]) > std::abs(augmented[pivot][c]))
+                pivot = r;
+        std::swap(augmented[c], augmented[pivot]);
+
+        double const diagonal = augmented[c][c];
+        for (auto& v : augmented[c])
+            v /= diagonal;
+        for (std::size_t r = 0; r < k; ++r)
+        {
+            if (r == c)
+                continue;
+            double const factor = augmented[r][c];
+            for (std::size_t j = 0; j < 2 * k; ++j)
+                augmented[r][j] -= factor * augmented[c][j];
+        }
+    }
+
+    std::vector<double> coefficients(k, 0.0);
+    for (std::size_t a = 0; a < k; ++a)
+        for (std::size_t b = 0; b < k; ++b)
+            for (std::size_t r = 0; r < x.size(); ++r)
+                coefficients[a] += augmented[a][k + b] * x[r][b] * target[r];
+
+    double ssr = 0.0;
+    for (std::size_t r = 0; r < x.size(); ++r)
+    {
+        double residual = target[r];
+        for (std::size_t a = 0; a < k; ++a)
+            residual -= x[r][a] * coefficients[a];
+        ssr += residual * residual;
+    }
+
+    double const sigmaSq = ssr / (x.size() - k);
+    return coefficients[0] / std::sqrt(sigmaSq * augmented[0][k]);
+}
+
+// Check the ADF statistic from the normal equations against explicit least squares
+int TestAdf()
+{
+    int errorCount = 0;
+
+    std::mt19937_64 generator(3);
+    std::normal_distribution<double> normal;
+    std::vector<double> y(250);
+    double level = 0.0;
+    for (auto& v : y)
+    {
+        level = 0.95 * level + normal(generator);
+        v = 10.0 + level;
+    }
+
+    Deterministic const deterministics[3] = { Deterministic::NONE, Deterministic::CONSTANT, Deterministic::TREND };
+    AdfWorkspace workspace;
+    for (std::size_t lags = 0; lags < 5; ++lags)
+    {
+        for (auto deterministic : deterministics)
+        {
+            AdfResult const result = AdfTest(y.data(), y.size(), lags, deterministic, workspace);
+            double const expected = ReferenceAdfStatistic(y, lags, deterministic);
+            if (!(std::abs(result.statistic - expected) <= 1e-8 * std::abs(expected)) || result.numObservations != y.size() - 1 - lags)
+            {
+                std::cout << "ADF error. lags=" << lags << ", deterministic=" << static_cast<int>(deterministic)
+                    << ", expected=" << expected << ", actual=" << result.statistic << std::endl;
+                errorCount++;
+            }
+        }
+    }
+
+    // Too short for the regression
+    if (!std::isnan(AdfTest(y.data(), 4, 2, Deterministic::CONSTANT, workspace).statistic))
+    {
+        std::cout << "ADF error. Expected NaN for a series too short to test" << std::endl;
+        errorCount++;
+    }
+
+    return errorCount;
+}
+
+// Check response surface critical values against the Dickey-Fuller and Engle-Granger tables
+int TestCriticalValues()
+{
+    int errorCount = 0;
+
+    struct Case
+    {
+        std::size_t numVariables;
+        Deterministic deterministic;
+        SignificanceLevel level;
+        std::size_t numObservations;
+        double expected;
+    };
+
+    Case const cases[] =
+    {
+        { 1, Deterministic::CONSTANT, SignificanceLevel::FIVE_PERCENT, 100, -2.8909 },
+        { 1, Deterministic::CONSTANT, SignificanceLevel::ONE_PERCENT, 100, -3.4975 },
+        { 1, Deterministic::NONE, SignificanceLevel::FIVE_PERCENT, 1000000, -1.9410 },
+        { 1, Deterministic::TREND, SignificanceLevel::FIVE_PERCENT, 1000000, -3.4105 },
+        { 2, Deterministic::CONSTANT, SignificanceLevel::FIVE_PERCENT, 1000000, -3.3361 },
+        { 2, Deterministic::CONSTANT, SignificanceLevel::TEN_PERCENT, 1000000, -3.0445 },
+    };
+
+    for (auto const& c : cases)
+    {
+        double const actual = MacKinnonCriticalValue(c.numVariables, c.deterministic, c.level, c.numObservations);
+        if (!(std::abs(actual - c.expected) <= 1e-4))
+        {
+            std::cout << "Critical value error. N=" << c.numVariables << ", T=" << c.numObservations
+                << ", expected=" << c.expected << ", actual=" << actual << std::endl;
+            errorCount++;
+        }
+    }
+
+    return errorCount;
+}
+
+// Check a scan of simulated prices finds the planted pairs and their hedge ratios, rejects most
+// independent random walks, and gives the same results on any number of threads
+int TestPairScan()
+{
+    int errorCount = 0;
+
+    std::size_t const numSymbols = 24;
+    std::size_t const numPairs = 4;
+    std::size_t const numObservations = 1000;
+    PriceMatrix const prices = SimulatePriceMatrix(numSymbols, numObservations, numPairs, 7);
+
+    EngleGrangerSettings settings;
+    settings.numThreads = 1;
+    EngleGrangerScanner const scanner(prices);
+    std::vector<PairResult> const results = scanner.Scan(settings);
+    if (results.size() != NumPairs(numSymbols))
+    {
+        std::cout << "Pair scan error. Expected " << NumPairs(numSymbols) << " results" << std::endl;
+        return 1;
+    }
+
+    // Hedge ratios of the planted pairs are checked regressing S(2k+1) on S(2k), as simulated
+    EngleGrangerSettings oneDirection = settings;
+    oneDirection.bothDirections = false;
+    EngleGrangerScanner::Workspace workspace;
+
+    std::size_t falsePositives = 0;
+    for (std::size_t i = 0; i < numSymbols; ++i)
+    {
+        for (std::size_t j = i + 1; j < numSymbols; ++j)
+        {
+            PairResult const& result = results[PairIndex(i, j, numSymbols)];
+            bool const planted = i % 2 == 0 && j == i + 1 && i / 2 < numPairs;
+            bool const rejected = result.statistic < EngleGrangerCriticalValue(SignificanceLevel::FIVE_PERCENT, result.numObservations);
+
+            if (std::min(result.dependent, result.independent) != i || std::max(result.dependent, result.independent) != j)
+            {
+                std::cout << "Pair scan error. Result for (" << i << ", " << j << ") is for (" << result.dependent << ", " << result.independent << ")" << std::endl;
+                errorCount++;
+            }
+
+            if (planted)
+            {
+                // S(2k+1) = 0.5 + beta S(2k) + noise, beta = 0.5 + k / (numPairs - 1)
+                double const beta = 0.5 + static_cast<double>(i / 2) / (numPairs - 1);
+                double const hedgeRatio = scanner.TestPair(i, j, oneDirection, workspace).hedgeRatio;
+                if (!rejected || !(std::abs(hedgeRatio - beta) < 0.1))
+                {
+                    std::cout << "Pair scan error. Planted pair (" << i << ", " << j << ") statistic=" << result.statistic
+                        << ", hedge ratio=" << hedgeRatio << ", expected " << beta << std::endl;
+                    errorCount++;
+                }
+            }
+            else if (rejected)
+                ++falsePositives;
+        }
+    }
+
+    // Taking the better of two directions makes the test somewhat oversized
+    if (falsePositives > (NumPairs(numSymbols) - numPairs) / 8)
+    {
+        std::cout << "Pair scan error. " << falsePositives << " independent pairs found cointegrated at 5%" << std::endl;
+        errorCount++;
+    }
+
+    PairResult const single = scanner.TestPair(0, 1, settings, workspace);
+    if (single.statistic != results[0].statistic || single.hedgeRatio != results[0].hedgeRatio)
+    {
+        std::cout << "Pair scan error. TestPair differs from Scan" << std::endl;
+        errorCount++;
+    }
+
+    settings.numThreads = 3;
+    std::vector<PairResult> const threaded = scanner.Scan(settings);
+    for (std::size_t p = 0; p < results.size(); ++p)
+    {
+        if (threaded[p].statistic != results[p].statistic || threaded[p].dependent != results[p].dependent)
+        {
+            std::cout << "Pair scan error. Threaded result differs for pair " << p << std::endl;
+            errorCount++;
+        }
+    }
+
+    return errorCount;
+}
+
+// Residuals of the columns of y regressed on the columns of x, by Gauss-Jordan elimination
+std::vector<std::vector<double> > ReferenceResiduals(std::vector<std::vector<double> > const& y, std::vector<std::vector<double> > const& x)
+{
+    std::size_t const p = x.size();
+    std::size_t const m = y[0].size();
+    std::vector<std::vector<double> > residuals(y);
+    if (p == 0)
+        return residuals;
+
+    for (auto& target : residuals)
+    {
+        // [X'X | X'y] reduced to [I | coefficients]
+        std::vector<std::vector<double> > augmented(p, std::vector<double>(p + 1, 0.0));
+        for (std::size_t a = 0; a < p; ++a)
+        {
+            for (std::size_t t = 0; t < m; ++t)
+            {
+                for (std::size_t b = 0; b < p; ++b)
+                    augmented[a][b] += x[a][t] * x[b][t];
+                augmented[a][p] += x[a][t] * target[t];
+            }
+        }
+        for (std::size_t c = 0; c < p; ++c)
+        {
+            std::size_t pivot = c;
+            for (std::size_t r = c + 1; r < p; ++r)
+                if (std::abs(augmented[r][c]) > std::abs(augmented[pivot][c]))
+                    pivot = r;
+            std::swap(augmented[c], augmented[pivot]);
+
+            double const diagonal = augmented[c][c];
+            for (auto& v : augmented[c])
+                v /= diagonal;
+            for (std::size_t r = 0; r < p; ++r)
+            {
+                if (r == c)
+                    continue;
+                double const factor = augmented[r][c];
+                for (std::size_t j = 0; j <= p; ++j)
+                    augmented[r][j] -= factor * augmented[c][j];
+            }
+        }
+
+        for (std::size_t t = 0; t < m; ++t)
+            for (std::size_t a = 0; a < p; ++a)
+                target[t] -= augmented[a][p] * x[a][t];
+    }
+
+    return residuals;
+}
+
+// Check Johansen eigenvalues and vectors solve the eigenproblem of residual moments computed directly,
+// for each lag and deterministic setting, and that a basket holding one cointegrated pair has rank one
+int TestJohansen()
+{
+    int errorCount = 0;
+
+    std::size_t const numObservations = 1000;
+    PriceMatrix const prices = SimulatePriceMatrix(6, numObservations, 1, 11);
+    std::size_t const basket[3] = { 0, 1, 4 };
+    std::size_t const n = 3;
+
+    Deterministic const deterministics[3] = { Deterministic::NONE, Deterministic::CONSTANT, Deterministic::TREND };
+    for (std::size_t lags = 0; lags < 3; ++lags)
+    {
+        for (auto deterministic : deterministics)
+        {
+            JohansenSettings settings;
+            settings.lags = lags;
+            settings.deterministic = deterministic;
+            settings.numThreads = 2;
+            JohansenScanner const scanner(prices, settings);
+            JohansenResult const result = scanner.Test(std::vector<std::size_t>(basket, basket + n));
+
+            // Regressions over t = lags + 1 .. T - 1
+            std::size_t const m = numObservations - 1 - lags;
+            std::vector<std::vector<double> > z0(n, std::vector<double>(m)), z1(n, std::vector<double>(m)), z2;
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                double const* y = prices.Column(basket[i]);
+                for (std::size_t t = lags + 1; t < numObservations; ++t)
+                {
+                    z0[i][t - lags - 1] = y[t] - y[t - 1];
+                    z1[i][t - lags - 1] = y[t - 1];
+                }
+                for (std::size_t lag = 1; lag <= lags; ++lag)
+                {
+                    std::vector<double> column(m);
+                    for (std::size_t t = lags + 1; t < numObservations; ++t)
+                        column[t - lags - 1] = y[t - lag] - y[t - lag - 1];
+                    z2.push_back(column);
+                }
+            }
+            for (std::size_t j = 0; j < static_cast<std::size_t>(deterministic); ++j)
+            {
+                std::vector<double> column(m);
+                for (std::size_t t = 0; t < m; ++t)
+                    column[t] = j == 0 ? 1.0 : static_cast<double>(t);
+                z2.push_back(column);
+            }
+
+            std::vector<std::vector<double> > const r0 = ReferenceResiduals(z0, z2);
+            std::vector<std::vector<double> > const r1 = ReferenceResiduals(z1, z2);
+
+            // Moments, with A = S10 S00^-1 S01
+            std::vector<double> s00(n * n), s01(n * n), s11(n * n), a(n * n, 0.0);
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                for (std::size_t j = 0; j < n; ++j)
+                {
+                    s00[i * n + j] = Dot(r0[i].data(), r0[j].data(), m) / m;
+                    s01[i * n + j] = Dot(r0[i].data(), r1[j].data(), m) / m;
+                    s11[i * n + j] = Dot(r1[i].data(), r1[j].data(), m) / m;
+                }
+            }
+            std::vector<double> l00(s00);
+            CholeskyDecompose(l00.data(), n);
+            for (std::size_t j = 0; j < n; ++j)
+            {
+                std::vector<double> column(n);
+                for (std::size_t i = 0; i < n; ++i)
+                    column[i] = s01[i * n + j];
+                CholeskySolve(l00.data(), n, column.data());
+                for (std::size_t i = 0; i < n; ++i)
+                    for (std::size_t k = 0; k < n; ++k)
+                        a[i * n + j] += s01[k * n + i] * column[k];
+            }
+
+            if (result.eigenvalues.size() != n || result.numObservations != m)
+            {
+                std::cout << "Johansen error. lags=" << lags << ", deterministic=" << static_cast<int>(deterministic) << ": no result" << std::endl;
+                errorCount++;
+                continue;
+            }
+
+            // A beta = lambda S11 beta, beta' S11 beta = 1
+            for (std::size_t r = 0; r < n; ++r)
+            {
+                double const lambda = result.eigenvalues[r];
+                double const* beta = &result.vectors[r * n];
+                double residual = 0.0, scale = 0.0, norm = 0.0;
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    double const left = Dot(&a[i * n], beta, n);
+                    double const right = lambda * Dot(&s11[i * n], beta, n);
+                    residual = std::max(residual, std::abs(left - right));
+                    scale = std::max(scale, std::abs(Dot(&s11[i * n], beta, n)));
+                    norm += beta[i] * Dot(&s11[i * n], beta, n);
+                }
+
+                if (!(residual <= 1e-8 * scale) || !(std::abs(norm - 1.0) < 1e-8) || !(lambda >= 0.0 && lambda < 1.0))
+                {
+                    std::cout << "Johansen error. lags=" << lags << ", deterministic=" << static_cast<int>(deterministic)
+                        << ", r=" << r << ", eigenvalue=" << lambda << ", residual=" << residual << ", norm=" << norm << std::endl;
+                    errorCount++;
+                }
+            }
+
+            // Trace of S11^-1 A is the sum of eigenvalues
+            std::vector<double> l11(s11);
+            CholeskyDecompose(l11.data(), n);
+            double trace = 0.0, sum = 0.0;
+            for (std::size_t j = 0; j < n; ++j)
+            {
+                std::vector<double> column(n);
+                for (std::size_t i = 0; i < n; ++i)
+                    column[i] = a[i * n + j];
+                CholeskySolve(l11.data(), n, column.data());
+                trace += column[j];
+                sum += result.eigenvalues[j];
+            }
+
+            double const trace0 = -static_cast<double>(m) * (std::log1p(-result.eigenvalues[0]) + std::log1p(-result.eigenvalues[1]) + std::log1p(-result.eigenvalues[2]));
+            if (!(std::abs(trace - sum) < 1e-9) || !(std::abs(result.traceStatistics[0] - trace0) < 1e-9 * trace0) ||
+                result.traceStatistics[2] != result.maxEigenStatistics[2])
+            {
+                std::cout << "Johansen error. lags=" << lags << ", deterministic=" << static_cast<int>(deterministic)
+                    << ", eigenvalue sum=" << sum << ", expected " << trace << std::endl;
+                errorCount++;
+            }
+
+            // One cointegrating relation among two random walks and a cointegrated pair
+            if (deterministic == Deterministic::CONSTANT && !(result.traceStatistics[0] > 35.0 && result.traceStatistics[1] < 25.0))
+            {
+                std::cout << "Johansen error. lags=" << lags << ", trace statistics " << result.traceStatistics[0] << ", "
+                    << result.traceStatistics[1] << " do not show rank one" << std::endl;
+                errorCount++;
+            }
+        }
+    }
+
+    return errorCount;
+}
+
+// Check combination ranking and the parallel top basket scan against testing every basket
+int TestBasketScan()
+{
+    int errorCount = 0;
+
+    if (BinomialCoefficient(30, 12) != 86493225 || BinomialCoefficient(5, 6) != 0)
+    {
+        std::cout << "Basket scan error. Binomial coefficients" << std::endl;
+        errorCount++;
+    }
+
+    std::size_t const numSymbols = 9, size = 3;
+    std::vector<std::size_t> combination(size), unranked(size);
+    CombinationFromRank(0, numSymbols, size, combination.data());
+    std::vector<std::vector<std::size_t> > baskets;
+    std::uint64_t rank = 0;
+    do
+    {
+        CombinationFromRank(rank++, numSymbols, size, unranked.data());
+        if (unranked != combination)
+        {
+            std::cout << "Basket scan error. Combination of rank " << rank - 1 << " differs from enumeration" << std::endl;
+            errorCount++;
+        }
+        baskets.push_back(combination);
+    } while (NextCombination(combination.data(), numSymbols, size));
+
+    if (rank != BinomialCoefficient(numSymbols, size))
+    {
+        std::cout << "Basket scan error. Enumerated " << rank << " combinations" << std::endl;
+        errorCount++;
+    }
+
+    PriceMatrix const prices = SimulatePriceMatrix(numSymbols, 500, 2, 13);
+    JohansenSettings settings;
+    settings.numThreads = 1;
+    JohansenScanner const scanner(prices, settings);
+    std::vector<JohansenResult> all = scanner.TestBaskets(baskets);
+    std::stable_sort(all.begin(), all.end(), [] (JohansenResult const& x, JohansenResult const& y)
+    {
+        return x.traceStatistics[0] > y.traceStatistics[0];
+    });
+
+    std::size_t const top = 10;
+    std::vector<JohansenResult> const serial = scanner.ScanCombinations(size, top);
+    settings.numThreads = 3;
+    std::vector<JohansenResult> const threaded = JohansenScanner(prices, settings).ScanCombinations(size, top);
+    if (serial.size() != top || threaded.size() != top)
+    {
+        std::cout << "Basket scan error. Expected " << top << " baskets" << std::endl;
+        return errorCount + 1;
+    }
+
+    for (std::size_t i = 0; i < top; ++i)
+    {
+        if (serial[i].basket != all[i].basket || threaded[i].basket != all[i].basket || threaded[i].traceStatistics != all[i].traceStatistics)
+        {
+            std::cout << "Basket scan error. Basket " << i << " differs from testing all baskets" << std::endl;
+            errorCount++;
+        }
+    }
+
+    // The strongest baskets hold a planted pair, (0, 1) or (2, 3)
+    auto const holds = [] (std::vector<std::size_t> const& basket, std::size_t a, std::size_t b)
+    {
+        return std::count(basket.begin(), basket.end(), a) + std::count(basket.begin(), basket.end(), b) == 2;
+    };
+    if (!holds(serial[0].basket, 0, 1) && !holds(serial[0].basket, 2, 3))
+    {
+        std::cout << "Basket scan error. Top basket holds no cointegrated pair" << std::endl;
+        errorCount++;
+    }
+
+    return errorCount;
+}
+
+// Check rolling statistics against full Engle-Granger tests of each window, after many updates and
+// refreshes of the running sums, and the pair monitor against single pairs
+int TestRolling()
+{
+    int errorCount = 0;
+
+    std::size_t const numObservations = 1500;
+    std::size_t const window = 250;
+    PriceMatrix const prices = SimulatePriceMatrix(4, numObservations, 1, 17);
+    double const* x = prices.Column(0);
+    double const* y = prices.Column(1);
+
+    auto const close = [] (double actual, double expected, double tolerance)
+    {
+        return std::abs(actual - expected) <= tolerance * std::max(1.0, std::abs(expected));
+    };
+
+    for (std::size_t lags = 0; lags < 3; ++lags)
+    {
+        RollingCointegration rolling(window, lags);
+        AdfWorkspace adfWorkspace;
+        EngleGrangerSettings settings;
+        settings.lags = lags;
+        settings.bothDirections = false;
+        EngleGrangerScanner::Workspace workspace;
+
+        for (std::size_t t = 0; t < numObservations; ++t)
+        {
+            rolling.Update(x[t], y[t]);
+            if (t % 97 != 0 && t != window - 1)
+                continue;
+
+            // The window so far, as a two column price matrix
+            std::size_t const begin = t + 1 > window ? t + 1 - window : 0;
+            PriceMatrix pair;
+            pair.numObservations = t + 1 - begin;
+            pair.symbols.push_back("x");
+            pair.symbols.push_back("y");
+            pair.logPrices.assign(x + begin, x + t + 1);
+            pair.logPrices.insert(pair.logPrices.end(), y + begin, y + t + 1);
+
+            RollingStatistics const statistics = rolling.Statistics(adfWorkspace);
+            if (pair.numObservations < lags + 5)
+            {
+                if (!std::isnan(statistics.adfStatistic))
+                {
+                    std::cout << "Rolling error. Statistics before the window holds enough observations" << std::endl;
+                    errorCount++;
+                }
+                continue;
+            }
+
+            PairResult const expected = EngleGrangerScanner(pair).TestPair(0, 1, settings, workspace);
+            double const residual = y[t] - expected.intercept - expected.hedgeRatio * x[t];
+            if (!close(statistics.hedgeRatio, expected.hedgeRatio, 1e-9) || !close(statistics.intercept, expected.intercept, 1e-9) ||
+                !close(statistics.spreadStd, expected.spreadStd, 1e-8) || !close(statistics.adfStatistic, expected.statistic, 1e-7) ||
+                !close(statistics.zScore, residual / expected.spreadStd, 1e-7) || statistics.numObservations != expected.numObservations)
+            {
+                std::cout << "Rolling error. lags=" << lags << ", t=" << t << ", hedge ratio=" << statistics.hedgeRatio << " (" << expected.hedgeRatio
+                    << "), ADF=" << statistics.adfStatistic << " (" << expected.statistic << "), z=" << statistics.zScore << " ("
+                    << residual / expected.spreadStd << ")" << std::endl;
+                errorCount++;
+            }
+        }
+    }
+
+    // Monitor of (1 on 0) and (3 on 2) against single pairs
+    std::vector<std::pair<std::size_t, std::size_t> > pairs;
+    pairs.push_back(std::make_pair(1, 0));
+    pairs.push_back(std::make_pair(3, 2));
+    RollingPairMonitor monitor(pairs, 100);
+    RollingCointegration single(100);
+    AdfWorkspace adfWorkspace;
+    std::vector<double> bar(prices.NumSymbols());
+    for (std::size_t t = 0; t < 300; ++t)
+    {
+        for (std::size_t s = 0; s < bar.size(); ++s)
+            bar[s] = prices.Column(s)[t];
+        monitor.Update(bar.data());
+        single.Update(bar[2], bar[3]);
+    }
+
+    if (monitor.Statistics(1).adfStatistic != single.Statistics(adfWorkspace).adfStatistic)
+    {
+        std::cout << "Rolling error. Monitor differs from a single pair" << std::endl;
+        errorCount++;
+    }
+
+    return errorCount;
+}
+
+// Check the CSV reader takes logs, drops incomplete rows and selects symbols
+int TestPriceCsv()
+{
+    int errorCount = 0;
+
+    std::istringstream csv(
+        "date,AAA,BBB,CCC\r\n"
+        "2014-01-02,1,2,4\r\n"
+        "2014-01-03,2,,8\r\n"
+        "2014-01-06,4,8,16\r\n");
+    std::size_t dropped = 0;
+    PriceMatrix const prices = ReadPriceCsv(csv, &dropped);
+    if (prices.NumSymbols() != 3 || prices.numObservations != 2 || dropped != 1 || prices.symbols[2] != "CCC")
+    {
+        std::cout << "Price CSV error. Read " << prices.NumSymbols() << " symbols, " << prices.numObservations << " rows, dropped " << dropped << std::endl;
+        return 1;
+    }
+
+    // Same prices through a column store, where the incomplete date is dropped as well
+    std::string const path = "coint_test_store.bin";
+    {
+        std::istringstream again(csv.str());
+        ColumnStoreWriter writer;
+        writer.AddCsv(again);
+        writer.Write(path);
+    }
+    {
+        PriceMatrix const stored = ReadPriceStore(ColumnStore(path), std::vector<std::string>(), &dropped);
+        if (stored.symbols != prices.symbols || stored.logPrices != prices.logPrices || dropped != 1)
+        {
+            std::cout << "Price CSV error. Column store differs" << std::endl;
+            errorCount++;
+        }
+    }
+    std::remove(path.c_str());
+
+    std::istringstream universe("Company,Symbol\nCharlie,CCC\nAlpha,AAA\n");
+    PriceMatrix const selected = SelectSymbols(prices, ReadSymbolList(universe));
+    if (selected.NumSymbols() != 2 || !(std::abs(selected.Column(0)[1] - std::log(16.0)) < 1e-15) || !(std::abs(selected.Column(1)[0]) < 1e-15))
+    {
+        std::cout << "Price CSV error. Symbol selection" << std::endl;
+        errorCount++;
+    }
+
+    return errorCount;
+}
+
+// Check Philox against the known answers of Random123, simulations against MacKinnon and the cache round trip
+int TestSimulatedCriticalValues()
+{
+    int errorCount = 0;
+
+    std::uint32_t const counters[3][4] = { { 0, 0, 0, 0 }, { 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu },
+        { 0x243f6a88u, 0x85a308d3u, 0x13198a2eu, 0x03707344u } };
+    std::uint32_t const keys[3][2] = { { 0, 0 }, { 0xffffffffu, 0xffffffffu }, { 0xa4093822u, 0x299f31d0u } };
+    std::uint32_t const answers[3][4] = { { 0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u },
+        { 0x408f276du, 0x41c83b0eu, 0xa20bc7c6u, 0x6d5451fdu }, { 0xd16cfe09u, 0x94fdccebu, 0x5001e420u, 0x24126ea1u } };
+    for (int i = 0; i < 3; ++i)
+    {
+        std::uint32_t out[4];
+        Philox4x32::Generate(counters[i], keys[i], out);
+        if (!std::equal(out, out + 4, answers[i]))
+        {
+            std::cout << "Simulation error. Philox known answer " << i << std::endl;
+            errorCount++;
+        }
+    }
+
+    // Samples do not depend on the number of threads
+    SimulationSettings settings;
+    settings.test = SimulatedTest::ENGLE_GRANGER;
+    settings.numVariables = 2;
+    settings.numObservations = 200;
+    if (SimulateStatistics(settings, 300, 7, 1) != SimulateStatistics(settings, 300, 7, 3))
+    {
+        std::cout << "Simulation error. Samples depend on the threads" << std::endl;
+        errorCount++;
+    }
+
+    // Dickey-Fuller with a constant at T = 500: MacKinnon gives -2.867 at 5%
+    SimulationSettings adf;
+    adf.numObservations = 500;
+    adf.lags = 0;
+    std::vector<CriticalValueTable> const tables = SimulateCriticalValues(adf, 20000, 11);
+    double const fivePercent = tables[0].Quantile(0.05);
+    double const expected = MacKinnonCriticalValue(1, Deterministic::CONSTANT, SignificanceLevel::FIVE_PERCENT, 500);
+    if (!(std::abs(fivePercent - expected) < 0.05))
+    {
+        std::cout << "Simulation error. ADF 5% " << fivePercent << " expected " << expected << std::endl;
+        errorCount++;
+    }
+
+    // Johansen trace of two driftless walks with an unrestricted constant: the 5% value lies between those
+    // tabulated for walks with drift (15.4) and for a restricted constant (20.0) by Osterwald-Lenum
+    SimulationSettings johansen;
+    johansen.test = SimulatedTest::JOHANSEN;
+    johansen.numVariables = 2;
+    johansen.numObservations = 400;
+    std::string const path = "coint_critical_values_test.csv";
+    std::remove(path.c_str());
+    double trace = 0.0;
+    {
+        CriticalValueCache cache(path);
+        trace = cache.Get(johansen, "trace", 4000, 3).Quantile(0.95);
+        if (!(trace > 15.4 && trace < 20.0) || cache.Size() != 2)
+        {
+            std::cout << "Simulation error. Johansen trace 5% " << trace << " with " << cache.Size() << " tables" << std::endl;
+            errorCount++;
+        }
+    }
+
+    CriticalValueCache reloaded(path);
+    CriticalValueTable const* cached = reloaded.Find(johansen, "max-eigen", 4000);
+    if (reloaded.Size() != 2 || cached == nullptr || reloaded.Find(johansen, "trace", 4000)->Quantile(0.95) != trace ||
+        reloaded.Find(johansen, "trace", 4001) != nullptr)
+    {
+        std::cout << "Simulation error. Cache round trip" << std::endl;
+        errorCount++;
+    }
+    std::remove(path.c_str());
+
+    return errorCount;
+}
+
+int main()
+{
+    std::cout << "Testing inner products" << std::endl;
+    int c0 = TestDot();
+    if (c0 == 0)
+        std::cout << "Inner product tests passed!" << std::endl;
+    else
+        std::cout << "Inner product tests failed! " << c0 << " errors" << std::endl;
+
+    std::cout << "Testing Cholesky" << std::endl;
+    int c1 = TestCholesky();
+    if (c1 == 0)
+        std::cout << "Cholesky tests passed!" << std::endl;
+    else
+        std::cout << "Cholesky tests failed! " << c1 << " errors" << std::endl;
+
+    std::cout << "Testing ADF" << std::endl;
+    int c2 = TestAdf();
+    if (c2 == 0)
+        std::cout << "ADF tests passed!" << std::endl;
+    else
+        std::cout << "ADF tests failed! " << c2 << " errors" << std::endl;
+
+    std::cout << "Testing critical values" << std::endl;
+    int c3 = TestCriticalValues();
+    if (c3 == 0)
+        std::cout << "Critical value tests passed!" << std::endl;
+    else
+        std::cout << "Critical value tests failed! " << c3 << " errors" << std::endl;
+
+    std::cout << "Testing pair scan" << std::endl;
+    int c4 = TestPairScan();
+    if (c4 == 0)
+        std::cout << "Pair scan tests passed!" << std::endl;
+    else
+        std::cout << "Pair scan tests failed! " << c4 << " errors" << std::endl;
+
+    std::cout << "Testing price CSV" << std::endl;
+    int c5 = TestPriceCsv();
+    if (c5 == 0)
+        std::cout << "Price CSV tests passed!" << std::endl;
+    else
+        std::cout << "Price CSV tests failed! " << c5 << " errors" << std::endl;
+
+    std::cout << "Testing Gram matrix" << std::endl;
+    int c6 = TestGramMatrix();
+    if (c6 == 0)
+        std::cout << "Gram matrix tests passed!" << std::endl;
+    else
+        std::cout << "Gram matrix tests failed! " << c6 << " errors" << std::endl;
+
+    std::cout << "Testing symmetric eigen" << std::endl;
+    int c7 = TestSymmetricEigen();
+    if (c7 == 0)
+        std::cout << "Symmetric eigen tests passed!" << std::endl;
+    else
+        std::cout << "Symmetric eigen tests failed! " << c7 << " errors" << std::endl;
+
+    std::cout << "Testing Johansen" << std::endl;
+    int c8 = TestJohansen();
+    if (c8 == 0)
+        std::cout << "Johansen tests passed!" << std::endl;
+    else
+        std::cout << "Johansen tests failed! " << c8 << " errors" << std::endl;
+
+    std::cout << "Testing basket scan" << std::endl;
+    int c9 = TestBasketScan();
+    if (c9 == 0)
+        std::cout << "Basket scan tests passed!" << std::endl;
+    else
+        std::cout << "Basket scan tests failed! " << c9 << " errors" << std::endl;
+
+    std::cout << "Testing rolling statistics" << std::endl;
+    int c10 = TestRolling();
+    if (c10 == 0)
+        std::cout << "Rolling statistics tests passed!" << std::endl;
+    else
+        std::cout << "Rolling statistics tests failed! " << c10 << " errors" << std::endl;
+
+    std::cout << "Testing simulated critical values" << std::endl;
+    int c11 = TestSimulatedCriticalValues();
+    if (c11 == 0)
+        std::cout << "Simulated critical value tests passed!" << std::endl;
+    else
+        std::cout << "Simulated critical value tests failed! " << c11 << " errors" << std::endl;
+
+    return c0 + c1 + c2 + c3 + c4 + c5 + c6 + c7 + c8 + c9 + c10 + c11;
+}
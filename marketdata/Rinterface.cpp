@@ -0,0 +1,101 @@
+#include <Rcpp.h>
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "columnStore.hpp"
+
+using namespace Rcpp;
+using namespace CqfProject;
+
+// Days since the epoch of an R Date, or the whole range if NA
+std::int32_t ToDays(double date, std::int32_t missing)
+{
+    return std::isnan(date) ? missing : static_cast<std::int32_t>(std::floor(date));
+}
+
+// Log returns of the symbols (all if none given) between consecutive dates in [from, to] where all of
+// them are priced. The matrix is filled straight from the mapped columns, with the symbols as column
+// names and the Date of each return in attribute "dates".
+// [[Rcpp::export]]
+NumericMatrix CppReadLogReturns(
+    std::string path,
+    CharacterVector symbols = CharacterVector::create(),
+    double from = NA_REAL,
+    double to = NA_REAL)
+{
+    ColumnStore const store(path);
+
+    std::vector<std::string> names = as<std::vector<std::string> >(symbols);
+    if (names.empty())
+        for (std::size_t c = 0; c < store.NumSymbols(); ++c)
+            names.push_back(store.Symbol(c));
+
+    std::vector<std::size_t> const columns = store.Columns(names);
+    std::vector<std::size_t> const rows = store.CompleteRows(columns,
+        ToDays(from, std::numeric_limits<std::int32_t>::min()), ToDays(to, std::numeric_limits<std::int32_t>::max()));
+    std::size_t const numReturns = rows.size() < 2 ? 0 : rows.size() - 1;
+
+    NumericMatrix returns(static_cast<int>(numReturns), static_cast<int>(columns.size()));
+    store.LogReturns(columns, rows, returns.begin());
+
+    NumericVector dates(numReturns);
+    for (std::size_t t = 0; t < numReturns; ++t)
+        dates[t] = store.Dates()[rows[t + 1]];
+    dates.attr("class") = "Date";
+
+    colnames(returns) = wrap(names);
+    returns.attr("dates") = dates;
+    return returns;
+}
+
+// Symbols of a store with the number of dates they are priced on
+// [[Rcpp::export]]
+DataFrame CppColumnStoreSymbols(std::string path)
+{
+    ColumnStore const store(path);
+    CharacterVector symbols(store.NumSymbols());
+    IntegerVector counts(store.NumSymbols());
+    for (std::size_t c = 0; c < store.NumSymbols(); ++c)
+    {
+        symbols[c] = store.Symbol(c);
+        double const* prices = store.Prices(c);
+        for (std::size_t t = 0; t < store.NumDates(); ++t)
+            counts[c] += prices[t] > 0.0;
+    }
+
+    return DataFrame::create(_["symbol"] = symbols, _["prices"] = counts, _["stringsAsFactors"] = false);
+}
+
+// Writes the series of the symbols, dates[[i]] and prices[[i]] for symbols[i], to the store in one pass,
+// keeping the prices of other symbols and dates already in it when append is true. NA prices are missing.
+// [[Rcpp::export]]
+void CppWriteColumnStore(std::string path, CharacterVector symbols, List dates, List prices, bool append = true)
+{
+    if (dates.size() != symbols.size() || prices.size() != symbols.size())
+        stop("one series of dates and prices per symbol expected");
+
+    ColumnStoreWriter writer;
+    if (append && std::ifstream(path.c_str()))
+        writer = ColumnStoreWriter(ColumnStore(path));
+
+    for (R_xlen_t s = 0; s < symbols.size(); ++s)
+    {
+        NumericVector const seriesDates = dates[s];
+        NumericVector const seriesPrices = prices[s];
+        if (seriesDates.size() != seriesPrices.size())
+            stop("one date per price expected for " + as<std::string>(symbols[s]));
+
+        std::vector<std::int32_t> days(seriesDates.size());
+        for (R_xlen_t t = 0; t < seriesDates.size(); ++t)
+            days[t] = static_cast<std::int32_t>(std::floor(seriesDates[t]));
+
+        writer.Add(as<std::string>(symbols[s]), days, seriesPrices.begin());
+    }
+
+    writer.Write(path);
+}
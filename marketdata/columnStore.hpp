@@ -0,0 +1,607 @@
+#ifndef MARKETDATA_COLUMN_STORE_HPP
+#define MARKETDATA_COLUMN_STORE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace CqfProject
+{
+    // Columnar store of daily adjusted closes: one date axis shared by all symbols, and one contiguous
+    // column of prices per symbol, NaN where a symbol has no price for a date. The file is mapped into
+    // memory and read in place, so opening a store of thousands of symbols costs a page fault per
+    // column touched rather than a parse.
+    //
+    // Layout, native byte order, sections aligned to 64 bytes:
+    //     header        ColumnStoreHeader
+    //     dates         int32[numDates], days since 1970-01-01 (R's Date), ascending
+    //     names         char[numSymbols][COLUMN_STORE_NAME_LENGTH], NUL padded, in column order
+    //     index         uint32[numSymbols], columns sorted by name
+    //     prices        double[numSymbols][columnStride], column major
+    struct ColumnStoreHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t nameLength;
+        std::uint64_t numDates;
+        std::uint64_t numSymbols;
+        std::uint64_t columnStride;
+        std::uint64_t namesOffset;
+        std::uint64_t indexOffset;
+        std::uint64_t pricesOffset;
+    };
+
+    static char const COLUMN_STORE_MAGIC[8] = { 'C', 'Q', 'F', 'C', 'O', 'L', 'S', '\0' };
+    static std::uint32_t const COLUMN_STORE_VERSION = 1;
+    static std::size_t const COLUMN_STORE_NAME_LENGTH = 24;
+    static std::size_t const COLUMN_STORE_ALIGNMENT = 64;
+
+    // Days since 1970-01-01 of a proleptic Gregorian date (H. Hinnant, "chrono-compatible low-level
+    // date algorithms")
+    inline std::int32_t DaysFromCivil(int year, unsigned month, unsigned day)
+    {
+        year -= month <= 2;
+        int const era = (year >= 0 ? year : year - 399) / 400;
+        unsigned const yearOfEra = static_cast<unsigned>(year - era * 400);
+        unsigned const dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        unsigned const dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        return era * 146097 + static_cast<int>(dayOfEra) - 719468;
+    }
+
+    inline void CivilFromDays(std::int32_t days, int& year, unsigned& month, unsigned& day)
+    {
+        days += 719468;
+        int const era = (days >= 0 ? days : days - 146096) / 146097;
+        unsigned const dayOfEra = static_cast<unsigned>(days - era * 146097);
+        unsigned const yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        unsigned const dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        unsigned const mp = (5 * dayOfYear + 2) / 153;
+        day = dayOfYear - (153 * mp + 2) / 5 + 1;
+        month = mp < 10 ? mp + 3 : mp - 9;
+        year = static_cast<int>(yearOfEra) + era * 400 + (month <= 2);
+    }
+
+    // Date of YYYY-MM-DD or YYYY/MM/DD, with an optional time after it; false if not a valid date
+    inline bool ParseDate(std::string const& text, std::int32_t& days)
+    {
+        int year = 0;
+        unsigned month = 0, day = 0;
+        char separator1 = 0, separator2 = 0;
+        if (std::sscanf(text.c_str(), "%d%c%u%c%u", &year, &separator1, &month, &separator2, &day) != 5 ||
+            separator1 != separator2 || (separator1 != '-' && separator1 != '/') || month < 1 || month > 12 || day < 1 || day > 31)
+            return false;
+
+        days = DaysFromCivil(year, month, day);
+        int checkYear;
+        unsigned checkMonth, checkDay;
+        CivilFromDays(days, checkYear, checkMonth, checkDay);
+        return checkDay == day;
+    }
+
+    inline std::string FormatDate(std::int32_t days)
+    {
+        int year;
+        unsigned month, day;
+        CivilFromDays(days, year, month, day);
+        char buffer[16];
+        std::snprintf(buffer, sizeof(buffer), "%04d-%02u-%02u", year, month, day);
+        return buffer;
+    }
+
+    // Read only mapping of a whole file, released on destruction
+    class MappedFile
+    {
+    public:
+        MappedFile()
+            : mData(nullptr)
+            , mSize(0)
+        {}
+
+        explicit MappedFile(std::string const& path)
+            : MappedFile()
+        {
+#ifndef _WIN32
+            int const fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("failed to open " + path);
+
+            struct stat status;
+            if (::fstat(fd, &status) != 0)
+            {
+                ::close(fd);
+                throw std::runtime_error("failed to stat " + path);
+            }
+
+            mSize = static_cast<std::size_t>(status.st_size);
+            if (mSize != 0)
+            {
+                void* const data = ::mmap(nullptr, mSize, PROT_READ, MAP_SHARED, fd, 0);
+                if (data == MAP_FAILED)
+                {
+                    ::close(fd);
+                    throw std::runtime_error("failed to map " + path);
+                }
+                mData = static_cast<char const*>(data);
+            }
+            ::close(fd);
+#else
+            // No mapping without POSIX; the file is read once instead
+            std::ifstream file(path.c_str(), std::ios::binary);
+            if (!file)
+                throw std::runtime_error("failed to open " + path);
+            mBuffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            mData = mBuffer.data();
+            mSize = mBuffer.size();
+#endif
+        }
+
+        MappedFile(MappedFile&& other)
+            : mData(other.mData)
+            , mSize(other.mSize)
+#ifdef _WIN32
+            , mBuffer(std::move(other.mBuffer))
+#endif
+        {
+            other.mData = nullptr;
+            other.mSize = 0;
+        }
+
+        MappedFile& operator=(MappedFile&& other)
+        {
+            if (this != &other)
+            {
+                Release();
+                mData = other.mData;
+                mSize = other.mSize;
+#ifdef _WIN32
+                mBuffer = std::move(other.mBuffer);
+#endif
+                other.mData = nullptr;
+                other.mSize = 0;
+            }
+            return *this;
+        }
+
+        MappedFile(MappedFile const&) = delete;
+        MappedFile& operator=(MappedFile const&) = delete;
+
+        ~MappedFile()
+        {
+            Release();
+        }
+
+        char const* Data() const
+        {
+            return mData;
+        }
+
+        std::size_t Size() const
+        {
+            return mSize;
+        }
+
+    private:
+        void Release()
+        {
+#ifndef _WIN32
+            if (mData != nullptr)
+                ::munmap(const_cast<char*>(mData), mSize);
+#endif
+            mData = nullptr;
+            mSize = 0;
+        }
+
+        char const* mData;
+        std::size_t mSize;
+#ifdef _WIN32
+        std::vector<char> mBuffer;
+#endif
+    };
+
+    // Reader of a store file. Pointers it returns stay valid while it is alive.
+    class ColumnStore
+    {
+    public:
+        static std::size_t const npos = static_cast<std::size_t>(-1);
+
+        explicit ColumnStore(std::string const& path)
+            : mFile(path)
+            , mHeader(nullptr)
+        {
+            if (mFile.Size() < sizeof(ColumnStoreHeader))
+                throw std::runtime_error(path + " is not a column store");
+
+            mHeader = reinterpret_cast<ColumnStoreHeader const*>(mFile.Data());
+            if (std::memcmp(mHeader->magic, COLUMN_STORE_MAGIC, sizeof(COLUMN_STORE_MAGIC)) != 0)
+                throw std::runtime_error(path + " is not a column store");
+            if (mHeader->version != COLUMN_STORE_VERSION || mHeader->nameLength != COLUMN_STORE_NAME_LENGTH)
+                throw std::runtime_error(path + " has an unsupported column store version");
+
+            // Section ends in 64 bits, any overflow treated as past the end of the file
+            std::uint64_t datesEnd, namesEnd, indexEnd, columnBytes, pricesEnd;
+            if (!MultiplyAdd(mHeader->numDates, sizeof(std::int32_t), sizeof(ColumnStoreHeader), datesEnd) ||
+                !MultiplyAdd(mHeader->numSymbols, COLUMN_STORE_NAME_LENGTH, mHeader->namesOffset, namesEnd) ||
+                !MultiplyAdd(mHeader->numSymbols, sizeof(std::uint32_t), mHeader->indexOffset, indexEnd) ||
+                !MultiplyAdd(mHeader->columnStride, sizeof(double), 0, columnBytes) ||
+                !MultiplyAdd(mHeader->numSymbols, columnBytes, mHeader->pricesOffset, pricesEnd) ||
+                mHeader->columnStride < mHeader->numDates || mHeader->namesOffset < datesEnd ||
+                mHeader->indexOffset < namesEnd || mHeader->pricesOffset < indexEnd || pricesEnd > mFile.Size())
+                throw std::runtime_error(path + " is truncated");
+
+            // Find trusts the index to name columns of the store
+            std::uint32_t const* const index = Index();
+            for (std::size_t i = 0; i < NumSymbols(); ++i)
+                if (index[i] >= mHeader->numSymbols)
+                    throw std::runtime_error(path + " has a corrupt symbol index");
+        }
+
+        std::size_t NumDates() const
+        {
+            return static_cast<std::size_t>(mHeader->numDates);
+        }
+
+        std::size_t NumSymbols() const
+        {
+            return static_cast<std::size_t>(mHeader->numSymbols);
+        }
+
+        // Days since 1970-01-01, ascending
+        std::int32_t const* Dates() const
+        {
+            return reinterpret_cast<std::int32_t const*>(mFile.Data() + sizeof(ColumnStoreHeader));
+        }
+
+        std::string Symbol(std::size_t column) const
+        {
+            char const* name = Name(column);
+            return std::string(name, std::find(name, name + COLUMN_STORE_NAME_LENGTH, '\0'));
+        }
+
+        // Column of the symbol by binary search of the index, or npos
+        std::size_t Find(std::string const& symbol) const
+        {
+            if (symbol.size() > COLUMN_STORE_NAME_LENGTH)
+                return npos;
+
+            char key[COLUMN_STORE_NAME_LENGTH] = {};
+            std::memcpy(key, symbol.data(), symbol.size());
+
+            std::uint32_t const* index = Index();
+            std::uint32_t const* const end = index + NumSymbols();
+            std::uint32_t const* const found = std::lower_bound(index, end, key, [this] (std::uint32_t column, char const* name)
+            {
+                return std::memcmp(Name(column), name, COLUMN_STORE_NAME_LENGTH) < 0;
+            });
+
+            return found != end && std::memcmp(Name(*found), key, COLUMN_STORE_NAME_LENGTH) == 0 ? *found : npos;
+        }
+
+        // Columns of the symbols, in their order. Throws if any is missing.
+        std::vector<std::size_t> Columns(std::vector<std::string> const& symbols) const
+        {
+            std::vector<std::size_t> columns;
+            columns.reserve(symbols.size());
+            for (auto const& symbol : symbols)
+            {
+                std::size_t const column = Find(symbol);
+                if (column == npos)
+                    throw std::runtime_error("no prices for symbol " + symbol);
+                columns.push_back(column);
+            }
+            return columns;
+        }
+
+        // Prices of one symbol for every date, NaN where missing
+        double const* Prices(std::size_t column) const
+        {
+            return reinterpret_cast<double const*>(mFile.Data() + mHeader->pricesOffset) + column * mHeader->columnStride;
+        }
+
+        // Rows with dates in [firstDate, lastDate] where all the columns have a positive price
+        std::vector<std::size_t> CompleteRows(std::vector<std::size_t> const& columns,
+            std::int32_t firstDate = std::numeric_limits<std::int32_t>::min(), std::int32_t lastDate = std::numeric_limits<std::int32_t>::max()) const
+        {
+            std::int32_t const* const dates = Dates();
+            std::size_t const begin = std::lower_bound(dates, dates + NumDates(), firstDate) - dates;
+            std::size_t const end = std::upper_bound(dates, dates + NumDates(), lastDate) - dates;
+
+            std::vector<unsigned char> complete(end > begin ? end - begin : 0, 1);
+            for (std::size_t column : columns)
+            {
+                double const* prices = Prices(column);
+                for (std::size_t t = begin; t < end; ++t)
+                    complete[t - begin] &= prices[t] > 0.0;
+            }
+
+            std::vector<std::size_t> rows;
+            for (std::size_t t = begin; t < end; ++t)
+                if (complete[t - begin])
+                    rows.push_back(t);
+            return rows;
+        }
+
+        // Log prices of the rows, column major into out, rows.size() per column
+        void LogPrices(std::vector<std::size_t> const& columns, std::vector<std::size_t> const& rows, double* out) const
+        {
+            for (std::size_t c = 0; c < columns.size(); ++c)
+            {
+                double const* prices = Prices(columns[c]);
+                double* column = out + c * rows.size();
+                for (std::size_t t = 0; t < rows.size(); ++t)
+                    column[t] = std::log(prices[rows[t]]);
+            }
+        }
+
+        // Log returns between consecutive rows, column major into out, rows.size() - 1 per column. Row t
+        // of the result is the return to rows[t + 1].
+        void LogReturns(std::vector<std::size_t> const& columns, std::vector<std::size_t> const& rows, double* out) const
+        {
+            if (rows.size() < 2)
+                return;
+
+            std::size_t const numReturns = rows.size() - 1;
+            for (std::size_t c = 0; c < columns.size(); ++c)
+            {
+                double const* prices = Prices(columns[c]);
+                double* column = out + c * numReturns;
+                double previous = std::log(prices[rows[0]]);
+                for (std::size_t t = 0; t < numReturns; ++t)
+                {
+                    double const current = std::log(prices[rows[t + 1]]);
+                    column[t] = current - previous;
+                    previous = current;
+                }
+            }
+        }
+
+    private:
+        char const* Name(std::size_t column) const
+        {
+            return mFile.Data() + mHeader->namesOffset + column * COLUMN_STORE_NAME_LENGTH;
+        }
+
+        std::uint32_t const* Index() const
+        {
+            return reinterpret_cast<std::uint32_t const*>(mFile.Data() + mHeader->indexOffset);
+        }
+
+        // result = a * b + c, false if that overflows
+        static bool MultiplyAdd(std::uint64_t a, std::uint64_t b, std::uint64_t c, std::uint64_t& result)
+        {
+            std::uint64_t const max = std::numeric_limits<std::uint64_t>::max();
+            if (b != 0 && a > (max - c) / b)
+                return false;
+            result = a * b + c;
+            return true;
+        }
+
+        MappedFile mFile;
+        ColumnStoreHeader const* mHeader;
+    };
+
+    // Builds a store in memory from series and wide CSV files, then writes it. Prices added later for
+    // the same symbol and date replace earlier ones, so a store can be updated by reading it back,
+    // adding recent prices and writing it again.
+    class ColumnStoreWriter
+    {
+    public:
+        ColumnStoreWriter()
+        {}
+
+        explicit ColumnStoreWriter(ColumnStore const& store)
+        {
+            std::vector<std::int32_t> const dates(store.Dates(), store.Dates() + store.NumDates());
+            for (std::size_t c = 0; c < store.NumSymbols(); ++c)
+                Add(store.Symbol(c), dates, store.Prices(c));
+        }
+
+        // Prices of a symbol on the dates; missing or non-positive prices are skipped
+        void Add(std::string const& symbol, std::vector<std::int32_t> const& dates, double const* prices)
+        {
+            std::map<std::int32_t, double>& series = mSeries[SeriesIndex(symbol)];
+            for (std::size_t t = 0; t < dates.size(); ++t)
+                if (prices[t] > 0.0 && std::isfinite(prices[t]))
+                    series[dates[t]] = prices[t];
+        }
+
+        // Wide CSV of prices as coint-scan reads it (date,SYM1,SYM2,... then one row per date), with dates
+        // as YYYY-MM-DD. Empty, NA or non-positive fields are missing. Returns the number of prices added.
+        std::size_t AddCsv(std::istream& is)
+        {
+            std::vector<std::string> fields;
+            std::string line;
+            if (!std::getline(is, line))
+                throw std::runtime_error("price file is empty");
+
+            SplitLine(line, fields);
+            if (fields.size() < 2)
+                throw std::runtime_error("price file header has no symbols");
+
+            std::vector<std::size_t> series;
+            for (std::size_t s = 1; s < fields.size(); ++s)
+                series.push_back(SeriesIndex(fields[s]));
+
+            std::size_t added = 0;
+            std::size_t lineNumber = 1;
+            while (std::getline(is, line))
+            {
+                ++lineNumber;
+                if (line.empty() || line == "\r")
+                    continue;
+
+                SplitLine(line, fields);
+                std::int32_t date;
+                if (fields.size() != series.size() + 1 || !ParseDate(fields[0], date))
+                {
+                    std::ostringstream os;
+                    os << "line " << lineNumber << ": expected a date and " << series.size() << " prices";
+                    throw std::runtime_error(os.str());
+                }
+
+                for (std::size_t s = 0; s < series.size(); ++s)
+                {
+                    char const* begin = fields[s + 1].c_str();
+                    char* end = nullptr;
+                    double const price = std::strtod(begin, &end);
+                    if (end != begin && *end == '\0' && price > 0.0 && std::isfinite(price))
+                    {
+                        mSeries[series[s]][date] = price;
+                        ++added;
+                    }
+                }
+            }
+
+            return added;
+        }
+
+        std::size_t NumSymbols() const
+        {
+            return mSymbols.size();
+        }
+
+        // Writes to a temporary file and renames it, so readers mapping the old file are not disturbed
+        void Write(std::string const& path) const
+        {
+            std::vector<std::int32_t> dates;
+            for (auto const& series : mSeries)
+                for (auto const& price : series)
+                    dates.push_back(price.first);
+            std::sort(dates.begin(), dates.end());
+            dates.erase(std::unique(dates.begin(), dates.end()), dates.end());
+
+            std::size_t const numSymbols = mSymbols.size();
+            ColumnStoreHeader header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, COLUMN_STORE_MAGIC, sizeof(COLUMN_STORE_MAGIC));
+            header.version = COLUMN_STORE_VERSION;
+            header.nameLength = COLUMN_STORE_NAME_LENGTH;
+            header.numDates = dates.size();
+            header.numSymbols = numSymbols;
+            header.columnStride = Align(dates.size() * sizeof(double)) / sizeof(double);
+            header.namesOffset = Align(sizeof(ColumnStoreHeader) + dates.size() * sizeof(std::int32_t));
+            header.indexOffset = Align(header.namesOffset + numSymbols * COLUMN_STORE_NAME_LENGTH);
+            header.pricesOffset = Align(header.indexOffset + numSymbols * sizeof(std::uint32_t));
+
+            std::vector<char> names(numSymbols * COLUMN_STORE_NAME_LENGTH, '\0');
+            for (std::size_t c = 0; c < numSymbols; ++c)
+                std::memcpy(&names[c * COLUMN_STORE_NAME_LENGTH], mSymbols[c].data(), mSymbols[c].size());
+
+            std::vector<std::uint32_t> index(numSymbols);
+            for (std::size_t c = 0; c < numSymbols; ++c)
+                index[c] = static_cast<std::uint32_t>(c);
+            std::sort(index.begin(), index.end(), [&] (std::uint32_t a, std::uint32_t b)
+            {
+                return std::memcmp(&names[a * COLUMN_STORE_NAME_LENGTH], &names[b * COLUMN_STORE_NAME_LENGTH], COLUMN_STORE_NAME_LENGTH) < 0;
+            });
+
+            std::string const temporary = path + ".tmp";
+            {
+                std::ofstream file(temporary.c_str(), std::ios::binary | std::ios::trunc);
+                if (!file)
+                    throw std::runtime_error("failed to create " + temporary);
+
+                file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+                file.write(reinterpret_cast<char const*>(dates.data()), dates.size() * sizeof(std::int32_t));
+                Pad(file, header.namesOffset);
+                file.write(names.data(), names.size());
+                Pad(file, header.indexOffset);
+                file.write(reinterpret_cast<char const*>(index.data()), index.size() * sizeof(std::uint32_t));
+                Pad(file, header.pricesOffset);
+
+                std::vector<double> column(static_cast<std::size_t>(header.columnStride));
+                for (auto const& series : mSeries)
+                {
+                    std::fill(column.begin(), column.end(), std::numeric_limits<double>::quiet_NaN());
+                    std::size_t t = 0;
+                    for (auto const& price : series)
+                    {
+                        while (dates[t] < price.first)
+                            ++t;
+                        column[t] = price.second;
+                    }
+                    file.write(reinterpret_cast<char const*>(column.data()), column.size() * sizeof(double));
+                }
+
+                if (!file)
+                    throw std::runtime_error("failed to write " + temporary);
+            }
+
+            if (std::rename(temporary.c_str(), path.c_str()) != 0)
+            {
+                std::remove(temporary.c_str());
+                throw std::runtime_error("failed to replace " + path);
+            }
+        }
+
+    private:
+        static std::uint64_t Align(std::uint64_t offset)
+        {
+            return (offset + COLUMN_STORE_ALIGNMENT - 1) / COLUMN_STORE_ALIGNMENT * COLUMN_STORE_ALIGNMENT;
+        }
+
+        static void Pad(std::ofstream& file, std::uint64_t offset)
+        {
+            static char const zeros[COLUMN_STORE_ALIGNMENT] = {};
+            std::uint64_t const position = static_cast<std::uint64_t>(file.tellp());
+            file.write(zeros, static_cast<std::streamsize>(offset - position));
+        }
+
+        static void SplitLine(std::string const& line, std::vector<std::string>& fields)
+        {
+            fields.clear();
+            std::istringstream is(line);
+            std::string field;
+            while (std::getline(is, field, ','))
+                fields.push_back(field);
+            if (!line.empty() && line.back() == ',')
+                fields.push_back(std::string());
+
+            // Tolerate CRLF files
+            if (!fields.empty() && !fields.back().empty() && fields.back().back() == '\r')
+                fields.back().pop_back();
+        }
+
+        std::size_t SeriesIndex(std::string const& symbol)
+        {
+            if (symbol.empty() || symbol.size() > COLUMN_STORE_NAME_LENGTH)
+                throw std::runtime_error("symbol '" + symbol + "' is empty or too long");
+
+            auto const found = mColumns.find(symbol);
+            if (found != mColumns.end())
+                return found->second;
+
+            mColumns[symbol] = mSymbols.size();
+            mSymbols.push_back(symbol);
+            mSeries.push_back(std::map<std::int32_t, double>());
+            return mSymbols.size() - 1;
+        }
+
+        std::vector<std::string> mSymbols;
+        std::unordered_map<std::string, std::size_t> mColumns;
+        std::vector<std::map<std::int32_t, double> > mSeries;
+    };
+}
+
+#endif
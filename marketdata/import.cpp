@@ -0,0 +1,137 @@
+#include "columnStore.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace CqfProject;
+
+// marketdata-import: builds or updates a column store from wide CSV files of adjusted closes
+// (date,SYM1,SYM2,... with YYYY-MM-DD dates), aligning all symbols on the union of their dates. With
+// --list, prints the symbols of a store with their first and last dates instead.
+
+void PrintUsage()
+{
+    std::cerr
+        << "Usage: marketdata-import [options] STORE [FILE...]" << std::endl
+        << "Imports wide CSVs of prices (date,SYM1,SYM2,...) into the column store STORE, or stdin if no FILE or -" << std::endl
+        << "  --append              keep the prices already in STORE, replacing those of the same date" << std::endl
+        << "  --list                print symbol,first,last,prices of STORE and exit" << std::endl;
+}
+
+int List(std::string const& path)
+{
+    ColumnStore const store(path);
+    std::int32_t const* const dates = store.Dates();
+
+    std::cout << "symbol,first,last,prices" << std::endl;
+    for (std::size_t c = 0; c < store.NumSymbols(); ++c)
+    {
+        double const* prices = store.Prices(c);
+        std::size_t first = store.NumDates(), last = 0, count = 0;
+        for (std::size_t t = 0; t < store.NumDates(); ++t)
+        {
+            if (prices[t] > 0.0)
+            {
+                first = std::min(first, t);
+                last = t;
+                ++count;
+            }
+        }
+
+        std::cout << store.Symbol(c) << ',' << (count != 0 ? FormatDate(dates[first]) : "") << ','
+            << (count != 0 ? FormatDate(dates[last]) : "") << ',' << count << '\n';
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    bool append = false, list = false;
+    std::string storePath;
+    std::vector<std::string> inputs;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const arg = argv[i];
+        if (arg == "--append")
+            append = true;
+        else if (arg == "--list")
+            list = true;
+        else if (arg == "-" || arg.compare(0, 2, "--") != 0)
+        {
+            if (storePath.empty())
+                storePath = arg;
+            else
+                inputs.push_back(arg);
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (storePath.empty() || (list && (append || !inputs.empty())))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        if (list)
+            return List(storePath);
+
+        ColumnStoreWriter writer;
+        if (append)
+        {
+            std::ifstream existing(storePath.c_str());
+            if (existing)
+                writer = ColumnStoreWriter(ColumnStore(storePath));
+        }
+
+        if (inputs.empty())
+            inputs.push_back("-");
+
+        std::size_t added = 0;
+        for (auto const& input : inputs)
+        {
+            try
+            {
+                if (input == "-")
+                    added += writer.AddCsv(std::cin);
+                else
+                {
+                    std::ifstream file(input.c_str());
+                    if (!file)
+                        throw std::runtime_error("failed to open");
+                    added += writer.AddCsv(file);
+                }
+            }
+            catch (std::exception const& e)
+            {
+                std::cerr << (input == "-" ? "stdin" : input) << ": " << e.what() << std::endl;
+                return 1;
+            }
+        }
+
+        writer.Write(storePath);
+
+        ColumnStore const store(storePath);
+        std::cerr << "Imported " << added << " prices; " << storePath << " has " << store.NumSymbols() << " symbols over "
+            << store.NumDates() << " dates" << std::endl;
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,191 @@
+#include "columnStore.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace CqfProject;
+
+// Check date conversion against known days since the epoch, and that invalid dates are rejected
+int TestDates()
+{
+    int errorCount = 0;
+
+    struct Case
+    {
+        char const* text;
+        std::int32_t days;
+    };
+    Case const cases[] = { { "1970-01-01", 0 }, { "2000-03-01", 11017 }, { "2009/01/02", 14246 }, { "1969-12-31", -1 } };
+    for (auto const& c : cases)
+    {
+        std::int32_t days = 0;
+        if (!ParseDate(c.text, days) || days != c.days || FormatDate(days) != std::string(c.text).replace(4, 1, "-").replace(7, 1, "-"))
+        {
+            std::cout << "Date error. " << c.text << " gave " << days << std::endl;
+            errorCount++;
+        }
+    }
+
+    std::int32_t days = 0;
+    if (ParseDate("2013-02-29", days) || ParseDate("2013-13-01", days) || ParseDate("Date", days))
+    {
+        std::cout << "Date error. Invalid date accepted" << std::endl;
+        errorCount++;
+    }
+
+    return errorCount;
+}
+
+// Check CSV import aligns symbols on the union of dates, and the store reads back and updates
+int TestColumnStore()
+{
+    int errorCount = 0;
+    std::string const path = "marketdata_test_store.bin";
+
+    {
+        ColumnStoreWriter writer;
+        std::istringstream first(
+            "Date,MMM,AXP\r\n"
+            "2014-01-02,100,50\r\n"
+            "2014-01-03,110,NA\r\n"
+            "2014-01-06,121,55\r\n");
+        std::istringstream second(
+            "Date,T\n"
+            "2014-01-03,30\n"
+            "2014-01-06,33\n"
+            "2014-01-07,36.3\n");
+        std::size_t const added = writer.AddCsv(first) + writer.AddCsv(second);
+        if (added != 8)
+        {
+            std::cout << "Store error. Imported " << added << " prices" << std::endl;
+            errorCount++;
+        }
+        writer.Write(path);
+    }
+
+    {
+        ColumnStore const store(path);
+        if (store.NumSymbols() != 3 || store.NumDates() != 4 || store.Symbol(2) != "T" || FormatDate(store.Dates()[3]) != "2014-01-07")
+        {
+            std::cout << "Store error. Read " << store.NumSymbols() << " symbols over " << store.NumDates() << " dates" << std::endl;
+            return errorCount + 1;
+        }
+
+        if (store.Find("AXP") != 1 || store.Find("MMM") != 0 || store.Find("T") != 2 || store.Find("IBM") != ColumnStore::npos ||
+            !std::isnan(store.Prices(1)[1]) || !std::isnan(store.Prices(0)[3]))
+        {
+            std::cout << "Store error. Symbol index or missing prices" << std::endl;
+            errorCount++;
+        }
+
+        // MMM and T are both priced on 01-03 and 01-06 only
+        std::vector<std::size_t> const columns = store.Columns(std::vector<std::string>{ "T", "MMM" });
+        std::vector<std::size_t> const rows = store.CompleteRows(columns);
+        std::vector<double> returns(columns.size() * (rows.size() - 1));
+        store.LogReturns(columns, rows, returns.data());
+        if (rows.size() != 2 || rows[0] != 1 || !(std::abs(returns[0] - std::log(1.1)) < 1e-15) || !(std::abs(returns[1] - std::log(1.1)) < 1e-15))
+        {
+            std::cout << "Store error. Log returns of complete rows" << std::endl;
+            errorCount++;
+        }
+
+        std::int32_t first = 0;
+        ParseDate("2014-01-03", first);
+        if (store.CompleteRows(std::vector<std::size_t>{ 0 }, first).size() != 2)
+        {
+            std::cout << "Store error. Date range" << std::endl;
+            errorCount++;
+        }
+
+        // Update from the mapped store, replacing one price and adding a date
+        ColumnStoreWriter writer(store);
+        std::istringstream update("Date,MMM\n2014-01-06,120\n2014-01-08,125\n");
+        writer.AddCsv(update);
+        writer.Write(path);
+    }
+
+    ColumnStore const updated(path);
+    if (updated.NumDates() != 5 || updated.Prices(0)[2] != 120.0 || updated.Prices(2)[3] != 36.3 || updated.Prices(0)[4] != 125.0)
+    {
+        std::cout << "Store error. Update" << std::endl;
+        errorCount++;
+    }
+
+    // Headers whose sections overflow or whose index names missing columns are rejected when opened
+    std::string bytes;
+    {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    std::uint64_t const hugeStride = std::uint64_t(1) << 61;
+    std::uint32_t const badColumn = 7;
+    std::string overflowing = bytes;
+    std::memcpy(&overflowing[offsetof(ColumnStoreHeader, columnStride)], &hugeStride, sizeof(hugeStride));
+    std::string badIndex = bytes;
+    std::uint64_t indexOffset = 0;
+    std::memcpy(&indexOffset, &bytes[offsetof(ColumnStoreHeader, indexOffset)], sizeof(indexOffset));
+    std::memcpy(&badIndex[indexOffset], &badColumn, sizeof(badColumn));
+
+    for (std::string const* corrupt : { &overflowing, &badIndex })
+    {
+        {
+            std::ofstream file(path.c_str(), std::ios::binary);
+            file.write(corrupt->data(), corrupt->size());
+        }
+
+        try
+        {
+            ColumnStore const store(path);
+            std::cout << "Store error. Corrupt header accepted" << std::endl;
+            errorCount++;
+        }
+        catch (std::runtime_error const&)
+        {
+        }
+    }
+
+    std::remove(path.c_str());
+
+    std::istringstream malformed("Date,MMM\nyesterday,100\n");
+    try
+    {
+        ColumnStoreWriter().AddCsv(malformed);
+        std::cout << "Store error. Malformed date accepted" << std::endl;
+        errorCount++;
+    }
+    catch (std::runtime_error const&)
+    {
+    }
+
+    return errorCount;
+}
+
+int main()
+{
+    std::cout << "Testing dates" << std::endl;
+    int c0 = TestDates();
+    if (c0 == 0)
+        std::cout << "Date tests passed!" << std::endl;
+    else
+        std::cout << "Date tests failed! " << c0 << " errors" << std::endl;
+
+    std::cout << "Testing column store" << std::endl;
+    int c1 = TestColumnStore();
+    if (c1 == 0)
+        std::cout << "Column store tests passed!" << std::endl;
+    else
+        std::cout << "Column store tests failed! " << c1 << " errors" << std::endl;
+
+    return c0 + c1;
+}
@@ -0,0 +1,23 @@
+#ifndef THIRDPARTY_NLOPT_THREADS_HPP
+#define THIRDPARTY_NLOPT_THREADS_HPP
+
+#include <nlopt.h>
+
+#include <mutex>
+
+namespace CqfProject
+{
+    // nlopt_optimize seeds nlopt's global generator on first use, unless seeded already. Without
+    // THREADLOCAL (as the vendored CMake build configures it) that write races when the first
+    // optimizations start on several threads together, so call this once before starting them.
+    // SLSQP, MMA, Nelder-Mead, subplex, COBYLA and BOBYQA keep all other state in their nlopt_opt, and
+    // are safe to run concurrently on separate objects; MMA only saves and restores its global verbosity
+    // flag around each dual solve, which stays 0 unless set.
+    inline void SeedNloptOnce()
+    {
+        static std::once_flag seeded;
+        std::call_once(seeded, [] () { nlopt_srand(20140101); });
+    }
+}
+
+#endif
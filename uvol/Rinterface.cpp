@@ -1,74 +1,21 @@
 #include <Rcpp.h>
 
+#include <memory>
 #include <stdexcept>
 
+#include "batchValuation.hpp"
 #include "finiteDifferencePricer.hpp"
 #include "blackScholes.hpp"
+#include "impliedVolatility.hpp"
+#include "Rinterface.hpp"
 
 using namespace Rcpp;
 using namespace CqfProject;
 
-Side ToSide(std::string const& s)
-{
-    if (s == "bid")
-        return Side::BID;
-    else if (s == "ask")
-        return Side::ASK;
-    else
-        throw std::runtime_error("invalid side");
-}
-
-Interpolation ToInterpolation(std::string const& s)
-{
-    if (s == "linear")
-        return Interpolation::LINEAR;
-    else if (s == "cubic")
-        return Interpolation::CUBIC;
-    else
-        throw std::runtime_error("invalid interpolation");
-}
-
-PayoffSampling ToPayoffSampling(std::string const& s)
-{
-    if (s == "point")
-        return PayoffSampling::POINT;
-    else if (s == "interval")
-        return PayoffSampling::INTERVAL;
-    else
-        throw std::runtime_error("invalid payoff sampling");
-}
-
-
-template<typename StringType>
-OptionContract::Type ToContractType(StringType s)
-{
-    if (s == "call")
-        return OptionContract::Type::CALL;
-    else if (s == "bcall")
-        return OptionContract::Type::BINARY_CALL;
-    else if (s == "put")
-        return OptionContract::Type::PUT;
-    else if (s == "bput")
-        return OptionContract::Type::BINARY_PUT;
-    else
-        throw std::runtime_error("invalid contract type");
-}
-
 void PopulateContracts(FiniteDifferencePricer& pricer, DataFrame const& options)
 {
-    CharacterVector type = options["type"];
-    NumericVector expiry = options["expiry"];
-    NumericVector qty = options["qty"];
-    NumericVector strike = options["strike"];
-
-    int const count = options.nrows();
-    for (int i = 0; i < count; ++i)
-        pricer.AddContract(
-            OptionContract(
-                ToContractType(type[i]),
-                expiry[i],
-                strike[i],
-                qty[i]));
+    PortfolioColumns const columns(options);
+    pricer.SetContracts(columns.View());
 }
 
 // [[Rcpp::export]]
@@ -118,6 +65,151 @@ List CppPriceEuropeanUncertainVol(
     }
 }
 
+// Price the options portfolio once per row of a matrix of quantities (columns in options row order),
+// in parallel. threads = 0 uses all hardware threads.
+// [[Rcpp::export]]
+NumericVector CppPriceEuropeanUncertainVolMatrix(
+    DataFrame options,
+    NumericMatrix quantities,
+    double minVol,
+    double maxVol,
+    double riskFreeRate,
+    double underlyingPrice,
+    std::string side,
+    int priceSteps,
+    double maxPrice,
+    std::string interpolation = "cubic",
+    std::string payoffSampling = "interval",
+    int threads = 0)
+{
+    if (quantities.ncol() != options.nrows())
+        throw std::runtime_error("quantity matrix must have one column per option");
+
+    FiniteDifferencePricer pricer(
+        minVol,
+        maxVol,
+        riskFreeRate,
+        maxPrice,
+        priceSteps,
+        ToPayoffSampling(payoffSampling),
+        ToInterpolation(interpolation));
+
+    PopulateContracts(pricer, options);
+
+    NumericVector values(quantities.nrow());
+    ValuateQuantityMatrix(
+        pricer,
+        underlyingPrice,
+        ToSide(side),
+        quantities.begin(),
+        quantities.nrow(),
+        values.begin(),
+        static_cast<unsigned>(std::max(threads, 0)));
+
+    return values;
+}
+
+// Persistent pricer handles. The pricer is owned by the external pointer and deleted by
+// CppFreePricer, or by R's garbage collector if never freed explicitly.
+typedef XPtr<FiniteDifferencePricer> PricerHandle;
+
+FiniteDifferencePricer& GetPricer(PricerHandle const& handle)
+{
+    FiniteDifferencePricer* pricer = handle.get();
+    if (pricer == nullptr)
+        throw std::runtime_error("pricer has been freed");
+
+    return *pricer;
+}
+
+// [[Rcpp::export]]
+PricerHandle CppCreateUncertainVolPricer(
+    DataFrame options,
+    double minVol,
+    double maxVol,
+    double riskFreeRate,
+    int priceSteps,
+    double maxPrice,
+    std::string interpolation = "cubic",
+    std::string payoffSampling = "interval")
+{
+    std::unique_ptr<FiniteDifferencePricer> pricer(
+        new FiniteDifferencePricer(
+            minVol,
+            maxVol,
+            riskFreeRate,
+            maxPrice,
+            priceSteps,
+            ToPayoffSampling(payoffSampling),
+            ToInterpolation(interpolation)));
+
+    PopulateContracts(*pricer, options);
+
+    return PricerHandle(pricer.release(), true);
+}
+
+// [[Rcpp::export]]
+void CppSetPricerContracts(PricerHandle pricer, DataFrame options)
+{
+    PopulateContracts(GetPricer(pricer), options);
+}
+
+// Update contract quantities in place, in the row order of the options the pricer was created with
+// [[Rcpp::export]]
+void CppSetPricerQuantities(PricerHandle pricer, NumericVector qty)
+{
+    FiniteDifferencePricer& p = GetPricer(pricer);
+    if (static_cast<std::size_t>(qty.size()) != p.GetContractCount())
+        throw std::runtime_error("quantity count does not match contract count");
+
+    p.SetMultipliers(qty.begin());
+}
+
+// [[Rcpp::export]]
+double CppValuatePricer(PricerHandle pricer, double underlyingPrice, std::string side)
+{
+    return GetPricer(pricer).Valuate(underlyingPrice, ToSide(side));
+}
+
+// Time per phase of the pricer's valuations since creation or the last reset, as a data frame of
+// phase, ticks and calls. Ticks are in the unit attribute; all zero unless compiled with UVOL_PHASE_PROFILING.
+// [[Rcpp::export]]
+DataFrame CppPricerPhaseProfile(PricerHandle pricer, bool reset = false)
+{
+    FiniteDifferencePricer& p = GetPricer(pricer);
+    PhaseProfile const& profile = p.GetPhaseProfile();
+
+    CharacterVector phases(NUM_PHASES);
+    NumericVector ticks(NUM_PHASES);
+    NumericVector calls(NUM_PHASES);
+    for (int i = 0; i < NUM_PHASES; ++i)
+    {
+        Phase const phase = static_cast<Phase>(i);
+        phases[i] = PhaseName(phase);
+        ticks[i] = static_cast<double>(profile.GetTicks(phase));
+        calls[i] = static_cast<double>(profile.GetCount(phase));
+    }
+
+    if (reset)
+        p.ResetPhaseProfile();
+
+    DataFrame result = DataFrame::create(
+        Named("phase") = phases,
+        Named("ticks") = ticks,
+        Named("calls") = calls,
+        Named("stringsAsFactors") = false);
+    result.attr("unit") = PhaseTickUnit();
+    result.attr("enabled") = IsPhaseProfilingEnabled();
+    return result;
+}
+
+// [[Rcpp::export]]
+void CppFreePricer(PricerHandle pricer)
+{
+    delete pricer.get();
+    R_ClearExternalPtr(pricer);
+}
+
 // [[Rcpp::export]]
 double CppPriceEuropeanBS(
     DataFrame options,
@@ -125,33 +217,64 @@ double CppPriceEuropeanBS(
     double riskFreeRate,
     double underlyingPrice)
 {
-    CharacterVector type = options["type"];
-    NumericVector expiry = options["expiry"];
-    NumericVector qty = options["qty"];
-    NumericVector strike = options["strike"];
+    PortfolioColumns const columns(options);
+    return BlackScholesPortfolio(columns.View(), vol, riskFreeRate, underlyingPrice);
+}
+
+
+// [[Rcpp::export]]
+NumericVector CppImpliedVolatility(
+    DataFrame quotes,
+    double riskFreeRate,
+    double underlyingPrice,
+    int iterations = 4)
+{
+    // Quotes share the contract columns, with price in place of quantity
+    PortfolioColumns const columns(quotes, "price");
+    PortfolioView const view = columns.View();
 
-    int const count = options.nrows();
-    double sum = 0.0;
+    int const count = quotes.nrows();
+    std::vector<OptionType> types(count);
     for (int i = 0; i < count; ++i)
-    {
-        double const T = expiry[i];
-        double const K = strike[i];
-        double const q = qty[i];
-
-        PutCallPair const putCall = BlackScholesPutCall(vol, riskFreeRate, T, underlyingPrice, K);
-
-        if (type[i] == "call")
-            sum += q * putCall.call;
-        else if (type[i] == "put")
-            sum += q * putCall.put;
-        else if (type[i] == "bcall")
-            sum += q * BlackScholesBinaryCall(vol, riskFreeRate, T, underlyingPrice, K);
-        else if (type[i] == "bput")
-            sum += q * BlackScholesBinaryPut(vol, riskFreeRate, T, underlyingPrice, K);
-        else
-            throw std::runtime_error("Invalid option type");
-    }
+        types[i] = view.GetType(i);
 
-    return sum;
+    NumericVector vols(count);
+    ImpliedVolatility(
+        types.data(),
+        view.expiries,
+        view.strikes,
+        view.quantities,
+        vols.begin(),
+        count,
+        riskFreeRate,
+        underlyingPrice,
+        iterations);
+
+    return vols;
 }
 
+// [[Rcpp::export]]
+NumericVector CppVolatilityBand(
+    NumericVector vols,
+    NumericVector expiries,
+    double minExpiry,
+    double maxExpiry,
+    double lowerQuantile = 0.0,
+    double upperQuantile = 1.0)
+{
+    if (vols.size() != expiries.size())
+        throw std::runtime_error("vols and expiries must have the same length");
+
+    VolatilityBand const band = SelectVolatilityBand(
+        vols.begin(),
+        expiries.begin(),
+        vols.size(),
+        minExpiry,
+        maxExpiry,
+        lowerQuantile,
+        upperQuantile);
+
+    return NumericVector::create(
+        _["minVol"] = band.minVol,
+        _["maxVol"] = band.maxVol);
+}
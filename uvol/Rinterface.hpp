@@ -0,0 +1,152 @@
+#ifndef UVOL_RINTERFACE_HPP
+#define UVOL_RINTERFACE_HPP
+
+#include <Rcpp.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "finiteDifferencePricer.hpp"
+#include "optionContract.hpp"
+
+// Conversions from R arguments, shared by the Rcpp modules (Rinterface.cpp, and RinterfaceHedgeSearch.cpp,
+// which is built separately as only it links nlopt)
+
+namespace CqfProject
+{
+    inline Side ToSide(std::string const& s)
+    {
+        if (s == "bid")
+            return Side::BID;
+        else if (s == "ask")
+            return Side::ASK;
+        else
+            throw std::runtime_error("invalid side");
+    }
+
+    inline Interpolation ToInterpolation(std::string const& s)
+    {
+        if (s == "linear")
+            return Interpolation::LINEAR;
+        else if (s == "cubic")
+            return Interpolation::CUBIC;
+        else
+            throw std::runtime_error("invalid interpolation");
+    }
+
+    inline PayoffSampling ToPayoffSampling(std::string const& s)
+    {
+        if (s == "point")
+            return PayoffSampling::POINT;
+        else if (s == "interval")
+            return PayoffSampling::INTERVAL;
+        else
+            throw std::runtime_error("invalid payoff sampling");
+    }
+
+    template<typename StringType>
+    inline OptionContract::Type ToContractType(StringType s)
+    {
+        if (s == "call")
+            return OptionContract::Type::CALL;
+        else if (s == "bcall")
+            return OptionContract::Type::BINARY_CALL;
+        else if (s == "put")
+            return OptionContract::Type::PUT;
+        else if (s == "bput")
+            return OptionContract::Type::BINARY_PUT;
+        else
+            throw std::runtime_error("invalid contract type");
+    }
+
+    // Columns of an options data frame (type, expiry, strike, qty), held for the lifetime of their PortfolioView.
+    // Numeric columns are used in place. Types given as a factor with levels in OptionType order
+    // (see ContractTypeFactor in utility.R) or as 1-based integer codes, like factor codes, are also used in place;
+    // other factors are remapped per level, and character columns fall back to per row string conversion.
+    class PortfolioColumns
+    {
+    public:
+        PortfolioColumns(Rcpp::DataFrame const& options, char const* quantityColumn = "qty")
+            : mExpiry(options["expiry"])
+            , mStrike(options["strike"])
+            , mQuantity(options[quantityColumn])
+            , mTypeCodeBase(0)
+        {
+            Rcpp::RObject const type = options["type"];
+            int const count = options.nrows();
+
+            if (Rf_isFactor(type))
+            {
+                Rcpp::CharacterVector levels = type.attr("levels");
+                Rcpp::IntegerVector const codes(type);
+
+                bool canonical = levels.size() <= NUM_OPTION_TYPES;
+                for (int j = 0; canonical && j < levels.size(); ++j)
+                    canonical = ToContractType(levels[j]) == static_cast<OptionType>(j);
+
+                if (canonical)
+                {
+                    mTypeCodes = codes;
+                    mTypeCodeBase = 1;
+                    CheckNoMissingTypes();
+                }
+                else
+                {
+                    std::vector<int> levelCodes(levels.size());
+                    for (int j = 0; j < levels.size(); ++j)
+                        levelCodes[j] = static_cast<int>(ToContractType(levels[j]));
+
+                    mTypeCodes = Rcpp::IntegerVector(count);
+                    for (int i = 0; i < count; ++i)
+                    {
+                        if (codes[i] == NA_INTEGER)
+                            throw std::runtime_error("invalid contract type");
+                        mTypeCodes[i] = levelCodes[codes[i] - 1];
+                    }
+                }
+            }
+            else if (TYPEOF(type) == INTSXP)
+            {
+                mTypeCodes = Rcpp::IntegerVector(type);
+                mTypeCodeBase = 1;
+                CheckNoMissingTypes();
+            }
+            else
+            {
+                Rcpp::CharacterVector names(type);
+                mTypeCodes = Rcpp::IntegerVector(count);
+                for (int i = 0; i < count; ++i)
+                    mTypeCodes[i] = static_cast<int>(ToContractType(names[i]));
+            }
+        }
+
+        PortfolioView View() const
+        {
+            return PortfolioView(
+                mTypeCodes.size(),
+                mTypeCodes.begin(),
+                mTypeCodeBase,
+                mExpiry.begin(),
+                mStrike.begin(),
+                mQuantity.begin());
+        }
+
+    private:
+        // Codes used in place must not be NA, which would underflow when the base is taken off
+        void CheckNoMissingTypes() const
+        {
+            for (int const code : mTypeCodes)
+                if (code == NA_INTEGER)
+                    throw std::runtime_error("invalid contract type");
+        }
+
+        Rcpp::NumericVector mExpiry;
+        Rcpp::NumericVector mStrike;
+        Rcpp::NumericVector mQuantity;
+        Rcpp::IntegerVector mTypeCodes;
+        int mTypeCodeBase;
+    };
+}
+
+#endif
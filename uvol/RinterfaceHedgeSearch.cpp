@@ -0,0 +1,129 @@
+#include <Rcpp.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "hedgeSearch.hpp"
+#include "Rinterface.hpp"
+
+// The hedge search, built apart from Rinterface.cpp as it links nlopt (see LoadHedgeSearch in
+// optimization.R), so the pricing functions build without it
+
+using namespace Rcpp;
+using namespace CqfProject;
+
+nlopt_algorithm ToLocalAlgorithm(std::string const& s)
+{
+    if (s == "neldermead")
+        return NLOPT_LN_NELDERMEAD;
+    else if (s == "sbplx")
+        return NLOPT_LN_SBPLX;
+    else if (s == "bobyqa")
+        return NLOPT_LN_BOBYQA;
+    else if (s == "cobyla")
+        return NLOPT_LN_COBYLA;
+    else
+        throw std::runtime_error("invalid local algorithm");
+}
+
+// Best static hedges of the exotic portfolio for each number of hedges from minHedges to maxHedges, searched
+// in parallel over subsets of the candidate hedges (options columns with price, the market price per unit,
+// in place of qty). Returns one row per number of hedges and side (bid then ask), with the 1-based rows of
+// the candidates used and their quantities as list columns.
+// [[Rcpp::export]]
+List CppSearchHedges(
+    DataFrame exotic,
+    DataFrame candidates,
+    double minVol,
+    double maxVol,
+    double riskFreeRate,
+    double underlyingPrice,
+    int steps1,
+    int steps2,
+    double maxPrice,
+    int minHedges = 1,
+    int maxHedges = 2,
+    int starts = 4,
+    double minQuantity = -1.0,
+    double maxQuantity = 1.0,
+    int maxSubsets = 2000,
+    int beamWidth = 20,
+    std::string algorithm = "neldermead",
+    int maxit = 1000,
+    std::string interpolation = "cubic",
+    std::string payoffSampling = "interval",
+    int threads = 0)
+{
+    PortfolioColumns const exoticColumns(exotic);
+    PortfolioView const exoticView = exoticColumns.View();
+    std::vector<OptionContract> exoticContracts;
+    for (std::size_t i = 0; i < exoticView.size; ++i)
+        exoticContracts.push_back(exoticView.GetContract(i));
+
+    PortfolioColumns const candidateColumns(candidates, "price");
+    PortfolioView const candidateView = candidateColumns.View();
+    std::vector<OptionContract> candidateContracts;
+    for (std::size_t i = 0; i < candidateView.size; ++i)
+        candidateContracts.push_back(candidateView.GetContract(i));
+    std::vector<Real> const candidatePrices(candidateView.quantities, candidateView.quantities + candidateView.size);
+
+    if (minHedges < 0 || maxHedges < minHedges || starts < 1 || maxSubsets < 1 || beamWidth < 1 || maxit < 1)
+        throw std::runtime_error("invalid hedge search settings");
+
+    HedgeSearchSettings settings;
+    settings.steps1 = steps1;
+    settings.steps2 = steps2;
+    settings.maxPrice = maxPrice;
+    settings.payoffSampling = ToPayoffSampling(payoffSampling);
+    settings.interpolation = ToInterpolation(interpolation);
+    settings.minHedges = minHedges;
+    settings.maxHedges = maxHedges;
+    settings.numStarts = starts;
+    settings.minQuantity = minQuantity;
+    settings.maxQuantity = maxQuantity;
+    settings.maxSubsets = maxSubsets;
+    settings.beamWidth = beamWidth;
+    settings.algorithm = ToLocalAlgorithm(algorithm);
+    settings.maxEvaluations = maxit;
+    settings.numThreads = static_cast<unsigned>(std::max(threads, 0));
+
+    HedgeSearch search(exoticContracts, candidateContracts, candidatePrices, minVol, maxVol, riskFreeRate, underlyingPrice, settings);
+    std::vector<HedgeResult> const results = search.Search();
+
+    int const count = static_cast<int>(results.size());
+    CharacterVector side(count);
+    IntegerVector hedges(count);
+    NumericVector value(count);
+    IntegerVector evaluations(count);
+    IntegerVector status(count);
+    List rows(count);
+    List quantities(count);
+    for (int i = 0; i < count; ++i)
+    {
+        HedgeResult const& result = results[i];
+        side[i] = result.side == Side::BID ? "bid" : "ask";
+        hedges[i] = static_cast<int>(result.hedges.size());
+        value[i] = result.value;
+        evaluations[i] = result.evaluations;
+        status[i] = result.status;
+
+        IntegerVector resultRows(result.hedges.size());
+        for (std::size_t h = 0; h < result.hedges.size(); ++h)
+            resultRows[h] = static_cast<int>(result.hedges[h]) + 1;
+        rows[i] = resultRows;
+        quantities[i] = NumericVector(result.quantities.begin(), result.quantities.end());
+    }
+
+    List result = List::create(
+        _["side"] = side,
+        _["hedges"] = hedges,
+        _["value"] = value,
+        _["evaluations"] = evaluations,
+        _["status"] = status,
+        _["rows"] = rows,
+        _["quantities"] = quantities);
+    result.attr("solves") = static_cast<double>(search.GetSolveCount());
+    return result;
+}
@@ -1,7 +1,8 @@
 #ifndef AVX_HPP
 #define AVX_HPP
 
-#if defined (__AVX__)
+// Define UVOL_DISABLE_SIMD to build the generic kernels on AVX capable targets, for comparison
+#if defined (__AVX__) && !defined (UVOL_DISABLE_SIMD)
 #   define USE_AVX
 #endif
 
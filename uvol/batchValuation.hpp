@@ -0,0 +1,45 @@
+#ifndef UVOL_BATCH_VALUATION_HPP
+#define UVOL_BATCH_VALUATION_HPP
+
+#include "../coint/parallel.hpp"
+#include "finiteDifferencePricer.hpp"
+#include "types.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace CqfProject
+{
+    // Valuate the prototype's portfolio once per row of a matrix of contract quantities.
+    // quantities is column major (as R matrices), numRows x contract count, with columns in the order
+    // contracts were added to the prototype. Rows are spread across threads, each with its own copy of the pricer.
+    inline void ValuateQuantityMatrix(
+        FiniteDifferencePricer const& prototype,
+        Real price,
+        Side side,
+        Real const* quantities,
+        std::size_t numRows,
+        Real* values,
+        unsigned numThreads = 0)
+    {
+        std::size_t const numContracts = prototype.GetContractCount();
+        std::atomic<std::size_t> nextRow(0);
+        RunParallel(ThreadCount(numThreads, numRows), [&] (std::size_t, std::atomic<bool> const& failed)
+        {
+            FiniteDifferencePricer pricer(prototype);
+            std::vector<Real> rowQuantities(numContracts);
+
+            for (std::size_t row = nextRow++; row < numRows && !failed; row = nextRow++)
+            {
+                for (std::size_t j = 0; j < numContracts; ++j)
+                    rowQuantities[j] = quantities[j * numRows + row];
+
+                pricer.SetMultipliers(rowQuantities.data());
+                values[row] = pricer.Valuate(price, side);
+            }
+        });
+    }
+}
+
+#endif
@@ -0,0 +1,568 @@
+#include "benchmark.hpp"
+#include "blackScholes.hpp"
+#include "finiteDifferencePricer.hpp"
+#include "impliedVolatility.hpp"
+#include "kernelMetrics.hpp"
+#include "normalDistribution.hpp"
+#include "perfCounters.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace CqfProject;
+
+Real const rate = 0.05;
+Real const price = 100.0;
+Real const minVol = 0.10;
+Real const maxVol = 0.30;
+Real const maxExpiry = 1.0;
+
+struct BenchmarkConfig
+{
+    BenchmarkConfig()
+        : quick(false)
+        , counters(nullptr)
+    {}
+
+    bool quick;
+    std::string filter;
+    BenchmarkOptions options;
+
+    /// Hardware counters, if requested with --perf
+    PerfCounters* counters;
+};
+
+bool Selected(BenchmarkConfig const& config, std::string const& name)
+{
+    return config.filter.empty() || name.find(config.filter) != std::string::npos;
+}
+
+// Abramowitz & Stegun 7.1.26, the previous Phi implementation. Kept as a speed reference.
+// From http://www.johndcook.com/cpp_phi.html
+double PhiAbramowitzStegun(double x)
+{
+    double a1 =  0.254829592;
+    double a2 = -0.284496736;
+    double a3 =  1.421413741;
+    double a4 = -1.453152027;
+    double a5 =  1.061405429;
+    double p  =  0.3275911;
+
+    int sign = 1;
+    if (x < 0)
+        sign = -1;
+    x = std::fabs(x)/std::sqrt(2.0);
+
+    double t = 1.0/(1.0 + p*x);
+    double y = 1.0 - (((((a5*t + a4)*t) + a3)*t + a2)*t + a1)*t*std::exp(-x*x);
+
+    return 0.5*(1.0 + sign*y);
+}
+
+// Instruction set of the grid kernel valuations run, e.g. as dispatched at run time
+char const* KernelName()
+{
+#if defined (UVOL_KERNEL_DISPATCH)
+    return GetGridKernels().name;
+#elif defined (USE_AVX)
+    return "avx";
+#else
+    return "generic";
+#endif
+}
+
+// Single thread machine peaks the kernel metrics are compared against, measured with loops compiled
+// for the same instruction set as the grid kernel
+struct MachinePeaks
+{
+    MachinePeaks()
+        : kernel(KernelName())
+        , cacheBytes(32 * 1024)
+        , cacheBandwidth(0.0)
+        , memoryBandwidth(0.0)
+        , flops(0.0)
+    {}
+
+    /// Instruction set the peaks were measured with
+    std::string kernel;
+
+    /// Working set below which cacheBandwidth applies, a typical L1 data cache
+    std::size_t cacheBytes;
+
+    /// Bytes per nanosecond, i.e. GB/s
+    double cacheBandwidth;
+    double memoryBandwidth;
+
+    /// Floating point operations per nanosecond, i.e. GFLOP/s
+    double flops;
+};
+
+// Best case STREAM triad bandwidth over a working set of the given size, with the dispatched kernel's
+// instruction set when built with the per instruction set kernels
+double MeasureBandwidth(std::size_t workingSetBytes, BenchmarkOptions const& options)
+{
+    std::size_t const count = workingSetBytes / (3 * sizeof(Real));
+    std::vector<Real> a(count, 0.0);
+    std::vector<Real> b(count, 1.0);
+    std::vector<Real> c(count, 2.0);
+    Real const scalar = 3.0;
+
+    auto const triad = [&] ()
+    {
+#if defined (UVOL_KERNEL_DISPATCH)
+        GetGridKernels().triad(a.data(), b.data(), c.data(), scalar, count);
+#else
+        Real* RESTRICT pa = a.data();
+        Real const* RESTRICT pb = b.data();
+        Real const* RESTRICT pc = c.data();
+        for (std::size_t i = 0; i < count; ++i)
+            pa[i] = pb[i] + scalar * pc[i];
+#endif
+        DoNotOptimize(a[count / 2]);
+    };
+
+    // Repeat small working sets so each repetition is long enough to time
+    std::size_t const passes = std::max<std::size_t>(1, (16u << 20) / workingSetBytes);
+    auto const repeated = [&] ()
+    {
+        for (std::size_t p = 0; p < passes; ++p)
+            triad();
+    };
+
+    BenchmarkStatistics const stats = RunBenchmark(repeated, passes * 3 * count * sizeof(Real), options);
+    return 1.0 / stats.min;
+}
+
+// Best case multiply-add throughput, with enough independent chains to hide latency, with the
+// dispatched kernel's instruction set (e.g. fused multiply-add) as for MeasureBandwidth
+double MeasurePeakFlops(BenchmarkOptions const& options)
+{
+    std::size_t const chains = PEAK_CHAINS;
+    std::size_t const iterations = 100000;
+    Real acc[chains];
+    for (std::size_t j = 0; j < chains; ++j)
+        acc[j] = Real(j);
+
+    Real const m = 0.999999;
+    Real const c = 1e-6;
+
+    auto const kernel = [&] ()
+    {
+#if defined (UVOL_KERNEL_DISPATCH)
+        GetGridKernels().multiplyAdd(acc, m, c, iterations);
+#else
+        for (std::size_t k = 0; k < iterations; ++k)
+            for (std::size_t j = 0; j < chains; ++j)
+                acc[j] = acc[j] * m + c;
+#endif
+
+        Real sum = 0.0;
+        for (std::size_t j = 0; j < chains; ++j)
+            sum += acc[j];
+        DoNotOptimize(sum);
+    };
+
+    BenchmarkStatistics const stats = RunBenchmark(kernel, 2 * chains * iterations, options);
+    return 1.0 / stats.min;
+}
+
+MachinePeaks MeasureMachinePeaks(BenchmarkConfig const& config)
+{
+    MachinePeaks peaks;
+    BenchmarkOptions const options(1, config.quick ? 3 : 10);
+    peaks.cacheBandwidth = MeasureBandwidth(peaks.cacheBytes * 3 / 4, options);
+    peaks.memoryBandwidth = MeasureBandwidth((config.quick ? 16u : 64u) << 20, options);
+    peaks.flops = MeasurePeakFlops(options);
+
+    std::cerr << "Machine peaks (" << peaks.kernel << "): cache " << peaks.cacheBandwidth << " GB/s, memory " << peaks.memoryBandwidth
+        << " GB/s, " << peaks.flops << " GFLOP/s" << std::endl;
+
+    return peaks;
+}
+
+// Kernel work of one valuation against its median time, placed on the roofline of the
+// cache or memory bandwidth, depending on the working set
+void WriteRoofline(
+    JsonWriter& json,
+    KernelMetrics const& metrics,
+    double nsPerValuation,
+    std::size_t workingSetBytes,
+    MachinePeaks const& peaks)
+{
+    double const valuations = static_cast<double>(metrics.valuations);
+    double const bandwidth = workingSetBytes <= peaks.cacheBytes ? peaks.cacheBandwidth : peaks.memoryBandwidth;
+    double const intensity = metrics.ArithmeticIntensity();
+    double const attainable = std::min(peaks.flops, intensity * bandwidth);
+    double const gflops = metrics.Flops() / valuations / nsPerValuation;
+
+    json.Key("kernel").BeginObject();
+    json.Member("timeSteps", metrics.timeSteps / metrics.valuations);
+    json.Member("nodeUpdates", metrics.nodeUpdates / metrics.valuations);
+    json.Member("simdIterations", metrics.simdIterations / metrics.valuations);
+    json.Member("bytes", metrics.Bytes() / metrics.valuations);
+    json.Member("flops", metrics.Flops() / metrics.valuations);
+    json.Member("workingSetBytes", workingSetBytes);
+    json.Member("arithmeticIntensity", intensity);
+    json.Member("nodesPerSecond", metrics.nodeUpdates / valuations / nsPerValuation * 1e9);
+    json.Member("gbPerSecond", metrics.Bytes() / valuations / nsPerValuation);
+    json.Member("gflopPerSecond", gflops);
+
+    // A roofline is only meaningful against peaks of the instruction set the kernel ran
+    if (peaks.kernel == KernelName())
+    {
+        json.Member("attainableGflopPerSecond", attainable);
+        json.Member("fractionOfAttainable", gflops / attainable);
+        json.Member("bound", intensity * bandwidth < peaks.flops ? "bandwidth" : "compute");
+    }
+    json.EndObject();
+}
+
+// Hardware event counts per operation over the benchmark repetitions, run after and separately
+// from the timed repetitions so counter reads never appear in the timings
+template<typename F>
+void WriteCounters(JsonWriter& json, BenchmarkConfig const& config, F f, std::size_t operationsPerRepetition)
+{
+    PerfCounters& counters = *config.counters;
+    std::size_t const repetitions = std::max(config.options.repetitions, (std::size_t)1);
+
+    counters.Start();
+    for (std::size_t i = 0; i < repetitions; ++i)
+        f();
+    counters.Stop();
+
+    double const operations = static_cast<double>(repetitions) * operationsPerRepetition;
+
+    json.Key("counters").BeginObject();
+    for (int i = 0; i < NUM_PERF_EVENTS; ++i)
+    {
+        PerfEvent const event = static_cast<PerfEvent>(i);
+        if (counters.IsAvailable(event))
+            json.Member(PerfEventName(event), counters.GetCount(event) / operations);
+    }
+
+    double const cycles = counters.GetCount(PerfEvent::CYCLES);
+    if (counters.IsAvailable(PerfEvent::INSTRUCTIONS) && counters.IsAvailable(PerfEvent::CYCLES))
+        json.Member("instructionsPerCycle", counters.GetCount(PerfEvent::INSTRUCTIONS) / cycles);
+    if (counters.IsAvailable(PerfEvent::REF_CYCLES) && counters.IsAvailable(PerfEvent::CYCLES))
+        json.Member("frequencyRatio", cycles / counters.GetCount(PerfEvent::REF_CYCLES));
+    json.EndObject();
+}
+
+// Ticks per valuation in each phase of Valuate, over the warm-up and timed repetitions
+void WritePhases(JsonWriter& json, PhaseProfile const& profile)
+{
+    double const valuations = static_cast<double>(profile.GetCount(Phase::INTERPOLATION));
+    if (valuations == 0.0)
+        return;
+
+    json.Key("phases").BeginObject();
+    json.Member("unit", std::string(PhaseTickUnit()) + "/valuation");
+    for (int i = 0; i < NUM_PHASES; ++i)
+    {
+        Phase const phase = static_cast<Phase>(i);
+        json.Member(PhaseName(phase), profile.GetTicks(phase) / valuations);
+    }
+    json.EndObject();
+}
+
+// Time f, which performs operationsPerRepetition operations, and write its statistics, with
+// optional grid parameters, roofline and hardware counters
+template<typename F>
+void RunCase(
+    JsonWriter& json,
+    BenchmarkConfig const& config,
+    std::string const& name,
+    std::string const& unit,
+    F f,
+    std::size_t operationsPerRepetition,
+    std::size_t numPriceSteps = 0,
+    std::size_t numContracts = 0,
+    std::size_t numExpiries = 0,
+    KernelMetrics const* metrics = nullptr,
+    MachinePeaks const* peaks = nullptr,
+    FiniteDifferencePricer* pricer = nullptr)
+{
+    if (pricer != nullptr)
+        pricer->ResetPhaseProfile();
+
+    BenchmarkStatistics const stats = RunBenchmark(f, operationsPerRepetition, config.options);
+
+    json.BeginObject();
+    json.Member("name", name);
+    json.Member("unit", unit);
+    if (numPriceSteps > 0)
+    {
+        json.Member("priceSteps", numPriceSteps);
+        json.Member("contracts", numContracts);
+        json.Member("expiries", numExpiries);
+    }
+    json.Member("stats", stats);
+    if (metrics != nullptr && peaks != nullptr && metrics->valuations > 0)
+    {
+        // Price step arrays of the pricer work space: prices, six coefficients, two value buffers
+        WriteRoofline(json, *metrics, stats.median, 9 * (numPriceSteps + 1) * sizeof(Real), *peaks);
+    }
+    if (pricer != nullptr && IsPhaseProfilingEnabled())
+        WritePhases(json, pricer->GetPhaseProfile());
+    if (config.counters != nullptr)
+        WriteCounters(json, config, f, operationsPerRepetition);
+    json.EndObject();
+
+    std::cerr << name;
+    if (numPriceSteps > 0)
+        std::cerr << " steps=" << numPriceSteps << " contracts=" << numContracts << " expiries=" << numExpiries;
+    std::cerr << ": median " << stats.median << " " << unit << ", p99 " << stats.p99 << ", MAD " << stats.mad << std::endl;
+}
+
+// Valuation with a pricer constructed and populated per call (cold), as CppPriceEuropeanUncertainVol,
+// and with a persistent pricer that only has quantities updated (warm), as the R pricer handles
+void BenchmarkValuation(BenchmarkConfig const& config, MachinePeaks const& peaks, JsonWriter& json)
+{
+    std::vector<std::size_t> const steps = config.quick
+        ? std::vector<std::size_t>{ 50, 100 }
+        : std::vector<std::size_t>{ 50, 100, 200, 300 };
+
+    std::vector<std::size_t> const contractCounts = config.quick
+        ? std::vector<std::size_t>{ 1, 10, 100 }
+        : std::vector<std::size_t>{ 1, 10, 100, 1000 };
+
+    for (std::size_t numPriceSteps : steps)
+    {
+        for (std::size_t numContracts : contractCounts)
+        {
+            std::size_t const numExpiries = std::min<std::size_t>(numContracts, 4);
+            std::vector<OptionContract> const contracts = CreateBenchmarkPortfolio(numContracts, numExpiries, price, maxExpiry);
+
+            if (Selected(config, "valuate_cold"))
+            {
+                auto const cold = [&] ()
+                {
+                    FiniteDifferencePricer pricer(minVol, maxVol, rate, price * Real(2), numPriceSteps);
+                    for (auto const& contract : contracts)
+                        pricer.AddContract(contract);
+                    DoNotOptimize(pricer.Valuate(price, Side::BID));
+                };
+
+                RunCase(json, config, "valuate_cold", "ns/valuation", cold, 1, numPriceSteps, numContracts, numExpiries);
+            }
+
+            if (Selected(config, "valuate_warm"))
+            {
+                FiniteDifferencePricer pricer(minVol, maxVol, rate, price * Real(2), numPriceSteps);
+                for (auto const& contract : contracts)
+                    pricer.AddContract(contract);
+
+                std::vector<Real> quantities(numContracts);
+                std::size_t iteration = 0;
+                auto const warm = [&] ()
+                {
+                    // Vary quantities as an optimizer would
+                    for (std::size_t i = 0; i < numContracts; ++i)
+                        quantities[i] = contracts[i].multiplier * (1.0 + 0.01 * (iteration % 7));
+                    ++iteration;
+
+                    pricer.SetMultipliers(quantities.data());
+                    DoNotOptimize(pricer.Valuate(price, Side::BID));
+                };
+
+                // Count kernel work in a separate call, so the timed calls use the null metrics policy
+                KernelMetrics metrics;
+                pricer.Valuate(price, Side::BID, FiniteDifferencePricer::NullOutIt(), 0, metrics);
+
+                RunCase(json, config, "valuate_warm", "ns/valuation", warm, 1, numPriceSteps, numContracts, numExpiries, &metrics, &peaks, &pricer);
+            }
+        }
+    }
+}
+
+// Normal CDF, scalar and batch, against the A&S approximation it replaced
+void BenchmarkNormalCdf(BenchmarkConfig const& config, JsonWriter& json)
+{
+    std::size_t const count = 100000;
+    std::vector<Real> x(count);
+    std::vector<Real> y(count);
+    for (std::size_t i = 0; i < count; ++i)
+        x[i] = -8.0 + 16.0 * i / count;
+
+    if (Selected(config, "phi_abramowitz_stegun"))
+    {
+        auto const as = [&] ()
+        {
+            for (std::size_t i = 0; i < count; ++i)
+                y[i] = PhiAbramowitzStegun(x[i]);
+            DoNotOptimize(y[count / 2]);
+        };
+        RunCase(json, config, "phi_abramowitz_stegun", "ns/evaluation", as, count);
+    }
+
+    if (Selected(config, "normal_cdf_scalar"))
+    {
+        auto const scalar = [&] ()
+        {
+            Real sum = 0.0;
+            for (std::size_t i = 0; i < count; ++i)
+                sum += NormalCdf(x[i]);
+            DoNotOptimize(sum);
+        };
+        RunCase(json, config, "normal_cdf_scalar", "ns/evaluation", scalar, count);
+    }
+
+    if (Selected(config, "normal_cdf_batch"))
+    {
+        auto const batch = [&] ()
+        {
+            NormalCdf(x.data(), y.data(), count);
+            DoNotOptimize(y[count / 2]);
+        };
+        RunCase(json, config, "normal_cdf_batch", "ns/evaluation", batch, count);
+    }
+}
+
+// Batch implied volatility of a chain of calls and puts
+void BenchmarkImpliedVolatility(BenchmarkConfig const& config, JsonWriter& json)
+{
+    if (!Selected(config, "implied_volatility"))
+        return;
+
+    std::size_t const count = 10000;
+    std::vector<OptionType> types(count);
+    std::vector<Real> expiries(count);
+    std::vector<Real> strikes(count);
+    std::vector<Real> prices(count);
+    std::vector<Real> vols(count);
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        types[i] = i % 2 == 0 ? OptionType::CALL : OptionType::PUT;
+        expiries[i] = 0.1 + (i % 20) * 0.1;
+        strikes[i] = 60.0 + (i % 81);
+        prices[i] = BlackScholesOption(types[i], 0.1 + 0.3 * (i % 7) / 6.0, rate, expiries[i], price, strikes[i]);
+    }
+
+    auto const iv = [&] ()
+    {
+        ImpliedVolatility(types.data(), expiries.data(), strikes.data(), prices.data(), vols.data(), count, rate, price);
+        DoNotOptimize(vols[count / 2]);
+    };
+    RunCase(json, config, "implied_volatility", "ns/quote", iv, count);
+}
+
+void PrintUsage()
+{
+    std::cerr
+        << "Usage: uvol_bench [options]" << std::endl
+        << "  --quick            small grids and few repetitions" << std::endl
+        << "  --filter NAME      run benchmarks whose name contains NAME" << std::endl
+        << "  --repetitions N    timed repetitions per benchmark" << std::endl
+        << "  --warmup N         untimed warm-up repetitions per benchmark" << std::endl
+        << "  --output FILE      write JSON results to FILE instead of stdout" << std::endl
+        << "  --perf             count hardware events per operation with perf_event_open" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkConfig config;
+    std::string outputFile;
+    bool perf = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const arg = argv[i];
+        bool const hasValue = i + 1 < argc;
+
+        if (arg == "--quick")
+        {
+            config.quick = true;
+            config.options = BenchmarkOptions(1, 5);
+        }
+        else if (arg == "--filter" && hasValue)
+            config.filter = argv[++i];
+        else if (arg == "--repetitions" && hasValue)
+            config.options.repetitions = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--warmup" && hasValue)
+            config.options.warmupRepetitions = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--output" && hasValue)
+            outputFile = argv[++i];
+        else if (arg == "--perf")
+            perf = true;
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    // Continue without counters where perf events are not permitted, e.g. in containers
+    std::unique_ptr<PerfCounters> counters;
+    if (perf)
+    {
+        counters.reset(new PerfCounters());
+        if (counters->IsAvailable())
+            config.counters = counters.get();
+        else
+            std::cerr << "Hardware counters unavailable, check /proc/sys/kernel/perf_event_paranoid" << std::endl;
+    }
+
+    std::ofstream file;
+    if (!outputFile.empty())
+    {
+        file.open(outputFile.c_str());
+        if (!file)
+        {
+            std::cerr << "Failed to open " << outputFile << std::endl;
+            return 1;
+        }
+    }
+
+    std::ostream& os = outputFile.empty() ? std::cout : file;
+    JsonWriter json(os);
+
+    json.BeginObject();
+    json.Key("build").BeginObject();
+    json.Member("kernel", KernelName());
+#if defined (__VERSION__)
+    json.Member("compiler", __VERSION__);
+#endif
+#if defined (__OPTIMIZE__)
+    json.Member("optimized", true);
+#else
+    json.Member("optimized", false);
+#endif
+    json.Member("counters", config.counters != nullptr);
+    json.EndObject();
+
+    MachinePeaks peaks;
+    if (Selected(config, "valuate_warm"))
+    {
+        peaks = MeasureMachinePeaks(config);
+
+        json.Key("machine").BeginObject();
+        json.Member("kernel", peaks.kernel);
+        json.Member("cacheBytes", peaks.cacheBytes);
+        json.Member("cacheGbPerSecond", peaks.cacheBandwidth);
+        json.Member("memoryGbPerSecond", peaks.memoryBandwidth);
+        json.Member("peakGflopPerSecond", peaks.flops);
+        json.EndObject();
+    }
+
+    json.Member("warmupRepetitions", config.options.warmupRepetitions);
+    json.Member("repetitions", config.options.repetitions);
+
+    json.Key("benchmarks").BeginArray();
+    BenchmarkValuation(config, peaks, json);
+    BenchmarkNormalCdf(config, json);
+    BenchmarkImpliedVolatility(config, json);
+    json.EndArray();
+
+    json.EndObject();
+    os << std::endl;
+
+    return 0;
+}
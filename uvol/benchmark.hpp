@@ -0,0 +1,331 @@
+#ifndef UVOL_BENCHMARK_HPP
+#define UVOL_BENCHMARK_HPP
+
+#include "optionContract.hpp"
+#include "stopwatch.hpp"
+#include "types.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace CqfProject
+{
+    // Keep a benchmarked result alive without the compiler eliding its computation
+    inline void DoNotOptimize(double value)
+    {
+        static double volatile sink;
+        sink = value;
+    }
+
+    struct BenchmarkOptions
+    {
+        BenchmarkOptions(std::size_t warmupRepetitions = 3, std::size_t repetitions = 30)
+            : warmupRepetitions(warmupRepetitions)
+            , repetitions(repetitions)
+        {}
+
+        std::size_t warmupRepetitions;
+        std::size_t repetitions;
+    };
+
+    // Robust summary of per operation times, in nanoseconds
+    struct BenchmarkStatistics
+    {
+        std::size_t repetitions;
+        double min;
+        double median;
+        double mean;
+        double p99;
+        double max;
+        double mad;
+        double stddev;
+    };
+
+    // Quantile by linear interpolation of sorted samples
+    inline double SortedQuantile(std::vector<double> const& sorted, double q)
+    {
+        if (sorted.empty())
+            throw std::runtime_error("no samples");
+
+        double const h = q * (sorted.size() - 1);
+        std::size_t const lo = static_cast<std::size_t>(h);
+        std::size_t const hi = std::min(lo + 1, sorted.size() - 1);
+        return sorted[lo] + (h - lo) * (sorted[hi] - sorted[lo]);
+    }
+
+    inline BenchmarkStatistics CalculateStatistics(std::vector<double> samples)
+    {
+        std::sort(samples.begin(), samples.end());
+
+        BenchmarkStatistics stats;
+        stats.repetitions = samples.size();
+        stats.min = samples.front();
+        stats.max = samples.back();
+        stats.median = SortedQuantile(samples, 0.5);
+        stats.p99 = SortedQuantile(samples, 0.99);
+
+        double sum = 0.0;
+        for (double s : samples)
+            sum += s;
+        stats.mean = sum / samples.size();
+
+        double sumSq = 0.0;
+        std::vector<double> deviations;
+        deviations.reserve(samples.size());
+        for (double s : samples)
+        {
+            sumSq += (s - stats.mean) * (s - stats.mean);
+            deviations.push_back(std::abs(s - stats.median));
+        }
+        stats.stddev = samples.size() > 1 ? std::sqrt(sumSq / (samples.size() - 1)) : 0.0;
+
+        std::sort(deviations.begin(), deviations.end());
+        stats.mad = SortedQuantile(deviations, 0.5);
+
+        return stats;
+    }
+
+    // Time repetitions of f(), after warm-up, each normalized to nanoseconds per operation
+    template<typename F>
+    BenchmarkStatistics RunBenchmark(F f, std::size_t operationsPerRepetition, BenchmarkOptions const& options)
+    {
+        for (std::size_t i = 0; i < options.warmupRepetitions; ++i)
+            f();
+
+        Stopwatch stopwatch;
+        std::vector<double> samples;
+        samples.reserve(options.repetitions);
+        for (std::size_t i = 0; i < std::max(options.repetitions, (std::size_t)1); ++i)
+        {
+            stopwatch.Start();
+            f();
+            stopwatch.Stop();
+            samples.push_back(static_cast<double>(stopwatch.GetElapsedNanoseconds()) / operationsPerRepetition);
+        }
+
+        return CalculateStatistics(samples);
+    }
+
+    // Least squares fit of y = prefactor * x^exponent, on log scales
+    struct PowerLawFit
+    {
+        double exponent;
+        double prefactor;
+        double rSquared;
+    };
+
+    inline PowerLawFit FitPowerLaw(std::vector<double> const& x, std::vector<double> const& y)
+    {
+        if (x.size() != y.size() || x.size() < 2)
+            throw std::runtime_error("power law fit needs at least two points");
+
+        std::size_t const n = x.size();
+        double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            double const lx = std::log(x[i]);
+            double const ly = std::log(y[i]);
+            sx += lx;
+            sy += ly;
+            sxx += lx * lx;
+            sxy += lx * ly;
+        }
+
+        double const denominator = n * sxx - sx * sx;
+        PowerLawFit fit;
+        fit.exponent = denominator != 0.0 ? (n * sxy - sx * sy) / denominator : 0.0;
+        double const intercept = (sy - fit.exponent * sx) / n;
+        fit.prefactor = std::exp(intercept);
+
+        double ssRes = 0.0, ssTot = 0.0;
+        double const meanY = sy / n;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            double const ly = std::log(y[i]);
+            double const residual = ly - (intercept + fit.exponent * std::log(x[i]));
+            ssRes += residual * residual;
+            ssTot += (ly - meanY) * (ly - meanY);
+        }
+        fit.rSquared = ssTot > 0.0 ? 1.0 - ssRes / ssTot : 1.0;
+
+        return fit;
+    }
+
+    // Mixed portfolio of calls, puts and binaries, with strikes around the money, spread evenly over
+    // numExpiries expiries up to maxExpiry
+    inline std::vector<OptionContract> CreateBenchmarkPortfolio(
+        std::size_t numContracts,
+        std::size_t numExpiries,
+        Real price,
+        Real maxExpiry)
+    {
+        std::vector<OptionContract> contracts;
+        for (std::size_t i = 0; i < numContracts; ++i)
+        {
+            Real const expiry = maxExpiry * (1 + i % numExpiries) / numExpiries;
+            Real const strike = price * (0.75 + 0.5 * ((i / numExpiries) % 21) / 20.0);
+            OptionType const type = static_cast<OptionType>(i % NUM_OPTION_TYPES);
+            contracts.push_back(OptionContract(type, expiry, strike, i % 2 == 0 ? 1.0 : -1.0));
+        }
+
+        return contracts;
+    }
+
+    // Minimal streaming JSON writer for machine readable benchmark output
+    class JsonWriter
+    {
+    public:
+        explicit JsonWriter(std::ostream& os)
+            : mOs(os)
+            , mFirst(1, true)
+            , mAfterKey(false)
+        {}
+
+        JsonWriter& BeginObject()
+        {
+            Separate();
+            mOs << '{';
+            mFirst.push_back(true);
+            return *this;
+        }
+
+        JsonWriter& EndObject()
+        {
+            mFirst.pop_back();
+            mOs << '}';
+            return *this;
+        }
+
+        JsonWriter& BeginArray()
+        {
+            Separate();
+            mOs << '[';
+            mFirst.push_back(true);
+            return *this;
+        }
+
+        JsonWriter& EndArray()
+        {
+            mFirst.pop_back();
+            mOs << ']';
+            return *this;
+        }
+
+        JsonWriter& Key(std::string const& key)
+        {
+            Separate();
+            WriteString(key);
+            mOs << ':';
+            mAfterKey = true;
+            return *this;
+        }
+
+        JsonWriter& Value(std::string const& value)
+        {
+            Separate();
+            WriteString(value);
+            return *this;
+        }
+
+        JsonWriter& Value(char const* value)
+        {
+            return Value(std::string(value));
+        }
+
+        JsonWriter& Value(bool value)
+        {
+            Separate();
+            mOs << (value ? "true" : "false");
+            return *this;
+        }
+
+        JsonWriter& Value(double value)
+        {
+            Separate();
+            if (std::isfinite(value))
+                mOs << value;
+            else
+                mOs << "null";
+            return *this;
+        }
+
+        JsonWriter& Value(std::int64_t value)
+        {
+            Separate();
+            mOs << value;
+            return *this;
+        }
+
+        JsonWriter& Value(std::size_t value)
+        {
+            return Value(static_cast<std::int64_t>(value));
+        }
+
+        JsonWriter& Value(int value)
+        {
+            return Value(static_cast<std::int64_t>(value));
+        }
+
+        template<typename T>
+        JsonWriter& Member(std::string const& key, T const& value)
+        {
+            return Key(key).Value(value);
+        }
+
+        JsonWriter& Member(std::string const& key, BenchmarkStatistics const& stats)
+        {
+            Key(key).BeginObject();
+            Member("repetitions", stats.repetitions);
+            Member("min", stats.min);
+            Member("median", stats.median);
+            Member("mean", stats.mean);
+            Member("p99", stats.p99);
+            Member("max", stats.max);
+            Member("mad", stats.mad);
+            Member("stddev", stats.stddev);
+            return EndObject();
+        }
+
+    private:
+        // Comma between elements, none after a key
+        void Separate()
+        {
+            if (mAfterKey)
+            {
+                mAfterKey = false;
+                return;
+            }
+
+            if (!mFirst.back())
+                mOs << ',';
+            mFirst.back() = false;
+        }
+
+        void WriteString(std::string const& s)
+        {
+            mOs << '"';
+            for (char c : s)
+            {
+                if (c == '"' || c == '\\')
+                    mOs << '\\' << c;
+                else if (c == '\n')
+                    mOs << "\\n";
+                else
+                    mOs << c;
+            }
+            mOs << '"';
+        }
+
+        std::ostream& mOs;
+        std::vector<bool> mFirst;
+        bool mAfterKey;
+    };
+}
+
+#endif
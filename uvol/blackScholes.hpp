@@ -1,6 +1,8 @@
 #ifndef UVOL_BLACK_SCHOLES_HPP
 #define UVOL_BLACK_SCHOLES_HPP
 
+#include "normalDistribution.hpp"
+#include "optionContract.hpp"
 #include "types.hpp"
 
 #include <cmath>
@@ -8,30 +10,10 @@
 
 namespace CqfProject
 {
-    // From http://www.johndcook.com/cpp_phi.html
+    // Standard normal cumulative distribution
     inline double Phi(double x)
     {
-        using namespace std;
-
-        // constants
-        double a1 =  0.254829592;
-        double a2 = -0.284496736;
-        double a3 =  1.421413741;
-        double a4 = -1.453152027;
-        double a5 =  1.061405429;
-        double p  =  0.3275911;
-
-        // Save the sign of x
-        int sign = 1;
-        if (x < 0)
-            sign = -1;
-        x = fabs(x)/sqrt(2.0);
-
-        // A&S formula 7.1.26
-        double t = 1.0/(1.0 + p*x);
-        double y = 1.0 - (((((a5*t + a4)*t) + a3)*t + a2)*t + a1)*t*exp(-x*x);
-
-        return 0.5*(1.0 + sign*y);
+        return NormalCdf(x);
     }
 
     struct PutCallPair
@@ -121,6 +103,26 @@ namespace CqfProject
             throw std::runtime_error("invalid option type");
         }
     }
+
+    // Value of a portfolio of contracts at constant volatility
+    inline Real BlackScholesPortfolio(
+        PortfolioView const& portfolio,
+        Real vol,
+        Real rate,
+        Real price)
+    {
+        Real sum = 0;
+        for (std::size_t i = 0; i < portfolio.size; ++i)
+            sum += portfolio.quantities[i] * BlackScholesOption(
+                portfolio.GetType(i),
+                vol,
+                rate,
+                portfolio.expiries[i],
+                price,
+                portfolio.strikes[i]);
+
+        return sum;
+    }
 }
 
 #endif
@@ -2,7 +2,10 @@
 #define UVOL_FINITE_DIFFERENCE_PRICER_HPP
 
 #include "avx.hpp"
+#include "gridKernels.hpp"
+#include "kernelMetrics.hpp"
 #include "optionContract.hpp"
+#include "phaseProfiler.hpp"
 #include "types.hpp"
 
 #include <algorithm>
@@ -10,6 +13,7 @@
 #include <cstdint>
 #include <cstdlib>
 #include <memory>
+#include <new>
 #include <stdexcept>
 #include <vector>
 
@@ -33,7 +37,10 @@ namespace CqfProject
         INTERVAL
     };
 
-    class FiniteDifferencePricer
+    // Grid, contracts and work space shared by the pricers below. Derived chooses payoff sampling and
+    // interpolation, and so which specialization of ValuateImpl a valuation runs.
+    template<typename Derived>
+    class FiniteDifferencePricerBase
     {
     public:
         struct NullOutIt
@@ -48,52 +55,46 @@ namespace CqfProject
             NullOutIt& operator ++ (int) { return *this; }
         };
 
-        FiniteDifferencePricer(
+        FiniteDifferencePricerBase(
             Real minVol,
             Real maxVol,
             Real rate,
             Real maxPrice,
-            std::size_t numPriceSteps,
-            PayoffSampling payoffSampling = PayoffSampling::INTERVAL,
-            Interpolation interpolation = Interpolation::LINEAR)
+            std::size_t numPriceSteps)
             : mMinVol(minVol)
             , mMaxVol(maxVol)
             , mRate(rate)
             , mMaxPrice(maxPrice)
             , mNumPriceSteps(std::max(numPriceSteps, (std::size_t)3))
-            , mPayoffSampling(payoffSampling)
-            , mInterpolation(interpolation)
             , mDeltaPrice(maxPrice / numPriceSteps)
             , mTargetDeltaTime(Real(0.9) / (numPriceSteps * numPriceSteps * maxVol * maxVol))
+            , mExpiryOrderValid(false)
             , mAllocation(nullptr)
         {
             assert(maxVol >= minVol);
+            AllocateWorkspace();
+        }
 
-            // Padded price step arrays for
-            // price, (alpha, beta, gamma) * 2, scratch * 2
-            std::size_t const priceStepChunks = ((numPriceSteps + 1) * sizeof(Real) + 31 + 32) / 32;
-            std::size_t const allocRequirement = priceStepChunks * 32 * 9;
-            mAllocation = malloc(allocRequirement + 32);
-            void* allignedAllocation = (void*)(((std::uintptr_t)mAllocation + 31u) & ~(std::uintptr_t)31u);
-
-            std::size_t const realPerChunk = 32 / sizeof(Real);
-            std::size_t const realPerArray = priceStepChunks * realPerChunk;
-            mPrices = (Real*)allignedAllocation;
-            mAlpha1 = mPrices + realPerArray;
-            mBeta1 = mAlpha1 + realPerArray;
-            mGamma1 = mBeta1 + realPerArray;
-            mAlpha2 = mGamma1 + realPerArray;
-            mBeta2 = mAlpha2 + realPerArray;
-            mGamma2 = mBeta2 + realPerArray;
-            mScratch1 = mGamma2 + realPerArray;
-            mScratch2 = mScratch1 + realPerArray;
-
-            // Pre-calculate prices
-            for (std::size_t i = 0; i <= mNumPriceSteps; ++i)
-                mPrices[i] = i * mDeltaPrice;
+        // Copies parameters and contracts, with a separate work space (e.g. one per thread)
+        FiniteDifferencePricerBase(FiniteDifferencePricerBase const& other)
+            : mMinVol(other.mMinVol)
+            , mMaxVol(other.mMaxVol)
+            , mRate(other.mRate)
+            , mMaxPrice(other.mMaxPrice)
+            , mNumPriceSteps(other.mNumPriceSteps)
+            , mContracts(other.mContracts)
+            , mDeltaPrice(other.mDeltaPrice)
+            , mTargetDeltaTime(other.mTargetDeltaTime)
+            , mExpiryOrder(other.mExpiryOrder)
+            , mExpiryOrderValid(other.mExpiryOrderValid)
+            , mAllocation(nullptr)
+        {
+            AllocateWorkspace();
         }
 
-        ~FiniteDifferencePricer()
+        FiniteDifferencePricerBase& operator = (FiniteDifferencePricerBase const&) = delete;
+
+        ~FiniteDifferencePricerBase()
         {
             std::free(mAllocation);
         }
@@ -101,6 +102,54 @@ namespace CqfProject
         void AddContract(OptionContract const& contract)
         {
             mContracts.push_back(contract);
+            mExpiryOrderValid = false;
+        }
+
+        // Replace contracts with those of a columnar portfolio. Reuses contract storage across calls, so
+        // after the first call this is one pass over the columns with no allocation or string work.
+        // The rows are still copied, since the view does not own its columns (e.g. R vectors released
+        // after the call) and SetMultiplier updates quantities in place.
+        void SetContracts(PortfolioView const& portfolio)
+        {
+            mContracts.clear();
+            mContracts.reserve(portfolio.size);
+            for (std::size_t i = 0; i < portfolio.size; ++i)
+                mContracts.push_back(portfolio.GetContract(i));
+
+            mExpiryOrderValid = false;
+        }
+
+        void ClearContracts()
+        {
+            mContracts.clear();
+            mExpiryOrderValid = false;
+        }
+
+        std::size_t GetContractCount() const
+        {
+            return mContracts.size();
+        }
+
+        // Contracts are indexed in the order they were added
+        OptionContract const& GetContract(std::size_t index) const
+        {
+            return mContracts[index];
+        }
+
+        // Update contract quantity in place, e.g. between valuations of a hedged portfolio
+        void SetMultiplier(std::size_t index, Real multiplier)
+        {
+            if (index >= mContracts.size())
+                throw std::runtime_error("contract index out of range");
+
+            mContracts[index].multiplier = multiplier;
+        }
+
+        // Update all contract quantities in place, in the order contracts were added
+        void SetMultipliers(Real const* multipliers)
+        {
+            for (std::size_t i = 0; i < mContracts.size(); ++i)
+                mContracts[i].multiplier = multipliers[i];
         }
 
         Real const* BeginPrices() const
@@ -113,6 +162,18 @@ namespace CqfProject
             return mPrices + mNumPriceSteps + 1;
         }
 
+        // Time per phase of Valuate, accumulated since construction or the last reset.
+        // Stays at zero unless built with UVOL_PHASE_PROFILING. Copies start with an empty profile.
+        PhaseProfile const& GetPhaseProfile() const
+        {
+            return mPhaseProfile;
+        }
+
+        void ResetPhaseProfile()
+        {
+            mPhaseProfile.Reset();
+        }
+
         Real Valuate(Real price, Side side)
         {
             return Valuate(price, side, NullOutIt(), 0);
@@ -121,24 +182,85 @@ namespace CqfProject
         template<typename OutIt>
         Real Valuate(Real price, Side side, OutIt valuesOut, int detail)
         {
-            // Maintain contracts sorted by descending expiry
-            auto const expiryGreater = [] (OptionContract const& a, OptionContract const& b) { return a.expiry > b.expiry; };
-            if (!std::is_sorted(mContracts.begin(), mContracts.end(), expiryGreater))
-                std::sort(mContracts.begin(), mContracts.end(), expiryGreater);
+            NullKernelMetrics metrics;
+            return Valuate(price, side, valuesOut, detail, metrics);
+        }
+
+        // Valuate, reporting work done by the kernel to a metrics policy, e.g. KernelMetrics
+        template<typename OutIt, typename Metrics>
+        Real Valuate(Real price, Side side, OutIt valuesOut, int detail, Metrics& metrics)
+        {
+            // Order contracts by descending expiry, only when the contract set has changed
+            if (!mExpiryOrderValid)
+            {
+                UVOL_PHASE_BEGIN(mPhaseProfile, Phase::SORT, sortTimer);
+                UpdateExpiryOrder();
+            }
 
+            return static_cast<Derived&>(*this).ValuateSpecialized(price, side, valuesOut, detail, metrics);
+        }
+
+    protected:
+        template<PayoffSampling Sampling, Interpolation Interp, typename OutIt, typename Metrics>
+        Real ValuateAs(Real price, Side side, OutIt valuesOut, int detail, Metrics& metrics)
+        {
             if (side == Side::BID)
             {
                 // Minimum portfolio value
-                return ValuateImpl(price, SelectMin(), valuesOut, detail);
+                return ValuateImpl<Sampling, Interp>(price, SelectMin(), valuesOut, detail, metrics);
             }
             else
             {
                 // Maximum portfolio value
-                return ValuateImpl(price, SelectMax(), valuesOut, detail);
+                return ValuateImpl<Sampling, Interp>(price, SelectMax(), valuesOut, detail, metrics);
             }
         }
 
     private:
+        void AllocateWorkspace()
+        {
+            // Padded price step arrays for
+            // price, (alpha, beta, gamma) * 2, scratch * 2
+            std::size_t const priceStepChunks = ((mNumPriceSteps + 1) * sizeof(Real) + 31 + 32) / 32;
+            std::size_t const allocRequirement = priceStepChunks * 32 * 9;
+            mAllocation = malloc(allocRequirement + 32);
+            if (mAllocation == nullptr)
+                throw std::bad_alloc();
+
+            void* allignedAllocation = (void*)(((std::uintptr_t)mAllocation + 31u) & ~(std::uintptr_t)31u);
+
+            std::size_t const realPerChunk = 32 / sizeof(Real);
+            std::size_t const realPerArray = priceStepChunks * realPerChunk;
+            mPrices = (Real*)allignedAllocation;
+            mAlpha1 = mPrices + realPerArray;
+            mBeta1 = mAlpha1 + realPerArray;
+            mGamma1 = mBeta1 + realPerArray;
+            mAlpha2 = mGamma1 + realPerArray;
+            mBeta2 = mAlpha2 + realPerArray;
+            mGamma2 = mBeta2 + realPerArray;
+            mScratch1 = mGamma2 + realPerArray;
+            mScratch2 = mScratch1 + realPerArray;
+
+            // Pre-calculate prices
+            for (std::size_t i = 0; i <= mNumPriceSteps; ++i)
+                mPrices[i] = i * mDeltaPrice;
+        }
+
+        void UpdateExpiryOrder()
+        {
+            mExpiryOrder.resize(mContracts.size());
+            for (std::size_t i = 0; i < mContracts.size(); ++i)
+                mExpiryOrder[i] = i;
+
+            std::vector<OptionContract> const& contracts = mContracts;
+            std::stable_sort(
+                mExpiryOrder.begin(),
+                mExpiryOrder.end(),
+                [&contracts] (std::size_t a, std::size_t b) { return contracts[a].expiry > contracts[b].expiry; });
+
+            mExpiryOrderValid = true;
+        }
+
         struct SelectMin
         {
             Real operator() (Real a, Real b) const
@@ -169,8 +291,61 @@ namespace CqfProject
 #endif
         };
 
-        template<typename MinMaxSelector, typename OutIt>
-        Real ValuateImpl(Real price, MinMaxSelector minMaxSelector, OutIt valuesOut, int detail)
+#if defined (UVOL_KERNEL_DISPATCH)
+        static GridStepKernel SelectGridStep(GridKernels const& kernels, SelectMin)
+        {
+            return kernels.bid;
+        }
+
+        static GridStepKernel SelectGridStep(GridKernels const& kernels, SelectMax)
+        {
+            return kernels.ask;
+        }
+#endif
+
+        // Add a contract's payoff to the grid, switching on its type once per contract rather than per node
+        template<PayoffSampling Sampling>
+        static void AddPayoff(OptionContract const& contract, Real const* RESTRICT prices, Real halfDeltaPrice, Real* RESTRICT values, std::size_t numPriceSteps)
+        {
+            switch (contract.type)
+            {
+            case OptionType::CALL:
+                AddPayoff<Sampling, OptionType::CALL>(contract.strike, contract.multiplier, prices, halfDeltaPrice, values, numPriceSteps);
+                break;
+
+            case OptionType::PUT:
+                AddPayoff<Sampling, OptionType::PUT>(contract.strike, contract.multiplier, prices, halfDeltaPrice, values, numPriceSteps);
+                break;
+
+            case OptionType::BINARY_CALL:
+                AddPayoff<Sampling, OptionType::BINARY_CALL>(contract.strike, contract.multiplier, prices, halfDeltaPrice, values, numPriceSteps);
+                break;
+
+            case OptionType::BINARY_PUT:
+                AddPayoff<Sampling, OptionType::BINARY_PUT>(contract.strike, contract.multiplier, prices, halfDeltaPrice, values, numPriceSteps);
+                break;
+
+            default:
+                throw std::runtime_error("invalid option type");
+            }
+        }
+
+        template<PayoffSampling Sampling, OptionType Type>
+        static void AddPayoff(Real strike, Real multiplier, Real const* RESTRICT prices, Real halfDeltaPrice, Real* RESTRICT values, std::size_t numPriceSteps)
+        {
+            typedef ContractPayoff<Type> Payoff;
+
+            for (std::uint32_t i = 0; i <= numPriceSteps; ++i)
+            {
+                Real const payoff = Sampling == PayoffSampling::POINT
+                    ? Payoff::Payoff(strike, prices[i])
+                    : Payoff::AveragePayoff(strike, prices[i] - halfDeltaPrice, prices[i] + halfDeltaPrice);
+                values[i] += payoff * multiplier;
+            }
+        }
+
+        template<PayoffSampling Sampling, Interpolation Interp, typename MinMaxSelector, typename OutIt, typename Metrics>
+        Real ValuateImpl(Real price, MinMaxSelector minMaxSelector, OutIt valuesOut, int detail, Metrics& metrics)
         {
             std::size_t numPriceSteps = mNumPriceSteps;
             Real const deltaPrice = mDeltaPrice;
@@ -193,6 +368,13 @@ namespace CqfProject
             Real* RESTRICT current = (Real*)ASSUME_ALIGNED(mScratch1, 32);
             Real* RESTRICT next = (Real*)ASSUME_ALIGNED(mScratch2, 32);
 
+#if defined (UVOL_KERNEL_DISPATCH)
+            GridKernels const& gridKernels = GetGridKernels();
+            GridStepKernel const gridStep = SelectGridStep(gridKernels, minMaxSelector);
+#endif
+
+            metrics.CountValuation();
+
             // Initial state
             for (std::size_t i = 0; i <= numPriceSteps; ++i)
                 current[i] = Real(0);
@@ -200,24 +382,15 @@ namespace CqfProject
             // March from last expiry to next expiry or to 0
             for (std::size_t contractIndex = 0; contractIndex < mContracts.size(); ++contractIndex)
             {
-                OptionContract const& contract = mContracts[contractIndex];
+                OptionContract const& contract = mContracts[mExpiryOrder[contractIndex]];
 
                 // Add payoffs
-                if (mPayoffSampling == PayoffSampling::POINT)
-                {
-                    for (std::uint32_t i = 0; i <= numPriceSteps; ++i)
-                        current[i] += contract.CalculatePayoff(prices[i]) * contract.multiplier;
-                }
-                else
-                {
-                    for (std::uint32_t i = 0; i <= numPriceSteps; ++i)
-                        current[i] += contract.CalculateAveragePayoff(
-                            prices[i] - halfDeltaPrice,
-                            prices[i] + halfDeltaPrice) * contract.multiplier;
-                }
+                UVOL_PHASE_BEGIN(mPhaseProfile, Phase::PAYOFF, payoffTimer);
+                AddPayoff<Sampling>(contract, prices, halfDeltaPrice, current, numPriceSteps);
+                UVOL_PHASE_END(payoffTimer);
 
                 // Find next expiry and time to it
-                Real const nextExpiry = contractIndex == mContracts.size() - 1 ? Real(0) : mContracts[contractIndex + 1].expiry;
+                Real const nextExpiry = contractIndex == mContracts.size() - 1 ? Real(0) : mContracts[mExpiryOrder[contractIndex + 1]].expiry;
                 Real const timeToNextExpiry = contract.expiry - nextExpiry;
 
                 // If contracts are too close together, assume at same expiry
@@ -230,6 +403,7 @@ namespace CqfProject
                 Real const deltaTime = timeToNextExpiry / timeSteps;
 
                 // Pre-cache coefficients
+                UVOL_PHASE_BEGIN(mPhaseProfile, Phase::COEFFICIENTS, coefficientTimer);
                 for (std::size_t i = 0; i < numPriceSteps; ++i)
                 {
                     // Coefficients at i are for calculating at price level i + 1 (for alignment)
@@ -244,16 +418,39 @@ namespace CqfProject
                     beta2[i] = 1 + deltaTime * (-maxVolSq * ii2 - rate);
                     gamma2[i] = deltaTime * (0.5 * maxVolSq * ii2 + 0.5 * rate * ii);
                 }
+                UVOL_PHASE_END(coefficientTimer);
 
+                // Each step streams the six coefficient arrays, reads current and writes next
+#if defined (UVOL_KERNEL_DISPATCH)
+                std::size_t const simdIterationsPerStep = (numPriceSteps - 2 + gridKernels.lanes) / gridKernels.lanes;
+#elif defined (USE_AVX)
+                std::size_t const simdIterationsPerStep = (numPriceSteps + 2) / 4;
+#else
+                std::size_t const simdIterationsPerStep = numPriceSteps - 1;
+#endif
+                metrics.CountCoefficientSetup(6 * numPriceSteps * sizeof(Real));
+                metrics.CountMarch(
+                    timeSteps,
+                    numPriceSteps - 1,
+                    simdIterationsPerStep,
+                    6 * numPriceSteps * sizeof(Real),
+                    2 * (numPriceSteps + 1) * sizeof(Real));
+
+                UVOL_PHASE_BEGIN(mPhaseProfile, Phase::MARCH, marchTimer);
                 for (std::size_t k = 0; k < timeSteps; ++k)
                 {
                     // Write out values of entire grid if requested
                     if (detail >= 2)
+                    {
+                        UVOL_PHASE_BEGIN(mPhaseProfile, Phase::DETAIL_OUTPUT, detailTimer);
                         for (std::uint32_t i = 0; i <= numPriceSteps; ++i)
                             *valuesOut++ = current[i];
+                    }
 
                     // Main grid
-#if defined (USE_AVX)
+#if defined (UVOL_KERNEL_DISPATCH)
+                    gridStep(current, next, alpha1, beta1, gamma1, alpha2, beta2, gamma2, numPriceSteps);
+#elif defined (USE_AVX)
                     __m256d lower = _mm256_load_pd(current);
                     // Each iteration calculates next[i+1:i+5]
                     // earliest termination: i = numPriceSteps - 1 -> last = [numPriceSteps - 4, numPriceSteps - 1]
@@ -321,14 +518,19 @@ namespace CqfProject
 
                     std::swap(next, current);
                 }
+                UVOL_PHASE_END(marchTimer);
             }
 
             // Copy out values
             if (detail >= 1)
+            {
+                UVOL_PHASE_BEGIN(mPhaseProfile, Phase::DETAIL_OUTPUT, detailTimer);
                 for (std::uint32_t i = 0; i <= numPriceSteps; ++i)
                     *valuesOut++ = current[i];
+            }
 
-            // Find closest below price
+            // Find closest below price, timed until return
+            UVOL_PHASE_BEGIN(mPhaseProfile, Phase::INTERPOLATION, interpolationTimer);
             std::size_t const index = static_cast<std::size_t>(price / deltaPrice);
             if (index > numPriceSteps)
                 throw std::runtime_error("Price not in simulated set");
@@ -336,7 +538,7 @@ namespace CqfProject
             Real const distance = price - prices[index];
             Real const k = distance / deltaPrice;
 
-            if (mInterpolation == Interpolation::CUBIC &&
+            if (Interp == Interpolation::CUBIC &&
                 index >= 1u &&
                 index < numPriceSteps - 1)
             {
@@ -373,8 +575,6 @@ namespace CqfProject
         Real mRate;
         Real mMaxPrice;
         std::size_t mNumPriceSteps;
-        PayoffSampling mPayoffSampling;
-        Interpolation mInterpolation;
         std::vector<OptionContract> mContracts;
 
         //
@@ -387,6 +587,13 @@ namespace CqfProject
         /// dt small enough to meet stability condition given dS
         Real mTargetDeltaTime;
 
+        /// Indices of mContracts by descending expiry, rebuilt when contracts are added or replaced
+        std::vector<std::size_t> mExpiryOrder;
+        bool mExpiryOrderValid;
+
+        /// Time per phase of Valuate, when built with UVOL_PHASE_PROFILING
+        PhaseProfile mPhaseProfile;
+
         //
         // Work space and cache, to avoid repeated allocation and calculations.
         // Uses a single allocation, linearly allocates from this space
@@ -403,6 +610,84 @@ namespace CqfProject
         Real* mScratch1;
         Real* mScratch2;
     };
+
+    // Pricer with payoff sampling and interpolation fixed at compile time, so payoff and interpolation code
+    // is generated without runtime branches
+    template<PayoffSampling Sampling, Interpolation Interp>
+    class FiniteDifferencePricerT : public FiniteDifferencePricerBase<FiniteDifferencePricerT<Sampling, Interp> >
+    {
+        typedef FiniteDifferencePricerBase<FiniteDifferencePricerT<Sampling, Interp> > Base;
+        friend Base;
+
+    public:
+        FiniteDifferencePricerT(
+            Real minVol,
+            Real maxVol,
+            Real rate,
+            Real maxPrice,
+            std::size_t numPriceSteps)
+            : Base(minVol, maxVol, rate, maxPrice, numPriceSteps)
+        {}
+
+    private:
+        template<typename OutIt, typename Metrics>
+        Real ValuateSpecialized(Real price, Side side, OutIt valuesOut, int detail, Metrics& metrics)
+        {
+            return this->template ValuateAs<Sampling, Interp>(price, side, valuesOut, detail, metrics);
+        }
+    };
+
+    // Pricer with payoff sampling and interpolation chosen at run time, e.g. from R or the command line.
+    // Dispatches once per valuation to the same code as the matching FiniteDifferencePricerT.
+    class FiniteDifferencePricer : public FiniteDifferencePricerBase<FiniteDifferencePricer>
+    {
+        typedef FiniteDifferencePricerBase<FiniteDifferencePricer> Base;
+        friend Base;
+
+    public:
+        FiniteDifferencePricer(
+            Real minVol,
+            Real maxVol,
+            Real rate,
+            Real maxPrice,
+            std::size_t numPriceSteps,
+            PayoffSampling payoffSampling = PayoffSampling::INTERVAL,
+            Interpolation interpolation = Interpolation::LINEAR)
+            : Base(minVol, maxVol, rate, maxPrice, numPriceSteps)
+            , mPayoffSampling(payoffSampling)
+            , mInterpolation(interpolation)
+        {}
+
+    private:
+        template<typename OutIt, typename Metrics>
+        Real ValuateSpecialized(Real price, Side side, OutIt valuesOut, int detail, Metrics& metrics)
+        {
+            if (mPayoffSampling == PayoffSampling::POINT)
+            {
+                return mInterpolation == Interpolation::CUBIC
+                    ? ValuateAs<PayoffSampling::POINT, Interpolation::CUBIC>(price, side, valuesOut, detail, metrics)
+                    : ValuateAs<PayoffSampling::POINT, Interpolation::LINEAR>(price, side, valuesOut, detail, metrics);
+            }
+            else
+            {
+                return mInterpolation == Interpolation::CUBIC
+                    ? ValuateAs<PayoffSampling::INTERVAL, Interpolation::CUBIC>(price, side, valuesOut, detail, metrics)
+                    : ValuateAs<PayoffSampling::INTERVAL, Interpolation::LINEAR>(price, side, valuesOut, detail, metrics);
+            }
+        }
+
+        PayoffSampling mPayoffSampling;
+        Interpolation mInterpolation;
+    };
+
+    // Richardson extrapolation of values priced with steps1 and steps2 price steps, eliminating the dS^2 error term
+    inline Real RichardsonExtrapolate(Real value1, Real value2, std::size_t steps1, std::size_t steps2)
+    {
+        Real const ds1Sq = Real(1) / (Real(steps1) * Real(steps1));
+        Real const ds2Sq = Real(1) / (Real(steps2) * Real(steps2));
+
+        return (value1 * ds2Sq - value2 * ds1Sq) / (ds2Sq - ds1Sq);
+    }
 }
 
 #endif
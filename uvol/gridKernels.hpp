@@ -0,0 +1,109 @@
+#ifndef UVOL_GRID_KERNELS_HPP
+#define UVOL_GRID_KERNELS_HPP
+
+#include "types.hpp"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// Interior grid update of FiniteDifferencePricer, compiled once per instruction set in
+// gridKernelsSse2.cpp, gridKernelsAvx2.cpp and gridKernelsAvx512.cpp and selected at run time,
+// with the loops uvol-bench measures machine peaks by, so roofline peaks match the kernel's instructions.
+// The build defines UVOL_KERNEL_DISPATCH for targets linking the kernel objects; header only
+// users (e.g. the R interface) keep the inline kernels of finiteDifferencePricer.hpp.
+
+namespace CqfProject
+{
+    // Calculates next[1:numPriceSteps - 1] from current[0:numPriceSteps] and the coefficients for the
+    // minimum (alpha1, beta1, gamma1) and maximum (alpha2, beta2, gamma2) volatility.
+    // Arrays are 32 byte aligned and padded to a multiple of 4, next must not alias the others.
+    typedef void (*GridStepKernel)(
+        Real const* current,
+        Real* next,
+        Real const* alpha1,
+        Real const* beta1,
+        Real const* gamma1,
+        Real const* alpha2,
+        Real const* beta2,
+        Real const* gamma2,
+        std::size_t numPriceSteps);
+
+    /// Independent multiply-add chains of the peak throughput loop
+    std::size_t const PEAK_CHAINS = 32;
+
+    // STREAM triad a[i] = b[i] + scalar * c[i] over count elements
+    typedef void (*TriadKernel)(Real* a, Real const* b, Real const* c, Real scalar, std::size_t count);
+
+    // iterations of acc[j] = acc[j] * m + c for each of the PEAK_CHAINS values of acc
+    typedef void (*MultiplyAddKernel)(Real* acc, Real m, Real c, std::size_t iterations);
+
+    struct GridKernels
+    {
+        char const* name;
+
+        /// Doubles per vector register
+        std::size_t lanes;
+
+        /// Selecting the minimum (bid) and maximum (ask) of the two volatilities
+        GridStepKernel bid;
+        GridStepKernel ask;
+
+        /// Machine peak loops for uvol-bench
+        TriadKernel triad;
+        MultiplyAddKernel multiplyAdd;
+    };
+
+#if defined (UVOL_KERNEL_DISPATCH)
+    GridKernels const& GetGridKernelsSse2();
+    GridKernels const& GetGridKernelsAvx2();
+#   if !defined (UVOL_NO_AVX512_KERNEL)
+    GridKernels const& GetGridKernelsAvx512();
+#   endif
+
+    // Kernels by name ("sse2", "avx2" or "avx512"), nullptr if unknown, not built or not supported by this CPU
+    inline GridKernels const* FindGridKernels(char const* name)
+    {
+#   if !defined (UVOL_NO_AVX512_KERNEL)
+        if (std::strcmp(name, "avx512") == 0)
+            return __builtin_cpu_supports("avx512f") ? &GetGridKernelsAvx512() : nullptr;
+#   endif
+        if (std::strcmp(name, "avx2") == 0)
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? &GetGridKernelsAvx2() : nullptr;
+        if (std::strcmp(name, "sse2") == 0)
+            return &GetGridKernelsSse2();
+
+        return nullptr;
+    }
+
+    // Widest kernels this CPU supports, unless overridden by the UVOL_KERNEL environment variable
+    inline GridKernels const& SelectGridKernels()
+    {
+        char const* const requested = std::getenv("UVOL_KERNEL");
+        if (requested != nullptr && requested[0] != '\0')
+        {
+            if (GridKernels const* kernels = FindGridKernels(requested))
+                return *kernels;
+
+            std::cerr << "UVOL_KERNEL=" << requested << " not available, using the default kernels" << std::endl;
+        }
+
+        char const* const preference[] = { "avx512", "avx2" };
+        for (char const* name : preference)
+            if (GridKernels const* kernels = FindGridKernels(name))
+                return *kernels;
+
+        return GetGridKernelsSse2();
+    }
+
+    // Kernels used by all pricers, selected on first use
+    inline GridKernels const& GetGridKernels()
+    {
+        static GridKernels const& kernels = SelectGridKernels();
+        return kernels;
+    }
+#endif
+}
+
+#endif
@@ -0,0 +1,11 @@
+// Grid kernels compiled with -mavx2 -mfma, see gridKernels.hpp
+#include "gridKernelsImpl.hpp"
+
+namespace CqfProject
+{
+    GridKernels const& GetGridKernelsAvx2()
+    {
+        static GridKernels const kernels = MakeGridKernels<4>("avx2");
+        return kernels;
+    }
+}
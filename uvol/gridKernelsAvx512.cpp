@@ -0,0 +1,11 @@
+// Grid kernels compiled with -mavx512f, see gridKernels.hpp
+#include "gridKernelsImpl.hpp"
+
+namespace CqfProject
+{
+    GridKernels const& GetGridKernelsAvx512()
+    {
+        static GridKernels const kernels = MakeGridKernels<8>("avx512");
+        return kernels;
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef UVOL_GRID_KERNELS_IMPL_HPP
+#define UVOL_GRID_KERNELS_IMPL_HPP
+
+#include "avx.hpp"
+#include "gridKernels.hpp"
+
+// Generic grid update, included only by the per instruction set kernel sources. Everything here has
+// internal linkage, so each source keeps its own copy compiled for its instruction set and the linker
+// cannot substitute one compiled with wider instructions.
+
+namespace CqfProject
+{
+    namespace
+    {
+        struct SelectMinKernel
+        {
+            Real operator() (Real a, Real b) const
+            {
+                return a < b ? a : b;
+            }
+        };
+
+        struct SelectMaxKernel
+        {
+            Real operator() (Real a, Real b) const
+            {
+                return a > b ? a : b;
+            }
+        };
+
+        template<typename MinMaxSelector>
+        void GridStep(
+            Real const* current,
+            Real* next,
+            Real const* alpha1,
+            Real const* beta1,
+            Real const* gamma1,
+            Real const* alpha2,
+            Real const* beta2,
+            Real const* gamma2,
+            std::size_t numPriceSteps)
+        {
+            MinMaxSelector const minMaxSelector;
+
+            Real const* RESTRICT c = (Real const*)ASSUME_ALIGNED(current, 32);
+            Real* RESTRICT n = (Real*)ASSUME_ALIGNED(next, 32);
+            Real const* RESTRICT a1 = (Real const*)ASSUME_ALIGNED(alpha1, 32);
+            Real const* RESTRICT b1 = (Real const*)ASSUME_ALIGNED(beta1, 32);
+            Real const* RESTRICT g1 = (Real const*)ASSUME_ALIGNED(gamma1, 32);
+            Real const* RESTRICT a2 = (Real const*)ASSUME_ALIGNED(alpha2, 32);
+            Real const* RESTRICT b2 = (Real const*)ASSUME_ALIGNED(beta2, 32);
+            Real const* RESTRICT g2 = (Real const*)ASSUME_ALIGNED(gamma2, 32);
+
+            // Coefficients at i are for price level i + 1, so both coefficients and next are read and
+            // written from the same aligned offset
+            for (std::size_t i = 0; i < numPriceSteps - 1; ++i)
+            {
+                Real const next1 = c[i] * a1[i] + c[i + 1] * b1[i] + c[i + 2] * g1[i];
+                Real const next2 = c[i] * a2[i] + c[i + 1] * b2[i] + c[i + 2] * g2[i];
+
+                n[i + 1] = minMaxSelector(next1, next2);
+            }
+        }
+
+        void Triad(Real* a, Real const* b, Real const* c, Real scalar, std::size_t count)
+        {
+            Real* RESTRICT pa = a;
+            Real const* RESTRICT pb = b;
+            Real const* RESTRICT pc = c;
+            for (std::size_t i = 0; i < count; ++i)
+                pa[i] = pb[i] + scalar * pc[i];
+        }
+
+        void MultiplyAdd(Real* acc, Real m, Real c, std::size_t iterations)
+        {
+            // Chains held in a local array, so they stay in registers across iterations
+            Real local[PEAK_CHAINS];
+            for (std::size_t j = 0; j < PEAK_CHAINS; ++j)
+                local[j] = acc[j];
+
+            for (std::size_t k = 0; k < iterations; ++k)
+                for (std::size_t j = 0; j < PEAK_CHAINS; ++j)
+                    local[j] = local[j] * m + c;
+
+            for (std::size_t j = 0; j < PEAK_CHAINS; ++j)
+                acc[j] = local[j];
+        }
+
+        template<std::size_t Lanes>
+        GridKernels MakeGridKernels(char const* name)
+        {
+            GridKernels kernels;
+            kernels.name = name;
+            kernels.lanes = Lanes;
+            kernels.bid = &GridStep<SelectMinKernel>;
+            kernels.ask = &GridStep<SelectMaxKernel>;
+            kernels.triad = &Triad;
+            kernels.multiplyAdd = &MultiplyAdd;
+            return kernels;
+        }
+    }
+}
+
+#endif
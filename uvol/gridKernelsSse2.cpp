@@ -0,0 +1,11 @@
+// Grid kernels compiled with -msse2, see gridKernels.hpp
+#include "gridKernelsImpl.hpp"
+
+namespace CqfProject
+{
+    GridKernels const& GetGridKernelsSse2()
+    {
+        static GridKernels const kernels = MakeGridKernels<2>("sse2");
+        return kernels;
+    }
+}
@@ -0,0 +1,462 @@
+#ifndef UVOL_HEDGE_SEARCH_HPP
+#define UVOL_HEDGE_SEARCH_HPP
+
+#include "../coint/parallel.hpp"
+#include "../thirdparty/nloptThreads.hpp"
+#include "batchValuation.hpp"
+#include "finiteDifferencePricer.hpp"
+#include "optionContract.hpp"
+#include "types.hpp"
+
+#include <nlopt.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+namespace CqfProject
+{
+    struct HedgeSearchSettings
+    {
+        HedgeSearchSettings()
+            : steps1(210)
+            , steps2(290)
+            , maxPrice(0)
+            , payoffSampling(PayoffSampling::INTERVAL)
+            , interpolation(Interpolation::CUBIC)
+            , minHedges(1)
+            , maxHedges(2)
+            , numStarts(4)
+            , minQuantity(-1)
+            , maxQuantity(1)
+            , maxSubsets(2000)
+            , beamWidth(20)
+            , algorithm(NLOPT_LN_NELDERMEAD)
+            , relativeTolerance(1e-8)
+            , maxEvaluations(1000)
+            , numThreads(0)
+        {}
+
+        /// Price steps of the Richardson pair; steps2 = 0 values on steps1 alone
+        std::size_t steps1;
+        std::size_t steps2;
+
+        /// Top of the price grid, 0 for twice the underlying price
+        Real maxPrice;
+
+        PayoffSampling payoffSampling;
+        Interpolation interpolation;
+
+        /// Numbers of hedges to find the best hedge for
+        std::size_t minHedges;
+        std::size_t maxHedges;
+
+        /// Local searches per subset of strikes: from zero (or the hedge it extends) and from Halton points
+        std::size_t numStarts;
+
+        /// Bounds on each hedge quantity
+        Real minQuantity;
+        Real maxQuantity;
+
+        /// Subsets of one size searched exhaustively up to this many; beyond, the best beamWidth hedges of
+        /// one size fewer are extended by each other candidate
+        std::size_t maxSubsets;
+        std::size_t beamWidth;
+
+        /// nlopt local algorithm; derivative free, as the value is only piecewise smooth in the quantities
+        nlopt_algorithm algorithm;
+        double relativeTolerance;
+        int maxEvaluations;
+
+        /// 0 uses all hardware threads
+        unsigned numThreads;
+    };
+
+    // Best hedge found for one side and number of hedges
+    struct HedgeResult
+    {
+        HedgeResult()
+            : side(Side::BID)
+            , value(0)
+            , evaluations(0)
+            , status(NLOPT_FAILURE)
+        {}
+
+        Side side;
+
+        /// Indices of the candidate hedges used, ascending, with their quantities
+        std::vector<std::size_t> hedges;
+        std::vector<Real> quantities;
+
+        /// Value of the exotic net of the hedges' cost: highest bid or lowest ask found
+        Real value;
+
+        /// Valuations of the local search that found it (a Richardson pair counts once)
+        int evaluations;
+        nlopt_result status;
+    };
+
+    // Static hedge search for an exotic under uncertain volatility (see RunOptimization in optimization.R),
+    // over subsets of a listing of candidate hedges. For each number of hedges and each side, finds the
+    // subset and quantities giving the best value of the exotic net of the hedges' market cost: the
+    // highest bid, or the lowest ask.
+    //
+    // Every (side, subset, start) is an independent local search with nlopt, and all of one size run in
+    // parallel. Starts are zero, or the best hedge one strike smaller padded with zero, and then points
+    // of a Halton sequence over the quantity bounds, so the same subset always gets the same starts and
+    // results do not depend on the number of threads. Beyond maxSubsets subsets of a size, the search
+    // extends the best hedges of the size below (a beam search), which keeps a 50 strike listing to a
+    // few thousand local searches per size.
+    class HedgeSearch
+    {
+    public:
+        // exotic: contracts held at their multipliers. candidates: hedges (multipliers ignored) and their
+        // market prices per unit.
+        HedgeSearch(
+            std::vector<OptionContract> const& exotic,
+            std::vector<OptionContract> const& candidates,
+            std::vector<Real> const& candidatePrices,
+            Real minVol,
+            Real maxVol,
+            Real rate,
+            Real underlyingPrice,
+            HedgeSearchSettings const& settings = HedgeSearchSettings())
+            : mExotic(exotic)
+            , mCandidates(candidates)
+            , mCandidatePrices(candidatePrices)
+            , mMinVol(minVol)
+            , mMaxVol(maxVol)
+            , mRate(rate)
+            , mUnderlyingPrice(underlyingPrice)
+            , mSettings(settings)
+            , mNumSolves(0)
+        {
+            if (candidates.size() != candidatePrices.size())
+                throw std::runtime_error("one price per candidate hedge expected");
+            if (settings.maxHedges < settings.minHedges || settings.maxHedges > candidates.size())
+                throw std::runtime_error("invalid number of hedges");
+            if (!(settings.minQuantity < settings.maxQuantity))
+                throw std::runtime_error("invalid hedge quantity bounds");
+            if (settings.maxHedges > NUM_HALTON_BASES)
+                throw std::runtime_error("too many hedges for the Halton sequence");
+
+            if (mSettings.maxPrice == 0)
+                mSettings.maxPrice = 2 * underlyingPrice;
+        }
+
+        // Best hedge per number of hedges, from minHedges to maxHedges, bid then ask for each
+        std::vector<HedgeResult> Search()
+        {
+            SeedNloptOnce();
+            mNumSolves = 0;
+
+            std::size_t const n = mCandidates.size();
+            std::vector<HedgeResult> best;
+
+            // Best hedges of the previous size per side, which the beam extends
+            std::vector<HedgeResult> beam[2];
+
+            // Sizes below minHedges are searched only if the beam must build up to it
+            std::size_t first = mSettings.minHedges;
+            while (first > 1 && Combinations(n, first) > mSettings.maxSubsets)
+                --first;
+
+            for (std::size_t size = first; size <= mSettings.maxHedges; ++size)
+            {
+                bool const exhaustive = size == first || Combinations(n, size) <= mSettings.maxSubsets;
+                std::vector<Task> tasks;
+                for (int s = 0; s < 2; ++s)
+                {
+                    Side const side = s == 0 ? Side::BID : Side::ASK;
+                    if (exhaustive)
+                    {
+                        std::vector<std::size_t> subset(size);
+                        for (std::size_t i = 0; i < size; ++i)
+                            subset[i] = i;
+                        do
+                            AddTasks(side, subset, std::vector<Real>(size, Real(0)), tasks);
+                        while (NextCombination(subset, n));
+                    }
+                    else
+                    {
+                        // Each extension once, from the best parent that leads to it
+                        std::set<std::vector<std::size_t> > seen;
+                        for (HedgeResult const& parent : beam[s])
+                        {
+                            for (std::size_t c = 0; c < n; ++c)
+                            {
+                                std::vector<std::size_t> subset = parent.hedges;
+                                if (std::find(subset.begin(), subset.end(), c) != subset.end())
+                                    continue;
+
+                                std::vector<Real> start = parent.quantities;
+                                std::size_t const position = std::lower_bound(subset.begin(), subset.end(), c) - subset.begin();
+                                subset.insert(subset.begin() + position, c);
+                                start.insert(start.begin() + position, Real(0));
+                                if (seen.insert(subset).second)
+                                    AddTasks(side, subset, start, tasks);
+                            }
+                        }
+                    }
+                }
+
+                RunTasks(tasks);
+                mNumSolves += tasks.size();
+
+                // Best of the starts per subset, in task order, then the best subsets per side
+                for (int s = 0; s < 2; ++s)
+                {
+                    Side const side = s == 0 ? Side::BID : Side::ASK;
+                    std::vector<HedgeResult> subsets;
+                    for (Task const& task : tasks)
+                    {
+                        if (task.result.side != side)
+                            continue;
+                        if (subsets.empty() || subsets.back().hedges != task.result.hedges)
+                            subsets.push_back(task.result);
+                        else if (Better(task.result, subsets.back()))
+                            subsets.back() = task.result;
+                    }
+
+                    std::stable_sort(subsets.begin(), subsets.end(), &HedgeSearch::Better);
+                    if (subsets.size() > mSettings.beamWidth)
+                        subsets.resize(mSettings.beamWidth);
+                    if (size >= mSettings.minHedges && !subsets.empty())
+                        best.push_back(subsets.front());
+                    beam[s].swap(subsets);
+                }
+            }
+
+            return best;
+        }
+
+        // Value of the exotic with hedges of the given candidates and quantities, net of their cost
+        Real Value(Side side, std::vector<std::size_t> const& hedges, std::vector<Real> const& quantities) const
+        {
+            Pricers pricers(*this);
+            pricers.SetHedges(hedges);
+            return pricers.Value(side, quantities.data());
+        }
+
+        // Local searches run by the last Search
+        std::size_t GetSolveCount() const
+        {
+            return mNumSolves;
+        }
+
+    private:
+        static std::size_t const NUM_HALTON_BASES = 16;
+
+        struct Task
+        {
+            std::vector<Real> start;
+            HedgeResult result;
+        };
+
+        // Finite difference pricers of the Richardson pair, holding the exotic and one subset of hedges
+        class Pricers
+        {
+        public:
+            explicit Pricers(HedgeSearch const& search)
+                : mSearch(search)
+                , mPricer1(search.CreatePricer(search.mSettings.steps1))
+                , mPricer2(search.CreatePricer(search.mSettings.steps2 != 0 ? search.mSettings.steps2 : 3))
+            {}
+
+            void SetHedges(std::vector<std::size_t> const& hedges)
+            {
+                mHedges = hedges;
+                mMultipliers.resize(mSearch.mExotic.size() + hedges.size());
+                for (FiniteDifferencePricer* pricer : { &mPricer1, &mPricer2 })
+                {
+                    pricer->ClearContracts();
+                    for (OptionContract const& contract : mSearch.mExotic)
+                        pricer->AddContract(contract);
+                    for (std::size_t h : hedges)
+                        pricer->AddContract(mSearch.mCandidates[h]);
+                }
+                for (std::size_t i = 0; i < mSearch.mExotic.size(); ++i)
+                    mMultipliers[i] = mSearch.mExotic[i].multiplier;
+            }
+
+            Real Value(Side side, Real const* quantities)
+            {
+                std::size_t const numExotic = mSearch.mExotic.size();
+                Real cost = 0;
+                for (std::size_t i = 0; i < mHedges.size(); ++i)
+                {
+                    mMultipliers[numExotic + i] = quantities[i];
+                    cost += quantities[i] * mSearch.mCandidatePrices[mHedges[i]];
+                }
+
+                HedgeSearchSettings const& settings = mSearch.mSettings;
+                mPricer1.SetMultipliers(mMultipliers.data());
+                Real value = mPricer1.Valuate(mSearch.mUnderlyingPrice, side);
+                if (settings.steps2 != 0)
+                {
+                    mPricer2.SetMultipliers(mMultipliers.data());
+                    value = RichardsonExtrapolate(value, mPricer2.Valuate(mSearch.mUnderlyingPrice, side), settings.steps1, settings.steps2);
+                }
+
+                return value - cost;
+            }
+
+        private:
+            HedgeSearch const& mSearch;
+            FiniteDifferencePricer mPricer1;
+            FiniteDifferencePricer mPricer2;
+            std::vector<std::size_t> mHedges;
+            std::vector<Real> mMultipliers;
+        };
+
+        // Objective of one local search: nlopt minimizes, so the bid is negated
+        struct Objective
+        {
+            Pricers* pricers;
+            Side side;
+            int evaluations;
+
+            static double Evaluate(unsigned, double const* x, double*, void* data)
+            {
+                Objective& objective = *static_cast<Objective*>(data);
+                ++objective.evaluations;
+                Real const value = objective.pricers->Value(objective.side, x);
+                return objective.side == Side::BID ? -value : value;
+            }
+        };
+
+        FiniteDifferencePricer CreatePricer(std::size_t steps) const
+        {
+            return FiniteDifferencePricer(mMinVol, mMaxVol, mRate, mSettings.maxPrice, steps, mSettings.payoffSampling, mSettings.interpolation);
+        }
+
+        static bool Better(HedgeResult const& a, HedgeResult const& b)
+        {
+            return a.side == Side::BID ? a.value > b.value : a.value < b.value;
+        }
+
+        static std::size_t Combinations(std::size_t n, std::size_t k)
+        {
+            // Saturates rather than overflows, as only comparison with maxSubsets matters
+            double count = 1;
+            for (std::size_t i = 0; i < k; ++i)
+                count = count * (n - i) / (i + 1);
+            return count > 1e18 ? static_cast<std::size_t>(1e18) : static_cast<std::size_t>(count + 0.5);
+        }
+
+        // Next ascending k-subset of 0..n-1 in lexicographic order; false after the last
+        static bool NextCombination(std::vector<std::size_t>& subset, std::size_t n)
+        {
+            std::size_t const k = subset.size();
+            for (std::size_t i = k; i-- > 0;)
+            {
+                if (subset[i] < n - k + i)
+                {
+                    ++subset[i];
+                    for (std::size_t j = i + 1; j < k; ++j)
+                        subset[j] = subset[j - 1] + 1;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Radical inverse of index in a prime base: coordinate of the Halton sequence
+        static Real Halton(std::size_t index, std::size_t dimension)
+        {
+            static unsigned const primes[NUM_HALTON_BASES] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53 };
+            unsigned const base = primes[dimension];
+            Real result = 0, scale = Real(1) / base;
+            for (; index > 0; index /= base, scale /= base)
+                result += scale * (index % base);
+            return result;
+        }
+
+        void AddTasks(Side side, std::vector<std::size_t> const& subset, std::vector<Real> const& start, std::vector<Task>& tasks) const
+        {
+            Real const width = mSettings.maxQuantity - mSettings.minQuantity;
+            std::size_t const numStarts = subset.empty() ? 1 : std::max<std::size_t>(mSettings.numStarts, 1);
+            for (std::size_t s = 0; s < numStarts; ++s)
+            {
+                Task task;
+                task.result.side = side;
+                task.result.hedges = subset;
+                task.start = start;
+                for (std::size_t d = 0; d < subset.size(); ++d)
+                {
+                    if (s > 0)
+                        task.start[d] = mSettings.minQuantity + width * Halton(s, d);
+                    task.start[d] = std::min(std::max(task.start[d], mSettings.minQuantity), mSettings.maxQuantity);
+                }
+                tasks.push_back(task);
+            }
+        }
+
+        void Solve(Pricers& pricers, Task& task) const
+        {
+            HedgeResult& result = task.result;
+            pricers.SetHedges(result.hedges);
+            result.quantities = task.start;
+
+            Objective objective = { &pricers, result.side, 0 };
+            if (result.hedges.empty())
+            {
+                result.value = pricers.Value(result.side, nullptr);
+                result.evaluations = 1;
+                result.status = NLOPT_SUCCESS;
+                return;
+            }
+
+            nlopt_opt const opt = nlopt_create(mSettings.algorithm, static_cast<unsigned>(result.hedges.size()));
+            if (opt == nullptr)
+                throw std::runtime_error("failed to create the nlopt problem");
+
+            nlopt_set_lower_bounds1(opt, mSettings.minQuantity);
+            nlopt_set_upper_bounds1(opt, mSettings.maxQuantity);
+            nlopt_set_min_objective(opt, &Objective::Evaluate, &objective);
+            nlopt_set_xtol_rel(opt, mSettings.relativeTolerance);
+            nlopt_set_maxeval(opt, mSettings.maxEvaluations);
+
+            double minimum = 0;
+            result.status = nlopt_optimize(opt, result.quantities.data(), &minimum);
+            nlopt_destroy(opt);
+
+            if (result.status < 0 && result.status != NLOPT_ROUNDOFF_LIMITED)
+                throw std::runtime_error("hedge search failed in nlopt");
+
+            result.value = result.side == Side::BID ? -minimum : minimum;
+            result.evaluations = objective.evaluations;
+        }
+
+        // Local searches in parallel, each thread with its own pricers
+        void RunTasks(std::vector<Task>& tasks) const
+        {
+            if (tasks.empty())
+                return;
+
+            std::atomic<std::size_t> nextTask(0);
+            RunParallel(ThreadCount(mSettings.numThreads, tasks.size()), [&] (std::size_t, std::atomic<bool> const& failed)
+            {
+                Pricers pricers(*this);
+                for (std::size_t t = nextTask++; t < tasks.size() && !failed; t = nextTask++)
+                    Solve(pricers, tasks[t]);
+            });
+        }
+
+        std::vector<OptionContract> mExotic;
+        std::vector<OptionContract> mCandidates;
+        std::vector<Real> mCandidatePrices;
+        Real mMinVol;
+        Real mMaxVol;
+        Real mRate;
+        Real mUnderlyingPrice;
+        HedgeSearchSettings mSettings;
+
+        std::size_t mNumSolves;
+    };
+}
+
+#endif
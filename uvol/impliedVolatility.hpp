@@ -0,0 +1,238 @@
+#ifndef UVOL_IMPLIED_VOLATILITY_HPP
+#define UVOL_IMPLIED_VOLATILITY_HPP
+
+#include "avx.hpp"
+#include "normalDistribution.hpp"
+#include "types.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace CqfProject
+{
+    // Implied volatility inversion of European calls and puts.
+    //
+    // Works in Jaeckel's normalized coordinates, x = ln(F / K), b = undiscounted price / sqrt(F * K),
+    // solving for total volatility s = vol * sqrt(T) in the normalized out of the money call
+    //   b(x, s) = exp(x / 2) * Phi(x / s + s / 2) - exp(-x / 2) * Phi(x / s - s / 2), x <= 0
+    // The initial guess is the larger of Corrado-Miller's closed form and the small price asymptote
+    // s = |x| / sqrt(-2 ln(b)), refined by a fixed number of third order Householder steps.
+    // The refinement loop has no data dependent branches, so it vectorizes across quotes.
+
+    // Initial guess for normalized total volatility, x <= 0, beta in (0, exp(x / 2))
+    inline Real ImpliedTotalVolatilityGuess(Real x, Real beta)
+    {
+        Real const sqrtTwoPi = 2.50662827463100050242;
+        Real const invPi = 0.31830988618379067154;
+
+        // Corrado-Miller, in normalized units (F = exp(x / 2), K = exp(-x / 2))
+        Real const ePlus = std::exp(Real(0.5) * x);
+        Real const eMinus = Real(1) / ePlus;
+        Real const halfDiff = Real(0.5) * (ePlus - eMinus);
+        Real const c = beta - halfDiff;
+        Real const disc = c * c - Real(4) * halfDiff * halfDiff * invPi;
+        Real const corradoMiller = sqrtTwoPi / (ePlus + eMinus) * (c + std::sqrt(std::max(disc, Real(0))));
+
+        // Leading order of b(x, s) ~ exp(-x^2 / (2 s^2)) for small s
+        Real const lowerAsymptote = std::abs(x) / std::sqrt(Real(-2) * std::log(std::min(beta, Real(0.5))));
+
+        return std::max(corradoMiller, lowerAsymptote);
+    }
+
+    // Refine normalized total volatilities s in place. x <= 0 and beta are normalized OTM call prices.
+    inline void ImpliedTotalVolatilityNormalized(
+        Real const* RESTRICT x,
+        Real const* RESTRICT beta,
+        Real* RESTRICT s,
+        std::size_t count,
+        std::size_t iterations)
+    {
+        Real const invSqrtTwoPi = 0.39894228040143267794;
+        Real const minS = 1e-8;
+        Real const maxS = 20.0;
+
+        // Iterations outermost, so the loop over quotes is innermost and vectorizes
+        for (std::size_t k = 0; k < iterations; ++k)
+        {
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                Real const xi = x[i];
+                Real const bi = beta[i];
+                Real const si = s[i];
+                Real const ePlus = ExpBranchFree(Real(0.5) * xi);
+                Real const eMinus = Real(1) / ePlus;
+
+                Real const xs = xi / si;
+                Real const d1 = xs + Real(0.5) * si;
+                Real const d2 = xs - Real(0.5) * si;
+                Real const b = ePlus * NormalCdf(d1) - eMinus * NormalCdf(d2);
+                Real const bSafe = b > Real(1e-300) ? b : Real(1e-300);
+
+                // Derivatives of b relative to vega = b'
+                Real const vega = invSqrtTwoPi * ExpBranchFree(Real(-0.5) * (xs * xs + Real(0.25) * si * si));
+                Real const h2 = xs * xs / si - Real(0.25) * si;
+                Real const h3 = h2 * h2 - Real(3) * xs * xs / (si * si) - Real(0.25);
+
+                // Below the inflexion point s = sqrt(2 |x|) b is convex and exponentially flat in s,
+                // so iterate on ln(b) - ln(beta) instead, as Jaeckel does.
+                // Derivatives of ln(b) relative to its first derivative r1 = b' / b.
+                bool const lower = si * si < Real(-2) * xi;
+                Real const r1 = vega / bSafe;
+                Real const logH2 = h2 - r1;
+                Real const logH3 = h3 - Real(3) * h2 * r1 + Real(2) * r1 * r1;
+                Real const logBeta = LogBranchFree(bi > Real(1e-300) ? bi : Real(1e-300));
+
+                Real const nu = lower
+                    ? (logBeta - LogBranchFree(bSafe)) / (r1 > Real(1e-300) ? r1 : Real(1e-300))
+                    : (bi - b) / (vega > Real(1e-300) ? vega : Real(1e-300));
+                Real const g2 = lower ? logH2 : h2;
+                Real const g3 = lower ? logH3 : h3;
+                Real const step = nu * (Real(1) + Real(0.5) * g2 * nu) / (Real(1) + nu * (g2 + g3 * nu / Real(6)));
+
+                // Fall back to a Newton step where the Householder correction degenerates
+                Real const newS = si + (std::abs(step) < maxS ? step : nu);
+                Real const clampedS = newS < minS ? Real(0.5) * si : newS;
+                s[i] = clampedS > maxS ? maxS : clampedS;
+            }
+        }
+    }
+
+    // Implied volatilities of market prices of calls and puts. Binary options and prices outside
+    // the no-arbitrage bounds produce NaN.
+    inline void ImpliedVolatility(
+        OptionType const* types,
+        Real const* expiries,
+        Real const* strikes,
+        Real const* prices,
+        Real* vols,
+        std::size_t count,
+        Real rate,
+        Real underlyingPrice,
+        std::size_t iterations = 4)
+    {
+        // Process in chunks to keep the normalized work space on the stack
+        std::size_t const chunkSize = 256;
+        Real x[chunkSize];
+        Real beta[chunkSize];
+        Real s[chunkSize];
+        Real sqrtT[chunkSize];
+
+        Real const nan = std::numeric_limits<Real>::quiet_NaN();
+
+        for (std::size_t begin = 0; begin < count; begin += chunkSize)
+        {
+            std::size_t const n = std::min(chunkSize, count - begin);
+
+            // Normalize and map to out of the money calls
+            for (std::size_t j = 0; j < n; ++j)
+            {
+                std::size_t const i = begin + j;
+                Real const T = expiries[i];
+                Real const K = strikes[i];
+                Real const forward = underlyingPrice * std::exp(rate * T);
+                Real const sqrtFK = std::sqrt(forward * K);
+                Real const undiscounted = prices[i] * std::exp(rate * T);
+                Real const xi = std::log(forward / K);
+
+                // Put-call parity on undiscounted prices: c - p = F - K
+                Real call;
+                switch (types[i])
+                {
+                case OptionType::CALL:
+                    call = undiscounted;
+                    break;
+
+                case OptionType::PUT:
+                    call = undiscounted + forward - K;
+                    break;
+
+                default:
+                    call = nan;
+                    break;
+                }
+
+                // b(x) = b(-x) + exp(x / 2) - exp(-x / 2)
+                Real const b = call / sqrtFK;
+                Real const intrinsic = std::max(forward - K, Real(0)) / sqrtFK;
+                Real const upper = forward / sqrtFK;
+                bool const valid = T > Real(0) && b > intrinsic && b < upper;
+
+                x[j] = -std::abs(xi);
+                beta[j] = valid ? (xi > Real(0) ? b - intrinsic : b) : Real(0);
+                sqrtT[j] = valid ? std::sqrt(T) : nan;
+                s[j] = valid ? ImpliedTotalVolatilityGuess(x[j], beta[j]) : Real(1);
+            }
+
+            ImpliedTotalVolatilityNormalized(x, beta, s, n, iterations);
+
+            for (std::size_t j = 0; j < n; ++j)
+                vols[begin + j] = s[j] / sqrtT[j];
+        }
+    }
+
+    inline Real ImpliedVolatility(
+        OptionType type,
+        Real expiry,
+        Real strike,
+        Real price,
+        Real rate,
+        Real underlyingPrice,
+        std::size_t iterations = 4)
+    {
+        Real vol;
+        ImpliedVolatility(&type, &expiry, &strike, &price, &vol, 1, rate, underlyingPrice, iterations);
+        return vol;
+    }
+
+    struct VolatilityBand
+    {
+        Real minVol;
+        Real maxVol;
+    };
+
+    // Select [minVol, maxVol] for uncertain volatility pricing as quantiles of the implied volatilities
+    // with expiry in [minExpiry, maxExpiry]. Quantiles 0 and 1 give the min and max. NaN volatilities are ignored.
+    inline VolatilityBand SelectVolatilityBand(
+        Real const* vols,
+        Real const* expiries,
+        std::size_t count,
+        Real minExpiry,
+        Real maxExpiry,
+        Real lowerQuantile = 0,
+        Real upperQuantile = 1)
+    {
+        if (!(lowerQuantile >= 0 && lowerQuantile <= upperQuantile && upperQuantile <= 1))
+            throw std::runtime_error("invalid volatility band quantiles");
+
+        std::vector<Real> selected;
+        for (std::size_t i = 0; i < count; ++i)
+            if (expiries[i] >= minExpiry && expiries[i] <= maxExpiry && !std::isnan(vols[i]))
+                selected.push_back(vols[i]);
+
+        if (selected.empty())
+            throw std::runtime_error("no implied volatilities in expiry range");
+
+        // Linearly interpolated quantile, as R's default quantile type
+        auto const quantile = [&selected] (Real q) -> Real
+        {
+            Real const h = q * (selected.size() - 1);
+            std::size_t const lo = static_cast<std::size_t>(h);
+            std::size_t const hi = std::min(lo + 1, selected.size() - 1);
+            std::nth_element(selected.begin(), selected.begin() + lo, selected.end());
+            Real const vlo = selected[lo];
+            Real const vhi = hi == lo ? vlo : *std::min_element(selected.begin() + lo + 1, selected.end());
+            return vlo + (h - lo) * (vhi - vlo);
+        };
+
+        VolatilityBand band;
+        band.minVol = quantile(lowerQuantile);
+        band.maxVol = quantile(upperQuantile);
+        return band;
+    }
+}
+
+#endif
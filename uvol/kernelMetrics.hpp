@@ -0,0 +1,102 @@
+#ifndef UVOL_KERNEL_METRICS_HPP
+#define UVOL_KERNEL_METRICS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace CqfProject
+{
+    // Metrics policies for FiniteDifferencePricer::Valuate.
+    // The pricer reports its work once per expiry segment, not per node, so even the counting policy is cheap.
+    // With NullKernelMetrics, the default, every call is empty and inlined away.
+
+    struct NullKernelMetrics
+    {
+        void CountValuation() {}
+        void CountCoefficientSetup(std::size_t bytes) {}
+        void CountMarch(
+            std::size_t timeSteps,
+            std::size_t nodesPerStep,
+            std::size_t simdIterationsPerStep,
+            std::size_t coefficientBytesPerStep,
+            std::size_t stateBytesPerStep) {}
+    };
+
+    // Accumulates work done by the explicit finite difference kernel, over any number of valuations
+    struct KernelMetrics
+    {
+        KernelMetrics()
+        {
+            Reset();
+        }
+
+        void Reset()
+        {
+            valuations = 0;
+            timeSteps = 0;
+            nodeUpdates = 0;
+            simdIterations = 0;
+            coefficientBytes = 0;
+            stateBytes = 0;
+        }
+
+        void CountValuation()
+        {
+            ++valuations;
+        }
+
+        // Coefficients written when a segment between expiries is set up
+        void CountCoefficientSetup(std::size_t bytes)
+        {
+            coefficientBytes += bytes;
+        }
+
+        // timeSteps steps of the stencil, each updating nodesPerStep interior nodes
+        // in simdIterationsPerStep iterations of the kernel loop
+        void CountMarch(
+            std::size_t steps,
+            std::size_t nodesPerStep,
+            std::size_t simdIterationsPerStep,
+            std::size_t coefficientBytesPerStep,
+            std::size_t stateBytesPerStep)
+        {
+            timeSteps += steps;
+            nodeUpdates += static_cast<std::uint64_t>(steps) * nodesPerStep;
+            simdIterations += static_cast<std::uint64_t>(steps) * simdIterationsPerStep;
+            coefficientBytes += static_cast<std::uint64_t>(steps) * coefficientBytesPerStep;
+            stateBytes += static_cast<std::uint64_t>(steps) * stateBytesPerStep;
+        }
+
+        // Floating point operations per node update: two three point stencils
+        // (3 multiplies, 2 adds each) and the min / max selection
+        static std::uint64_t FlopsPerNode()
+        {
+            return 11;
+        }
+
+        std::uint64_t Flops() const
+        {
+            return nodeUpdates * FlopsPerNode();
+        }
+
+        std::uint64_t Bytes() const
+        {
+            return coefficientBytes + stateBytes;
+        }
+
+        // Flops per byte moved, for placing the kernel on a roofline
+        double ArithmeticIntensity() const
+        {
+            return Bytes() > 0 ? static_cast<double>(Flops()) / Bytes() : 0.0;
+        }
+
+        std::uint64_t valuations;
+        std::uint64_t timeSteps;
+        std::uint64_t nodeUpdates;
+        std::uint64_t simdIterations;
+        std::uint64_t coefficientBytes;
+        std::uint64_t stateBytes;
+    };
+}
+
+#endif
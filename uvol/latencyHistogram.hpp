@@ -0,0 +1,127 @@
+#ifndef UVOL_LATENCY_HISTOGRAM_HPP
+#define UVOL_LATENCY_HISTOGRAM_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace CqfProject
+{
+    // Log-linear histogram of nanosecond latencies: 16 buckets per power of two above 32 ns, so quantiles are
+    // within 1/16 of the recorded values. Recording is lock free; reads may run concurrently with it,
+    // and then miss values still being recorded.
+    class LatencyHistogram
+    {
+    public:
+        static int const SUB_BUCKET_BITS = 4;
+        static int const SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        static int const NUM_BUCKETS = 2 * SUB_BUCKETS + (64 - SUB_BUCKET_BITS - 1) * SUB_BUCKETS;
+
+        LatencyHistogram()
+        {
+            Reset();
+        }
+
+        LatencyHistogram(LatencyHistogram const&) = delete;
+        LatencyHistogram& operator = (LatencyHistogram const&) = delete;
+
+        void Reset()
+        {
+            for (int i = 0; i < NUM_BUCKETS; ++i)
+                mCounts[i].store(0, std::memory_order_relaxed);
+            mMax.store(0, std::memory_order_relaxed);
+            mSum.store(0, std::memory_order_relaxed);
+        }
+
+        void Record(std::uint64_t ns)
+        {
+            mCounts[BucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+            mSum.fetch_add(ns, std::memory_order_relaxed);
+
+            std::uint64_t max = mMax.load(std::memory_order_relaxed);
+            while (ns > max && !mMax.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+                ;
+        }
+
+        std::uint64_t Count() const
+        {
+            std::uint64_t count = 0;
+            for (int i = 0; i < NUM_BUCKETS; ++i)
+                count += mCounts[i].load(std::memory_order_relaxed);
+            return count;
+        }
+
+        std::uint64_t Max() const
+        {
+            return mMax.load(std::memory_order_relaxed);
+        }
+
+        double Mean() const
+        {
+            std::uint64_t const count = Count();
+            return count == 0 ? 0.0 : static_cast<double>(mSum.load(std::memory_order_relaxed)) / count;
+        }
+
+        // Upper bound of the bucket holding the q quantile, at most the maximum recorded, 0 if empty
+        std::uint64_t Quantile(double q) const
+        {
+            std::uint64_t const count = Count();
+            if (count == 0)
+                return 0;
+
+            std::uint64_t const rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(q * count)));
+            std::uint64_t cumulative = 0;
+            for (int i = 0; i < NUM_BUCKETS; ++i)
+            {
+                cumulative += mCounts[i].load(std::memory_order_relaxed);
+                if (cumulative >= rank)
+                    return std::min(BucketUpperBound(i), Max());
+            }
+
+            return Max();
+        }
+
+        // Values up to 2 * SUB_BUCKETS have their own bucket, then SUB_BUCKETS per power of two
+        static int BucketIndex(std::uint64_t ns)
+        {
+            if (ns < static_cast<std::uint64_t>(2 * SUB_BUCKETS))
+                return static_cast<int>(ns);
+
+            int const msb = 63 - CountLeadingZeros(ns);
+            int const shift = msb - SUB_BUCKET_BITS;
+            int const mantissa = static_cast<int>(ns >> shift);
+            return 2 * SUB_BUCKETS + (shift - 1) * SUB_BUCKETS + (mantissa - SUB_BUCKETS);
+        }
+
+        static std::uint64_t BucketUpperBound(int index)
+        {
+            if (index < 2 * SUB_BUCKETS)
+                return static_cast<std::uint64_t>(index);
+
+            int const shift = (index - 2 * SUB_BUCKETS) / SUB_BUCKETS + 1;
+            std::uint64_t const mantissa = static_cast<std::uint64_t>((index - 2 * SUB_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS);
+            return ((mantissa + 1) << shift) - 1;
+        }
+
+    private:
+        static int CountLeadingZeros(std::uint64_t x)
+        {
+#if defined (__GNUC__)
+            return __builtin_clzll(x);
+#else
+            int n = 0;
+            for (std::uint64_t bit = std::uint64_t(1) << 63; (x & bit) == 0; bit >>= 1)
+                ++n;
+            return n;
+#endif
+        }
+
+        std::atomic<std::uint64_t> mCounts[NUM_BUCKETS];
+        std::atomic<std::uint64_t> mMax;
+        std::atomic<std::uint64_t> mSum;
+    };
+}
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef UVOL_NORMAL_DISTRIBUTION_HPP
+#define UVOL_NORMAL_DISTRIBUTION_HPP
+
+#include "avx.hpp"
+#include "types.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// ExpBranchFree rounds with (a + s) - s, which /fp:fast (as the Windows build uses) may fold to a
+#if defined (_MSC_VER)
+#pragma float_control(precise, on, push)
+#endif
+
+namespace CqfProject
+{
+    // exp(x) without library calls or data dependent branches, so that loops over it vectorize.
+    // Range reduction x = n * ln(2) + r, |r| <= ln(2) / 2, followed by a degree 13 Taylor polynomial.
+    // Relative error is within a few ulp. Arguments are clamped to [-708, 709].
+    inline Real ExpBranchFree(Real x)
+    {
+        Real const log2e = 1.4426950408889634;
+        Real const ln2Hi = 6.93147180369123816490e-01;
+        Real const ln2Lo = 1.90821492927058770002e-10;
+        Real const shifter = 6755399441055744.0; // 1.5 * 2^52
+
+        x = x < Real(-708) ? Real(-708) : x;
+        x = x > Real(709) ? Real(709) : x;
+
+        // Round x / ln(2) to nearest integer n, using the shifter to push the fraction out of the mantissa.
+        // Requires strict IEEE semantics; (a + s) - s must not be folded by the compiler.
+        Real const shifted = x * log2e + shifter;
+        Real const n = shifted - shifter;
+        Real const r = (x - n * ln2Hi) - n * ln2Lo;
+
+        Real p = Real(1.0 / 6227020800.0);
+        p = p * r + Real(1.0 / 479001600.0);
+        p = p * r + Real(1.0 / 39916800.0);
+        p = p * r + Real(1.0 / 3628800.0);
+        p = p * r + Real(1.0 / 362880.0);
+        p = p * r + Real(1.0 / 40320.0);
+        p = p * r + Real(1.0 / 5040.0);
+        p = p * r + Real(1.0 / 720.0);
+        p = p * r + Real(1.0 / 120.0);
+        p = p * r + Real(1.0 / 24.0);
+        p = p * r + Real(1.0 / 6.0);
+        p = p * r + Real(0.5);
+        p = p * r + Real(1);
+        p = p * r + Real(1);
+
+        // The low mantissa bits of the shifted value hold n + 2^51.
+        // Move them, biased by 1023, into the exponent field to form 2^n.
+        std::uint64_t bits;
+        std::memcpy(&bits, &shifted, sizeof(bits));
+        bits = (bits + 1023u) << 52;
+        Real scale;
+        std::memcpy(&scale, &bits, sizeof(scale));
+
+        return p * scale;
+    }
+
+    // Natural logarithm of positive normal x without library calls or data dependent branches.
+    // x = m * 2^e, m in [sqrt(2) / 2, sqrt(2)), ln(m) = 2 * atanh((m - 1) / (m + 1)) by its series.
+    inline Real LogBranchFree(Real x)
+    {
+        Real const ln2 = 0.69314718055994530942;
+        Real const sqrt2 = 1.41421356237309504880;
+        Real const twoPow52 = 4503599627370496.0;
+
+        std::uint64_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+
+        // Exponent as a double, by placing it in the mantissa of 2^52
+        std::uint64_t const exponentBits = (bits >> 52) | 0x4330000000000000u;
+        Real e;
+        std::memcpy(&e, &exponentBits, sizeof(e));
+        e = e - twoPow52 - Real(1023);
+
+        // Mantissa in [1, 2)
+        std::uint64_t const mantissaBits = (bits & 0x000fffffffffffffu) | 0x3ff0000000000000u;
+        Real m;
+        std::memcpy(&m, &mantissaBits, sizeof(m));
+
+        bool const high = m > sqrt2;
+        m = high ? Real(0.5) * m : m;
+        e = high ? e + Real(1) : e;
+
+        Real const t = (m - Real(1)) / (m + Real(1));
+        Real const t2 = t * t;
+
+        Real p = Real(1.0 / 21.0);
+        p = p * t2 + Real(1.0 / 19.0);
+        p = p * t2 + Real(1.0 / 17.0);
+        p = p * t2 + Real(1.0 / 15.0);
+        p = p * t2 + Real(1.0 / 13.0);
+        p = p * t2 + Real(1.0 / 11.0);
+        p = p * t2 + Real(1.0 / 9.0);
+        p = p * t2 + Real(1.0 / 7.0);
+        p = p * t2 + Real(1.0 / 5.0);
+        p = p * t2 + Real(1.0 / 3.0);
+        p = p * t2 + Real(1);
+
+        return e * ln2 + Real(2) * t * p;
+    }
+
+    // Standard normal probability density
+    inline Real NormalPdf(Real x)
+    {
+        Real const invSqrtTwoPi = 0.39894228040143267794;
+        return invSqrtTwoPi * ExpBranchFree(Real(-0.5) * x * x);
+    }
+
+    // Standard normal cumulative distribution, accurate to double precision.
+    // Hart (1968) algorithm 5666 as presented in West, "Better approximations to cumulative normal functions" (2005):
+    // a rational approximation up to |x| = 5 * sqrt(2), and a continued fraction in the tail.
+    // Both branches are evaluated and blended, so loops over it vectorize.
+    inline Real NormalCdf(Real x)
+    {
+        Real const z = std::fabs(x);
+        Real const e = ExpBranchFree(Real(-0.5) * z * z);
+
+        Real num = Real(3.52624965998911e-02);
+        num = num * z + Real(0.700383064443688);
+        num = num * z + Real(6.37396220353165);
+        num = num * z + Real(33.912866078383);
+        num = num * z + Real(112.079291497871);
+        num = num * z + Real(221.213596169931);
+        num = num * z + Real(220.206867912376);
+
+        Real den = Real(8.83883476483184e-02);
+        den = den * z + Real(1.75566716318264);
+        den = den * z + Real(16.064177579207);
+        den = den * z + Real(86.7807322029461);
+        den = den * z + Real(296.564248779674);
+        den = den * z + Real(637.333633378831);
+        den = den * z + Real(793.826512519948);
+        den = den * z + Real(440.413735824752);
+
+        Real cf = z + Real(0.65);
+        cf = z + Real(4) / cf;
+        cf = z + Real(3) / cf;
+        cf = z + Real(2) / cf;
+        cf = z + Real(1) / cf;
+
+        bool const central = z < Real(7.07106781186547);
+        Real const tailNum = central ? e * num : e;
+        Real const tailDen = central ? den : cf * Real(2.506628274631);
+        Real const tail = tailNum / tailDen;
+
+        return x > Real(0) ? Real(1) - tail : tail;
+    }
+
+    // Batch versions, out[i] = f(x[i])
+    inline void NormalPdf(Real const* RESTRICT x, Real* RESTRICT out, std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            out[i] = NormalPdf(x[i]);
+    }
+
+    inline void NormalCdf(Real const* RESTRICT x, Real* RESTRICT out, std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            out[i] = NormalCdf(x[i]);
+    }
+}
+
+#if defined (_MSC_VER)
+#pragma float_control(pop)
+#endif
+
+#endif
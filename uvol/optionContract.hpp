@@ -3,8 +3,89 @@
 
 #include "types.hpp"
 
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+
 namespace CqfProject
 {
+    // Payoffs of an option type known at compile time, so loops over a price grid need no switch per node.
+    // OptionContract::CalculatePayoff and CalculateAveragePayoff dispatch here on the runtime type.
+    template<OptionType type>
+    struct ContractPayoff;
+
+    template<>
+    struct ContractPayoff<OptionType::CALL>
+    {
+        static Real Payoff(Real strike, Real price, Real epsilon = 0.0001)
+        {
+            return std::max(price - strike, Real(0));
+        }
+
+        static Real AveragePayoff(Real strike, Real price1, Real price2)
+        {
+            return price1 > strike
+                ? Real(0.5) * (price1 + price2) - strike
+                : price2 > strike
+                ? Real(0.5) * (price2 - strike) * (price2 - strike) / (price2 - price1)
+                : Real(0);
+        }
+    };
+
+    template<>
+    struct ContractPayoff<OptionType::PUT>
+    {
+        static Real Payoff(Real strike, Real price, Real epsilon = 0.0001)
+        {
+            return std::max(strike - price, Real(0));
+        }
+
+        static Real AveragePayoff(Real strike, Real price1, Real price2)
+        {
+            return price2 < strike
+                ? strike - Real(0.5) * (price1 + price2)
+                : price1 < strike
+                ? Real(0.5) * (strike - price1) * (strike - price1) / (price2 - price1)
+                : Real(0);
+        }
+    };
+
+    template<>
+    struct ContractPayoff<OptionType::BINARY_CALL>
+    {
+        static Real Payoff(Real strike, Real price, Real epsilon = 0.0001)
+        {
+            return price > (strike - epsilon) ? Real(1) : Real(0);
+        }
+
+        static Real AveragePayoff(Real strike, Real price1, Real price2)
+        {
+            return price1 > strike
+                ? Real(1)
+                : price2 > strike
+                ? (price2 - strike) / (price2 - price1)
+                : Real(0);
+        }
+    };
+
+    template<>
+    struct ContractPayoff<OptionType::BINARY_PUT>
+    {
+        static Real Payoff(Real strike, Real price, Real epsilon = 0.0001)
+        {
+            return price < (strike + epsilon) ? Real(1) : Real(0);
+        }
+
+        static Real AveragePayoff(Real strike, Real price1, Real price2)
+        {
+            return price2 < strike
+                ? Real(1)
+                : price1 < strike
+                ? (strike - price1) / (price2 - price1)
+                : Real(0);
+        }
+    };
+
     struct OptionContract
     {
         typedef OptionType Type;
@@ -22,16 +103,16 @@ namespace CqfProject
             switch(type)
             {
             case Type::CALL:
-                return std::max(price - strike, Real(0));
+                return ContractPayoff<Type::CALL>::Payoff(strike, price, epsilon);
 
             case Type::PUT:
-                return std::max(strike - price, Real(0));
+                return ContractPayoff<Type::PUT>::Payoff(strike, price, epsilon);
 
             case Type::BINARY_CALL:
-                return price > (strike - epsilon) ? Real(1) : Real(0);
+                return ContractPayoff<Type::BINARY_CALL>::Payoff(strike, price, epsilon);
 
             case Type::BINARY_PUT:
-                return price < (strike + epsilon) ? Real(1) : Real(0);
+                return ContractPayoff<Type::BINARY_PUT>::Payoff(strike, price, epsilon);
 
             default:
                 throw std::runtime_error("invalid option type");
@@ -44,33 +125,16 @@ namespace CqfProject
             switch (type)
             {
             case Type::CALL:
-                return price1 > strike
-                    ? Real(0.5) * (price1 + price2) - strike
-                    : price2 > strike
-                    ? Real(0.5) * (price2 - strike) * (price2 - strike) / (price2 - price1)
-                    : Real(0);
+                return ContractPayoff<Type::CALL>::AveragePayoff(strike, price1, price2);
 
             case Type::PUT:
-                return price2 < strike
-                    ? strike - Real(0.5) * (price1 + price2)
-                    : price1 < strike
-                    ? Real(0.5) * (strike - price1) * (strike - price1) / (price2 - price1)
-                    : Real(0);
-                                
+                return ContractPayoff<Type::PUT>::AveragePayoff(strike, price1, price2);
 
             case Type::BINARY_CALL:
-                return price1 > strike
-                    ? Real(1)
-                    : price2 > strike
-                    ? (price2 - strike) / (price2 - price1)
-                    : Real(0);
+                return ContractPayoff<Type::BINARY_CALL>::AveragePayoff(strike, price1, price2);
 
             case Type::BINARY_PUT:
-                return price2 < strike
-                    ? Real(1)
-                    : price1 < strike
-                    ? (strike - price1) / (price2 - price1)
-                    : Real(0);
+                return ContractPayoff<Type::BINARY_PUT>::AveragePayoff(strike, price1, price2);
 
             default:
                 throw std::runtime_error("invalid option type");
@@ -82,6 +146,44 @@ namespace CqfProject
         Real strike;
         Real multiplier;
     };
+
+    // Non-owning columnar view of a portfolio, e.g. over the columns of an R data frame.
+    // Contract types are integer codes (see ToOptionType) offset by typeCodeBase, so 1-based R factor codes
+    // can be used without conversion.
+    struct PortfolioView
+    {
+        PortfolioView(
+            std::size_t size,
+            int const* typeCodes,
+            int typeCodeBase,
+            Real const* expiries,
+            Real const* strikes,
+            Real const* quantities)
+            : size(size)
+            , typeCodes(typeCodes)
+            , typeCodeBase(typeCodeBase)
+            , expiries(expiries)
+            , strikes(strikes)
+            , quantities(quantities)
+        {}
+
+        OptionType GetType(std::size_t i) const
+        {
+            return ToOptionType(typeCodes[i] - typeCodeBase);
+        }
+
+        OptionContract GetContract(std::size_t i) const
+        {
+            return OptionContract(GetType(i), expiries[i], strikes[i], quantities[i]);
+        }
+
+        std::size_t size;
+        int const* typeCodes;
+        int typeCodeBase;
+        Real const* expiries;
+        Real const* strikes;
+        Real const* quantities;
+    };
 }
 
 #endif
@@ -0,0 +1,319 @@
+#include "benchmark.hpp"
+#include "blackScholes.hpp"
+#include "finiteDifferencePricer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace CqfProject;
+
+// Accuracy against cost of finite difference configurations, per product type.
+// With minVol = maxVol the uncertain volatility price is the Black-Scholes price, so errors are exact.
+// Each configuration (grid size, interpolation, payoff sampling, or a Richardson pair of grid sizes)
+// is timed and compared with BlackScholesOption over a range of strikes, and the Pareto frontier of
+// cost against maximum absolute error marked for each product type.
+
+Real const rate = 0.05;
+Real const price = 100.0;
+Real const vol = 0.20;
+Real const expiry = 1.0;
+
+struct ParetoConfig
+{
+    ParetoConfig()
+        : quick(false)
+        , options(1, 5)
+        , errorBudget(0.0)
+    {}
+
+    bool quick;
+    BenchmarkOptions options;
+
+    /// Report the cheapest configuration within this maximum absolute error, if positive
+    Real errorBudget;
+};
+
+// Values of a grid configuration at each strike, with median ns per contract
+struct GridResult
+{
+    double nsPerContract;
+    std::vector<Real> values;
+};
+
+struct ParetoRow
+{
+    std::string method;
+    std::size_t steps1;
+    std::size_t steps2;
+    Interpolation interpolation;
+    PayoffSampling payoffSampling;
+    double nsPerContract;
+    Real maxAbsError;
+    Real rmsError;
+    bool pareto;
+};
+
+char const* ToString(Interpolation interpolation)
+{
+    return interpolation == Interpolation::CUBIC ? "cubic" : "linear";
+}
+
+char const* ToString(PayoffSampling payoffSampling)
+{
+    return payoffSampling == PayoffSampling::INTERVAL ? "interval" : "point";
+}
+
+char const* ToString(OptionType type)
+{
+    switch (type)
+    {
+    case OptionType::CALL:          return "call";
+    case OptionType::PUT:           return "put";
+    case OptionType::BINARY_CALL:   return "bcall";
+    case OptionType::BINARY_PUT:    return "bput";
+    }
+
+    return "unknown";
+}
+
+GridResult MeasureGrid(
+    ParetoConfig const& config,
+    OptionType type,
+    std::vector<Real> const& strikes,
+    std::size_t numPriceSteps,
+    Interpolation interpolation,
+    PayoffSampling payoffSampling)
+{
+    // One warm pricer per strike, as a persistent pricer handle would be
+    std::vector<std::unique_ptr<FiniteDifferencePricer>> pricers;
+    for (Real strike : strikes)
+    {
+        pricers.emplace_back(new FiniteDifferencePricer(vol, vol, rate, price * Real(2), numPriceSteps, payoffSampling, interpolation));
+        pricers.back()->AddContract(OptionContract(type, expiry, strike, 1.0));
+    }
+
+    GridResult result;
+    result.values.resize(strikes.size());
+
+    auto const valuate = [&] ()
+    {
+        for (std::size_t i = 0; i < pricers.size(); ++i)
+            result.values[i] = pricers[i]->Valuate(price, Side::BID);
+    };
+
+    result.nsPerContract = RunBenchmark(valuate, strikes.size(), config.options).median;
+    return result;
+}
+
+ParetoRow Evaluate(
+    std::vector<Real> const& values,
+    std::vector<Real> const& exact,
+    std::string const& method,
+    std::size_t steps1,
+    std::size_t steps2,
+    Interpolation interpolation,
+    PayoffSampling payoffSampling,
+    double nsPerContract)
+{
+    ParetoRow row;
+    row.method = method;
+    row.steps1 = steps1;
+    row.steps2 = steps2;
+    row.interpolation = interpolation;
+    row.payoffSampling = payoffSampling;
+    row.nsPerContract = nsPerContract;
+    row.maxAbsError = 0.0;
+    row.pareto = false;
+
+    Real sumSq = 0.0;
+    for (std::size_t i = 0; i < values.size(); ++i)
+    {
+        Real const error = std::abs(values[i] - exact[i]);
+        row.maxAbsError = std::max(row.maxAbsError, error);
+        sumSq += error * error;
+    }
+    row.rmsError = std::sqrt(sumSq / values.size());
+
+    return row;
+}
+
+// Mark rows not dominated in both cost and maximum error
+void MarkParetoFrontier(std::vector<ParetoRow>& rows)
+{
+    std::sort(rows.begin(), rows.end(), [] (ParetoRow const& a, ParetoRow const& b)
+    {
+        return a.nsPerContract < b.nsPerContract ||
+            (a.nsPerContract == b.nsPerContract && a.maxAbsError < b.maxAbsError);
+    });
+
+    Real bestError = std::numeric_limits<Real>::infinity();
+    for (auto& row : rows)
+    {
+        row.pareto = row.maxAbsError < bestError;
+        bestError = std::min(bestError, row.maxAbsError);
+    }
+}
+
+void PrintUsage()
+{
+    std::cerr
+        << "Usage: uvol_pareto [options]" << std::endl
+        << "  --quick            fewer grid sizes and repetitions" << std::endl
+        << "  --repetitions N    timed repetitions per configuration" << std::endl
+        << "  --budget ERROR     report the cheapest configuration within ERROR per product" << std::endl
+        << "  --output FILE      write CSV rows to FILE instead of stdout" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    ParetoConfig config;
+    std::string outputFile;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const arg = argv[i];
+        bool const hasValue = i + 1 < argc;
+
+        if (arg == "--quick")
+        {
+            config.quick = true;
+            config.options = BenchmarkOptions(0, 3);
+        }
+        else if (arg == "--repetitions" && hasValue)
+            config.options.repetitions = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--budget" && hasValue)
+            config.errorBudget = std::strtod(argv[++i], nullptr);
+        else if (arg == "--output" && hasValue)
+            outputFile = argv[++i];
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    std::ofstream file;
+    if (!outputFile.empty())
+    {
+        file.open(outputFile.c_str());
+        if (!file)
+        {
+            std::cerr << "Failed to open " << outputFile << std::endl;
+            return 1;
+        }
+    }
+
+    std::ostream& os = outputFile.empty() ? std::cout : file;
+    os << "product,method,steps1,steps2,interpolation,payoffSampling,nsPerContract,maxAbsError,rmsError,pareto" << std::endl;
+
+    std::vector<std::size_t> const steps = config.quick
+        ? std::vector<std::size_t>{ 50, 100, 150 }
+        : std::vector<std::size_t>{ 50, 75, 100, 150, 200, 250, 300, 400 };
+
+    // Richardson partners as ratios of the coarser grid, 4 / 3 is close to the R defaults of 210 and 290
+    std::vector<double> const richardsonRatios = { 4.0 / 3.0, 2.0 };
+
+    std::vector<Real> strikes;
+    for (Real strike = 80.0; strike <= 120.0; strike += 5.0)
+        strikes.push_back(strike);
+
+    Interpolation const interpolations[] = { Interpolation::LINEAR, Interpolation::CUBIC };
+    PayoffSampling const samplings[] = { PayoffSampling::POINT, PayoffSampling::INTERVAL };
+    OptionType const types[] = { OptionType::CALL, OptionType::PUT, OptionType::BINARY_CALL, OptionType::BINARY_PUT };
+
+    for (OptionType type : types)
+    {
+        std::vector<Real> exact;
+        for (Real strike : strikes)
+            exact.push_back(BlackScholesOption(type, vol, rate, expiry, price, strike));
+
+        // Single grid results, keyed by configuration, reused by the Richardson pairs
+        std::map<std::tuple<std::size_t, Interpolation, PayoffSampling>, GridResult> grids;
+        auto const grid = [&] (std::size_t numPriceSteps, Interpolation interpolation, PayoffSampling payoffSampling) -> GridResult const&
+        {
+            auto const key = std::make_tuple(numPriceSteps, interpolation, payoffSampling);
+            auto it = grids.find(key);
+            if (it == grids.end())
+                it = grids.insert(std::make_pair(key, MeasureGrid(config, type, strikes, numPriceSteps, interpolation, payoffSampling))).first;
+            return it->second;
+        };
+
+        std::vector<ParetoRow> rows;
+        for (Interpolation interpolation : interpolations)
+        {
+            for (PayoffSampling payoffSampling : samplings)
+            {
+                for (std::size_t steps1 : steps)
+                {
+                    GridResult const& single = grid(steps1, interpolation, payoffSampling);
+                    rows.push_back(Evaluate(single.values, exact, "fd", steps1, 0, interpolation, payoffSampling, single.nsPerContract));
+
+                    for (double ratio : richardsonRatios)
+                    {
+                        std::size_t const steps2 = static_cast<std::size_t>(std::lround(steps1 * ratio));
+                        GridResult const& fine = grid(steps2, interpolation, payoffSampling);
+
+                        std::vector<Real> values(strikes.size());
+                        for (std::size_t i = 0; i < strikes.size(); ++i)
+                            values[i] = RichardsonExtrapolate(single.values[i], fine.values[i], steps1, steps2);
+
+                        rows.push_back(Evaluate(values, exact, "richardson", steps1, steps2, interpolation, payoffSampling,
+                            single.nsPerContract + fine.nsPerContract));
+                    }
+                }
+            }
+        }
+
+        MarkParetoFrontier(rows);
+
+        std::cerr << ToString(type) << " Pareto frontier:" << std::endl;
+        ParetoRow const* withinBudget = nullptr;
+        for (auto const& row : rows)
+        {
+            os << ToString(type) << ','
+                << row.method << ','
+                << row.steps1 << ','
+                << row.steps2 << ','
+                << ToString(row.interpolation) << ','
+                << ToString(row.payoffSampling) << ','
+                << row.nsPerContract << ','
+                << row.maxAbsError << ','
+                << row.rmsError << ','
+                << (row.pareto ? 1 : 0) << std::endl;
+
+            if (row.pareto)
+            {
+                std::cerr << "  " << row.method << " " << row.steps1;
+                if (row.steps2 > 0)
+                    std::cerr << "/" << row.steps2;
+                std::cerr << " " << ToString(row.interpolation) << " " << ToString(row.payoffSampling)
+                    << ": " << row.nsPerContract << " ns, max error " << row.maxAbsError << std::endl;
+            }
+
+            // Rows are in ascending cost
+            if (withinBudget == nullptr && config.errorBudget > 0.0 && row.maxAbsError <= config.errorBudget)
+                withinBudget = &row;
+        }
+
+        if (config.errorBudget > 0.0)
+        {
+            if (withinBudget != nullptr)
+                std::cerr << "  cheapest within " << config.errorBudget << ": " << withinBudget->method << " "
+                    << withinBudget->steps1 << (withinBudget->steps2 > 0 ? "/" + std::to_string(withinBudget->steps2) : std::string())
+                    << " " << ToString(withinBudget->interpolation) << " " << ToString(withinBudget->payoffSampling) << std::endl;
+            else
+                std::cerr << "  no configuration within " << config.errorBudget << std::endl;
+        }
+    }
+
+    return 0;
+}
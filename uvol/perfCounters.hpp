@@ -0,0 +1,205 @@
+#ifndef UVOL_PERF_COUNTERS_HPP
+#define UVOL_PERF_COUNTERS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#if defined (__linux__)
+#   include <linux/perf_event.h>
+#   include <sys/ioctl.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#   include <cstring>
+#endif
+
+namespace CqfProject
+{
+    // Hardware events counted around pricing and benchmark loops.
+    // LLC_REFERENCES are L2 misses on most x86 parts, as every L2 miss looks up the last level cache.
+    // CYCLES / REF_CYCLES below 1 under load shows frequency throttling, e.g. from AVX-512 licences.
+    enum class PerfEvent
+    {
+        CYCLES,
+        REF_CYCLES,
+        INSTRUCTIONS,
+        BRANCH_MISSES,
+        L1D_MISSES,
+        LLC_REFERENCES,
+        LLC_MISSES
+    };
+
+    int const NUM_PERF_EVENTS = 7;
+
+    inline char const* PerfEventName(PerfEvent event)
+    {
+        switch (event)
+        {
+        case PerfEvent::CYCLES:         return "cycles";
+        case PerfEvent::REF_CYCLES:     return "refCycles";
+        case PerfEvent::INSTRUCTIONS:   return "instructions";
+        case PerfEvent::BRANCH_MISSES:  return "branchMisses";
+        case PerfEvent::L1D_MISSES:     return "l1dMisses";
+        case PerfEvent::LLC_REFERENCES: return "llcReferences";
+        case PerfEvent::LLC_MISSES:     return "llcMisses";
+        }
+
+        return "unknown";
+    }
+
+    // User space hardware counters of the calling thread, via Linux perf_event_open.
+    // Events the kernel, CPU or perf_event_paranoid setting do not allow are skipped;
+    // on other platforms nothing is available. Counts are scaled for multiplexing.
+    class PerfCounters
+    {
+    public:
+        PerfCounters()
+        {
+            for (int i = 0; i < NUM_PERF_EVENTS; ++i)
+            {
+                mFds[i] = -1;
+                mCounts[i] = std::numeric_limits<double>::quiet_NaN();
+                mFds[i] = Open(static_cast<PerfEvent>(i));
+            }
+        }
+
+        PerfCounters(PerfCounters const&) = delete;
+        PerfCounters& operator = (PerfCounters const&) = delete;
+
+        ~PerfCounters()
+        {
+#if defined (__linux__)
+            for (int i = 0; i < NUM_PERF_EVENTS; ++i)
+                if (mFds[i] >= 0)
+                    close(mFds[i]);
+#endif
+        }
+
+        // True if any event can be counted
+        bool IsAvailable() const
+        {
+            for (int i = 0; i < NUM_PERF_EVENTS; ++i)
+                if (mFds[i] >= 0)
+                    return true;
+
+            return false;
+        }
+
+        bool IsAvailable(PerfEvent event) const
+        {
+            return mFds[static_cast<int>(event)] >= 0;
+        }
+
+        // Reset and start counting
+        void Start()
+        {
+#if defined (__linux__)
+            for (int i = 0; i < NUM_PERF_EVENTS; ++i)
+            {
+                if (mFds[i] >= 0)
+                {
+                    ioctl(mFds[i], PERF_EVENT_IOC_RESET, 0);
+                    ioctl(mFds[i], PERF_EVENT_IOC_ENABLE, 0);
+                }
+            }
+#endif
+        }
+
+        // Stop counting and read the counts since Start
+        void Stop()
+        {
+#if defined (__linux__)
+            for (int i = 0; i < NUM_PERF_EVENTS; ++i)
+                if (mFds[i] >= 0)
+                    ioctl(mFds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+            for (int i = 0; i < NUM_PERF_EVENTS; ++i)
+            {
+                if (mFds[i] < 0)
+                    continue;
+
+                // value, time enabled, time running
+                std::uint64_t values[3];
+                if (read(mFds[i], values, sizeof(values)) != (ssize_t)sizeof(values) || values[2] == 0)
+                {
+                    mCounts[i] = std::numeric_limits<double>::quiet_NaN();
+                    continue;
+                }
+
+                mCounts[i] = static_cast<double>(values[0]) * values[1] / values[2];
+            }
+#endif
+        }
+
+        // Count of the last Start / Stop interval, NaN if the event is unavailable
+        double GetCount(PerfEvent event) const
+        {
+            return mCounts[static_cast<int>(event)];
+        }
+
+    private:
+        static int Open(PerfEvent event)
+        {
+#if defined (__linux__)
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            std::uint64_t const cacheReadMiss =
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+            switch (event)
+            {
+            case PerfEvent::CYCLES:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+
+            case PerfEvent::REF_CYCLES:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_REF_CPU_CYCLES;
+                break;
+
+            case PerfEvent::INSTRUCTIONS:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+
+            case PerfEvent::BRANCH_MISSES:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+                break;
+
+            case PerfEvent::L1D_MISSES:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_L1D | cacheReadMiss;
+                break;
+
+            case PerfEvent::LLC_REFERENCES:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CACHE_REFERENCES;
+                break;
+
+            case PerfEvent::LLC_MISSES:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CACHE_MISSES;
+                break;
+            }
+
+            // This thread, any CPU, no group
+            return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+            return -1;
+#endif
+        }
+
+        int mFds[NUM_PERF_EVENTS];
+        double mCounts[NUM_PERF_EVENTS];
+    };
+}
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef UVOL_PHASE_PROFILER_HPP
+#define UVOL_PHASE_PROFILER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#if defined (_MSC_VER)
+#   include <intrin.h>
+#   define UVOL_HAS_RDTSC
+#elif defined (__x86_64__) || defined (__i386__)
+#   include <x86intrin.h>
+#   define UVOL_HAS_RDTSC
+#endif
+
+// Phase profiling of FiniteDifferencePricer::Valuate. Define UVOL_PHASE_PROFILING to enable;
+// otherwise the macros expand to nothing and the pricer's profile stays at zero.
+// UVOL_PHASE_BEGIN starts a named timer, stopped by UVOL_PHASE_END or at the end of its scope.
+#if defined (UVOL_PHASE_PROFILING)
+#   define UVOL_PHASE_BEGIN(profile, phase, timer) ::CqfProject::ScopedPhaseTimer timer(profile, phase)
+#   define UVOL_PHASE_END(timer) timer.Stop()
+#else
+#   define UVOL_PHASE_BEGIN(profile, phase, timer)
+#   define UVOL_PHASE_END(timer)
+#endif
+
+namespace CqfProject
+{
+    enum class Phase
+    {
+        SORT,
+        PAYOFF,
+        COEFFICIENTS,
+        MARCH,
+        INTERPOLATION,
+        DETAIL_OUTPUT
+    };
+
+    int const NUM_PHASES = 6;
+
+    inline char const* PhaseName(Phase phase)
+    {
+        switch (phase)
+        {
+        case Phase::SORT:           return "sort";
+        case Phase::PAYOFF:         return "payoff";
+        case Phase::COEFFICIENTS:   return "coefficients";
+        case Phase::MARCH:          return "march";
+        case Phase::INTERPOLATION:  return "interpolation";
+        case Phase::DETAIL_OUTPUT:  return "detail";
+        }
+
+        return "unknown";
+    }
+
+    inline bool IsPhaseProfilingEnabled()
+    {
+#if defined (UVOL_PHASE_PROFILING)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Time stamp counter cycles where available, else steady clock nanoseconds
+    inline std::uint64_t ReadPhaseTicks()
+    {
+#if defined (UVOL_HAS_RDTSC)
+        return __rdtsc();
+#else
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    inline char const* PhaseTickUnit()
+    {
+#if defined (UVOL_HAS_RDTSC)
+        return "tsc cycles";
+#else
+        return "ns";
+#endif
+    }
+
+    class ScopedPhaseTimer;
+
+    // Ticks and entry counts per phase, accumulated over valuations until reset.
+    // Ticks are exclusive: time in a nested phase (detail output during the march) is not
+    // also counted in the enclosing phase.
+    struct PhaseProfile
+    {
+        PhaseProfile()
+        {
+            Reset();
+        }
+
+        void Reset()
+        {
+            for (int i = 0; i < NUM_PHASES; ++i)
+            {
+                ticks[i] = 0;
+                counts[i] = 0;
+            }
+            current = nullptr;
+        }
+
+        std::uint64_t GetTicks(Phase phase) const
+        {
+            return ticks[static_cast<int>(phase)];
+        }
+
+        std::uint64_t GetCount(Phase phase) const
+        {
+            return counts[static_cast<int>(phase)];
+        }
+
+        std::uint64_t ticks[NUM_PHASES];
+        std::uint64_t counts[NUM_PHASES];
+
+        /// Innermost running timer
+        ScopedPhaseTimer* current;
+    };
+
+    // Adds the ticks until stopped or destroyed, less those of nested timers, to a phase
+    class ScopedPhaseTimer
+    {
+    public:
+        ScopedPhaseTimer(PhaseProfile& profile, Phase phase)
+            : mProfile(profile)
+            , mParent(profile.current)
+            , mPhase(phase)
+            , mNestedTicks(0)
+            , mRunning(true)
+        {
+            mProfile.current = this;
+            mStart = ReadPhaseTicks();
+        }
+
+        ScopedPhaseTimer(ScopedPhaseTimer const&) = delete;
+        ScopedPhaseTimer& operator = (ScopedPhaseTimer const&) = delete;
+
+        ~ScopedPhaseTimer()
+        {
+            Stop();
+        }
+
+        void Stop()
+        {
+            if (!mRunning)
+                return;
+
+            mRunning = false;
+            std::uint64_t const elapsed = ReadPhaseTicks() - mStart;
+            int const index = static_cast<int>(mPhase);
+            mProfile.ticks[index] += elapsed - mNestedTicks;
+            mProfile.counts[index]++;
+
+            if (mParent != nullptr)
+                mParent->mNestedTicks += elapsed;
+            mProfile.current = mParent;
+        }
+
+    private:
+        PhaseProfile& mProfile;
+        ScopedPhaseTimer* mParent;
+        Phase mPhase;
+        std::uint64_t mStart;
+        std::uint64_t mNestedTicks;
+        bool mRunning;
+    };
+}
+
+#endif
@@ -0,0 +1,219 @@
+#include "batchValuation.hpp"
+#include "pricingJob.hpp"
+
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace CqfProject;
+
+// uvol-price: prices scenario and portfolio batches (see pricingJob.hpp for the input formats)
+// from files or stdin, writing one CSV row of bid, ask and Greeks per job to stdout in input order.
+// Jobs are read, priced and written a batch at a time; the next batch is read while the current one
+// is priced, so at most two batches are held in memory.
+
+struct PriceConfig
+{
+    PriceConfig()
+        : numThreads(0)
+        , batchSize(256)
+        , toBinary(false)
+    {}
+
+    PricingSettings settings;
+    unsigned numThreads;
+    std::size_t batchSize;
+
+    /// Convert the input to binary jobs on stdout instead of pricing
+    bool toBinary;
+
+    std::vector<std::string> inputs;
+};
+
+void PrintUsage()
+{
+    std::cerr
+        << "Usage: uvol-price [options] [FILE...]" << std::endl
+        << "Prices CSV or binary job files, or stdin if none or -, writing CSV results to stdout" << std::endl
+        << "  --steps N            price steps for jobs that do not set them (default 200)" << std::endl
+        << "  --interpolation I    cubic (default) or linear" << std::endl
+        << "  --sampling S         interval (default) or point payoff sampling" << std::endl
+        << "  --threads N          pricing threads, 0 for all cores (default)" << std::endl
+        << "  --batch N            jobs per batch, bounding memory (default 256)" << std::endl
+        << "  --to-binary          write the jobs as binary to stdout instead of pricing" << std::endl;
+}
+
+// Read up to batch.size() jobs, returning the number read
+std::size_t ReadBatch(JobReader& reader, std::vector<PricingJob>& batch)
+{
+    std::size_t count = 0;
+    while (count < batch.size() && reader.Read(batch[count]))
+        ++count;
+
+    return count;
+}
+
+// Returns the number of jobs that failed to price
+std::size_t PriceStream(PriceConfig const& config, std::istream& is, std::ostream& os, std::vector<JobPricer>& pricers)
+{
+    JobReader reader(is, config.settings.numPriceSteps);
+
+    std::vector<PricingJob> current(config.batchSize);
+    std::vector<PricingJob> next(config.batchSize);
+    std::vector<PricingResult> results(config.batchSize);
+    std::size_t failures = 0;
+
+    std::size_t count = ReadBatch(reader, current);
+    while (count > 0)
+    {
+        std::future<void> pricing = std::async(std::launch::async, [&] ()
+        {
+            PriceJobs(current.data(), count, results.data(), pricers);
+        });
+
+        std::size_t nextCount = 0;
+        try
+        {
+            nextCount = ReadBatch(reader, next);
+        }
+        catch (...)
+        {
+            pricing.wait();
+            throw;
+        }
+
+        pricing.get();
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            WriteResult(os, results[i]);
+            if (!results[i].error.empty())
+            {
+                std::cerr << "job " << results[i].id << ": " << results[i].error << std::endl;
+                ++failures;
+            }
+        }
+
+        std::swap(current, next);
+        count = nextCount;
+    }
+
+    return failures;
+}
+
+void ConvertStream(std::istream& is, std::ostream& os)
+{
+    JobReader reader(is);
+    PricingJob job;
+    while (reader.Read(job))
+        WriteBinaryJob(os, job);
+}
+
+int main(int argc, char** argv)
+{
+    PriceConfig config;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const arg = argv[i];
+        bool const hasValue = i + 1 < argc;
+
+        if (arg == "--steps" && hasValue)
+            config.settings.numPriceSteps = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--interpolation" && hasValue)
+        {
+            std::string const value = argv[++i];
+            if (value != "cubic" && value != "linear")
+            {
+                PrintUsage();
+                return 1;
+            }
+            config.settings.interpolation = value == "cubic" ? Interpolation::CUBIC : Interpolation::LINEAR;
+        }
+        else if (arg == "--sampling" && hasValue)
+        {
+            std::string const value = argv[++i];
+            if (value != "interval" && value != "point")
+            {
+                PrintUsage();
+                return 1;
+            }
+            config.settings.payoffSampling = value == "interval" ? PayoffSampling::INTERVAL : PayoffSampling::POINT;
+        }
+        else if (arg == "--threads" && hasValue)
+            config.numThreads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--batch" && hasValue)
+            config.batchSize = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--to-binary")
+            config.toBinary = true;
+        else if (arg == "-" || arg.compare(0, 2, "--") != 0)
+            config.inputs.push_back(arg);
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (config.settings.numPriceSteps < 3 || config.settings.numPriceSteps > MAX_PRICE_STEPS || config.batchSize == 0)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    if (config.inputs.empty())
+        config.inputs.push_back("-");
+
+    std::ios_base::sync_with_stdio(false);
+
+    unsigned const numThreads = config.numThreads == 0 ? DefaultThreadCount() : config.numThreads;
+    std::vector<JobPricer> pricers;
+    pricers.reserve(numThreads);
+    for (unsigned t = 0; t < numThreads; ++t)
+        pricers.emplace_back(config.settings);
+
+    std::cout.precision(std::numeric_limits<Real>::max_digits10);
+    if (!config.toBinary)
+        WriteResultHeader(std::cout);
+    else
+        WriteBinaryJobHeader(std::cout);
+
+    std::size_t failures = 0;
+    for (auto const& input : config.inputs)
+    {
+        std::ifstream file;
+        if (input != "-")
+        {
+            file.open(input.c_str(), std::ios::binary);
+            if (!file)
+            {
+                std::cerr << "Failed to open " << input << std::endl;
+                return 1;
+            }
+        }
+
+        std::istream& is = input == "-" ? std::cin : file;
+        try
+        {
+            if (config.toBinary)
+                ConvertStream(is, std::cout);
+            else
+                failures += PriceStream(config, is, std::cout, pricers);
+        }
+        catch (std::exception const& e)
+        {
+            std::cout.flush();
+            std::cerr << (input == "-" ? "stdin" : input) << ": " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout.flush();
+    return failures == 0 ? 0 : 2;
+}
@@ -0,0 +1,788 @@
+#include "batchValuation.hpp"
+#include "benchmark.hpp"
+#include "latencyHistogram.hpp"
+#include "pricingJob.hpp"
+#include "pricingProtocol.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace CqfProject;
+
+// uvol-priced: long lived pricing server on a Unix domain socket (protocol in pricingProtocol.hpp).
+// Each connection is served by its own thread, which queues requests for a pool of pricing workers.
+// A worker takes the oldest request together with any other queued requests on the same grid, and
+// prices them back to back on one pooled pricer, so the grid workspace is reused rather than allocated.
+// Latencies from request received to response sent, queue wait and pricing time are kept in histograms
+// and reported with the STATS message.
+
+typedef std::chrono::steady_clock Clock;
+
+std::uint64_t ElapsedNs(Clock::time_point from, Clock::time_point to)
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+}
+
+std::string DefaultSocketPath()
+{
+    char const* const runtimeDir = std::getenv("XDG_RUNTIME_DIR");
+    return std::string(runtimeDir != nullptr && runtimeDir[0] != '\0' ? runtimeDir : "/tmp") + "/uvol-priced.sock";
+}
+
+struct ServerConfig
+{
+    ServerConfig()
+        : socketPath(DefaultSocketPath())
+        , numWorkers(0)
+        , maxBatch(32)
+        , maxIdlePricers(64)
+    {}
+
+    std::string socketPath;
+    PricingSettings settings;
+
+    /// Pricing threads, 0 for all cores
+    unsigned numWorkers;
+
+    /// Most requests priced in one batch
+    std::size_t maxBatch;
+
+    /// Pricers kept for reuse across all grids, beyond which released pricers are freed
+    std::size_t maxIdlePricers;
+};
+
+// Idle pricers by grid, reused by later requests on the same grid
+class PricerPool
+{
+public:
+    explicit PricerPool(PricingSettings const& settings, std::size_t maxIdle)
+        : mSettings(settings)
+        , mMaxIdle(maxIdle)
+        , mIdle(0)
+        , mCreated(0)
+    {}
+
+    std::unique_ptr<FiniteDifferencePricer> Acquire(GridKey const& key)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto const it = mPricers.find(key);
+            if (it != mPricers.end() && !it->second.empty())
+            {
+                std::unique_ptr<FiniteDifferencePricer> pricer = std::move(it->second.back());
+                it->second.pop_back();
+                if (it->second.empty())
+                    mPricers.erase(it);
+                --mIdle;
+                return pricer;
+            }
+
+            ++mCreated;
+        }
+
+        return CreatePricer(key, mSettings);
+    }
+
+    void Release(GridKey const& key, std::unique_ptr<FiniteDifferencePricer> pricer)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mIdle >= mMaxIdle)
+        {
+            // Make room by freeing pricers of another grid, as this one is in use
+            auto it = mPricers.begin();
+            if (it != mPricers.end() && it->first == key)
+                ++it;
+            if (it == mPricers.end())
+                return;
+
+            mIdle -= it->second.size();
+            mPricers.erase(it);
+        }
+
+        mPricers[key].push_back(std::move(pricer));
+        ++mIdle;
+    }
+
+    std::size_t GetIdleCount()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mIdle;
+    }
+
+    std::size_t GetCreatedCount()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mCreated;
+    }
+
+private:
+    PricingSettings mSettings;
+    std::size_t mMaxIdle;
+    std::mutex mMutex;
+    std::map<GridKey, std::vector<std::unique_ptr<FiniteDifferencePricer>>> mPricers;
+    std::size_t mIdle;
+    std::size_t mCreated;
+};
+
+// Request waiting for a worker, owned by the connection thread until priced
+struct PendingRequest
+{
+    PendingRequest(PricingJob const& job, PricingSettings const& settings, Clock::time_point received)
+        : job(job)
+        , key(job, settings)
+        , received(received)
+    {}
+
+    PricingJob job;
+    GridKey key;
+    PricingResult result;
+    Clock::time_point received;
+    std::promise<void> done;
+};
+
+class PricingServer
+{
+public:
+    explicit PricingServer(ServerConfig const& config)
+        : mConfig(config)
+        , mPool(config.settings, config.maxIdlePricers)
+        , mListenFd(ListenUnixSocket(config.socketPath))
+        , mStopping(false)
+        , mBatches(0)
+        , mBatchedRequests(0)
+        , mMaxBatchSize(0)
+        , mErrors(0)
+    {}
+
+    PricingServer(PricingServer const&) = delete;
+    PricingServer& operator = (PricingServer const&) = delete;
+
+    ~PricingServer()
+    {
+        close(mListenFd);
+        unlink(mConfig.socketPath.c_str());
+    }
+
+    // Serve until Stop or a SHUTDOWN message
+    void Run()
+    {
+        unsigned const numWorkers = mConfig.numWorkers == 0 ? DefaultThreadCount() : mConfig.numWorkers;
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < numWorkers; ++i)
+            workers.emplace_back([this] () { WorkerLoop(); });
+
+        std::map<std::thread::id, std::thread> connections;
+        while (!mStopping)
+        {
+            int const fd = accept(mListenFd, nullptr, nullptr);
+            if (fd < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                break;
+            }
+
+            std::lock_guard<std::mutex> lock(mConnectionMutex);
+            if (mStopping)
+            {
+                close(fd);
+                break;
+            }
+
+            // Join threads of connections closed since the last accept, so a long running server only
+            // holds threads of open connections
+            for (std::thread::id const id : mClosedConnections)
+            {
+                auto const it = connections.find(id);
+                it->second.join();
+                connections.erase(it);
+            }
+            mClosedConnections.clear();
+
+            mConnectionFds.insert(fd);
+            std::thread thread([this, fd] () { ServeConnection(fd); });
+            connections[thread.get_id()] = std::move(thread);
+        }
+
+        Stop();
+        for (auto& connection : connections)
+            connection.second.join();
+
+        {
+            std::lock_guard<std::mutex> lock(mQueueMutex);
+            mQueueCondition.notify_all();
+        }
+        for (auto& thread : workers)
+            thread.join();
+    }
+
+    // Stop accepting, and end open connections once their current request is answered
+    void Stop()
+    {
+        std::lock_guard<std::mutex> lock(mConnectionMutex);
+        mStopping = true;
+        shutdown(mListenFd, SHUT_RDWR);
+        for (int fd : mConnectionFds)
+            shutdown(fd, SHUT_RD);
+    }
+
+private:
+    void ServeConnection(int fd)
+    {
+        std::uint8_t code;
+        std::string payload;
+        while (ReadFrame(fd, code, payload))
+        {
+            Clock::time_point const received = Clock::now();
+            ResponseStatus status = ResponseStatus::OK;
+            std::string response;
+
+            switch (static_cast<MessageType>(code))
+            {
+            case MessageType::PRICE:
+                try
+                {
+                    PricingJob job;
+                    DecodeJob(payload, job, mConfig.settings.numPriceSteps);
+
+                    PendingRequest request(job, mConfig.settings, received);
+                    std::future<void> done = request.done.get_future();
+                    Submit(request);
+                    done.wait();
+
+                    if (request.result.error.empty())
+                        response = EncodeResult(request.result);
+                    else
+                    {
+                        status = ResponseStatus::ERROR;
+                        response = request.result.error;
+                    }
+                }
+                catch (std::exception const& e)
+                {
+                    status = ResponseStatus::ERROR;
+                    response = e.what();
+                }
+                break;
+
+            case MessageType::STATS:
+                response = Stats();
+                break;
+
+            case MessageType::RESET_STATS:
+                ResetStats();
+                break;
+
+            case MessageType::SHUTDOWN:
+                Stop();
+                break;
+
+            default:
+                status = ResponseStatus::ERROR;
+                response = "unknown message type";
+                break;
+            }
+
+            if (status == ResponseStatus::ERROR)
+                ++mErrors;
+
+            if (!WriteFrame(fd, static_cast<std::uint8_t>(status), response))
+                break;
+
+            if (static_cast<MessageType>(code) == MessageType::PRICE)
+                mTotalLatency.Record(ElapsedNs(received, Clock::now()));
+        }
+
+        std::lock_guard<std::mutex> lock(mConnectionMutex);
+        mConnectionFds.erase(fd);
+        mClosedConnections.push_back(std::this_thread::get_id());
+        close(fd);
+    }
+
+    void Submit(PendingRequest& request)
+    {
+        std::lock_guard<std::mutex> lock(mQueueMutex);
+        mQueue.push_back(&request);
+        mQueueCondition.notify_one();
+    }
+
+    void WorkerLoop()
+    {
+        std::vector<PendingRequest*> batch;
+        std::vector<Real> grid;
+
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mQueueMutex);
+                mQueueCondition.wait(lock, [this] () { return !mQueue.empty() || (mStopping && NoConnections()); });
+                if (mQueue.empty())
+                    return;
+
+                // Oldest request, and queued requests on the same grid
+                batch.assign(1, mQueue.front());
+                mQueue.pop_front();
+                GridKey const& key = batch.front()->key;
+                for (auto it = mQueue.begin(); it != mQueue.end() && batch.size() < mConfig.maxBatch;)
+                {
+                    if ((*it)->key == key)
+                    {
+                        batch.push_back(*it);
+                        it = mQueue.erase(it);
+                    }
+                    else
+                        ++it;
+                }
+            }
+
+            ++mBatches;
+            std::size_t maxBatchSize = mMaxBatchSize.load();
+            while (batch.size() > maxBatchSize && !mMaxBatchSize.compare_exchange_weak(maxBatchSize, batch.size()))
+                ;
+
+            GridKey const key = batch.front()->key;
+            std::size_t answered = 0;
+            try
+            {
+                std::unique_ptr<FiniteDifferencePricer> pricer = mPool.Acquire(key);
+                for (; answered < batch.size(); ++answered)
+                {
+                    PendingRequest* const request = batch[answered];
+                    Clock::time_point const started = Clock::now();
+                    PriceJob(request->job, *pricer, key, grid, request->result);
+                    Clock::time_point const finished = Clock::now();
+
+                    mQueueLatency.Record(ElapsedNs(request->received, started));
+                    mPricingLatency.Record(ElapsedNs(started, finished));
+
+                    // Counted before the response, so statistics requested after it include this request
+                    ++mBatchedRequests;
+                    request->done.set_value();
+                }
+                mPool.Release(key, std::move(pricer));
+            }
+            catch (std::exception const& e)
+            {
+                // e.g. bad_alloc creating a pricer for the grid. Answer the rest of the batch with the error,
+                // rather than ending the server or leaving its connections waiting.
+                for (; answered < batch.size(); ++answered)
+                {
+                    PendingRequest* const request = batch[answered];
+                    request->result.Clear();
+                    request->result.id = request->job.id;
+                    request->result.error = e.what();
+
+                    ++mBatchedRequests;
+                    request->done.set_value();
+                }
+            }
+        }
+    }
+
+    bool NoConnections()
+    {
+        std::lock_guard<std::mutex> lock(mConnectionMutex);
+        return mConnectionFds.empty();
+    }
+
+    std::string Stats()
+    {
+        std::ostringstream os;
+        JsonWriter json(os);
+
+        std::size_t const batches = mBatches;
+        std::size_t const batchedRequests = mBatchedRequests;
+
+        json.BeginObject();
+        json.Member("requests", batchedRequests);
+        json.Member("errors", static_cast<std::size_t>(mErrors));
+        json.Member("batches", batches);
+        json.Member("meanBatchSize", batches == 0 ? 0.0 : static_cast<double>(batchedRequests) / batches);
+        json.Member("maxBatchSize", static_cast<std::size_t>(mMaxBatchSize));
+        json.Member("pricersCreated", mPool.GetCreatedCount());
+        json.Member("idlePricers", mPool.GetIdleCount());
+        json.Key("latencyNs").BeginObject();
+        WriteHistogram(json, "total", mTotalLatency);
+        WriteHistogram(json, "queue", mQueueLatency);
+        WriteHistogram(json, "pricing", mPricingLatency);
+        json.EndObject();
+        json.EndObject();
+
+        return os.str();
+    }
+
+    static void WriteHistogram(JsonWriter& json, char const* name, LatencyHistogram const& histogram)
+    {
+        json.Key(name).BeginObject();
+        json.Member("count", static_cast<std::size_t>(histogram.Count()));
+        json.Member("mean", histogram.Mean());
+        json.Member("p50", static_cast<std::size_t>(histogram.Quantile(0.5)));
+        json.Member("p99", static_cast<std::size_t>(histogram.Quantile(0.99)));
+        json.Member("p999", static_cast<std::size_t>(histogram.Quantile(0.999)));
+        json.Member("max", static_cast<std::size_t>(histogram.Max()));
+        json.EndObject();
+    }
+
+    void ResetStats()
+    {
+        mTotalLatency.Reset();
+        mQueueLatency.Reset();
+        mPricingLatency.Reset();
+        mBatches = 0;
+        mBatchedRequests = 0;
+        mMaxBatchSize = 0;
+        mErrors = 0;
+    }
+
+    ServerConfig mConfig;
+    PricerPool mPool;
+    int mListenFd;
+    std::atomic<bool> mStopping;
+
+    std::mutex mConnectionMutex;
+    std::set<int> mConnectionFds;
+
+    /// Threads of connections closed since Run last joined them
+    std::vector<std::thread::id> mClosedConnections;
+
+    std::mutex mQueueMutex;
+    std::condition_variable mQueueCondition;
+    std::deque<PendingRequest*> mQueue;
+
+    LatencyHistogram mTotalLatency;
+    LatencyHistogram mQueueLatency;
+    LatencyHistogram mPricingLatency;
+    std::atomic<std::size_t> mBatches;
+    std::atomic<std::size_t> mBatchedRequests;
+    std::atomic<std::size_t> mMaxBatchSize;
+    std::atomic<std::size_t> mErrors;
+};
+
+struct LoadConfig
+{
+    LoadConfig()
+        : numConnections(4)
+        , numRequests(2000)
+    {}
+
+    std::size_t numConnections;
+    std::size_t numRequests;
+
+    /// Jobs to send round robin; a default set if empty
+    std::vector<PricingJob> jobs;
+};
+
+// Two scenarios on the same grid (so requests batch) and one on another, as a quoting desk might send
+std::vector<PricingJob> DefaultLoadJobs(std::size_t numPriceSteps)
+{
+    std::vector<PricingJob> jobs(3);
+    for (std::size_t i = 0; i < jobs.size(); ++i)
+    {
+        jobs[i].id = i + 1;
+        jobs[i].numPriceSteps = numPriceSteps;
+        jobs[i].scenario.underlyingPrice = 100;
+        jobs[i].scenario.minVol = i < 2 ? 0.1 : 0.15;
+        jobs[i].scenario.maxVol = 0.3;
+        jobs[i].scenario.rate = 0.05;
+    }
+
+    jobs[0].contracts.push_back(OptionContract(OptionType::BINARY_CALL, 1.0, 100.0, 1.0));
+    jobs[0].contracts.push_back(OptionContract(OptionType::CALL, 1.0, 95.0, -0.5));
+    jobs[0].contracts.push_back(OptionContract(OptionType::CALL, 1.0, 105.0, 0.5));
+    jobs[1].contracts.push_back(OptionContract(OptionType::PUT, 0.5, 90.0, 1.0));
+    jobs[1].contracts.push_back(OptionContract(OptionType::PUT, 1.0, 90.0, -1.0));
+    jobs[2].contracts.push_back(OptionContract(OptionType::BINARY_PUT, 0.25, 100.0, 10.0));
+
+    return jobs;
+}
+
+// Send requests from several connections at once, checking each response against expected results if given.
+// Prints client side latency quantiles and returns the number of failed or mismatched requests.
+std::size_t RunLoad(std::string const& socketPath, LoadConfig const& config, std::vector<PricingResult> const* expected)
+{
+    LatencyHistogram latency;
+    std::atomic<std::size_t> nextRequest(0);
+    std::atomic<std::size_t> failures(0);
+
+    auto const client = [&] ()
+    {
+        try
+        {
+            PricingClient connection(socketPath);
+            for (std::size_t i = nextRequest++; i < config.numRequests; i = nextRequest++)
+            {
+                std::size_t const jobIndex = i % config.jobs.size();
+                Clock::time_point const start = Clock::now();
+                PricingResult const result = connection.Price(config.jobs[jobIndex]);
+                latency.Record(ElapsedNs(start, Clock::now()));
+
+                bool const failed = !result.error.empty() || (expected != nullptr &&
+                    (result.id != (*expected)[jobIndex].id ||
+                     result.bid != (*expected)[jobIndex].bid ||
+                     result.ask != (*expected)[jobIndex].ask ||
+                     result.bidDelta != (*expected)[jobIndex].bidDelta ||
+                     result.askGamma != (*expected)[jobIndex].askGamma));
+                if (failed)
+                {
+                    if (failures++ == 0)
+                        std::cerr << "Request for job " << config.jobs[jobIndex].id << " failed or mismatched: " << result.error << std::endl;
+                }
+            }
+        }
+        catch (std::exception const& e)
+        {
+            std::cerr << e.what() << std::endl;
+            ++failures;
+        }
+    };
+
+    Clock::time_point const start = Clock::now();
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < config.numConnections; ++i)
+        threads.emplace_back(client);
+    for (auto& thread : threads)
+        thread.join();
+    double const seconds = ElapsedNs(start, Clock::now()) * 1e-9;
+
+    std::cerr << config.numRequests << " requests over " << config.numConnections << " connections in " << seconds << " s ("
+        << config.numRequests / seconds << "/s), client latency ns p50 " << latency.Quantile(0.5)
+        << ", p99 " << latency.Quantile(0.99) << ", p999 " << latency.Quantile(0.999)
+        << ", max " << latency.Max() << std::endl;
+
+    return failures;
+}
+
+// Serve on a temporary socket in this process, load it, and check results, statistics and shutdown
+int SelfTest(ServerConfig config, LoadConfig load)
+{
+    config.socketPath = "/tmp/uvol-priced-test-" + std::to_string(getpid()) + ".sock";
+    if (load.jobs.empty())
+        load.jobs = DefaultLoadJobs(config.settings.numPriceSteps);
+
+    std::vector<PricingResult> expected(load.jobs.size());
+    JobPricer pricer(config.settings);
+    for (std::size_t i = 0; i < load.jobs.size(); ++i)
+        pricer.Price(load.jobs[i], expected[i]);
+
+    PricingServer server(config);
+    std::thread serverThread([&server] () { server.Run(); });
+
+    int errorCount = 0;
+    try
+    {
+        std::size_t const failures = RunLoad(config.socketPath, load, &expected);
+        if (failures != 0)
+        {
+            std::cerr << failures << " requests failed or did not match direct pricing" << std::endl;
+            errorCount++;
+        }
+
+        PricingClient control(config.socketPath);
+
+        // Invalid jobs are rejected without ending the connection
+        PricingJob invalid = load.jobs[0];
+        invalid.scenario.minVol = -1;
+        if (control.Price(invalid).error.empty())
+        {
+            std::cerr << "Invalid job was priced" << std::endl;
+            errorCount++;
+        }
+
+        std::string const stats = control.Stats();
+        std::cout << stats << std::endl;
+
+        std::string const requests = "\"requests\":" + std::to_string(load.numRequests) + ",";
+        if (stats.find(requests) == std::string::npos || stats.find("\"p999\":") == std::string::npos)
+        {
+            std::cerr << "Statistics do not show " << load.numRequests << " requests" << std::endl;
+            errorCount++;
+        }
+
+        control.ResetStats();
+        if (control.Stats().find("\"requests\":0,") == std::string::npos)
+        {
+            std::cerr << "Statistics not reset" << std::endl;
+            errorCount++;
+        }
+
+        // Grids too large or too long to price are rejected, and the server keeps serving
+        PricingJob oversized = load.jobs[0];
+        oversized.numPriceSteps = 0xFFFFFFFFu;
+        PricingJob highVol = load.jobs[0];
+        highVol.scenario.maxVol = 1e6;
+        PricingJob fineGrid = load.jobs[0];
+        fineGrid.numPriceSteps = MAX_PRICE_STEPS;
+        for (PricingJob const& job : { oversized, highVol, fineGrid })
+        {
+            if (control.Price(job).error.empty())
+            {
+                std::cerr << "Job with " << job.numPriceSteps << " steps and maxVol " << job.scenario.maxVol << " was priced" << std::endl;
+                errorCount++;
+            }
+        }
+
+        PricingResult const after = control.Price(load.jobs[0]);
+        if (!after.error.empty() || after.bid != expected[0].bid)
+        {
+            std::cerr << "Request after rejected jobs failed: " << after.error << std::endl;
+            errorCount++;
+        }
+
+        control.Shutdown();
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        server.Stop();
+        errorCount++;
+    }
+
+    serverThread.join();
+    return errorCount == 0 ? 0 : 1;
+}
+
+void PrintUsage()
+{
+    std::cerr
+        << "Usage: uvol-priced COMMAND [options]" << std::endl
+        << "Commands:" << std::endl
+        << "  serve                serve pricing requests until shut down" << std::endl
+        << "  stats                print statistics of a running server as JSON" << std::endl
+        << "  reset-stats          clear statistics of a running server" << std::endl
+        << "  shutdown             stop a running server" << std::endl
+        << "  load [FILE]          send requests for the jobs in FILE (CSV or binary), or a default set" << std::endl
+        << "  self-test            serve, load and check results in this process" << std::endl
+        << "Options:" << std::endl
+        << "  --socket PATH        socket path (default " << DefaultSocketPath() << ")" << std::endl
+        << "  --workers N          serve: pricing threads, 0 for all cores (default)" << std::endl
+        << "  --max-batch N        serve: most requests on one grid priced together (default 32)" << std::endl
+        << "  --max-idle N         serve: pricers kept for reuse (default 64)" << std::endl
+        << "  --steps N            price steps for jobs that do not set them (default 200)" << std::endl
+        << "  --interpolation I    cubic (default) or linear" << std::endl
+        << "  --sampling S         interval (default) or point payoff sampling" << std::endl
+        << "  --connections N      load: concurrent connections (default 4)" << std::endl
+        << "  --requests N         load: total requests (default 2000)" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    std::string const command = argv[1];
+    ServerConfig config;
+    LoadConfig load;
+    std::string jobFile;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string const arg = argv[i];
+        bool const hasValue = i + 1 < argc;
+
+        if (arg == "--socket" && hasValue)
+            config.socketPath = argv[++i];
+        else if (arg == "--workers" && hasValue)
+            config.numWorkers = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--max-batch" && hasValue)
+            config.maxBatch = std::max<std::size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--max-idle" && hasValue)
+            config.maxIdlePricers = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--steps" && hasValue)
+            config.settings.numPriceSteps = std::min(std::max<std::size_t>(3, std::strtoul(argv[++i], nullptr, 10)), MAX_PRICE_STEPS);
+        else if (arg == "--interpolation" && hasValue)
+            config.settings.interpolation = std::string(argv[++i]) == "linear" ? Interpolation::LINEAR : Interpolation::CUBIC;
+        else if (arg == "--sampling" && hasValue)
+            config.settings.payoffSampling = std::string(argv[++i]) == "point" ? PayoffSampling::POINT : PayoffSampling::INTERVAL;
+        else if (arg == "--connections" && hasValue)
+            load.numConnections = std::max<std::size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--requests" && hasValue)
+            load.numRequests = std::strtoul(argv[++i], nullptr, 10);
+        else if (command == "load" && arg.compare(0, 2, "--") != 0 && jobFile.empty())
+            jobFile = arg;
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    try
+    {
+        if (command == "serve")
+        {
+            PricingServer server(config);
+            std::cerr << "Serving on " << config.socketPath << std::endl;
+            server.Run();
+            return 0;
+        }
+        else if (command == "stats")
+        {
+            std::cout << PricingClient(config.socketPath).Stats() << std::endl;
+            return 0;
+        }
+        else if (command == "reset-stats")
+        {
+            PricingClient(config.socketPath).ResetStats();
+            return 0;
+        }
+        else if (command == "shutdown")
+        {
+            PricingClient(config.socketPath).Shutdown();
+            return 0;
+        }
+        else if (command == "load")
+        {
+            if (!jobFile.empty())
+            {
+                std::ifstream file(jobFile.c_str(), std::ios::binary);
+                if (!file)
+                {
+                    std::cerr << "Failed to open " << jobFile << std::endl;
+                    return 1;
+                }
+
+                JobReader reader(file, config.settings.numPriceSteps);
+                PricingJob job;
+                while (reader.Read(job))
+                    load.jobs.push_back(job);
+            }
+
+            if (load.jobs.empty())
+                load.jobs = DefaultLoadJobs(config.settings.numPriceSteps);
+
+            return RunLoad(config.socketPath, load, nullptr) == 0 ? 0 : 2;
+        }
+        else if (command == "self-test")
+            return SelfTest(config, load);
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    PrintUsage();
+    return 1;
+}
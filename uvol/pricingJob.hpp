@@ -0,0 +1,663 @@
+#ifndef UVOL_PRICING_JOB_HPP
+#define UVOL_PRICING_JOB_HPP
+
+#include "batchValuation.hpp"
+#include "finiteDifferencePricer.hpp"
+#include "optionContract.hpp"
+#include "types.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Scenario and portfolio batches for pricing outside R, as read by uvol-price.
+//
+// CSV input is a sequence of jobs, each a scenario line followed by the job's option lines:
+//     scenario,<id>,<underlyingPrice>,<minVol>,<maxVol>,<rate>[,<priceSteps>]
+//     option,<call|put|bcall|bput>,<expiry>,<strike>,<quantity>
+// Blank lines and lines starting with # are skipped.
+//
+// Binary input starts with the 8 bytes "UVOLJOB1", followed by jobs of
+//     uint64 id, uint32 priceSteps (0 for the default), uint32 contract count,
+//     float64 underlyingPrice, minVol, maxVol, rate,
+// each followed by its contracts of
+//     uint8 type code (see ToOptionType), float64 expiry, strike, quantity
+// with no padding, in the byte order of the host.
+
+namespace CqfProject
+{
+    struct PricingScenario
+    {
+        PricingScenario()
+            : underlyingPrice(0)
+            , minVol(0)
+            , maxVol(0)
+            , rate(0)
+        {}
+
+        Real underlyingPrice;
+        Real minVol;
+        Real maxVol;
+        Real rate;
+    };
+
+    struct PricingJob
+    {
+        PricingJob()
+            : id(0)
+            , numPriceSteps(0)
+        {}
+
+        std::uint64_t id;
+        PricingScenario scenario;
+
+        /// Overrides PricingSettings::numPriceSteps if non zero
+        std::size_t numPriceSteps;
+
+        std::vector<OptionContract> contracts;
+    };
+
+    struct PricingSettings
+    {
+        PricingSettings()
+            : numPriceSteps(200)
+            , interpolation(Interpolation::CUBIC)
+            , payoffSampling(PayoffSampling::INTERVAL)
+            , maxPriceMultiple(2)
+        {}
+
+        std::size_t numPriceSteps;
+        Interpolation interpolation;
+        PayoffSampling payoffSampling;
+
+        /// Grid upper bound as a multiple of the underlying price, as in pricing.R
+        Real maxPriceMultiple;
+    };
+
+    // Bid and ask values of a job's portfolio, with delta and gamma of each from the grid
+    struct PricingResult
+    {
+        PricingResult()
+            : id(0)
+        {
+            Clear();
+        }
+
+        void Clear()
+        {
+            Real const nan = std::numeric_limits<Real>::quiet_NaN();
+            bid = ask = bidDelta = bidGamma = askDelta = askGamma = nan;
+            error.clear();
+        }
+
+        std::uint64_t id;
+        Real bid;
+        Real ask;
+        Real bidDelta;
+        Real bidGamma;
+        Real askDelta;
+        Real askGamma;
+
+        /// Empty unless pricing failed
+        std::string error;
+    };
+
+    char const BINARY_JOB_MAGIC[8] = { 'U', 'V', 'O', 'L', 'J', 'O', 'B', '1' };
+
+    // Option type from its name as written by operator << (call, put, bcall, bput)
+    inline OptionType ParseOptionType(std::string const& name)
+    {
+        for (int code = 0; code < NUM_OPTION_TYPES; ++code)
+        {
+            std::ostringstream os;
+            os << ToOptionType(code);
+            if (os.str() == name)
+                return ToOptionType(code);
+        }
+
+        throw std::runtime_error("invalid option type '" + name + "'");
+    }
+
+    /// Most price steps a job may ask for, bounding the pricer's work space (about 5 MB) against
+    /// absurd grids from input files or clients of uvol-priced
+    std::size_t const MAX_PRICE_STEPS = 1u << 16;
+
+    /// Longest expiry (years) and highest volatility a job may use
+    Real const MAX_EXPIRY = 100;
+    Real const MAX_VOLATILITY = 10;
+
+    /// Most grid node updates (time steps times price steps) a job may need, some seconds of one core
+    double const MAX_GRID_UPDATES = 1e10;
+
+    // Grid node updates to value the job on numPriceSteps price steps. The pricer's time step is
+    // 0.9 / (numPriceSteps^2 maxVol^2), run out to the longest expiry.
+    inline double EstimateGridUpdates(PricingJob const& job, std::size_t numPriceSteps)
+    {
+        Real maxExpiry = 0;
+        for (auto const& contract : job.contracts)
+            maxExpiry = std::max(maxExpiry, contract.expiry);
+
+        double const steps = static_cast<double>(numPriceSteps);
+        double const maxVol = job.scenario.maxVol;
+        double const timeSteps = steps * steps * maxVol * maxVol * maxExpiry / 0.9;
+        return timeSteps * steps;
+    }
+
+    // Throws if the job is malformed or too costly to price; defaultPriceSteps is used when the job leaves
+    // its price steps to the settings
+    inline void ValidateJob(PricingJob const& job, std::size_t defaultPriceSteps = PricingSettings().numPriceSteps)
+    {
+        PricingScenario const& s = job.scenario;
+        if (!(s.underlyingPrice > 0) || !std::isfinite(s.underlyingPrice))
+            throw std::runtime_error("underlying price must be positive and finite");
+        if (!(s.minVol > 0) || !(s.maxVol >= s.minVol) || !(s.maxVol <= MAX_VOLATILITY))
+            throw std::runtime_error("volatilities must satisfy 0 < minVol <= maxVol <= " + std::to_string(static_cast<int>(MAX_VOLATILITY)));
+        if (!std::isfinite(s.rate))
+            throw std::runtime_error("rate must be finite");
+        if (job.numPriceSteps != 0 && job.numPriceSteps < 3)
+            throw std::runtime_error("at least 3 price steps are required");
+        if (job.numPriceSteps > MAX_PRICE_STEPS)
+            throw std::runtime_error("at most " + std::to_string(MAX_PRICE_STEPS) + " price steps are allowed");
+
+        for (auto const& contract : job.contracts)
+        {
+            if (!(contract.expiry >= 0) || !(contract.expiry <= MAX_EXPIRY))
+                throw std::runtime_error("contract expiry must be between 0 and " + std::to_string(static_cast<int>(MAX_EXPIRY)) + " years");
+            if (!std::isfinite(contract.strike) || !std::isfinite(contract.multiplier))
+                throw std::runtime_error("invalid contract strike or quantity");
+        }
+
+        // Expiry and volatility are bounded above, so the estimate is finite
+        std::size_t const numPriceSteps = job.numPriceSteps != 0 ? job.numPriceSteps : defaultPriceSteps;
+        if (EstimateGridUpdates(job, numPriceSteps) > MAX_GRID_UPDATES)
+            throw std::runtime_error("job needs more than " + std::to_string(static_cast<long long>(MAX_GRID_UPDATES)) + " grid updates");
+    }
+
+    // Reads CSV jobs one at a time, holding only the job being read
+    class CsvJobReader
+    {
+    public:
+        // Jobs without their own price steps are checked against defaultPriceSteps
+        explicit CsvJobReader(std::istream& is, std::size_t defaultPriceSteps = PricingSettings().numPriceSteps)
+            : mIs(is)
+            , mDefaultPriceSteps(defaultPriceSteps)
+            , mLineNumber(0)
+            , mHavePending(false)
+        {}
+
+        // Next job, false at the end of input. Throws with the line number on malformed input.
+        bool Read(PricingJob& job)
+        {
+            job.contracts.clear();
+
+            std::vector<std::string> fields;
+            if (!mHavePending)
+            {
+                if (!NextRecord(fields))
+                    return false;
+                if (fields[0] != "scenario")
+                    Fail("expected a scenario line");
+                ParseScenario(fields, job);
+            }
+            else
+            {
+                job = mPending;
+                mHavePending = false;
+            }
+
+            std::size_t const jobLine = mLineNumber;
+            while (NextRecord(fields))
+            {
+                if (fields[0] == "scenario")
+                {
+                    // Start of the next job
+                    ParseScenario(fields, mPending);
+                    mHavePending = true;
+                    break;
+                }
+                else if (fields[0] == "option")
+                    job.contracts.push_back(ParseOption(fields));
+                else
+                    Fail("unknown record '" + fields[0] + "'");
+            }
+
+            try
+            {
+                ValidateJob(job, mDefaultPriceSteps);
+            }
+            catch (std::exception const& e)
+            {
+                throw std::runtime_error("line " + std::to_string(jobLine) + ": " + e.what());
+            }
+
+            return true;
+        }
+
+    private:
+        bool NextRecord(std::vector<std::string>& fields)
+        {
+            std::string line;
+            while (std::getline(mIs, line))
+            {
+                ++mLineNumber;
+                if (!line.empty() && line[line.size() - 1] == '\r')
+                    line.erase(line.size() - 1);
+                if (line.empty() || line[0] == '#')
+                    continue;
+
+                fields.clear();
+                std::size_t begin = 0;
+                for (;;)
+                {
+                    std::size_t const end = line.find(',', begin);
+                    fields.push_back(line.substr(begin, end == std::string::npos ? std::string::npos : end - begin));
+                    if (end == std::string::npos)
+                        break;
+                    begin = end + 1;
+                }
+
+                return true;
+            }
+
+            return false;
+        }
+
+        void ParseScenario(std::vector<std::string> const& fields, PricingJob& job)
+        {
+            if (fields.size() != 6 && fields.size() != 7)
+                Fail("scenario needs id, underlyingPrice, minVol, maxVol, rate and optionally priceSteps");
+
+            job.id = ParseUnsigned(fields[1]);
+            job.scenario.underlyingPrice = ParseReal(fields[2]);
+            job.scenario.minVol = ParseReal(fields[3]);
+            job.scenario.maxVol = ParseReal(fields[4]);
+            job.scenario.rate = ParseReal(fields[5]);
+            job.numPriceSteps = fields.size() == 7 ? static_cast<std::size_t>(ParseUnsigned(fields[6])) : 0;
+            job.contracts.clear();
+        }
+
+        OptionContract ParseOption(std::vector<std::string> const& fields)
+        {
+            if (fields.size() != 5)
+                Fail("option needs type, expiry, strike and quantity");
+
+            OptionType type = OptionType::CALL;
+            try
+            {
+                type = ParseOptionType(fields[1]);
+            }
+            catch (std::runtime_error const& e)
+            {
+                Fail(e.what());
+            }
+
+            return OptionContract(type, ParseReal(fields[2]), ParseReal(fields[3]), ParseReal(fields[4]));
+        }
+
+        Real ParseReal(std::string const& field)
+        {
+            char* end = nullptr;
+            Real const value = std::strtod(field.c_str(), &end);
+            if (field.empty() || *end != '\0')
+                Fail("invalid number '" + field + "'");
+            return value;
+        }
+
+        std::uint64_t ParseUnsigned(std::string const& field)
+        {
+            char* end = nullptr;
+            unsigned long long const value = std::strtoull(field.c_str(), &end, 10);
+            if (field.empty() || *end != '\0' || field[0] == '-')
+                Fail("invalid integer '" + field + "'");
+            return value;
+        }
+
+        [[noreturn]] void Fail(std::string const& message) const
+        {
+            throw std::runtime_error("line " + std::to_string(mLineNumber) + ": " + message);
+        }
+
+        std::istream& mIs;
+        std::size_t mDefaultPriceSteps;
+        std::size_t mLineNumber;
+
+        /// Scenario line read while looking for the end of the previous job
+        PricingJob mPending;
+        bool mHavePending;
+    };
+
+    // Reads binary jobs one at a time
+    class BinaryJobReader
+    {
+    public:
+        // Checks the magic unless reading jobs sent without it (one per message), throws if the input is not binary jobs.
+        // Jobs without their own price steps are checked against defaultPriceSteps.
+        explicit BinaryJobReader(std::istream& is, bool readMagic = true, std::size_t defaultPriceSteps = PricingSettings().numPriceSteps)
+            : mIs(is)
+            , mDefaultPriceSteps(defaultPriceSteps)
+            , mJobNumber(0)
+        {
+            char magic[sizeof(BINARY_JOB_MAGIC)];
+            if (readMagic && (!mIs.read(magic, sizeof(magic)) || std::memcmp(magic, BINARY_JOB_MAGIC, sizeof(magic)) != 0))
+                throw std::runtime_error("input is not binary pricing jobs");
+        }
+
+        bool Read(PricingJob& job)
+        {
+            std::uint64_t id;
+            if (!mIs.read(reinterpret_cast<char*>(&id), sizeof(id)))
+            {
+                if (mIs.gcount() != 0)
+                    Fail("truncated job");
+                return false;
+            }
+
+            ++mJobNumber;
+            std::uint32_t numPriceSteps = 0;
+            std::uint32_t numContracts = 0;
+            ReadValue(numPriceSteps);
+            ReadValue(numContracts);
+
+            job.id = id;
+            job.numPriceSteps = numPriceSteps;
+            ReadValue(job.scenario.underlyingPrice);
+            ReadValue(job.scenario.minVol);
+            ReadValue(job.scenario.maxVol);
+            ReadValue(job.scenario.rate);
+
+            // The count is untrusted until the contracts are read, so reserve no more than a typical job needs
+            job.contracts.clear();
+            job.contracts.reserve(std::min<std::uint32_t>(numContracts, 1024));
+            for (std::uint32_t i = 0; i < numContracts; ++i)
+            {
+                std::uint8_t typeCode = 0;
+                Real expiry, strike, quantity;
+                ReadValue(typeCode);
+                ReadValue(expiry);
+                ReadValue(strike);
+                ReadValue(quantity);
+
+                if (typeCode >= NUM_OPTION_TYPES)
+                    Fail("invalid option type code");
+                job.contracts.push_back(OptionContract(ToOptionType(typeCode), expiry, strike, quantity));
+            }
+
+            try
+            {
+                ValidateJob(job, mDefaultPriceSteps);
+            }
+            catch (std::exception const& e)
+            {
+                Fail(e.what());
+            }
+
+            return true;
+        }
+
+    private:
+        template<typename T>
+        void ReadValue(T& value)
+        {
+            char bytes[sizeof(T)];
+            if (!mIs.read(bytes, sizeof(bytes)))
+                Fail("truncated job");
+            std::memcpy(&value, bytes, sizeof(T));
+        }
+
+        [[noreturn]] void Fail(std::string const& message) const
+        {
+            throw std::runtime_error("binary job " + std::to_string(mJobNumber) + ": " + message);
+        }
+
+        std::istream& mIs;
+        std::size_t mDefaultPriceSteps;
+        std::size_t mJobNumber;
+    };
+
+    // Reads CSV or binary jobs, detected from the first character (binary input starts with 'U')
+    class JobReader
+    {
+    public:
+        explicit JobReader(std::istream& is, std::size_t defaultPriceSteps = PricingSettings().numPriceSteps)
+        {
+            if (is.peek() == BINARY_JOB_MAGIC[0])
+                mBinary.reset(new BinaryJobReader(is, true, defaultPriceSteps));
+            else
+                mCsv.reset(new CsvJobReader(is, defaultPriceSteps));
+        }
+
+        bool Read(PricingJob& job)
+        {
+            return mBinary ? mBinary->Read(job) : mCsv->Read(job);
+        }
+
+    private:
+        std::unique_ptr<CsvJobReader> mCsv;
+        std::unique_ptr<BinaryJobReader> mBinary;
+    };
+
+    inline void WriteBinaryJobHeader(std::ostream& os)
+    {
+        os.write(BINARY_JOB_MAGIC, sizeof(BINARY_JOB_MAGIC));
+    }
+
+    inline void WriteBinaryJob(std::ostream& os, PricingJob const& job)
+    {
+        auto const write = [&os] (void const* value, std::size_t size)
+        {
+            os.write(static_cast<char const*>(value), size);
+        };
+
+        std::uint64_t const id = job.id;
+        std::uint32_t const numPriceSteps = static_cast<std::uint32_t>(job.numPriceSteps);
+        std::uint32_t const numContracts = static_cast<std::uint32_t>(job.contracts.size());
+        write(&id, sizeof(id));
+        write(&numPriceSteps, sizeof(numPriceSteps));
+        write(&numContracts, sizeof(numContracts));
+        write(&job.scenario.underlyingPrice, sizeof(Real));
+        write(&job.scenario.minVol, sizeof(Real));
+        write(&job.scenario.maxVol, sizeof(Real));
+        write(&job.scenario.rate, sizeof(Real));
+
+        for (auto const& contract : job.contracts)
+        {
+            std::uint8_t const typeCode = static_cast<std::uint8_t>(contract.type);
+            write(&typeCode, sizeof(typeCode));
+            write(&contract.expiry, sizeof(Real));
+            write(&contract.strike, sizeof(Real));
+            write(&contract.multiplier, sizeof(Real));
+        }
+    }
+
+    // Delta and gamma at price from grid values, by central differences at the neighbouring nodes
+    // interpolated linearly
+    inline void GridGreeks(Real const* values, std::size_t numPriceSteps, Real deltaPrice, Real price, Real& delta, Real& gamma)
+    {
+        std::size_t index = static_cast<std::size_t>(price / deltaPrice);
+        index = std::max<std::size_t>(1, std::min(index, numPriceSteps - 2));
+
+        Real const k = price / deltaPrice - Real(index);
+        Real const* v = values + index;
+
+        Real const delta0 = (v[1] - v[-1]) / (2 * deltaPrice);
+        Real const delta1 = (v[2] - v[0]) / (2 * deltaPrice);
+        Real const gamma0 = (v[1] - 2 * v[0] + v[-1]) / (deltaPrice * deltaPrice);
+        Real const gamma1 = (v[2] - 2 * v[1] + v[0]) / (deltaPrice * deltaPrice);
+
+        delta = delta0 * (1 - k) + delta1 * k;
+        gamma = gamma0 * (1 - k) + gamma1 * k;
+    }
+
+    // Everything that determines a pricer's grid and coefficients, so jobs with equal keys can share a pricer
+    struct GridKey
+    {
+        GridKey(PricingJob const& job, PricingSettings const& settings)
+            : minVol(job.scenario.minVol)
+            , maxVol(job.scenario.maxVol)
+            , rate(job.scenario.rate)
+            , maxPrice(job.scenario.underlyingPrice * settings.maxPriceMultiple)
+            , numPriceSteps(job.numPriceSteps != 0 ? job.numPriceSteps : settings.numPriceSteps)
+        {}
+
+        bool operator == (GridKey const& rhs) const
+        {
+            return minVol == rhs.minVol && maxVol == rhs.maxVol && rate == rhs.rate &&
+                maxPrice == rhs.maxPrice && numPriceSteps == rhs.numPriceSteps;
+        }
+
+        bool operator != (GridKey const& rhs) const
+        {
+            return !(*this == rhs);
+        }
+
+        bool operator < (GridKey const& rhs) const
+        {
+            if (minVol != rhs.minVol) return minVol < rhs.minVol;
+            if (maxVol != rhs.maxVol) return maxVol < rhs.maxVol;
+            if (rate != rhs.rate) return rate < rhs.rate;
+            if (maxPrice != rhs.maxPrice) return maxPrice < rhs.maxPrice;
+            return numPriceSteps < rhs.numPriceSteps;
+        }
+
+        Real minVol;
+        Real maxVol;
+        Real rate;
+        Real maxPrice;
+        std::size_t numPriceSteps;
+    };
+
+    inline std::unique_ptr<FiniteDifferencePricer> CreatePricer(GridKey const& key, PricingSettings const& settings)
+    {
+        return std::unique_ptr<FiniteDifferencePricer>(new FiniteDifferencePricer(
+            key.minVol, key.maxVol, key.rate, key.maxPrice, key.numPriceSteps, settings.payoffSampling, settings.interpolation));
+    }
+
+    // Price a job with a pricer created for its grid key. grid is scratch space for the time zero values.
+    inline void PriceJob(PricingJob const& job, FiniteDifferencePricer& pricer, GridKey const& key, std::vector<Real>& grid, PricingResult& result)
+    {
+        result.Clear();
+        result.id = job.id;
+
+        try
+        {
+            Real const price = job.scenario.underlyingPrice;
+            pricer.ClearContracts();
+            for (auto const& contract : job.contracts)
+                pricer.AddContract(contract);
+
+            Real const deltaPrice = key.maxPrice / key.numPriceSteps;
+            grid.resize(key.numPriceSteps + 1);
+
+            result.bid = pricer.Valuate(price, Side::BID, grid.data(), 1);
+            GridGreeks(grid.data(), key.numPriceSteps, deltaPrice, price, result.bidDelta, result.bidGamma);
+
+            result.ask = pricer.Valuate(price, Side::ASK, grid.data(), 1);
+            GridGreeks(grid.data(), key.numPriceSteps, deltaPrice, price, result.askDelta, result.askGamma);
+        }
+        catch (std::exception const& e)
+        {
+            result.Clear();
+            result.id = job.id;
+            result.error = e.what();
+        }
+    }
+
+    // Prices jobs one after another, keeping the pricer while consecutive jobs share a grid
+    class JobPricer
+    {
+    public:
+        explicit JobPricer(PricingSettings const& settings)
+            : mSettings(settings)
+            , mKey(PricingJob(), settings)
+        {}
+
+        void Price(PricingJob const& job, PricingResult& result)
+        {
+            GridKey const key(job, mSettings);
+            if (!mPricer || key != mKey)
+            {
+                // Report a grid that cannot be allocated against this job, as PriceJob does for its failures
+                try
+                {
+                    mPricer = CreatePricer(key, mSettings);
+                    mKey = key;
+                }
+                catch (std::exception const& e)
+                {
+                    result.Clear();
+                    result.id = job.id;
+                    result.error = e.what();
+                    return;
+                }
+            }
+
+            PriceJob(job, *mPricer, mKey, mGrid, result);
+        }
+
+    private:
+        PricingSettings mSettings;
+        std::unique_ptr<FiniteDifferencePricer> mPricer;
+        GridKey mKey;
+
+        /// Grid values at time 0 for the Greeks
+        std::vector<Real> mGrid;
+    };
+
+    // Price jobs[0:count] into results across one JobPricer per thread (the calling thread included).
+    // Failures are reported per job in PricingResult::error.
+    inline void PriceJobs(PricingJob const* jobs, std::size_t count, PricingResult* results, std::vector<JobPricer>& pricers)
+    {
+        std::size_t const numThreads = std::min(pricers.size(), count);
+        if (numThreads == 0)
+            return;
+
+        std::atomic<std::size_t> nextJob(0);
+        auto const worker = [&] (JobPricer& pricer)
+        {
+            for (std::size_t i = nextJob++; i < count; i = nextJob++)
+                pricer.Price(jobs[i], results[i]);
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(numThreads - 1);
+        for (std::size_t t = 1; t < numThreads; ++t)
+            threads.emplace_back(worker, std::ref(pricers[t]));
+
+        worker(pricers[0]);
+
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    inline void WriteResultHeader(std::ostream& os)
+    {
+        os << "id,bid,ask,bidDelta,bidGamma,askDelta,askGamma" << '\n';
+    }
+
+    inline void WriteResult(std::ostream& os, PricingResult const& result)
+    {
+        os << result.id << ','
+            << result.bid << ','
+            << result.ask << ','
+            << result.bidDelta << ','
+            << result.bidGamma << ','
+            << result.askDelta << ','
+            << result.askGamma << '\n';
+    }
+}
+
+#endif
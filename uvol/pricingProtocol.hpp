@@ -0,0 +1,271 @@
+#ifndef UVOL_PRICING_PROTOCOL_HPP
+#define UVOL_PRICING_PROTOCOL_HPP
+
+#include "pricingJob.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Messages between uvol-priced and its clients over a Unix domain stream socket.
+// Each message is a frame of
+//     uint32 payload length, uint8 code, payload
+// in host byte order. Requests carry a MessageType code; a PRICE payload is one binary job
+// (see pricingJob.hpp) without the file magic. Responses carry a ResponseStatus code and either the
+// result (PRICE), JSON statistics (STATS), nothing, or an error message.
+// The result payload is uint64 id then float64 bid, ask, bidDelta, bidGamma, askDelta, askGamma.
+
+namespace CqfProject
+{
+    enum class MessageType : std::uint8_t
+    {
+        PRICE = 1,
+        STATS = 2,
+        RESET_STATS = 3,
+        SHUTDOWN = 4
+    };
+
+    enum class ResponseStatus : std::uint8_t
+    {
+        OK = 0,
+        ERROR = 1
+    };
+
+    /// Largest payload accepted, to bound memory per connection. Grid sizes are bounded by MAX_PRICE_STEPS.
+    std::uint32_t const MAX_FRAME_PAYLOAD = 16u << 20;
+
+    // False on end of stream or error
+    inline bool ReadFully(int fd, void* buffer, std::size_t size)
+    {
+        char* p = static_cast<char*>(buffer);
+        while (size > 0)
+        {
+            ssize_t const n = read(fd, p, size);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+
+            p += n;
+            size -= static_cast<std::size_t>(n);
+        }
+
+        return true;
+    }
+
+    inline bool WriteFully(int fd, void const* buffer, std::size_t size)
+    {
+        char const* p = static_cast<char const*>(buffer);
+        while (size > 0)
+        {
+            // No SIGPIPE if the peer has gone
+            ssize_t const n = send(fd, p, size, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+
+            p += n;
+            size -= static_cast<std::size_t>(n);
+        }
+
+        return true;
+    }
+
+    // False on end of stream, error or an oversized frame
+    inline bool ReadFrame(int fd, std::uint8_t& code, std::string& payload)
+    {
+        char header[5];
+        if (!ReadFully(fd, header, sizeof(header)))
+            return false;
+
+        std::uint32_t length;
+        std::memcpy(&length, header, sizeof(length));
+        code = static_cast<std::uint8_t>(header[4]);
+        if (length > MAX_FRAME_PAYLOAD)
+            return false;
+
+        payload.resize(length);
+        return length == 0 || ReadFully(fd, &payload[0], length);
+    }
+
+    // Header and payload in one write, so small frames go out as one segment
+    inline bool WriteFrame(int fd, std::uint8_t code, std::string const& payload)
+    {
+        std::uint32_t const length = static_cast<std::uint32_t>(payload.size());
+        std::string frame(5 + payload.size(), '\0');
+        std::memcpy(&frame[0], &length, sizeof(length));
+        frame[4] = static_cast<char>(code);
+        if (!payload.empty())
+            std::memcpy(&frame[5], payload.data(), payload.size());
+
+        return WriteFully(fd, frame.data(), frame.size());
+    }
+
+    inline std::string EncodeJob(PricingJob const& job)
+    {
+        std::ostringstream os;
+        WriteBinaryJob(os, job);
+        return os.str();
+    }
+
+    // Throws on a malformed job or one too costly to price, costing jobs without their own price steps at defaultPriceSteps
+    inline void DecodeJob(std::string const& payload, PricingJob& job, std::size_t defaultPriceSteps)
+    {
+        std::istringstream is(payload);
+        BinaryJobReader reader(is, false, defaultPriceSteps);
+        if (!reader.Read(job) || is.peek() != std::char_traits<char>::eof())
+            throw std::runtime_error("message is not a single pricing job");
+    }
+
+    inline std::string EncodeResult(PricingResult const& result)
+    {
+        Real const values[6] = { result.bid, result.ask, result.bidDelta, result.bidGamma, result.askDelta, result.askGamma };
+        std::string payload(sizeof(result.id) + sizeof(values), '\0');
+        std::memcpy(&payload[0], &result.id, sizeof(result.id));
+        std::memcpy(&payload[sizeof(result.id)], values, sizeof(values));
+        return payload;
+    }
+
+    inline void DecodeResult(std::string const& payload, PricingResult& result)
+    {
+        Real values[6];
+        if (payload.size() != sizeof(result.id) + sizeof(values))
+            throw std::runtime_error("malformed pricing result");
+
+        result.Clear();
+        std::memcpy(&result.id, payload.data(), sizeof(result.id));
+        std::memcpy(values, payload.data() + sizeof(result.id), sizeof(values));
+        result.bid = values[0];
+        result.ask = values[1];
+        result.bidDelta = values[2];
+        result.bidGamma = values[3];
+        result.askDelta = values[4];
+        result.askGamma = values[5];
+    }
+
+    inline sockaddr_un UnixSocketAddress(std::string const& path)
+    {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+            throw std::runtime_error("socket path too long: " + path);
+
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return address;
+    }
+
+    // Connected socket, throws if nothing is listening at path
+    inline int ConnectUnixSocket(std::string const& path)
+    {
+        sockaddr_un const address = UnixSocketAddress(path);
+        int const fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+
+        if (connect(fd, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) != 0)
+        {
+            int const error = errno;
+            close(fd);
+            throw std::runtime_error("connect " + path + ": " + std::strerror(error));
+        }
+
+        return fd;
+    }
+
+    // Listening socket at path, replacing a stale socket file
+    inline int ListenUnixSocket(std::string const& path, int backlog = 128)
+    {
+        sockaddr_un const address = UnixSocketAddress(path);
+        int const fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+
+        unlink(path.c_str());
+        if (bind(fd, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) != 0 || listen(fd, backlog) != 0)
+        {
+            int const error = errno;
+            close(fd);
+            throw std::runtime_error("listen " + path + ": " + std::strerror(error));
+        }
+
+        return fd;
+    }
+
+    // Blocking client of one connection to uvol-priced. Not thread safe; use one per thread.
+    class PricingClient
+    {
+    public:
+        explicit PricingClient(std::string const& socketPath)
+            : mFd(ConnectUnixSocket(socketPath))
+        {}
+
+        PricingClient(PricingClient const&) = delete;
+        PricingClient& operator = (PricingClient const&) = delete;
+
+        ~PricingClient()
+        {
+            close(mFd);
+        }
+
+        // Pricing failures are returned in PricingResult::error, connection failures throw
+        PricingResult Price(PricingJob const& job)
+        {
+            PricingResult result;
+            std::string const payload = Request(MessageType::PRICE, EncodeJob(job), &result.error);
+            if (result.error.empty())
+                DecodeResult(payload, result);
+            else
+                result.id = job.id;
+
+            return result;
+        }
+
+        // Server statistics as JSON
+        std::string Stats()
+        {
+            return Request(MessageType::STATS, std::string(), nullptr);
+        }
+
+        void ResetStats()
+        {
+            Request(MessageType::RESET_STATS, std::string(), nullptr);
+        }
+
+        void Shutdown()
+        {
+            Request(MessageType::SHUTDOWN, std::string(), nullptr);
+        }
+
+    private:
+        // Response payload. Error responses are stored in error if given, else thrown.
+        std::string Request(MessageType type, std::string const& payload, std::string* error)
+        {
+            std::uint8_t status;
+            std::string response;
+            if (!WriteFrame(mFd, static_cast<std::uint8_t>(type), payload) || !ReadFrame(mFd, status, response))
+                throw std::runtime_error("connection to pricing server lost");
+
+            if (status != static_cast<std::uint8_t>(ResponseStatus::OK))
+            {
+                if (error == nullptr)
+                    throw std::runtime_error("pricing server: " + response);
+                *error = response;
+            }
+
+            return response;
+        }
+
+        int mFd;
+    };
+}
+
+#endif
@@ -0,0 +1,349 @@
+#include "batchValuation.hpp"
+#include "benchmark.hpp"
+#include "finiteDifferencePricer.hpp"
+#include "kernelMetrics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace CqfProject;
+
+// Scaling sweep of valuation run time over price steps, contract count, expiry count and threads.
+// Writes one CSV row per configuration, and a summary of fitted power law exponents and the
+// grid size where the explicit scheme's cost crosses over that of an implicit alternative.
+
+Real const rate = 0.05;
+Real const price = 100.0;
+Real const minVol = 0.10;
+Real const maxVol = 0.30;
+Real const maxExpiry = 1.0;
+
+// Cost model of the implicit alternative: a fully implicit scheme with policy iteration for the
+// min / max volatility selection, taking priceSteps time steps per year (dt proportional to dS, rather
+// than dS^2 for explicit stability), each with a few tridiagonal solves
+double const IMPLICIT_TIME_STEPS_PER_PRICE_STEP = 1.0;
+double const IMPLICIT_POLICY_ITERATIONS = 3.0;
+
+struct SweepConfig
+{
+    SweepConfig()
+        : quick(false)
+        , options(1, 5)
+    {}
+
+    bool quick;
+    BenchmarkOptions options;
+};
+
+struct SweepRow
+{
+    std::string sweep;
+    std::size_t numPriceSteps;
+    std::size_t numContracts;
+    std::size_t numExpiries;
+    unsigned numThreads;
+    BenchmarkStatistics stats;
+    std::uint64_t nodeUpdates;
+    double modelImplicitNs;
+};
+
+void WriteCsvHeader(std::ostream& os)
+{
+    os << "sweep,priceSteps,contracts,expiries,threads,medianNs,p99Ns,madNs,nodeUpdates,nsPerNodeUpdate,modelImplicitNs,cheaper" << std::endl;
+}
+
+void WriteCsvRow(std::ostream& os, SweepRow const& row)
+{
+    os << row.sweep << ','
+        << row.numPriceSteps << ','
+        << row.numContracts << ','
+        << row.numExpiries << ','
+        << row.numThreads << ','
+        << row.stats.median << ','
+        << row.stats.p99 << ','
+        << row.stats.mad << ','
+        << row.nodeUpdates << ','
+        << row.stats.median / row.nodeUpdates << ',';
+
+    if (row.modelImplicitNs > 0.0)
+        os << row.modelImplicitNs << ',' << (row.stats.median <= row.modelImplicitNs ? "explicit" : "implicit");
+    else
+        os << ',';
+
+    os << std::endl;
+}
+
+// Median ns per valuation of a warm pricer over the portfolio, with the kernel work of one valuation
+SweepRow MeasureValuation(
+    SweepConfig const& config,
+    std::string const& sweep,
+    std::size_t numPriceSteps,
+    std::size_t numContracts,
+    std::size_t numExpiries)
+{
+    FiniteDifferencePricer pricer(minVol, maxVol, rate, price * Real(2), numPriceSteps);
+    for (auto const& contract : CreateBenchmarkPortfolio(numContracts, numExpiries, price, maxExpiry))
+        pricer.AddContract(contract);
+
+    KernelMetrics metrics;
+    pricer.Valuate(price, Side::BID, FiniteDifferencePricer::NullOutIt(), 0, metrics);
+
+    auto const valuate = [&] ()
+    {
+        DoNotOptimize(pricer.Valuate(price, Side::BID));
+    };
+
+    SweepRow row;
+    row.sweep = sweep;
+    row.numPriceSteps = numPriceSteps;
+    row.numContracts = numContracts;
+    row.numExpiries = numExpiries;
+    row.numThreads = 1;
+    row.stats = RunBenchmark(valuate, 1, config.options);
+    row.nodeUpdates = metrics.nodeUpdates;
+    row.modelImplicitNs = 0.0;
+
+    std::cerr << sweep << " steps=" << numPriceSteps << " contracts=" << numContracts << " expiries=" << numExpiries
+        << ": median " << row.stats.median << " ns/valuation" << std::endl;
+
+    return row;
+}
+
+// Best case ns per node of a tridiagonal (Thomas algorithm) solve, the inner kernel of an implicit scheme
+double MeasureTridiagonalNsPerNode(SweepConfig const& config)
+{
+    std::size_t const n = 1000;
+    std::vector<Real> lower(n, -0.25);
+    std::vector<Real> diagonal(n, 1.5);
+    std::vector<Real> upper(n, -0.25);
+    std::vector<Real> rhs(n, 1.0);
+    std::vector<Real> c(n);
+    std::vector<Real> d(n);
+
+    auto const solve = [&] ()
+    {
+        c[0] = upper[0] / diagonal[0];
+        d[0] = rhs[0] / diagonal[0];
+        for (std::size_t i = 1; i < n; ++i)
+        {
+            Real const m = Real(1) / (diagonal[i] - lower[i] * c[i - 1]);
+            c[i] = upper[i] * m;
+            d[i] = (rhs[i] - lower[i] * d[i - 1]) * m;
+        }
+
+        for (std::size_t i = n - 1; i-- > 0;)
+            d[i] -= c[i] * d[i + 1];
+
+        DoNotOptimize(d[n / 2]);
+    };
+
+    return RunBenchmark(solve, n, BenchmarkOptions(3, config.options.repetitions * 10)).min;
+}
+
+void Fit(std::ostream& summary, std::string const& axis, std::vector<SweepRow> const& rows, std::size_t (*value)(SweepRow const&))
+{
+    std::vector<double> x;
+    std::vector<double> y;
+    for (auto const& row : rows)
+    {
+        x.push_back(static_cast<double>(value(row)));
+        y.push_back(row.stats.median);
+    }
+
+    PowerLawFit const fit = FitPowerLaw(x, y);
+    summary << axis << "_exponent," << fit.exponent << std::endl;
+    summary << axis << "_r_squared," << fit.rSquared << std::endl;
+
+    std::cerr << axis << ": time ~ " << axis << "^" << fit.exponent << " (R^2 " << fit.rSquared << ")" << std::endl;
+}
+
+void PrintUsage()
+{
+    std::cerr
+        << "Usage: uvol_sweep [options]" << std::endl
+        << "  --quick            reduced ranges and repetitions" << std::endl
+        << "  --repetitions N    timed repetitions per configuration" << std::endl
+        << "  --output FILE      write CSV rows to FILE instead of stdout" << std::endl
+        << "  --summary FILE     write fitted exponents and crossover as CSV to FILE" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    SweepConfig config;
+    std::string outputFile;
+    std::string summaryFile;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const arg = argv[i];
+        bool const hasValue = i + 1 < argc;
+
+        if (arg == "--quick")
+        {
+            config.quick = true;
+            config.options = BenchmarkOptions(0, 3);
+        }
+        else if (arg == "--repetitions" && hasValue)
+            config.options.repetitions = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--output" && hasValue)
+            outputFile = argv[++i];
+        else if (arg == "--summary" && hasValue)
+            summaryFile = argv[++i];
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    std::ofstream file;
+    if (!outputFile.empty())
+    {
+        file.open(outputFile.c_str());
+        if (!file)
+        {
+            std::cerr << "Failed to open " << outputFile << std::endl;
+            return 1;
+        }
+    }
+
+    std::ostream& os = outputFile.empty() ? std::cout : file;
+    WriteCsvHeader(os);
+
+    std::ofstream summaryStream;
+    if (!summaryFile.empty())
+    {
+        summaryStream.open(summaryFile.c_str());
+        if (!summaryStream)
+        {
+            std::cerr << "Failed to open " << summaryFile << std::endl;
+            return 1;
+        }
+    }
+
+    std::ostream& summary = summaryFile.empty() ? static_cast<std::ostream&>(std::cerr) : summaryStream;
+    summary << "quantity,value" << std::endl;
+
+    // Price steps, single contract. Explicit cost is nodes * time steps ~ N * N^2.
+    std::vector<std::size_t> const steps = config.quick
+        ? std::vector<std::size_t>{ 100, 200, 400 }
+        : std::vector<std::size_t>{ 100, 200, 400, 800, 1600, 2400, 4000 };
+
+    double const tridiagonalNsPerNode = MeasureTridiagonalNsPerNode(config);
+
+    std::vector<SweepRow> stepRows;
+    for (std::size_t numPriceSteps : steps)
+    {
+        SweepRow row = MeasureValuation(config, "steps", numPriceSteps, 1, 1);
+
+        double const implicitTimeSteps = IMPLICIT_TIME_STEPS_PER_PRICE_STEP * numPriceSteps * maxExpiry;
+        row.modelImplicitNs = tridiagonalNsPerNode * numPriceSteps * implicitTimeSteps * IMPLICIT_POLICY_ITERATIONS;
+
+        WriteCsvRow(os, row);
+        stepRows.push_back(row);
+    }
+
+    // Contracts over four expiries, at fixed grid
+    std::vector<std::size_t> const contractCounts = config.quick
+        ? std::vector<std::size_t>{ 1, 10, 100, 1000 }
+        : std::vector<std::size_t>{ 1, 10, 100, 1000, 5000 };
+
+    std::vector<SweepRow> contractRows;
+    for (std::size_t numContracts : contractCounts)
+    {
+        SweepRow const row = MeasureValuation(config, "contracts", 200, numContracts, std::min<std::size_t>(numContracts, 4));
+        WriteCsvRow(os, row);
+        contractRows.push_back(row);
+    }
+
+    // Expiries, 40 contracts spread over them, at fixed grid
+    std::vector<std::size_t> const expiryCounts = config.quick
+        ? std::vector<std::size_t>{ 1, 5, 40 }
+        : std::vector<std::size_t>{ 1, 2, 5, 10, 20, 40 };
+
+    std::vector<SweepRow> expiryRows;
+    for (std::size_t numExpiries : expiryCounts)
+    {
+        SweepRow const row = MeasureValuation(config, "expiries", 200, 40, numExpiries);
+        WriteCsvRow(os, row);
+        expiryRows.push_back(row);
+    }
+
+    // Threads, valuating rows of a quantity matrix in parallel; time is per row
+    std::size_t const numThreadContracts = 100;
+    std::size_t const numRows = config.quick ? 16 : 64;
+    FiniteDifferencePricer prototype(minVol, maxVol, rate, price * Real(2), 200);
+    for (auto const& contract : CreateBenchmarkPortfolio(numThreadContracts, 4, price, maxExpiry))
+        prototype.AddContract(contract);
+
+    KernelMetrics metrics;
+    prototype.Valuate(price, Side::BID, FiniteDifferencePricer::NullOutIt(), 0, metrics);
+
+    std::vector<Real> quantities(numRows * numThreadContracts);
+    for (std::size_t i = 0; i < quantities.size(); ++i)
+        quantities[i] = (i % 7) - 3.0;
+    std::vector<Real> values(numRows);
+
+    std::vector<SweepRow> threadRows;
+    for (unsigned numThreads = 1; numThreads <= DefaultThreadCount(); numThreads *= 2)
+    {
+        auto const batch = [&] ()
+        {
+            ValuateQuantityMatrix(prototype, price, Side::BID, quantities.data(), numRows, values.data(), numThreads);
+            DoNotOptimize(values[0]);
+        };
+
+        SweepRow row;
+        row.sweep = "threads";
+        row.numPriceSteps = 200;
+        row.numContracts = numThreadContracts;
+        row.numExpiries = 4;
+        row.numThreads = numThreads;
+        row.stats = RunBenchmark(batch, numRows, config.options);
+        row.nodeUpdates = metrics.nodeUpdates;
+        row.modelImplicitNs = 0.0;
+
+        std::cerr << "threads=" << numThreads << ": median " << row.stats.median << " ns/valuation" << std::endl;
+        WriteCsvRow(os, row);
+        threadRows.push_back(row);
+    }
+
+    Fit(summary, "steps", stepRows, [] (SweepRow const& row) { return row.numPriceSteps; });
+    Fit(summary, "contracts", contractRows, [] (SweepRow const& row) { return row.numContracts; });
+    Fit(summary, "expiries", expiryRows, [] (SweepRow const& row) { return row.numExpiries; });
+    if (threadRows.size() >= 2)
+        Fit(summary, "threads", threadRows, [] (SweepRow const& row) { return (std::size_t)row.numThreads; });
+
+    // Explicit ~ a N^p against implicit ~ b N^2 cross at N = (b / a)^(1 / (p - 2))
+    std::vector<double> x;
+    std::vector<double> explicitNs;
+    for (auto const& row : stepRows)
+    {
+        x.push_back(static_cast<double>(row.numPriceSteps));
+        explicitNs.push_back(row.stats.median);
+    }
+
+    PowerLawFit const explicitFit = FitPowerLaw(x, explicitNs);
+    double const implicitPrefactor =
+        tridiagonalNsPerNode * IMPLICIT_TIME_STEPS_PER_PRICE_STEP * maxExpiry * IMPLICIT_POLICY_ITERATIONS;
+
+    summary << "tridiagonal_ns_per_node," << tridiagonalNsPerNode << std::endl;
+    if (explicitFit.exponent > 2.0)
+    {
+        double const crossover = std::pow(implicitPrefactor / explicitFit.prefactor, 1.0 / (explicitFit.exponent - 2.0));
+        summary << "implicit_crossover_steps," << crossover << std::endl;
+        std::cerr << "Explicit scheme costs more than the implicit model above ~" << crossover << " price steps" << std::endl;
+    }
+    else
+    {
+        summary << "implicit_crossover_steps," << std::endl;
+        std::cerr << "No crossover: explicit exponent " << explicitFit.exponent << " does not exceed 2" << std::endl;
+    }
+
+    return 0;
+}
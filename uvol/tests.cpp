@@ -0,0 +1,948 @@
+#include "batchValuation.hpp"
+#include "blackScholes.hpp"
+#include "finiteDifferencePricer.hpp"
+#include "hedgeSearch.hpp"
+#include "impliedVolatility.hpp"
+#include "latencyHistogram.hpp"
+#include "pricingJob.hpp"
+
+#include <boost/noncopyable.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+using namespace CqfProject;
+
+Real const rate = 0.05;
+Real const price = 100.0;
+Real const minVol = 0.10;
+Real const maxVol = 0.30;
+Real const timeToExpiry = 1.0;
+
+// Check implied volatility recovers the volatility used to price calls and puts
+int TestImpliedVolatility(Real relTolerance = 1e-8, Real minOtmValue = 1e-6)
+{
+    int errorCount = 0;
+
+    OptionType const types[2] = { OptionType::CALL, OptionType::PUT };
+    Real const expiries[4] = { 0.1, 0.5, 1.0, 2.0 };
+
+    for (auto typeIt = std::begin(types); typeIt != std::end(types); ++typeIt)
+    {
+        for (auto expiryIt = std::begin(expiries); expiryIt != std::end(expiries); ++expiryIt)
+        {
+            for (Real vol = 0.05; vol < 1.0; vol += 0.05)
+            {
+                for (Real strike = 0.5 * price; strike < 2.01 * price; strike += price / 50.0)
+                {
+                    // Skip quotes with negligible time value, where volatility is not identifiable
+                    Real const forward = price * std::exp(rate * *expiryIt);
+                    Real const otmValue = BlackScholesOption(
+                        strike < forward ? OptionType::PUT : OptionType::CALL, vol, rate, *expiryIt, price, strike);
+                    if (otmValue < minOtmValue)
+                        continue;
+
+                    Real const value = BlackScholesOption(*typeIt, vol, rate, *expiryIt, price, strike);
+                    Real const iv = ImpliedVolatility(*typeIt, *expiryIt, strike, value, rate, price);
+
+                    if (!(std::abs(iv / vol - 1.0) <= relTolerance))
+                    {
+                        std::cout << "Implied volatility error. Type=" << *typeIt << ", expiry=" << *expiryIt << ", strike=" << strike << ", vol=" << vol << ", iv=" << iv << std::endl;
+                        errorCount++;
+                    }
+                }
+            }
+        }
+    }
+
+    // Arbitrageable prices have no implied volatility
+    if (!std::isnan(ImpliedVolatility(OptionType::CALL, timeToExpiry, price, price * 2.0, rate, price)) ||
+        !std::isnan(ImpliedVolatility(OptionType::PUT, timeToExpiry, price, 0.0, rate, price)))
+    {
+        std::cout << "Implied volatility error. Expected NaN for price outside arbitrage bounds" << std::endl;
+        errorCount++;
+    }
+
+    return errorCount;
+}
+
+// Check pricing a columnar portfolio matches pricing the same contracts added one by one
+int TestPortfolioView()
+{
+    int errorCount = 0;
+
+    // Factor style 1-based type codes: call, put, bcall, bput
+    int const typeCodes[4] = { 1, 2, 3, 4 };
+    Real const expiries[4] = { 1.0, 0.5, 1.0, 0.25 };
+    Real const strikes[4] = { 100.0, 95.0, 105.0, 110.0 };
+    Real const quantities[4] = { 1.0, -0.5, 2.0, 0.75 };
+    PortfolioView const view(4, typeCodes, 1, expiries, strikes, quantities);
+
+    FiniteDifferencePricer columnar(minVol, maxVol, rate, price * Real(2), 100);
+    FiniteDifferencePricer rowwise(minVol, maxVol, rate, price * Real(2), 100);
+    columnar.SetContracts(view);
+    Real bsSum = 0.0;
+    for (int i = 0; i < 4; ++i)
+    {
+        OptionType const type = static_cast<OptionType>(i);
+        rowwise.AddContract(OptionContract(type, expiries[i], strikes[i], quantities[i]));
+        bsSum += quantities[i] * BlackScholesOption(type, minVol, rate, expiries[i], price, strikes[i]);
+    }
+
+    if (columnar.Valuate(price, Side::BID) != rowwise.Valuate(price, Side::BID) ||
+        columnar.Valuate(price, Side::ASK) != rowwise.Valuate(price, Side::ASK))
+    {
+        std::cout << "Portfolio view error. Columnar and row wise valuations differ" << std::endl;
+        errorCount++;
+    }
+
+    // Updating quantities in place matches a pricer constructed with the new quantities
+    Real const newQuantities[4] = { -1.0, 0.25, 0.5, 1.5 };
+    PortfolioView const newView(4, typeCodes, 1, expiries, strikes, newQuantities);
+    FiniteDifferencePricer fresh(minVol, maxVol, rate, price * Real(2), 100);
+    fresh.SetContracts(newView);
+    rowwise.SetMultipliers(newQuantities);
+
+    if (rowwise.Valuate(price, Side::BID) != fresh.Valuate(price, Side::BID))
+    {
+        std::cout << "Portfolio view error. Valuation after quantity update differs from new pricer" << std::endl;
+        errorCount++;
+    }
+
+    if (BlackScholesPortfolio(view, minVol, rate, price) != bsSum)
+    {
+        std::cout << "Portfolio view error. Black Scholes portfolio value differs from sum of contracts" << std::endl;
+        errorCount++;
+    }
+
+    return errorCount;
+}
+
+// Check parallel valuation of a quantity matrix matches valuing each row serially
+int TestQuantityMatrix(std::size_t numRows = 37, unsigned numThreads = 4)
+{
+    int errorCount = 0;
+
+    FiniteDifferencePricer pricer(minVol, maxVol, rate, price * Real(2), 100);
+    pricer.AddContract(OptionContract(OptionType::BINARY_CALL, timeToExpiry, price, 1.0));
+    pricer.AddContract(OptionContract(OptionType::CALL, timeToExpiry, 95.0, 0.0));
+    pricer.AddContract(OptionContract(OptionType::CALL, timeToExpiry, 105.0, 0.0));
+
+    // Column major, as R matrices
+    std::vector<Real> quantities(numRows * 3);
+    for (std::size_t row = 0; row < numRows; ++row)
+    {
+        quantities[row] = 1.0;
+        quantities[numRows + row] = -0.1 + 0.01 * row;
+        quantities[2 * numRows + row] = 0.1 - 0.005 * row;
+    }
+
+    std::vector<Real> values(numRows);
+    ValuateQuantityMatrix(pricer, price, Side::ASK, quantities.data(), numRows, values.data(), numThreads);
+
+    for (std::size_t row = 0; row < numRows; ++row)
+    {
+        Real const rowQuantities[3] = { quantities[row], quantities[numRows + row], quantities[2 * numRows + row] };
+        pricer.SetMultipliers(rowQuantities);
+        Real const expected = pricer.Valuate(price, Side::ASK);
+        if (values[row] != expected)
+        {
+            std::cout << "Quantity matrix error. Row=" << row << ", value=" << values[row] << ", expected=" << expected << std::endl;
+            errorCount++;
+        }
+    }
+
+    return errorCount;
+}
+
+// Check the hedge search: bid below ask, hedges improving with their number, reported values reproducible,
+// results independent of the number of threads, and the beam search used past maxSubsets
+int TestHedgeSearch()
+{
+    int errorCount = 0;
+
+    std::vector<OptionContract> const exotic(1, OptionContract(OptionType::BINARY_CALL, timeToExpiry, price, 1.0));
+    std::vector<OptionContract> candidates;
+    std::vector<Real> candidatePrices;
+    for (Real strike = 90.0; strike <= 110.0; strike += 5.0)
+    {
+        candidates.push_back(OptionContract(OptionType::CALL, timeToExpiry, strike, 0.0));
+        candidatePrices.push_back(BlackScholesPutCall(0.5 * (minVol + maxVol), rate, timeToExpiry, price, strike).call);
+    }
+
+    HedgeSearchSettings settings;
+    settings.steps1 = 40;
+    settings.steps2 = 60;
+    settings.minHedges = 0;
+    settings.maxHedges = 3;
+    settings.numStarts = 2;
+    settings.maxEvaluations = 200;
+    settings.numThreads = 1;
+
+    HedgeSearch search(exotic, candidates, candidatePrices, minVol, maxVol, rate, price, settings);
+    std::vector<HedgeResult> const serial = search.Search();
+
+    settings.numThreads = 4;
+    std::vector<HedgeResult> const parallel = HedgeSearch(exotic, candidates, candidatePrices, minVol, maxVol, rate, price, settings).Search();
+
+    settings.maxSubsets = 4;
+    settings.beamWidth = 2;
+    std::vector<HedgeResult> const beam = HedgeSearch(exotic, candidates, candidatePrices, minVol, maxVol, rate, price, settings).Search();
+
+    for (std::vector<HedgeResult> const* results : { &serial, &beam })
+    {
+        if (results->size() != 8)
+        {
+            std::cout << "Hedge search error. Results=" << results->size() << ", expected 8" << std::endl;
+            errorCount++;
+            continue;
+        }
+
+        for (std::size_t size = 0; size <= 3; ++size)
+        {
+            HedgeResult const& bid = (*results)[2 * size];
+            HedgeResult const& ask = (*results)[2 * size + 1];
+            bool valid = bid.side == Side::BID && ask.side == Side::ASK && bid.value < ask.value;
+            for (HedgeResult const* result : { &bid, &ask })
+            {
+                valid = valid && result->hedges.size() == size && result->quantities.size() == size && result->status > 0;
+                for (std::size_t i = 0; i < size; ++i)
+                    valid = valid && (i == 0 || result->hedges[i] > result->hedges[i - 1]) &&
+                        result->quantities[i] >= settings.minQuantity && result->quantities[i] <= settings.maxQuantity;
+                valid = valid && std::abs(search.Value(result->side, result->hedges, result->quantities) - result->value) < 1e-12;
+            }
+
+            // More hedges never do worse, up to the tolerance of the local searches
+            if (size > 0)
+                valid = valid && bid.value > (*results)[2 * size - 2].value - 1e-6 && ask.value < (*results)[2 * size - 1].value + 1e-6;
+
+            if (!valid)
+            {
+                std::cout << "Hedge search error. Hedges=" << size << ", bid=" << bid.value << ", ask=" << ask.value << std::endl;
+                errorCount++;
+            }
+        }
+
+        // A call spread narrows the spread of the binary substantially
+        Real const unhedged = (*results)[1].value - (*results)[0].value;
+        Real const hedged = (*results)[5].value - (*results)[4].value;
+        if (!(hedged < 0.5 * unhedged))
+        {
+            std::cout << "Hedge search error. Spread with two hedges " << hedged << ", unhedged " << unhedged << std::endl;
+            errorCount++;
+        }
+    }
+
+    for (std::size_t i = 0; i < serial.size() && i < parallel.size(); ++i)
+    {
+        if (parallel[i].value != serial[i].value || parallel[i].hedges != serial[i].hedges || parallel[i].quantities != serial[i].quantities)
+        {
+            std::cout << "Hedge search error. Result " << i << " differs across threads: " << parallel[i].value << " vs " << serial[i].value << std::endl;
+            errorCount++;
+        }
+    }
+
+    return errorCount;
+}
+
+// Check normal CDF and PDF against the C library erfc and exp
+int TestNormalDistribution(Real absTolerance = 1e-15, Real tailRelTolerance = 1e-8)
+{
+    int errorCount = 0;
+
+    for (Real x = -37.0; x <= 9.0; x += 0.001)
+    {
+        Real const cdf = NormalCdf(x);
+        Real const expectedCdf = 0.5 * std::erfc(-x / std::sqrt(2.0));
+        Real const pdf = NormalPdf(x);
+        Real const expectedPdf = std::exp(-0.5 * x * x) / std::sqrt(2.0 * 3.14159265358979323846);
+
+        if (std::abs(cdf - expectedCdf) > absTolerance ||
+            (expectedCdf > 0.0 && std::abs(cdf / expectedCdf - 1.0) > tailRelTolerance))
+        {
+            std::cout << "Normal CDF error. x=" << x << ", cdf=" << cdf << ", expected=" << expectedCdf << std::endl;
+            errorCount++;
+        }
+
+        if (std::abs(pdf - expectedPdf) > absTolerance ||
+            (expectedPdf > 0.0 && std::abs(pdf / expectedPdf - 1.0) > 1e-13))
+        {
+            std::cout << "Normal PDF error. x=" << x << ", pdf=" << pdf << ", expected=" << expectedPdf << std::endl;
+            errorCount++;
+        }
+    }
+
+    return errorCount;
+}
+
+// Check error from Black Scholes is within tolerance
+int TestCorrectness(std::size_t numPriceSteps = 200, Real relTolerance = 0.1, Real minValue = 0.001)
+{
+    int errorCount = 0;
+
+    OptionContract::Type const contractTypes[4] =
+        {
+            OptionContract::Type::CALL,
+            OptionContract::Type::PUT,
+            OptionContract::Type::BINARY_CALL,
+            OptionContract::Type::BINARY_PUT
+        };
+
+    for (auto typeIt = std::begin(contractTypes); typeIt != std::end(contractTypes); ++typeIt)
+    {
+        for (Real strike = 0.5 * price; strike < 1.51 * price; strike += price / 100.0)
+        {
+            // For contracts where gamma can change sign over time,
+            // we can't compare our model with Black Scholes, so use constant volatility
+            bool alwaysPositiveGamma =
+                *typeIt == OptionContract::Type::CALL ||
+                *typeIt == OptionContract::Type::PUT;
+
+            FiniteDifferencePricer pricer(
+                alwaysPositiveGamma ? minVol : maxVol,
+                maxVol,
+                rate,
+                price * Real(2),
+                numPriceSteps);
+
+            pricer.AddContract(OptionContract(*typeIt, timeToExpiry, strike, 1.0));
+
+            Real const fdBid = pricer.Valuate(price, Side::BID);
+            Real const fdAsk = pricer.Valuate(price, Side::ASK);
+            Real const bsBid = BlackScholesOption(*typeIt, alwaysPositiveGamma ? minVol : maxVol, rate, timeToExpiry, price, strike);
+            Real const bsAsk = BlackScholesOption(*typeIt, maxVol, rate, timeToExpiry, price, strike);
+
+            if (bsBid > minValue && std::abs((fdBid - bsBid) / bsBid) > relTolerance)
+            {
+                std::cout << "Correctness error. Type=" << *typeIt << ", strike=" << strike << ", fdBid=" << fdBid << ", bsBid=" << bsBid << std::endl;
+                errorCount++;
+            }
+                
+            if (bsAsk > minValue && std::abs((fdAsk - bsAsk) / bsAsk) > relTolerance)
+            {
+                std::cout << "Correctness error. Type=" << *typeIt << ", strike=" << strike << ", fdAsk=" << fdAsk << ", bsAsk=" << bsAsk << std::endl; 
+                errorCount++;
+            }
+        }
+    }
+
+    return errorCount;
+}
+
+// Test error reduces at second order as grid resolution doubles.
+// Uses the maximum error over strikes, as the error at a single strike oscillates and crosses zero
+// as the strike moves relative to the grid, and a wide price range, so that truncation of the
+// domain does not dominate the discretization error on fine grids.
+int TestConvergence(std::size_t minSteps = 20, std::size_t maxSteps = 320, Real minReduction = 3.0)
+{
+    int errorCount = 0;
+    Real lastBidError = 1e6;
+    Real lastAskError = 1e6;
+
+    for (std::size_t steps = minSteps; steps <= maxSteps; steps *= 2)
+    {
+        Real bidError = 0.0;
+        Real askError = 0.0;
+
+        for (Real strike = 0.5 * price; strike < 1.51 * price; strike += price / 20.0)
+        {
+            FiniteDifferencePricer pricer(
+                minVol,
+                maxVol,
+                rate,
+                price * Real(4),
+                steps);
+
+            pricer.AddContract(OptionContract(OptionType::CALL, timeToExpiry, strike, 1.0));
+
+            Real const fdBid = pricer.Valuate(price, Side::BID);
+            Real const fdAsk = pricer.Valuate(price, Side::ASK);
+            Real const bsBid = BlackScholesOption(OptionType::CALL, minVol, rate, timeToExpiry, price, strike);
+            Real const bsAsk = BlackScholesOption(OptionType::CALL, maxVol, rate, timeToExpiry, price, strike);
+
+            bidError = std::max(bidError, std::abs(bsBid - fdBid));
+            askError = std::max(askError, std::abs(bsAsk - fdAsk));
+        }
+
+        if (bidError * minReduction > lastBidError)
+        {
+            std::cout << "Bid convergence error. Error=" << bidError << ", LastError=" << lastBidError << ", Steps=" << steps << std::endl;
+            errorCount++;
+        }
+
+        if (askError * minReduction > lastAskError)
+        {
+            std::cout << "Ask convergence error. Error=" << askError << ", LastError=" << lastAskError << ", Steps=" << steps << std::endl;
+            errorCount++;
+        }
+
+        lastBidError = bidError;
+        lastAskError = askError;
+    }
+
+    return errorCount;
+}
+
+// Check the phase profile counts each phase of a valuation, or stays empty when profiling is compiled out
+int TestPhaseProfile()
+{
+    int errorCount = 0;
+
+    FiniteDifferencePricer pricer(minVol, maxVol, rate, price * Real(2), 100);
+    pricer.AddContract(OptionContract(OptionType::CALL, 0.5, price, 1.0));
+    pricer.AddContract(OptionContract(OptionType::PUT, 1.0, price, 1.0));
+    pricer.AddContract(OptionContract(OptionType::BINARY_CALL, 1.0, 110.0, 1.0));
+
+    std::vector<Real> values;
+    pricer.Valuate(price, Side::BID, std::back_inserter(values), 1);
+    pricer.Valuate(price, Side::ASK);
+
+    // Two valuations, sorted once, three payoffs and two march segments each
+    std::uint64_t const expected[NUM_PHASES] = { 1, 6, 4, 4, 2, 1 };
+    PhaseProfile const& profile = pricer.GetPhaseProfile();
+
+    for (int i = 0; i < NUM_PHASES; ++i)
+    {
+        Phase const phase = static_cast<Phase>(i);
+        std::uint64_t const expectedCount = IsPhaseProfilingEnabled() ? expected[i] : 0;
+        if (profile.GetCount(phase) != expectedCount || (expectedCount == 0 && profile.GetTicks(phase) != 0))
+        {
+            std::cout << "Phase profile error. Phase=" << PhaseName(phase) << ", count=" << profile.GetCount(phase) << ", expected=" << expectedCount << std::endl;
+            errorCount++;
+        }
+    }
+
+    pricer.ResetPhaseProfile();
+    if (pricer.GetPhaseProfile().GetCount(Phase::MARCH) != 0)
+    {
+        std::cout << "Phase profile error. Counts not cleared by reset" << std::endl;
+        errorCount++;
+    }
+
+    return errorCount;
+}
+
+// Check CSV and binary jobs parse alike, price as a direct valuation does, and give Black-Scholes Greeks
+// when the volatility is certain
+int TestPricingJobs(Real valueTolerance = 0.01, Real deltaTolerance = 0.002, Real gammaTolerance = 0.0005)
+{
+    int errorCount = 0;
+
+    std::istringstream csv(
+        "# comment\n"
+        "scenario,7,100,0.2,0.2,0.05,300\n"
+        "option,call,1,100,1\n"
+        "\n"
+        "scenario,8,100,0.1,0.3,0.05\n"
+        "option,bcall,1,100,1\n"
+        "option,call,1,95,-0.5\n"
+        "option,call,1,105,0.5\n");
+
+    std::vector<PricingJob> jobs;
+    JobReader csvReader(csv);
+    PricingJob job;
+    while (csvReader.Read(job))
+        jobs.push_back(job);
+
+    if (jobs.size() != 2 || jobs[0].id != 7 || jobs[0].numPriceSteps != 300 || jobs[0].contracts.size() != 1 ||
+        jobs[1].id != 8 || jobs[1].numPriceSteps != 0 || jobs[1].contracts.size() != 3)
+    {
+        std::cout << "Pricing job error. CSV jobs not read as written" << std::endl;
+        return 1;
+    }
+
+    std::stringstream binary;
+    WriteBinaryJobHeader(binary);
+    for (auto const& csvJob : jobs)
+        WriteBinaryJob(binary, csvJob);
+
+    std::vector<PricingJob> binaryJobs(jobs.size() + 1);
+    JobReader binaryReader(binary);
+    std::size_t numBinaryJobs = 0;
+    while (numBinaryJobs < binaryJobs.size() && binaryReader.Read(binaryJobs[numBinaryJobs]))
+        ++numBinaryJobs;
+
+    PricingSettings settings;
+    std::vector<JobPricer> pricers;
+    for (int t = 0; t < 2; ++t)
+        pricers.emplace_back(settings);
+
+    std::vector<PricingResult> results(jobs.size());
+    std::vector<PricingResult> binaryResults(jobs.size());
+    PriceJobs(jobs.data(), jobs.size(), results.data(), pricers);
+    PriceJobs(binaryJobs.data(), numBinaryJobs, binaryResults.data(), pricers);
+
+    if (numBinaryJobs != jobs.size())
+    {
+        std::cout << "Pricing job error. Binary jobs=" << numBinaryJobs << ", expected=" << jobs.size() << std::endl;
+        errorCount++;
+    }
+
+    for (std::size_t i = 0; i < jobs.size() && i < numBinaryJobs; ++i)
+    {
+        if (binaryResults[i].id != results[i].id || binaryResults[i].bid != results[i].bid || binaryResults[i].ask != results[i].ask)
+        {
+            std::cout << "Pricing job error. Binary job " << i << " priced differently from CSV" << std::endl;
+            errorCount++;
+        }
+
+        FiniteDifferencePricer pricer(
+            jobs[i].scenario.minVol,
+            jobs[i].scenario.maxVol,
+            jobs[i].scenario.rate,
+            jobs[i].scenario.underlyingPrice * settings.maxPriceMultiple,
+            jobs[i].numPriceSteps != 0 ? jobs[i].numPriceSteps : settings.numPriceSteps,
+            settings.payoffSampling,
+            settings.interpolation);
+        for (auto const& contract : jobs[i].contracts)
+            pricer.AddContract(contract);
+
+        Real const bid = pricer.Valuate(jobs[i].scenario.underlyingPrice, Side::BID);
+        Real const ask = pricer.Valuate(jobs[i].scenario.underlyingPrice, Side::ASK);
+        if (results[i].bid != bid || results[i].ask != ask || !results[i].error.empty())
+        {
+            std::cout << "Pricing job error. Job " << i << ", bid=" << results[i].bid << ", expected=" << bid
+                << ", ask=" << results[i].ask << ", expected=" << ask << std::endl;
+            errorCount++;
+        }
+    }
+
+    // Certain volatility call against Black-Scholes, with Greeks by central differences of the closed form
+    Real const h = 0.01;
+    Real const bsValue = BlackScholesOption(OptionType::CALL, 0.2, rate, timeToExpiry, price, price);
+    Real const bsUp = BlackScholesOption(OptionType::CALL, 0.2, rate, timeToExpiry, price + h, price);
+    Real const bsDown = BlackScholesOption(OptionType::CALL, 0.2, rate, timeToExpiry, price - h, price);
+    Real const bsDelta = (bsUp - bsDown) / (2 * h);
+    Real const bsGamma = (bsUp - 2 * bsValue + bsDown) / (h * h);
+
+    PricingResult const& certain = results[0];
+    if (!(std::abs(certain.bid - bsValue) <= valueTolerance) ||
+        !(std::abs(certain.bidDelta - bsDelta) <= deltaTolerance) ||
+        !(std::abs(certain.bidGamma - bsGamma) <= gammaTolerance) ||
+        certain.askDelta != certain.bidDelta)
+    {
+        std::cout << "Pricing job error. value=" << certain.bid << ", expected=" << bsValue
+            << ", delta=" << certain.bidDelta << ", expected=" << bsDelta
+            << ", gamma=" << certain.bidGamma << ", expected=" << bsGamma << std::endl;
+        errorCount++;
+    }
+
+    // Malformed input is rejected with its line
+    char const* const malformed[] = {
+        "option,call,1,100,1\n",
+        "scenario,1,100,0.3,0.1,0.05\n",
+        "scenario,1,100,0.1,0.3,0.05\noption,straddle,1,100,1\n",
+        "scenario,1,100,0.1,0.3\n",
+        "scenario,1,100,0.1,0.3,0.05,4294967295\noption,call,1,100,1\n",
+        "scenario,1,inf,0.1,0.3,0.05\noption,call,1,100,1\n",
+        "scenario,1,100,0.1,1e6,0.05\noption,call,1,100,1\n",
+        "scenario,1,100,0.1,0.3,0.05\noption,call,1e300,100,1\n",
+        "scenario,1,100,0.1,0.3,0.05\noption,call,1,nan,1\n",
+        "scenario,1,100,0.1,0.3,0.05,65536\noption,call,1,100,1\n" };
+    for (char const* text : malformed)
+    {
+        std::istringstream is(text);
+        JobReader reader(is);
+        bool threw = false;
+        try
+        {
+            while (reader.Read(job))
+                ;
+        }
+        catch (std::runtime_error const&)
+        {
+            threw = true;
+        }
+
+        if (!threw)
+        {
+            std::cout << "Pricing job error. Malformed input accepted: " << text;
+            errorCount++;
+        }
+    }
+
+    // A binary job claiming more contracts than it holds is truncated, not a huge allocation
+    std::stringstream truncated;
+    WriteBinaryJobHeader(truncated);
+    std::uint64_t const id = 9;
+    std::uint32_t const counts[] = { 0, 0xFFFFFFFFu };
+    Real const scenario[] = { 100, 0.1, 0.3, 0.05 };
+    truncated.write(reinterpret_cast<char const*>(&id), sizeof(id));
+    truncated.write(reinterpret_cast<char const*>(counts), sizeof(counts));
+    truncated.write(reinterpret_cast<char const*>(scenario), sizeof(scenario));
+
+    JobReader truncatedReader(truncated);
+    try
+    {
+        truncatedReader.Read(job);
+        std::cout << "Pricing job error. Truncated binary job accepted" << std::endl;
+        errorCount++;
+    }
+    catch (std::runtime_error const&)
+    {
+    }
+
+    return errorCount;
+}
+
+// Check histogram quantiles are within a bucket (1/16) of exact quantiles, over several orders of magnitude
+int TestLatencyHistogram(Real relTolerance = 1.0 / 16)
+{
+    int errorCount = 0;
+
+    LatencyHistogram histogram;
+    std::vector<std::uint64_t> values;
+    for (std::uint64_t i = 1; i <= 100000; ++i)
+        values.push_back(i * i / 7 + i);
+
+    for (auto value : values)
+        histogram.Record(value);
+
+    double const quantiles[] = { 0.0, 0.5, 0.9, 0.99, 0.999, 1.0 };
+    for (double q : quantiles)
+    {
+        std::size_t const rank = std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(q * values.size())));
+        std::uint64_t const exact = values[rank - 1];
+        std::uint64_t const estimate = histogram.Quantile(q);
+        if (estimate < exact || estimate > exact * (1 + relTolerance) + 1)
+        {
+            std::cout << "Latency histogram error. q=" << q << ", quantile=" << estimate << ", expected=" << exact << std::endl;
+            errorCount++;
+        }
+    }
+
+    if (histogram.Count() != values.size() || histogram.Max() != values.back())
+    {
+        std::cout << "Latency histogram error. count=" << histogram.Count() << ", max=" << histogram.Max() << std::endl;
+        errorCount++;
+    }
+
+    histogram.Reset();
+    if (histogram.Count() != 0 || histogram.Quantile(0.5) != 0)
+    {
+        std::cout << "Latency histogram error. Not empty after reset" << std::endl;
+        errorCount++;
+    }
+
+    return errorCount;
+}
+
+// Portfolios for golden value regression tests
+std::vector<OptionContract> GoldenPortfolio(int index)
+{
+    std::vector<OptionContract> contracts;
+    switch (index)
+    {
+    case 0:
+        // At the money call
+        contracts.push_back(OptionContract(OptionType::CALL, timeToExpiry, price, 1.0));
+        break;
+
+    case 1:
+        // Binary call hedged with a call spread
+        contracts.push_back(OptionContract(OptionType::BINARY_CALL, timeToExpiry, price, 1.0));
+        contracts.push_back(OptionContract(OptionType::CALL, timeToExpiry, 95.0, 0.08));
+        contracts.push_back(OptionContract(OptionType::CALL, timeToExpiry, 105.0, -0.08));
+        break;
+
+    default:
+        // Mixed types over four expiries
+        for (int i = 0; i < 8; ++i)
+        {
+            OptionType const type = static_cast<OptionType>(i % NUM_OPTION_TYPES);
+            Real const expiry = 0.25 * (1 + i % 4);
+            Real const strike = 85.0 + 5.0 * i;
+            contracts.push_back(OptionContract(type, expiry, strike, i % 3 == 0 ? -1.0 : 0.5));
+        }
+        break;
+    }
+
+    return contracts;
+}
+
+struct GoldenValue
+{
+    int portfolio;
+    std::size_t numPriceSteps;
+    Interpolation interpolation;
+    PayoffSampling payoffSampling;
+    Side side;
+    Real value;
+};
+
+// Reference values, from the AVX kernel. Regenerate with uvol_tests --print-golden only when a change
+// to the numerical method is intended; kernel optimizations must reproduce them.
+GoldenValue const goldenValues[] =
+{
+    { 0, 50, Interpolation::LINEAR, PayoffSampling::POINT, Side::BID, 6.7182572600692163 },
+    { 0, 50, Interpolation::LINEAR, PayoffSampling::POINT, Side::ASK, 14.212208712774817 },
+    { 0, 50, Interpolation::LINEAR, PayoffSampling::INTERVAL, Side::BID, 6.788778073333205 },
+    { 0, 50, Interpolation::LINEAR, PayoffSampling::INTERVAL, Side::ASK, 14.237519032677675 },
+    { 0, 50, Interpolation::CUBIC, PayoffSampling::POINT, Side::BID, 6.7182572600692163 },
+    { 0, 50, Interpolation::CUBIC, PayoffSampling::POINT, Side::ASK, 14.212208712774817 },
+    { 0, 50, Interpolation::CUBIC, PayoffSampling::INTERVAL, Side::BID, 6.788778073333205 },
+    { 0, 50, Interpolation::CUBIC, PayoffSampling::INTERVAL, Side::ASK, 14.237519032677675 },
+    { 0, 137, Interpolation::LINEAR, PayoffSampling::POINT, Side::BID, 6.8120818693404814 },
+    { 0, 137, Interpolation::LINEAR, PayoffSampling::POINT, Side::ASK, 14.235452595890338 },
+    { 0, 137, Interpolation::LINEAR, PayoffSampling::INTERVAL, Side::BID, 6.8120818693404814 },
+    { 0, 137, Interpolation::LINEAR, PayoffSampling::INTERVAL, Side::ASK, 14.235452595890338 },
+    { 0, 137, Interpolation::CUBIC, PayoffSampling::POINT, Side::BID, 6.7938026621507497 },
+    { 0, 137, Interpolation::CUBIC, PayoffSampling::POINT, Side::ASK, 14.228716044045393 },
+    { 0, 137, Interpolation::CUBIC, PayoffSampling::INTERVAL, Side::BID, 6.7938026621507497 },
+    { 0, 137, Interpolation::CUBIC, PayoffSampling::INTERVAL, Side::ASK, 14.228716044045393 },
+    { 0, 200, Interpolation::LINEAR, PayoffSampling::POINT, Side::BID, 6.7997077120620943 },
+    { 0, 200, Interpolation::LINEAR, PayoffSampling::POINT, Side::ASK, 14.230055776571159 },
+    { 0, 200, Interpolation::LINEAR, PayoffSampling::INTERVAL, Side::BID, 6.8040013718402603 },
+    { 0, 200, Interpolation::LINEAR, PayoffSampling::INTERVAL, Side::ASK, 14.231636759547108 },
+    { 0, 200, Interpolation::CUBIC, PayoffSampling::POINT, Side::BID, 6.7997077120620943 },
+    { 0, 200, Interpolation::CUBIC, PayoffSampling::POINT, Side::ASK, 14.230055776571159 },
+    { 0, 200, Interpolation::CUBIC, PayoffSampling::INTERVAL, Side::BID, 6.8040013718402603 },
+    { 0, 200, Interpolation::CUBIC, PayoffSampling::INTERVAL, Side::ASK, 14.231636759547108 },
+    { 1, 50, Interpolation::LINEAR, PayoffSampling::POINT, Side::BID, 0.59985339456673981 },
+    { 1, 50, Interpolation::LINEAR, PayoffSampling::POINT, Side::ASK, 1.3949310775875492 },
+    { 1, 50, Interpolation::LINEAR, PayoffSampling::INTERVAL, Side::BID, 0.5880859634079818 },
+    { 1, 50, Interpolation::LINEAR, PayoffSampling::INTERVAL, Side::ASK, 1.3459376332719979 },
+    { 1, 50, Interpolation::CUBIC, PayoffSampling::POINT, Side::BID, 0.59985339456673981 },
+    { 1, 50, Interpolation::CUBIC, PayoffSampling::POINT, Side::ASK, 1.3949310775875492 },
+    { 1, 50, Interpolation::CUBIC, PayoffSampling::INTERVAL, Side::BID, 0.5880859634079818 },
+    { 1, 50, Interpolation::CUBIC, PayoffSampling::INTERVAL, Side::ASK, 1.3459376332719979 },
+    { 1, 137, Interpolation::LINEAR, PayoffSampling::POINT, Side::BID, 0.57046181050810052 },
+    { 1, 137, Interpolation::LINEAR, PayoffSampling::POINT, Side::ASK, 1.3709967646303056 },
+    { 1, 137, Interpolation::LINEAR, PayoffSampling::INTERVAL, Side::BID, 0.57111585481319083 },
+    { 1, 137, Interpolation::LINEAR, PayoffSampling::INTERVAL, Side::ASK, 1.3703431714267245 },
+    { 1, 137, Interpolation::CUBIC, PayoffSampling::POINT, Side::BID, 0.57061804061381216 },
+    { 1, 137, Interpolation::CUBIC, PayoffSampling::POINT, Side::ASK, 1.371883969559704 },
+    { 1, 137, Interpolation::CUBIC, PayoffSampling::INTERVAL, Side::BID, 0.57127234128657656 },
+    { 1, 137, Interpolation::CUBIC, PayoffSampling::INTERVAL, Side::ASK, 1.371227566352067 },
+    { 1, 200, Interpolation::LINEAR, PayoffSampling::POINT, Side::BID, 0.57662160967266618 },
+    { 1, 200, Interpolation::LINEAR, PayoffSampling::POINT, Side::ASK, 1.3779077335017718 },
+    { 1, 200, Interpolation::LINEAR, PayoffSampling::INTERVAL, Side::BID, 0.57464880237215277 },
+    { 1, 200, Interpolation::LINEAR, PayoffSampling::INTERVAL, Side::ASK, 1.3662313210385721 },
+    { 1, 200, Interpolation::CUBIC, PayoffSampling::POINT, Side::BID, 0.57662160967266618 },
+    { 1, 200, Interpolation::CUBIC, PayoffSampling::POINT, Side::ASK, 1.3779077335017718 },
+    { 1, 200, Interpolation::CUBIC, PayoffSampling::INTERVAL, Side::BID, 0.57464880237215277 },
+    { 1, 200, Interpolation::CUBIC, PayoffSampling::INTERVAL, Side::ASK, 1.3662313210385721 },
+    { 2, 50, Interpolation::LINEAR, PayoffSampling::POINT, Side::BID, -12.025459131674632 },
+    { 2, 50, Interpolation::LINEAR, PayoffSampling::POINT, Side::ASK, -5.9441242360288093 },
+    { 2, 50, Interpolation::LINEAR, PayoffSampling::INTERVAL, Side::BID, -11.936343263506464 },
+    { 2, 50, Interpolation::LINEAR, PayoffSampling::INTERVAL, Side::ASK, -5.9577919748780452 },
+    { 2, 50, Interpolation::CUBIC, PayoffSampling::POINT, Side::BID, -12.025459131674632 },
+    { 2, 50, Interpolation::CUBIC, PayoffSampling::POINT, Side::ASK, -5.9441242360288093 },
+    { 2, 50, Interpolation::CUBIC, PayoffSampling::INTERVAL, Side::BID, -11.936343263506464 },
+    { 2, 50, Interpolation::CUBIC, PayoffSampling::INTERVAL, Side::ASK, -5.9577919748780452 },
+    { 2, 137, Interpolation::LINEAR, PayoffSampling::POINT, Side::BID, -12.047431185011153 },
+    { 2, 137, Interpolation::LINEAR, PayoffSampling::POINT, Side::ASK, -5.8691075254429119 },
+    { 2, 137, Interpolation::LINEAR, PayoffSampling::INTERVAL, Side::BID, -12.013737991470729 },
+    { 2, 137, Interpolation::LINEAR, PayoffSampling::INTERVAL, Side::ASK, -5.8696980964387109 },
+    { 2, 137, Interpolation::CUBIC, PayoffSampling::POINT, Side::BID, -12.071829347597321 },
+    { 2, 137, Interpolation::CUBIC, PayoffSampling::POINT, Side::ASK, -5.8804212670915899 },
+    { 2, 137, Interpolation::CUBIC, PayoffSampling::INTERVAL, Side::BID, -12.038013947649397 },
+    { 2, 137, Interpolation::CUBIC, PayoffSampling::INTERVAL, Side::ASK, -5.8809900799615686 },
+    { 2, 200, Interpolation::LINEAR, PayoffSampling::POINT, Side::BID, -12.061796304387586 },
+    { 2, 200, Interpolation::LINEAR, PayoffSampling::POINT, Side::ASK, -5.8702314850320878 },
+    { 2, 200, Interpolation::LINEAR, PayoffSampling::INTERVAL, Side::BID, -12.032287726093454 },
+    { 2, 200, Interpolation::LINEAR, PayoffSampling::INTERVAL, Side::ASK, -5.8767742786585737 },
+    { 2, 200, Interpolation::CUBIC, PayoffSampling::POINT, Side::BID, -12.061796304387586 },
+    { 2, 200, Interpolation::CUBIC, PayoffSampling::POINT, Side::ASK, -5.8702314850320878 },
+    { 2, 200, Interpolation::CUBIC, PayoffSampling::INTERVAL, Side::BID, -12.032287726093454 },
+    { 2, 200, Interpolation::CUBIC, PayoffSampling::INTERVAL, Side::ASK, -5.8767742786585737 }
+};
+
+int const NUM_GOLDEN_PORTFOLIOS = 3;
+std::size_t const goldenSteps[3] = { 50, 137, 200 };
+
+Real GoldenValuate(int portfolio, std::size_t numPriceSteps, Interpolation interpolation, PayoffSampling payoffSampling, Side side)
+{
+    FiniteDifferencePricer pricer(minVol, maxVol, rate, price * Real(2), numPriceSteps, payoffSampling, interpolation);
+    for (auto const& contract : GoldenPortfolio(portfolio))
+        pricer.AddContract(contract);
+
+    return pricer.Valuate(price, side);
+}
+
+// Print golden values in the format of the goldenValues table
+void PrintGoldenValues()
+{
+    char const* const interpolations[2] = { "Interpolation::LINEAR", "Interpolation::CUBIC" };
+    char const* const samplings[2] = { "PayoffSampling::POINT", "PayoffSampling::INTERVAL" };
+    char const* const sides[2] = { "Side::BID", "Side::ASK" };
+
+    for (int portfolio = 0; portfolio < NUM_GOLDEN_PORTFOLIOS; ++portfolio)
+        for (std::size_t numPriceSteps : goldenSteps)
+            for (int interpolation = 0; interpolation < 2; ++interpolation)
+                for (int sampling = 0; sampling < 2; ++sampling)
+                    for (int side = 0; side < 2; ++side)
+                    {
+                        Real const value = GoldenValuate(
+                            portfolio,
+                            numPriceSteps,
+                            interpolation == 0 ? Interpolation::LINEAR : Interpolation::CUBIC,
+                            sampling == 0 ? PayoffSampling::POINT : PayoffSampling::INTERVAL,
+                            side == 0 ? Side::BID : Side::ASK);
+
+                        std::printf("    { %d, %u, %s, %s, %s, %.17g },\n",
+                            portfolio, (unsigned)numPriceSteps, interpolations[interpolation], samplings[sampling], sides[side], value);
+                    }
+}
+
+// Check valuations reproduce the golden values, guarding kernel optimizations against accuracy changes
+int TestGoldenValues(Real relTolerance = 1e-9)
+{
+    int errorCount = 0;
+
+    for (auto const& golden : goldenValues)
+    {
+        Real const value = GoldenValuate(golden.portfolio, golden.numPriceSteps, golden.interpolation, golden.payoffSampling, golden.side);
+        if (!(std::abs(value - golden.value) <= relTolerance * std::max(std::abs(golden.value), Real(1))))
+        {
+            std::cout << "Golden value error. Portfolio=" << golden.portfolio << ", steps=" << golden.numPriceSteps
+                << ", value=" << value << ", expected=" << golden.value << std::endl;
+            errorCount++;
+        }
+    }
+
+    return errorCount;
+}
+
+template<PayoffSampling Sampling, Interpolation Interp>
+Real SpecializedValuate(int portfolio, std::size_t numPriceSteps, Side side)
+{
+    FiniteDifferencePricerT<Sampling, Interp> pricer(minVol, maxVol, rate, price * Real(2), numPriceSteps);
+    for (auto const& contract : GoldenPortfolio(portfolio))
+        pricer.AddContract(contract);
+
+    return pricer.Valuate(price, side);
+}
+
+// Check each compile time specialization reproduces the runtime pricer exactly, on the golden cases
+int TestSpecializedPricers()
+{
+    int errorCount = 0;
+
+    for (auto const& golden : goldenValues)
+    {
+        bool const point = golden.payoffSampling == PayoffSampling::POINT;
+        bool const cubic = golden.interpolation == Interpolation::CUBIC;
+        Real const value = point
+            ? (cubic
+                ? SpecializedValuate<PayoffSampling::POINT, Interpolation::CUBIC>(golden.portfolio, golden.numPriceSteps, golden.side)
+                : SpecializedValuate<PayoffSampling::POINT, Interpolation::LINEAR>(golden.portfolio, golden.numPriceSteps, golden.side))
+            : (cubic
+                ? SpecializedValuate<PayoffSampling::INTERVAL, Interpolation::CUBIC>(golden.portfolio, golden.numPriceSteps, golden.side)
+                : SpecializedValuate<PayoffSampling::INTERVAL, Interpolation::LINEAR>(golden.portfolio, golden.numPriceSteps, golden.side));
+
+        Real const expected = GoldenValuate(golden.portfolio, golden.numPriceSteps, golden.interpolation, golden.payoffSampling, golden.side);
+        if (value != expected)
+        {
+            std::cout << "Specialized pricer error. Portfolio=" << golden.portfolio << ", steps=" << golden.numPriceSteps
+                << ", value=" << value << ", expected=" << expected << std::endl;
+            errorCount++;
+        }
+    }
+
+    return errorCount;
+}
+
+int main(int argc, char** argv)
+{
+    using namespace CqfProject;
+
+    if (argc > 1 && std::strcmp(argv[1], "--print-golden") == 0)
+    {
+        PrintGoldenValues();
+        return 0;
+    }
+
+    std::cout << "Testing normal distribution" << std::endl;
+    int c0 = TestNormalDistribution();
+    if (c0 == 0)
+        std::cout << "Normal distribution tests passed!" << std::endl;
+    else
+        std::cout << "Normal distribution tests failed! " << c0 << " errors" << std::endl;
+
+    std::cout << "Testing implied volatility" << std::endl;
+    int c3 = TestImpliedVolatility();
+    if (c3 == 0)
+        std::cout << "Implied volatility tests passed!" << std::endl;
+    else
+        std::cout << "Implied volatility tests failed! " << c3 << " errors" << std::endl;
+
+    std::cout << "Testing portfolio view" << std::endl;
+    int c4 = TestPortfolioView();
+    if (c4 == 0)
+        std::cout << "Portfolio view tests passed!" << std::endl;
+    else
+        std::cout << "Portfolio view tests failed! " << c4 << " errors" << std::endl;
+
+    std::cout << "Testing quantity matrix" << std::endl;
+    int c5 = TestQuantityMatrix();
+    if (c5 == 0)
+        std::cout << "Quantity matrix tests passed!" << std::endl;
+    else
+        std::cout << "Quantity matrix tests failed! " << c5 << " errors" << std::endl;
+
+    std::cout << "Testing correctness" << std::endl;
+    int c1 = TestCorrectness();
+    if (c1 == 0)
+        std::cout << "Correctness tests passed!" << std::endl;
+    else
+        std::cout << "Correctness tests failed! " << c1 << " errors" << std::endl;
+
+    std::cout << "Testing convergence" << std::endl;
+    int c2 = TestConvergence();
+    if (c2 == 0)
+        std::cout << "Convergence tests passed!" << std::endl;
+    else
+        std::cout << "Convergence tests failed! " << c2 << " errors" << std::endl;
+
+    std::cout << "Testing phase profile" << std::endl;
+    int c7 = TestPhaseProfile();
+    if (c7 == 0)
+        std::cout << "Phase profile tests passed!" << std::endl;
+    else
+        std::cout << "Phase profile tests failed! " << c7 << " errors" << std::endl;
+
+    std::cout << "Testing pricing jobs" << std::endl;
+    int c8 = TestPricingJobs();
+    if (c8 == 0)
+        std::cout << "Pricing job tests passed!" << std::endl;
+    else
+        std::cout << "Pricing job tests failed! " << c8 << " errors" << std::endl;
+
+    std::cout << "Testing latency histogram" << std::endl;
+    int c9 = TestLatencyHistogram();
+    if (c9 == 0)
+        std::cout << "Latency histogram tests passed!" << std::endl;
+    else
+        std::cout << "Latency histogram tests failed! " << c9 << " errors" << std::endl;
+
+    std::cout << "Testing hedge search" << std::endl;
+    int c10 = TestHedgeSearch();
+    if (c10 == 0)
+        std::cout << "Hedge search tests passed!" << std::endl;
+    else
+        std::cout << "Hedge search tests failed! " << c10 << " errors" << std::endl;
+
+    std::cout << "Testing golden values" << std::endl;
+    int c6 = TestGoldenValues();
+    if (c6 == 0)
+        std::cout << "Golden value tests passed!" << std::endl;
+    else
+        std::cout << "Golden value tests failed! " << c6 << " errors" << std::endl;
+
+    std::cout << "Testing specialized pricers" << std::endl;
+    int c11 = TestSpecializedPricers();
+    if (c11 == 0)
+        std::cout << "Specialized pricer tests passed!" << std::endl;
+    else
+        std::cout << "Specialized pricer tests failed! " << c11 << " errors" << std::endl;
+
+    return c0 + c1 + c2 + c3 + c4 + c5 + c6 + c7 + c8 + c9 + c10 + c11 == 0 ? 0 : 1;
+}
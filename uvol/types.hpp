@@ -16,7 +16,18 @@ namespace CqfProject
         BINARY_PUT
     };
 
-    std::ostream& operator << (std::ostream& os, OptionType optionType)
+    // Integer codes of option types follow declaration order: call = 0, put = 1, bcall = 2, bput = 3
+    int const NUM_OPTION_TYPES = 4;
+
+    inline OptionType ToOptionType(int code)
+    {
+        if (code < 0 || code >= NUM_OPTION_TYPES)
+            throw std::runtime_error("invalid option type code");
+
+        return static_cast<OptionType>(code);
+    }
+
+    inline std::ostream& operator << (std::ostream& os, OptionType optionType)
     {
         switch (optionType)
         {